@@ -282,6 +282,8 @@ enum ovs_key_attr {
 	OVS_KEY_ATTR_ND,        /* struct ovs_key_nd */
 	OVS_KEY_ATTR_SKB_MARK,  /* u32 skb mark */
 	OVS_KEY_ATTR_TUNNEL,	/* Nested set of ovs_tunnel attributes */
+	OVS_KEY_ATTR_DP_HASH = 19, /* u32 hash computed by the datapath */
+	OVS_KEY_ATTR_RECIRC_ID, /* u32 recirc id */
 
 #ifdef __KERNEL__
 	OVS_KEY_ATTR_IPV4_TUNNEL,  /* struct ovs_key_ipv4_tunnel */
@@ -498,6 +500,26 @@ struct ovs_action_push_vlan {
 	__be16 vlan_tci;	/* 802.1Q TCI (VLAN ID and priority). */
 };
 
+/**
+ * enum ovs_hash_alg - Hash algorithms for %OVS_ACTION_ATTR_HASH.
+ * @OVS_HASH_ALG_L4: Hash over the packet's L2 through L4 flow fields: the
+ * Ethernet addresses and type, the IP addresses and protocol, and the L4
+ * ports.
+ */
+enum ovs_hash_alg {
+	OVS_HASH_ALG_L4,
+};
+
+/**
+ * struct ovs_action_hash - %OVS_ACTION_ATTR_HASH action argument.
+ * @hash_alg: Algorithm used to compute the hash, one of %OVS_HASH_ALG_*.
+ * @hash_basis: Basis used for computing the hash.
+ */
+struct ovs_action_hash {
+	__u32 hash_alg;		/* One of ovs_hash_alg. */
+	__u32 hash_basis;
+};
+
 /**
  * enum ovs_action_attr - Action types.
  *
@@ -521,6 +543,14 @@ struct ovs_action_push_vlan {
  * indicate the new packet contents This could potentially still be
  * %ETH_P_MPLS_* if the resulting MPLS label stack is not empty.  If there
  * is no MPLS label stack, as determined by ethertype, no action is taken.
+ * @OVS_ACTION_ATTR_RECIRC: Recirculate the packet: look it up again in the
+ * flow table with its %OVS_KEY_ATTR_RECIRC_ID set to the u32 argument and
+ * execute the actions of the flow that it matches.  Actions that follow
+ * %OVS_ACTION_ATTR_RECIRC are executed afterward on the packet as it was
+ * before recirculation.  Zero is not a valid recirculation id.
+ * @OVS_ACTION_ATTR_HASH: Compute a hash of the packet as specified by the
+ * &struct ovs_action_hash argument and store it as the packet's
+ * %OVS_KEY_ATTR_DP_HASH, for use by a later %OVS_ACTION_ATTR_RECIRC.
  *
  * Only a single header can be set with a single %OVS_ACTION_ATTR_SET.  Not all
  * fields within a header are modifiable, e.g. the IPv4 protocol and fragment
@@ -537,6 +567,8 @@ enum ovs_action_attr {
 	OVS_ACTION_ATTR_SAMPLE,       /* Nested OVS_SAMPLE_ATTR_*. */
 	OVS_ACTION_ATTR_PUSH_MPLS,    /* struct ovs_action_push_mpls. */
 	OVS_ACTION_ATTR_POP_MPLS,     /* __be16 ethertype. */
+	OVS_ACTION_ATTR_RECIRC,	      /* u32 recirc_id. */
+	OVS_ACTION_ATTR_HASH,	      /* struct ovs_action_hash. */
 	__OVS_ACTION_ATTR_MAX
 };
 
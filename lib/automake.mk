@@ -30,6 +30,10 @@ lib_libopenvswitch_a_SOURCES = \
 	lib/compiler.h \
 	lib/coverage.c \
 	lib/coverage.h \
+	lib/cpu.c \
+	lib/cpu.h \
+	lib/crc32c.c \
+	lib/crc32c.h \
 	lib/csum.c \
 	lib/csum.h \
 	lib/daemon.c \
@@ -128,6 +132,8 @@ lib_libopenvswitch_a_SOURCES = \
 	lib/ovsdb-parser.h \
 	lib/ovsdb-types.c \
 	lib/ovsdb-types.h \
+	lib/packed-flow.c \
+	lib/packed-flow.h \
 	lib/packets.c \
 	lib/packets.h \
 	lib/pcap-file.c \
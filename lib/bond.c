@@ -26,6 +26,7 @@
 #include "coverage.h"
 #include "dynamic-string.h"
 #include "flow.h"
+#include "heap.h"
 #include "hmap.h"
 #include "lacp.h"
 #include "list.h"
@@ -42,12 +43,8 @@
 
 VLOG_DEFINE_THIS_MODULE(bond);
 
-/* Bit-mask for hashing a flow down to a bucket.
- * There are (BOND_MASK + 1) buckets. */
-#define BOND_MASK 0xff
-
 /* A hash bucket for mapping a flow to a slave.
- * "struct bond" has an array of (BOND_MASK + 1) of these. */
+ * "struct bond" has an array of ('hash_mask' + 1) of these. */
 struct bond_entry {
     struct bond_slave *slave;   /* Assigned slave, NULL if unassigned. */
     uint64_t tx_bytes;          /* Count of bytes recently transmitted. */
@@ -72,7 +69,8 @@ struct bond_slave {
     tag_type tag;               /* Tag associated with this slave. */
 
     /* Rebalancing info.  Used only by bond_rebalance(). */
-    struct list bal_node;       /* In bond_rebalance()'s 'bals' list. */
+    struct heap_node from_node; /* In bond_rebalance()'s 'froms' heap. */
+    struct heap_node to_node;   /* In bond_rebalance()'s 'tos' heap. */
     struct list entries;        /* 'struct bond_entry's assigned here. */
     uint64_t tx_bytes;          /* Sum across 'tx_bytes' of entries. */
 };
@@ -96,7 +94,8 @@ struct bond {
     uint32_t basis;             /* Basis for flow hash function. */
 
     /* SLB specific bonding info. */
-    struct bond_entry *hash;     /* An array of (BOND_MASK + 1) elements. */
+    struct bond_entry *hash;     /* An array of ('hash_mask' + 1) elements. */
+    uint32_t hash_mask;          /* Number of hash buckets, minus 1. */
     int rebalance_interval;      /* Interval between rebalances, in ms. */
     long long int next_rebalance; /* Next rebalancing time. */
     bool send_learning_packets;
@@ -129,7 +128,8 @@ static tag_type bond_get_active_slave_tag(const struct bond *);
 static struct bond_slave *choose_output_slave(const struct bond *,
                                               const struct flow *,
                                               struct flow_wildcards *,
-                                              uint16_t vlan, tag_type *tags);
+                                              uint16_t vlan, tag_type *tags,
+                                              uint32_t *hashp);
 static void bond_update_fake_slave_stats(struct bond *);
 
 /* Attempts to parse 's' as the name of a bond balancing mode.  If successful,
@@ -253,6 +253,16 @@ bond_reconfigure(struct bond *bond, const struct bond_settings *s)
         revalidate = true;
     }
 
+    ovs_assert(IS_POW2(s->n_buckets)
+               && s->n_buckets >= BOND_MIN_BUCKETS
+               && s->n_buckets <= BOND_MAX_BUCKETS);
+    if (bond->hash_mask != s->n_buckets - 1) {
+        bond->hash_mask = s->n_buckets - 1;
+        free(bond->hash);
+        bond->hash = NULL;
+        revalidate = true;
+    }
+
     if (s->fake_iface) {
         if (bond->next_fake_iface_update == LLONG_MAX) {
             bond->next_fake_iface_update = time_msec();
@@ -349,7 +359,7 @@ bond_slave_unregister(struct bond *bond, const void *slave_)
     del_active = bond->active_slave == slave;
     if (bond->hash) {
         struct bond_entry *e;
-        for (e = bond->hash; e <= &bond->hash[BOND_MASK]; e++) {
+        for (e = bond->hash; e <= &bond->hash[bond->hash_mask]; e++) {
             if (e->slave == slave) {
                 e->slave = NULL;
             }
@@ -506,7 +516,7 @@ bond_compose_learning_packet(struct bond *bond,
 
     memset(&flow, 0, sizeof flow);
     memcpy(flow.dl_src, eth_src, ETH_ADDR_LEN);
-    slave = choose_output_slave(bond, &flow, NULL, vlan, &tags);
+    slave = choose_output_slave(bond, &flow, NULL, vlan, &tags, NULL);
 
     packet = ofpbuf_new(0);
     compose_rarp(packet, eth_src);
@@ -610,13 +620,19 @@ bond_check_admissibility(struct bond *bond, const void *slave_,
  * If 'wc' is non-NULL, bitwise-OR's 'wc' with the set of bits that were
  * significant in the selection.  At some point earlier, 'wc' should
  * have been initialized (e.g., by flow_wildcards_init_catchall()).
+ *
+ * If 'hashp' is non-NULL and the bond balances flows across its slaves,
+ * stores the hash that selected the slave in '*hashp', for accounting the
+ * flow's traffic later with bond_account_hash() instead of bond_account().
+ * Otherwise stores 0 there.
  */
 void *
 bond_choose_output_slave(struct bond *bond, const struct flow *flow,
                          struct flow_wildcards *wc, uint16_t vlan,
-                         tag_type *tags)
+                         tag_type *tags, uint32_t *hashp)
 {
-    struct bond_slave *slave = choose_output_slave(bond, flow, wc, vlan, tags);
+    struct bond_slave *slave = choose_output_slave(bond, flow, wc, vlan, tags,
+                                                   hashp);
     if (slave) {
         *tags |= slave->tag;
         return slave->aux;
@@ -645,29 +661,38 @@ bond_account(struct bond *bond, const struct flow *flow, uint16_t vlan,
     }
 }
 
-static struct bond_slave *
-bond_slave_from_bal_node(struct list *bal)
+/* Notifies 'bond' that 'n_bytes' bytes were sent in a flow for which
+ * bond_choose_output_slave() reported 'hash'.  This is cheaper than
+ * bond_account(), which has to hash the flow again.
+ *
+ * 'hash' remains valid across changes to the number of buckets, but not
+ * across changes to the bond's mode or hash basis, which require the caller
+ * to revalidate its flows anyway. */
+void
+bond_account_hash(struct bond *bond, uint32_t hash, uint64_t n_bytes)
 {
-    return CONTAINER_OF(bal, struct bond_slave, bal_node);
+    if (bond_is_balanced(bond)) {
+        bond->hash[hash & bond->hash_mask].tx_bytes += n_bytes;
+    }
 }
 
 static void
-log_bals(struct bond *bond, const struct list *bals)
+log_bals(struct bond *bond)
 {
     if (VLOG_IS_DBG_ENABLED()) {
         struct ds ds = DS_EMPTY_INITIALIZER;
         const struct bond_slave *slave;
 
-        LIST_FOR_EACH (slave, bal_node, bals) {
+        HMAP_FOR_EACH (slave, hmap_node, &bond->slaves) {
+            if (!slave->enabled) {
+                continue;
+            }
             if (ds.length) {
                 ds_put_char(&ds, ',');
             }
             ds_put_format(&ds, " %s %"PRIu64"kB",
                           slave->name, slave->tx_bytes / 1024);
 
-            if (!slave->enabled) {
-                ds_put_cstr(&ds, " (disabled)");
-            }
             if (!list_is_empty(&slave->entries)) {
                 struct bond_entry *e;
 
@@ -715,82 +740,74 @@ bond_shift_load(struct bond_entry *hash, struct bond_slave *to,
 }
 
 /* Picks and returns a bond_entry to migrate from 'from' (the most heavily
- * loaded bond slave) to a bond slave that has 'to_tx_bytes' bytes of load,
- * given that doing so must decrease the ratio of the load on the two slaves by
- * at least 0.1.  Returns NULL if there is no appropriate entry.
- *
- * The list of entries isn't sorted.  I don't know of a reason to prefer to
- * shift away small hashes or large hashes. */
+ * loaded bond slave) to a bond slave that has 'to_tx_bytes' bytes of load.
+ * Chooses the entry that leaves the two slaves' loads closest to equal, and
+ * only if that shrinks the difference between them by at least 10%.  Returns
+ * NULL if there is no appropriate entry. */
 static struct bond_entry *
 choose_entry_to_migrate(const struct bond_slave *from, uint64_t to_tx_bytes)
 {
+    uint64_t overload = from->tx_bytes - to_tx_bytes;
+    uint64_t best_diff = overload - overload / 10;
+    struct bond_entry *best = NULL;
     struct bond_entry *e;
 
     if (list_is_short(&from->entries)) {
-        /* 'from' carries no more than one MAC hash, so shifting load away from
+        /* 'from' carries no more than one hash, so shifting load away from
          * it would be pointless. */
         return NULL;
     }
 
     LIST_FOR_EACH (e, list_node, &from->entries) {
-        double old_ratio, new_ratio;
-        uint64_t delta;
-
-        if (to_tx_bytes == 0) {
-            /* Nothing on the new slave, move it. */
-            return e;
-        }
-
-        delta = e->tx_bytes;
-        old_ratio = (double)from->tx_bytes / to_tx_bytes;
-        new_ratio = (double)(from->tx_bytes - delta) / (to_tx_bytes + delta);
-        if (old_ratio - new_ratio > 0.1
-            && fabs(new_ratio - 1.0) < fabs(old_ratio - 1.0)) {
-            /* We're aiming for an ideal ratio of 1, meaning both the 'from'
-               and 'to' slave have the same load.  Therefore, we only move an
-               entry if it decreases the load on 'from', and brings us closer
-               to equal traffic load. */
-            return e;
+        uint64_t delta = e->tx_bytes;
+
+        if (delta < overload) {
+            /* After the move, 'from' would carry 'overload - 2 * delta' more
+             * than 'to', or less if that is negative. */
+            uint64_t diff = (2 * delta > overload
+                             ? 2 * delta - overload
+                             : overload - 2 * delta);
+            if (diff < best_diff) {
+                best = e;
+                best_diff = diff;
+            }
         }
     }
 
-    return NULL;
+    return best;
 }
 
-/* Inserts 'slave' into 'bals' so that descending order of 'tx_bytes' is
- * maintained. */
-static void
-insert_bal(struct list *bals, struct bond_slave *slave)
+/* Returns 'slave''s load as a heap priority, in kB since heap priorities are
+ * only 32 bits wide. */
+static uint32_t
+bond_slave_load_priority(const struct bond_slave *slave)
 {
-    struct bond_slave *pos;
-
-    LIST_FOR_EACH (pos, bal_node, bals) {
-        if (slave->tx_bytes > pos->tx_bytes) {
-            break;
-        }
-    }
-    list_insert(&pos->bal_node, &slave->bal_node);
+    return MIN(slave->tx_bytes / 1024, UINT32_MAX);
 }
 
-/* Removes 'slave' from its current list and then inserts it into 'bals' so
- * that descending order of 'tx_bytes' is maintained. */
+/* Updates 'slave''s position in 'froms' and 'tos' after its load changed. */
 static void
-reinsert_bal(struct list *bals, struct bond_slave *slave)
+bond_slave_reheap(struct heap *froms, struct heap *tos,
+                  struct bond_slave *slave)
 {
-    list_remove(&slave->bal_node);
-    insert_bal(bals, slave);
+    uint32_t load = bond_slave_load_priority(slave);
+
+    heap_change(froms, &slave->from_node, load);
+    heap_change(tos, &slave->to_node, UINT32_MAX - load);
 }
 
 /* If 'bond' needs rebalancing, does so.
  *
- * The caller should have called bond_account() for each active flow, to ensure
- * that flow data is consistently accounted at this point. */
+ * The caller should have called bond_account() or bond_account_hash() for
+ * each active flow, to ensure that flow data is consistently accounted at
+ * this point. */
 void
 bond_rebalance(struct bond *bond, struct tag_set *tags)
 {
     struct bond_slave *slave;
     struct bond_entry *e;
-    struct list bals;
+    struct heap froms;          /* Enabled slaves, most loaded first. */
+    struct heap tos;            /* Enabled slaves, least loaded first. */
 
     if (!bond_is_balanced(bond) || time_msec() < bond->next_rebalance) {
         return;
@@ -803,31 +820,38 @@ bond_rebalance(struct bond *bond, struct tag_set *tags)
         slave->tx_bytes = 0;
         list_init(&slave->entries);
     }
-    for (e = &bond->hash[0]; e <= &bond->hash[BOND_MASK]; e++) {
+    for (e = &bond->hash[0]; e <= &bond->hash[bond->hash_mask]; e++) {
         if (e->slave && e->tx_bytes) {
             e->slave->tx_bytes += e->tx_bytes;
             list_push_back(&e->slave->entries, &e->list_node);
         }
     }
 
-    /* Add enabled slaves to 'bals' in descending order of tx_bytes.
-     *
-     * XXX This is O(n**2) in the number of slaves but it could be O(n lg n)
-     * with a proper list sort algorithm. */
-    list_init(&bals);
+    heap_init(&froms);
+    heap_init(&tos);
     HMAP_FOR_EACH (slave, hmap_node, &bond->slaves) {
         if (slave->enabled) {
-            insert_bal(&bals, slave);
+            uint32_t load = bond_slave_load_priority(slave);
+
+            heap_insert(&froms, &slave->from_node, load);
+            heap_insert(&tos, &slave->to_node, UINT32_MAX - load);
         }
     }
-    log_bals(bond, &bals);
+    log_bals(bond);
 
     /* Shift load from the most-loaded slaves to the least-loaded slaves. */
-    while (!list_is_short(&bals)) {
-        struct bond_slave *from = bond_slave_from_bal_node(list_front(&bals));
-        struct bond_slave *to = bond_slave_from_bal_node(list_back(&bals));
+    while (heap_count(&froms) > 1) {
+        struct bond_slave *from = CONTAINER_OF(heap_max(&froms),
+                                               struct bond_slave, from_node);
+        struct bond_slave *to = CONTAINER_OF(heap_max(&tos),
+                                             struct bond_slave, to_node);
         uint64_t overload;
 
+        if (from->tx_bytes <= to->tx_bytes) {
+            /* All of the slaves carry the same load, as far as the heaps'
+             * kB granularity can tell. */
+            break;
+        }
         overload = from->tx_bytes - to->tx_bytes;
         if (overload < to->tx_bytes >> 5 || overload < 100000) {
             /* The extra load on 'from' (and all less-loaded slaves), compared
@@ -844,25 +868,27 @@ bond_rebalance(struct bond *bond, struct tag_set *tags)
 
             /* Delete element from from->entries.
              *
-             * We don't add the element to to->hashes.  That would only allow
+             * We don't add the element to to->entries.  That would only allow
              * 'e' to be migrated to another slave in this rebalancing run, and
              * there is no point in doing that. */
             list_remove(&e->list_node);
 
-            /* Re-sort 'bals'. */
-            reinsert_bal(&bals, from);
-            reinsert_bal(&bals, to);
+            bond_slave_reheap(&froms, &tos, from);
+            bond_slave_reheap(&froms, &tos, to);
         } else {
             /* Can't usefully migrate anything away from 'from'.
              * Don't reconsider it. */
-            list_remove(&from->bal_node);
+            heap_remove(&froms, &from->from_node);
+            heap_remove(&tos, &from->to_node);
         }
     }
+    heap_destroy(&froms);
+    heap_destroy(&tos);
 
     /* Implement exponentially weighted moving average.  A weight of 1/2 causes
      * historical data to decay to <1% in 7 rebalancing runs.  1,000,000 bytes
      * take 20 rebalancing runs to decay to 0 and get deleted entirely. */
-    for (e = &bond->hash[0]; e <= &bond->hash[BOND_MASK]; e++) {
+    for (e = &bond->hash[0]; e <= &bond->hash[bond->hash_mask]; e++) {
         e->tx_bytes /= 2;
         if (!e->tx_bytes) {
             e->slave = NULL;
@@ -997,7 +1023,7 @@ bond_print_details(struct ds *ds, const struct bond *bond)
         }
 
         /* Hashes. */
-        for (be = bond->hash; be <= &bond->hash[BOND_MASK]; be++) {
+        for (be = bond->hash; be <= &bond->hash[bond->hash_mask]; be++) {
             int hash = be - bond->hash;
 
             if (be->slave != slave) {
@@ -1067,7 +1093,7 @@ bond_unixctl_migrate(struct unixctl_conn *conn,
     }
 
     if (strspn(hash_s, "0123456789") == strlen(hash_s)) {
-        hash = atoi(hash_s) & BOND_MASK;
+        hash = strtoul(hash_s, NULL, 10) & bond->hash_mask;
     } else {
         unixctl_command_reply_error(conn, "bad hash");
         return;
@@ -1179,7 +1205,7 @@ bond_unixctl_hash(struct unixctl_conn *conn, int argc, const char *argv[],
     const char *vlan_s = argc > 2 ? argv[2] : NULL;
     const char *basis_s = argc > 3 ? argv[3] : NULL;
     uint8_t mac[ETH_ADDR_LEN];
-    uint8_t hash;
+    unsigned int hash;
     char *hash_cstr;
     unsigned int vlan;
     uint32_t basis;
@@ -1204,7 +1230,7 @@ bond_unixctl_hash(struct unixctl_conn *conn, int argc, const char *argv[],
 
     if (sscanf(mac_s, ETH_ADDR_SCAN_FMT, ETH_ADDR_SCAN_ARGS(mac))
         == ETH_ADDR_SCAN_COUNT) {
-        hash = bond_hash_src(mac, vlan, basis) & BOND_MASK;
+        hash = bond_hash_src(mac, vlan, basis);
 
         hash_cstr = xasprintf("%u", hash);
         unixctl_command_reply(conn, hash_cstr);
@@ -1236,7 +1262,7 @@ static void
 bond_entry_reset(struct bond *bond)
 {
     if (bond->balance != BM_AB) {
-        size_t hash_len = (BOND_MASK + 1) * sizeof *bond->hash;
+        size_t hash_len = (bond->hash_mask + 1) * sizeof *bond->hash;
 
         if (!bond->hash) {
             bond->hash = xmalloc(hash_len);
@@ -1350,14 +1376,20 @@ static struct bond_entry *
 lookup_bond_entry(const struct bond *bond, const struct flow *flow,
                   uint16_t vlan)
 {
-    return &bond->hash[bond_hash(bond, flow, vlan) & BOND_MASK];
+    return &bond->hash[bond_hash(bond, flow, vlan) & bond->hash_mask];
 }
 
 static struct bond_slave *
 choose_output_slave(const struct bond *bond, const struct flow *flow,
-                    struct flow_wildcards *wc, uint16_t vlan, tag_type *tags)
+                    struct flow_wildcards *wc, uint16_t vlan, tag_type *tags,
+                    uint32_t *hashp)
 {
     struct bond_entry *e;
+    uint32_t hash;
+
+    if (hashp) {
+        *hashp = 0;
+    }
 
     if (bond->lacp_status == LACP_CONFIGURED) {
         /* LACP has been configured on this bond but negotiations were
@@ -1382,7 +1414,11 @@ choose_output_slave(const struct bond *bond, const struct flow *flow,
         if (wc) {
             flow_mask_hash_fields(flow, wc, NX_HASH_FIELDS_ETH_SRC);
         }
-        e = lookup_bond_entry(bond, flow, vlan);
+        hash = bond_hash(bond, flow, vlan);
+        if (hashp) {
+            *hashp = hash;
+        }
+        e = &bond->hash[hash & bond->hash_mask];
         if (!e->slave || !e->slave->enabled) {
             e->slave = CONTAINER_OF(hmap_random_node(&bond->slaves),
                                     struct bond_slave, hmap_node);
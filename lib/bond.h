@@ -38,6 +38,13 @@ enum bond_mode {
 bool bond_mode_from_string(enum bond_mode *, const char *);
 const char *bond_mode_to_string(enum bond_mode);
 
+/* Range of the number of hash buckets in a balanced bond.  Flows are hashed
+ * into buckets, and rebalancing moves whole buckets between slaves, so more
+ * buckets allow finer balance at the cost of memory and rebalancing time. */
+#define BOND_MIN_BUCKETS 16
+#define BOND_DEFAULT_BUCKETS 256
+#define BOND_MAX_BUCKETS 65536
+
 /* Configuration for a bond as a whole. */
 struct bond_settings {
     char *name;                 /* Bond's name, for log messages. */
@@ -47,6 +54,9 @@ struct bond_settings {
     enum bond_mode balance;
     int rebalance_interval;     /* Milliseconds between rebalances.
                                    Zero to disable rebalancing. */
+    uint32_t n_buckets;         /* Number of hash buckets, a power of 2
+                                   between BOND_MIN_BUCKETS and
+                                   BOND_MAX_BUCKETS. */
 
     /* Link status detection. */
     int up_delay;               /* ms before enabling an up slave. */
@@ -90,11 +100,12 @@ enum bond_verdict bond_check_admissibility(struct bond *, const void *slave_,
                                            tag_type *);
 void *bond_choose_output_slave(struct bond *, const struct flow *,
                                struct flow_wildcards *, uint16_t vlan,
-                               tag_type *);
+                               tag_type *, uint32_t *hashp);
 
 /* Rebalancing. */
 void bond_account(struct bond *, const struct flow *, uint16_t vlan,
                   uint64_t n_bytes);
+void bond_account_hash(struct bond *, uint32_t hash, uint64_t n_bytes);
 void bond_rebalance(struct bond *, struct tag_set *);
 
 #endif /* bond.h */
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+#include "cpu.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if CPU_X86_DISPATCH
+#include <cpuid.h>
+
+/* Returns true if the CPU supports SSE4.2, which includes the "crc32"
+ * instruction. */
+bool
+cpu_has_sse42(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+}
+
+/* Returns true if the CPU supports AVX2 and the operating system saves the
+ * YMM registers across context switches. */
+bool
+cpu_has_avx2(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    uint32_t xcr0_lo, xcr0_hi;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+        || !(ecx & bit_OSXSAVE) || !(ecx & bit_SSE4_2)
+        || __get_cpuid_max(0, NULL) < 7) {
+        return false;
+    }
+    asm volatile(".byte 0x0f, 0x01, 0xd0" /* xgetbv */
+                 : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+    if ((xcr0_lo & 6) != 6) {
+        return false;
+    }
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1u << 5)) != 0; /* AVX2. */
+}
+#else  /* !CPU_X86_DISPATCH */
+bool
+cpu_has_sse42(void)
+{
+    return false;
+}
+
+bool
+cpu_has_avx2(void)
+{
+    return false;
+}
+#endif /* !CPU_X86_DISPATCH */
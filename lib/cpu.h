@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPU_H
+#define CPU_H 1
+
+#include <stdbool.h>
+
+/* CPU feature detection.
+ *
+ * Code that has faster implementations for particular instruction set
+ * extensions compiles them with per-function target attributes, e.g.
+ * __attribute__((target("sse4.2"))), so that the rest of Open vSwitch still
+ * runs on CPUs without the extensions, and then uses the functions below to
+ * choose an implementation at runtime.  CPU_X86_DISPATCH is 1 if the compiler
+ * supports this for x86, 0 otherwise. */
+
+#if (defined(__x86_64__) || defined(__i386__))                      \
+    && (defined(__clang__)                                          \
+        || (defined(__GNUC__)                                       \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define CPU_X86_DISPATCH 1
+#else
+#define CPU_X86_DISPATCH 0
+#endif
+
+bool cpu_has_sse42(void);
+bool cpu_has_avx2(void);
+
+#endif /* cpu.h */
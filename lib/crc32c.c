@@ -44,7 +44,14 @@
 
 #include <config.h>
 #include "crc32c.h"
+#include <string.h>
 #include "byte-order.h"
+#include "cpu.h"
+#include "util.h"
+
+#if CPU_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 /*****************************************************************/
 /*                                                               */
@@ -132,6 +139,115 @@ static const uint32_t crc32Table[256] = {
     0xBE2DA0A5L, 0x4C4623A6L, 0x5F16D052L, 0xAD7D5351L
 };
 
+static uint32_t
+crc32c_extend_table(uint32_t crc, const uint8_t *data, size_t size)
+{
+    while (size--) {
+        crc = crc32Table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if CPU_X86_DISPATCH
+/* Uses the SSE4.2 "crc32" instruction, which implements exactly this CRC. */
+static uint32_t __attribute__((target("sse4.2")))
+crc32c_extend_sse42(uint32_t crc, const uint8_t *data, size_t size)
+{
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+
+        memcpy(&word, data, sizeof word);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = crc64;
+#endif
+    for (; size >= 4; size -= 4, data += 4) {
+        uint32_t word;
+
+        memcpy(&word, data, sizeof word);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; size; size--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+struct crc32c_impl {
+    const char *name;
+    bool (*available)(void);
+    uint32_t (*extend)(uint32_t crc, const uint8_t *data, size_t size);
+};
+
+static bool
+crc32c_table_available(void)
+{
+    return true;
+}
+
+/* In order of preference. */
+static const struct crc32c_impl impls[] = {
+#if CPU_X86_DISPATCH
+    { "sse4.2", cpu_has_sse42, crc32c_extend_sse42 },
+#endif
+    { "table", crc32c_table_available, crc32c_extend_table },
+};
+
+static const struct crc32c_impl *impl;
+
+/*
+ * Continues the CRC32c computation in 'crc' over the 'size' bytes in 'data'
+ * and returns the new CRC, without the initial and final inversions that
+ * crc32c() applies.
+ */
+uint32_t
+crc32c_extend(uint32_t crc, const uint8_t *data, size_t size)
+{
+    if (!impl) {
+        size_t i;
+
+        for (i = 0; i < ARRAY_SIZE(impls); i++) {
+            if (impls[i].available()) {
+                impl = &impls[i];
+                break;
+            }
+        }
+    }
+    return impl->extend(crc, data, size);
+}
+
+/*
+ * For testing.  Switches to the implementation named 'name', if it is built
+ * in and the CPU supports it, returning true if successful.
+ */
+bool
+crc32c_set_impl(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(impls); i++) {
+        if (!strcmp(impls[i].name, name) && impls[i].available()) {
+            impl = &impls[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * For testing.  Returns the name of the 'idx'th built-in implementation, or
+ * NULL if 'idx' is out of range.
+ */
+const char *
+crc32c_impl_name(size_t idx)
+{
+    return idx < ARRAY_SIZE(impls) ? impls[idx].name : NULL;
+}
+
 /*
  * Compute a CRC32c checksum as per the SCTP requirements in RFC4960. This
  * includes beginning with a checksum of all ones, and returning the negated
@@ -140,11 +256,7 @@ static const uint32_t crc32Table[256] = {
 ovs_be32
 crc32c(const uint8_t *data, size_t size)
 {
-    uint32_t crc = 0xffffffffL;
-
-    while (size--) {
-        crc = crc32Table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
-    }
+    uint32_t crc = crc32c_extend(0xffffffffL, data, size);
 
     /* The result of this CRC calculation provides us a value in the reverse
      * byte-order as compared with our architecture. On big-endian systems,
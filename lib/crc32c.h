@@ -18,8 +18,15 @@
 #ifndef CRC32C_H
 #define CRC32C_H 1
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "openvswitch/types.h"
 
 ovs_be32 crc32c(const uint8_t *data, size_t);
+uint32_t crc32c_extend(uint32_t crc, const uint8_t *data, size_t);
+
+/* For testing. */
+bool crc32c_set_impl(const char *name);
+const char *crc32c_impl_name(size_t idx);
 
 #endif /* crc32c.h */
@@ -16,7 +16,14 @@
 
 #include <config.h>
 #include "csum.h"
+#include <string.h>
+#include "cpu.h"
 #include "unaligned.h"
+#include "util.h"
+
+#if CPU_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 #ifndef __CHECKER__
 
@@ -51,22 +58,139 @@ csum_add32(uint32_t partial, ovs_be32 new)
 }
 
 
+/* Folds the 64-bit one's-complement sum 'sum' into a partial checksum small
+ * enough that callers may keep adding to it without overflow. */
+static uint32_t
+csum_fold64(uint64_t sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (sum & 0xffff) + (sum >> 16);
+}
+
+/* Adds up 'data' 32 bits at a time in a 64-bit accumulator.  This is
+ * equivalent to adding it up 16 bits at a time, because 2**16 == 1 in one's
+ * complement arithmetic, and needs a quarter of the carries folded. */
+static uint32_t
+csum_continue_wide(uint32_t partial, const void *data_, size_t n)
+{
+    const uint8_t *data = data_;
+    uint64_t sum0 = partial, sum1 = 0;
+
+    for (; n >= 16; n -= 16, data += 16) {
+        sum0 += get_unaligned_u32((const uint32_t *) data);
+        sum1 += get_unaligned_u32((const uint32_t *) (data + 4));
+        sum0 += get_unaligned_u32((const uint32_t *) (data + 8));
+        sum1 += get_unaligned_u32((const uint32_t *) (data + 12));
+    }
+    for (; n >= 4; n -= 4, data += 4) {
+        sum0 += get_unaligned_u32((const uint32_t *) data);
+    }
+    if (n >= 2) {
+        sum1 += get_unaligned_u16((const uint16_t *) data);
+        n -= 2;
+        data += 2;
+    }
+    if (n) {
+        sum1 += *data;
+    }
+    return csum_fold64(sum0 + sum1);
+}
+
+#if CPU_X86_DISPATCH
+/* Like csum_continue_wide(), but widens eight 32-bit words at a time into
+ * four 64-bit lanes. */
+static uint32_t __attribute__((target("avx2")))
+csum_continue_avx2(uint32_t partial, const void *data_, size_t n)
+{
+    const uint8_t *data = data_;
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    uint64_t lanes[4];
+
+    for (; n >= 32; n -= 32, data += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) data);
+
+        acc0 = _mm256_add_epi64(
+            acc0, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+        acc1 = _mm256_add_epi64(
+            acc1, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(acc0, acc1));
+
+    /* Each lane is less than 2**33 times the number of iterations, so this
+     * cannot overflow for any realistic 'n'. */
+    partial = csum_fold64((uint64_t) partial
+                          + lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    return csum_continue_wide(partial, data, n);
+}
+#endif
+
+static bool
+csum_wide_available(void)
+{
+    return true;
+}
+
+struct csum_impl {
+    const char *name;
+    bool (*available)(void);
+    uint32_t (*continue_)(uint32_t partial, const void *, size_t);
+};
+
+/* In order of preference. */
+static const struct csum_impl impls[] = {
+#if CPU_X86_DISPATCH
+    { "avx2", cpu_has_avx2, csum_continue_avx2 },
+#endif
+    { "wide", csum_wide_available, csum_continue_wide },
+};
+
+static const struct csum_impl *impl;
+
 /* Adds the 'n' bytes in 'data' to the partial IP checksum 'partial' and
  * returns the updated checksum.  (To start a new checksum, pass 0 for
  * 'partial'.  To obtain the finished checksum, pass the return value to
  * csum_finish().) */
 uint32_t
-csum_continue(uint32_t partial, const void *data_, size_t n)
+csum_continue(uint32_t partial, const void *data, size_t n)
 {
-    const ovs_be16 *data = data_;
+    if (!impl) {
+        size_t i;
 
-    for (; n > 1; n -= 2, data++) {
-        partial = csum_add16(partial, get_unaligned_be16(data));
+        for (i = 0; i < ARRAY_SIZE(impls); i++) {
+            if (impls[i].available()) {
+                impl = &impls[i];
+                break;
+            }
+        }
     }
-    if (n) {
-        partial += *(uint8_t *) data;
+    return impl->continue_(partial, data, n);
+}
+
+/* For testing.  Switches csum_continue() to the implementation named 'name',
+ * if it is built in and the CPU supports it, returning true if successful. */
+bool
+csum_set_impl(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(impls); i++) {
+        if (!strcmp(impls[i].name, name) && impls[i].available()) {
+            impl = &impls[i];
+            return true;
+        }
     }
-    return partial;
+    return false;
+}
+
+/* For testing.  Returns the name of the 'idx'th built-in implementation of
+ * csum_continue(), or NULL if 'idx' is out of range. */
+const char *
+csum_impl_name(size_t idx)
+{
+    return idx < ARRAY_SIZE(impls) ? impls[idx].name : NULL;
 }
 
 /* Returns the IP checksum corresponding to 'partial', which is a value updated
@@ -85,21 +209,71 @@ csum_finish(uint32_t partial)
     return ~partial;
 }
 
+/* Incremental checksum update.
+ *
+ * When several fields of a packet change, updating its checksum with one
+ * recalc_csum*() call per field folds and complements the checksum for every
+ * field.  Instead, start with csum_update_init(), then call csum_update16(),
+ * csum_update32(), or csum_update128() once per changed field, then obtain the
+ * new checksum with csum_update_finish().  The result is the same as chaining
+ * the corresponding recalc_csum*() calls.
+ *
+ * See RFC 1624 for formula and explanation.  Ones-complement arithmetic is
+ * endian-independent, so this code does not use htons() or ntohs(). */
+
+/* Returns a partial checksum for updating 'old_csum'. */
+uint32_t
+csum_update_init(ovs_be16 old_csum)
+{
+    return (uint16_t) ~old_csum;
+}
+
+/* Adds to 'partial' the change of a 16-bit field from 'old_u16' to 'new_u16'
+ * and returns the updated partial checksum. */
+uint32_t
+csum_update16(uint32_t partial, ovs_be16 old_u16, ovs_be16 new_u16)
+{
+    return partial + (uint16_t) ~old_u16 + (uint16_t) new_u16;
+}
+
+/* Adds to 'partial' the change of a 32-bit field from 'old_u32' to 'new_u32'
+ * and returns the updated partial checksum. */
+uint32_t
+csum_update32(uint32_t partial, ovs_be32 old_u32, ovs_be32 new_u32)
+{
+    partial = csum_update16(partial, old_u32, new_u32);
+    return csum_update16(partial, old_u32 >> 16, new_u32 >> 16);
+}
+
+/* Adds to 'partial' the change of a 128-bit field from 'old_u32[4]' to
+ * 'new_u32[4]' and returns the updated partial checksum. */
+uint32_t
+csum_update128(uint32_t partial, const ovs_be32 old_u32[4],
+               const ovs_be32 new_u32[4])
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        partial = csum_update32(partial, old_u32[i], new_u32[i]);
+    }
+    return partial;
+}
+
+/* Returns the new checksum corresponding to 'partial'. */
+ovs_be16
+csum_update_finish(uint32_t partial)
+{
+    return csum_finish(partial);
+}
+
 /* Returns the new checksum for a packet in which the checksum field previously
  * contained 'old_csum' and in which a field that contained 'old_u16' was
  * changed to contain 'new_u16'. */
 ovs_be16
 recalc_csum16(ovs_be16 old_csum, ovs_be16 old_u16, ovs_be16 new_u16)
 {
-    /* Ones-complement arithmetic is endian-independent, so this code does not
-     * use htons() or ntohs().
-     *
-     * See RFC 1624 for formula and explanation. */
-    uint16_t hc_complement = ~old_csum;
-    uint16_t m_complement = ~old_u16;
-    uint16_t m_prime = new_u16;
-    uint32_t sum = hc_complement + m_complement + m_prime;
-    return csum_finish(sum);
+    return csum_update_finish(csum_update16(csum_update_init(old_csum),
+                                            old_u16, new_u16));
 }
 
 /* Returns the new checksum for a packet in which the checksum field previously
@@ -108,8 +282,8 @@ recalc_csum16(ovs_be16 old_csum, ovs_be16 old_u16, ovs_be16 new_u16)
 ovs_be16
 recalc_csum32(ovs_be16 old_csum, ovs_be32 old_u32, ovs_be32 new_u32)
 {
-    return recalc_csum16(recalc_csum16(old_csum, old_u32, new_u32),
-                         old_u32 >> 16, new_u32 >> 16);
+    return csum_update_finish(csum_update32(csum_update_init(old_csum),
+                                            old_u32, new_u32));
 }
 
 /* Returns the new checksum for a packet in which the checksum field previously
@@ -119,13 +293,8 @@ ovs_be16
 recalc_csum128(ovs_be16 old_csum, ovs_be32 old_u32[4],
                const ovs_be32 new_u32[4])
 {
-    ovs_be16 new_csum = old_csum;
-    int i;
-
-    for (i = 0; i < 4; ++i) {
-        new_csum = recalc_csum32(new_csum, old_u32[i], new_u32[i]);
-    }
-    return new_csum;
+    return csum_update_finish(csum_update128(csum_update_init(old_csum),
+                                             old_u32, new_u32));
 }
 #else  /* __CHECKER__ */
 /* Making sparse happy with these functions also makes them unreadable, so
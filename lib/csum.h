@@ -17,6 +17,7 @@
 #ifndef CSUM_H
 #define CSUM_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include "openvswitch/types.h"
@@ -31,4 +32,15 @@ ovs_be16 recalc_csum32(ovs_be16 old_csum, ovs_be32 old_u32, ovs_be32 new_u32);
 ovs_be16 recalc_csum128(ovs_be16 old_csum, ovs_be32 old_u32[4],
                         const ovs_be32 new_u32[4]);
 
+uint32_t csum_update_init(ovs_be16 old_csum);
+uint32_t csum_update16(uint32_t partial, ovs_be16 old_u16, ovs_be16 new_u16);
+uint32_t csum_update32(uint32_t partial, ovs_be32 old_u32, ovs_be32 new_u32);
+uint32_t csum_update128(uint32_t partial, const ovs_be32 old_u32[4],
+                        const ovs_be32 new_u32[4]);
+ovs_be16 csum_update_finish(uint32_t partial);
+
+/* For testing. */
+bool csum_set_impl(const char *name);
+const char *csum_impl_name(size_t idx);
+
 #endif /* csum.h */
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <net/if.h>
@@ -31,6 +32,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "byte-order.h"
 #include "csum.h"
 #include "dpif.h"
 #include "dpif-provider.h"
@@ -48,6 +50,7 @@
 #include "packets.h"
 #include "poll-loop.h"
 #include "random.h"
+#include "route-table.h"
 #include "shash.h"
 #include "sset.h"
 #include "timeval.h"
@@ -60,9 +63,22 @@ VLOG_DEFINE_THIS_MODULE(dpif_netdev);
 enum { MAX_PORTS = 256 };       /* Maximum number of ports. */
 enum { MAX_FLOWS = 65536 };     /* Maximum number of flows in flow table. */
 
-/* Enough headroom to add a vlan tag, plus an extra 2 bytes to allow IP
- * headers to be aligned on a 4-byte boundary.  */
-enum { DP_NETDEV_HEADROOM = 2 + VLAN_HEADER_LEN };
+/* Enough headroom to add a vlan tag and outer tunnel headers, plus an extra 2
+ * bytes to allow IP headers to be aligned on a 4-byte boundary.  */
+enum { DP_NETDEV_HEADROOM = (2 + VLAN_HEADER_LEN
+                             + ROUND_UP(TNL_HEADER_MAX, 4)) };
+
+/* Packet batches. */
+enum { DP_NETDEV_RX_BATCH = 32 }; /* Max packets received per port per run. */
+enum { DP_NETDEV_TX_BATCH = 32 }; /* Max packets queued per output port. */
+
+/* Maximum number of nested recirculations of a packet, to break loops.
+ * Tunnel encapsulation and decapsulation count as recirculations. */
+enum { DP_NETDEV_MAX_RECIRC_DEPTH = 5 };
+
+/* How often native tunneling rereads routes, ARP entries, and the IP addresses
+ * of internal ports, in milliseconds. */
+enum { DP_NETDEV_TNL_REFRESH_MSEC = 1000 };
 
 /* Queues. */
 enum { N_QUEUES = 2 };          /* Number of queues for dpif_recv(). */
@@ -99,20 +115,141 @@ struct dp_netdev {
     struct dp_netdev_port *ports[MAX_PORTS];
     struct list port_list;
     unsigned int serial;
+
+    /* Recirculation. */
+    int recirc_depth;           /* Current nesting of OVS_ACTION_ATTR_RECIRC. */
+    struct list recirc_clones;  /* Packet copies freed by dp_netdev_flush_tx(). */
+
+    /* Native tunneling. */
+    struct list tnl_ports;      /* Contains "struct dp_netdev_port"s. */
+    long long int tnl_refresh;  /* Next time to refresh ports' 'in4'. */
 };
 
+/* Native tunneling.
+ *
+ * There are no kernel vports behind the userspace datapath's GRE and VXLAN
+ * ports, so the datapath encapsulates and decapsulates their packets itself,
+ * the way the kernel would with the host's routes and ARP cache:
+ *
+ *     - A packet output to a tunnel port gets outer headers for the remote IP
+ *       and is then looked up again as input on the datapath port, normally
+ *       a bridge's internal port, that the host routes the remote IP
+ *       through, as if the host had sent it there.
+ *
+ *     - A tunnel packet output to the internal port that owns its outer
+ *       destination IP is taken by the tunnel port, decapsulated, and looked
+ *       up again as input on the tunnel port, instead of reaching the host.
+ */
 /* A port in a netdev-based datapath. */
 struct dp_netdev_port {
     int port_no;                /* Index into dp_netdev's 'ports'. */
     struct list node;           /* Element in dp_netdev's 'port_list'. */
     struct netdev *netdev;
     char *type;                 /* Port type as requested by user. */
+
+    /* Packets waiting for dp_netdev_flush_tx() to send them in one batch. */
+    struct ofpbuf *tx_packets[DP_NETDEV_TX_BATCH];
+    bool tx_owned[DP_NETDEV_TX_BATCH]; /* Delete packet after sending? */
+    size_t n_tx;
+
+    /* Native tunneling. */
+    enum tnl_type tnl_type;
+    struct list tnl_node;       /* In dp_netdev's 'tnl_ports', if a tunnel. */
+    ovs_be16 tnl_dst_port;      /* UDP destination port, for VXLAN. */
+    ovs_be32 in4;               /* IPv4 address of an internal port, or 0. */
+};
+
+/* Outer headers for one tunnel output operation, precomputed for the tunnel
+ * metadata that it last saw, so that encapsulating a packet takes a copy and
+ * a few length and checksum fixups. */
+struct dp_netdev_tnl_header {
+    struct flow_tnl tnl;        /* Metadata that 'hdr' was built for. */
+    long long int expires;      /* Rebuild after this time. */
+    struct dp_netdev_port *underlay; /* Port to look packets up on, or null if
+                                      * there is no route or next hop. */
+    struct tnl_header hdr;
+};
+
+/* A datapath action, decoded from its OVS_ACTION_ATTR_* form. */
+enum dp_netdev_op_type {
+    DP_NETDEV_OP_OUTPUT,
+    DP_NETDEV_OP_USERSPACE,
+    DP_NETDEV_OP_PUSH_VLAN,
+    DP_NETDEV_OP_POP_VLAN,
+    DP_NETDEV_OP_PUSH_MPLS,
+    DP_NETDEV_OP_POP_MPLS,
+    DP_NETDEV_OP_SET_ETHERNET,
+    DP_NETDEV_OP_SET_IPV4,
+    DP_NETDEV_OP_SET_IPV6,
+    DP_NETDEV_OP_SET_TCP,
+    DP_NETDEV_OP_SET_UDP,
+    DP_NETDEV_OP_SET_MPLS,
+    DP_NETDEV_OP_SET_TUNNEL,
+    DP_NETDEV_OP_SAMPLE,
+    DP_NETDEV_OP_HASH,
+    DP_NETDEV_OP_RECIRC
+};
+
+struct dp_netdev_op {
+    enum dp_netdev_op_type type;
+    union {
+        /* DP_NETDEV_OP_OUTPUT. */
+        struct {
+            uint32_t port_no;
+            struct dp_netdev_port *port; /* Null if there is no such port. */
+            bool clone;         /* Later ops modify the packet, so queue a
+                                 * copy for output instead of the packet. */
+            struct dp_netdev_tnl_header *tnl_header; /* If 'port' is a tunnel
+                                                      * port. */
+        } output;
+
+        /* DP_NETDEV_OP_USERSPACE.  Points into the original actions. */
+        const struct nlattr *userdata;
+
+        ovs_be16 vlan_tci;                      /* DP_NETDEV_OP_PUSH_VLAN. */
+        struct ovs_action_push_mpls push_mpls;  /* DP_NETDEV_OP_PUSH_MPLS. */
+        ovs_be16 ethertype;                     /* DP_NETDEV_OP_POP_MPLS. */
+
+        /* DP_NETDEV_OP_SET_*. */
+        struct ovs_key_ethernet ethernet;
+        struct ovs_key_ipv4 ipv4;
+        struct ovs_key_ipv6 ipv6;
+        struct ovs_key_tcp tcp;
+        struct ovs_key_udp udp;
+        ovs_be32 mpls_lse;
+        struct flow_tnl tunnel;
+
+        /* DP_NETDEV_OP_SAMPLE. */
+        struct {
+            uint32_t probability;
+            struct dp_netdev_program *actions;
+        } sample;
+
+        uint32_t hash_basis;                    /* DP_NETDEV_OP_HASH. */
+
+        /* DP_NETDEV_OP_RECIRC. */
+        struct {
+            uint32_t recirc_id;
+            bool clone;         /* The packet is used after recirculating, so
+                                 * recirculate a copy instead of the packet. */
+        } recirc;
+    } u;
+};
+
+/* A list of datapath actions compiled into an array of operations, so that
+ * executing them does not have to parse Netlink attributes.  Consecutive
+ * "set" actions that rewrite the same header are merged into one. */
+struct dp_netdev_program {
+    struct dp_netdev_op *ops;
+    size_t n_ops;
+    unsigned int port_serial;   /* dp_netdev 'serial' when ports resolved. */
 };
 
 /* A flow in dp_netdev's 'flow_table'. */
 struct dp_netdev_flow {
     struct hmap_node node;      /* Element in dp_netdev's 'flow_table'. */
     struct flow key;
+    struct miniflow mf;         /* 'key', compressed, hashed for 'node'. */
 
     /* Statistics. */
     long long int used;         /* Last used time, in monotonic msecs. */
@@ -123,6 +260,7 @@ struct dp_netdev_flow {
     /* Actions. */
     struct nlattr *actions;
     size_t actions_len;
+    struct dp_netdev_program program; /* 'actions', compiled. */
 };
 
 /* Interface to netdev-based datapath. */
@@ -152,10 +290,17 @@ static int dpif_netdev_open(const struct dpif_class *, const char *name,
 static int dp_netdev_output_userspace(struct dp_netdev *, const struct ofpbuf *,
                                     int queue_no, const struct flow *,
                                     const struct nlattr *userdata);
-static void dp_netdev_execute_actions(struct dp_netdev *,
-                                      struct ofpbuf *, struct flow *,
-                                      const struct nlattr *actions,
-                                      size_t actions_len);
+static void dp_netdev_program_init(struct dp_netdev_program *,
+                                   const struct dp_netdev *,
+                                   const struct nlattr *actions,
+                                   size_t actions_len);
+static void dp_netdev_program_destroy(struct dp_netdev_program *);
+static void dp_netdev_execute_program(struct dp_netdev *,
+                                      struct dp_netdev_program *,
+                                      struct ofpbuf **packets,
+                                      size_t n_packets, struct flow *,
+                                      const struct flow_tnl *);
+static void dp_netdev_flush_tx(struct dp_netdev *);
 
 static struct dpif_netdev *
 dpif_netdev_cast(const struct dpif *dpif)
@@ -267,6 +412,8 @@ create_dp_netdev(const char *name, const struct dpif_class *class,
     }
     hmap_init(&dp->flow_table);
     list_init(&dp->port_list);
+    list_init(&dp->recirc_clones);
+    list_init(&dp->tnl_ports);
 
     error = do_add_port(dp, name, "internal", OVSP_LOCAL);
     if (error) {
@@ -370,6 +517,55 @@ dpif_netdev_get_stats(const struct dpif *dpif, struct dpif_dp_stats *stats)
     return 0;
 }
 
+static void
+dp_netdev_port_update_in4(const struct dp_netdev *dp,
+                          struct dp_netdev_port *port)
+{
+    struct in_addr in4;
+
+    /* A dummy datapath opens internal ports as dummy netdevs, which only have
+     * an IP address if "netdev-dummy/ip4addr" gave them one. */
+    port->in4 = ((!strcmp(port->type, "internal")
+                  || dpif_netdev_class_is_dummy(dp->class))
+                 && !netdev_get_in4(port->netdev, &in4, NULL)
+                 ? in4.s_addr : htonl(0));
+}
+
+/* Sets up native tunneling for 'port', which is being added to 'dp' with
+ * name 'devname'. */
+static void
+dp_netdev_port_init_tnl(struct dp_netdev *dp, struct dp_netdev_port *port,
+                        const char *devname)
+{
+    port->tnl_dst_port = htons(0);
+    if (!strcmp(port->type, "gre")) {
+        port->tnl_type = TNL_TYPE_GRE;
+    } else if (!strcmp(port->type, "vxlan")) {
+        const struct netdev_tunnel_config *cfg;
+        unsigned int dst_port;
+
+        /* The datapath port is shared by every VXLAN port with the same UDP
+         * port, which is only part of its name. */
+        cfg = netdev_get_tunnel_config(port->netdev);
+        if (cfg && cfg->dst_port) {
+            port->tnl_dst_port = cfg->dst_port;
+        } else if (sscanf(devname, "vxlan_sys_%u", &dst_port) == 1
+                   && dst_port <= UINT16_MAX) {
+            port->tnl_dst_port = htons(dst_port);
+        } else {
+            port->tnl_dst_port = htons(4789);
+        }
+        port->tnl_type = TNL_TYPE_VXLAN;
+    } else {
+        port->tnl_type = TNL_TYPE_NONE;
+    }
+
+    if (port->tnl_type != TNL_TYPE_NONE) {
+        list_push_back(&dp->tnl_ports, &port->tnl_node);
+    }
+    dp_netdev_port_update_in4(dp, port);
+}
+
 static int
 do_add_port(struct dp_netdev *dp, const char *devname, const char *type,
             uint32_t port_no)
@@ -407,9 +603,11 @@ do_add_port(struct dp_netdev *dp, const char *devname, const char *type,
     }
 
     port = xmalloc(sizeof *port);
+    port->n_tx = 0;
     port->port_no = port_no;
     port->netdev = netdev;
     port->type = xstrdup(type);
+    dp_netdev_port_init_tnl(dp, port, devname);
 
     error = netdev_get_mtu(netdev, &mtu);
     if (!error && mtu > max_mtu) {
@@ -502,6 +700,9 @@ do_del_port(struct dp_netdev *dp, uint32_t port_no)
     }
 
     list_remove(&port->node);
+    if (port->tnl_type != TNL_TYPE_NONE) {
+        list_remove(&port->tnl_node);
+    }
     dp->ports[port->port_no] = NULL;
     dp->serial++;
 
@@ -564,6 +765,8 @@ static void
 dp_netdev_free_flow(struct dp_netdev *dp, struct dp_netdev_flow *flow)
 {
     hmap_remove(&dp->flow_table, &flow->node);
+    miniflow_destroy(&flow->mf);
+    dp_netdev_program_destroy(&flow->program);
     free(flow->actions);
     free(flow);
 }
@@ -651,19 +854,36 @@ dpif_netdev_port_poll_wait(const struct dpif *dpif_)
     }
 }
 
+/* Looks up the flow whose key is 'mf', given 'hash' ==
+ * miniflow_crc_hash(mf, 0).  Only the words present in 'mf' are hashed and
+ * compared. */
 static struct dp_netdev_flow *
-dp_netdev_lookup_flow(const struct dp_netdev *dp, const struct flow *key)
+dp_netdev_lookup_miniflow(const struct dp_netdev *dp,
+                          const struct miniflow *mf, uint32_t hash)
 {
     struct dp_netdev_flow *flow;
 
-    HMAP_FOR_EACH_WITH_HASH (flow, node, flow_hash(key, 0), &dp->flow_table) {
-        if (flow_equal(&flow->key, key)) {
+    HMAP_FOR_EACH_WITH_HASH (flow, node, hash, &dp->flow_table) {
+        if (miniflow_equal(&flow->mf, mf)) {
             return flow;
         }
     }
     return NULL;
 }
 
+static struct dp_netdev_flow *
+dp_netdev_lookup_flow(const struct dp_netdev *dp, const struct flow *key)
+{
+    struct dp_netdev_flow *flow;
+    struct miniflow mf;
+
+    miniflow_init(&mf, key);
+    flow = dp_netdev_lookup_miniflow(dp, &mf, miniflow_crc_hash(&mf, 0));
+    miniflow_destroy(&mf);
+
+    return flow;
+}
+
 static void
 get_dpif_flow_stats(struct dp_netdev_flow *flow, struct dpif_flow_stats *stats)
 {
@@ -735,12 +955,15 @@ dpif_netdev_flow_get(const struct dpif *dpif,
 }
 
 static int
-set_flow_actions(struct dp_netdev_flow *flow,
+set_flow_actions(const struct dp_netdev *dp, struct dp_netdev_flow *flow,
                  const struct nlattr *actions, size_t actions_len)
 {
     flow->actions = xrealloc(flow->actions, actions_len);
     flow->actions_len = actions_len;
     memcpy(flow->actions, actions, actions_len);
+
+    dp_netdev_program_destroy(&flow->program);
+    dp_netdev_program_init(&flow->program, dp, flow->actions, actions_len);
     return 0;
 }
 
@@ -754,13 +977,15 @@ dp_netdev_flow_add(struct dp_netdev *dp, const struct flow *key,
     flow = xzalloc(sizeof *flow);
     flow->key = *key;
 
-    error = set_flow_actions(flow, actions, actions_len);
+    error = set_flow_actions(dp, flow, actions, actions_len);
     if (error) {
         free(flow);
         return error;
     }
 
-    hmap_insert(&dp->flow_table, &flow->node, flow_hash(&flow->key, 0));
+    miniflow_init(&flow->mf, &flow->key);
+    hmap_insert(&dp->flow_table, &flow->node,
+                miniflow_crc_hash(&flow->mf, 0));
     return 0;
 }
 
@@ -803,7 +1028,8 @@ dpif_netdev_flow_put(struct dpif *dpif, const struct dpif_flow_put *put)
         }
     } else {
         if (put->flags & DPIF_FP_MODIFY) {
-            int error = set_flow_actions(flow, put->actions, put->actions_len);
+            int error = set_flow_actions(dp, flow, put->actions,
+                                         put->actions_len);
             if (!error) {
                 if (put->stats) {
                     get_dpif_flow_stats(flow, put->stats);
@@ -928,6 +1154,8 @@ static int
 dpif_netdev_execute(struct dpif *dpif, const struct dpif_execute *execute)
 {
     struct dp_netdev *dp = get_dp_netdev(dpif);
+    struct dp_netdev_program program;
+    struct ofpbuf *packet;
     struct ofpbuf copy;
     struct flow key;
     int error;
@@ -938,16 +1166,20 @@ dpif_netdev_execute(struct dpif *dpif, const struct dpif_execute *execute)
     }
 
     /* Make a deep copy of 'packet', because we might modify its data. */
-    ofpbuf_init(&copy, DP_NETDEV_HEADROOM + execute->packet->size);
-    ofpbuf_reserve(&copy, DP_NETDEV_HEADROOM);
+    ofpbuf_init_pooled(&copy, execute->packet->size, DP_NETDEV_HEADROOM);
     ofpbuf_put(&copy, execute->packet->data, execute->packet->size);
 
     flow_extract(&copy, 0, 0, NULL, -1, &key);
     error = dpif_netdev_flow_from_nlattrs(execute->key, execute->key_len,
                                           &key);
     if (!error) {
-        dp_netdev_execute_actions(dp, &copy, &key,
-                                  execute->actions, execute->actions_len);
+        dp_netdev_program_init(&program, dp,
+                               execute->actions, execute->actions_len);
+        packet = &copy;
+        dp_netdev_execute_program(dp, &program, &packet, 1, &key,
+                                  key.tunnel.ip_dst ? &key.tunnel : NULL);
+        dp_netdev_flush_tx(dp);
+        dp_netdev_program_destroy(&program);
     }
 
     ofpbuf_uninit(&copy);
@@ -1021,64 +1253,151 @@ dpif_netdev_recv_purge(struct dpif *dpif)
     dp_netdev_purge_queues(dpif_netdev->dp);
 }
 
+/* Accounts for the 'n_packets' packets in 'packets', all of which matched
+ * 'flow', in 'flow''s statistics.  'now' is the current time, read once by
+ * the caller for a whole batch of packets. */
 static void
-dp_netdev_flow_used(struct dp_netdev_flow *flow, const struct ofpbuf *packet)
+dp_netdev_flow_used(struct dp_netdev_flow *flow, struct ofpbuf **packets,
+                    size_t n_packets, long long int now)
 {
-    flow->used = time_msec();
-    flow->packet_count++;
-    flow->byte_count += packet->size;
-    flow->tcp_flags |= packet_get_tcp_flags(packet, &flow->key);
+    long long int n_bytes = 0;
+    uint8_t tcp_flags = 0;
+    size_t i;
+
+    for (i = 0; i < n_packets; i++) {
+        n_bytes += packets[i]->size;
+        tcp_flags |= packet_get_tcp_flags(packets[i], &flow->key);
+    }
+
+    flow->used = now;
+    flow->packet_count += n_packets;
+    flow->byte_count += n_bytes;
+    flow->tcp_flags |= tcp_flags;
 }
 
+/* Processes the 'n_packets' packets in 'packets', all received on 'port'.
+ * Packets that hit the same flow are executed together, and packets output to
+ * the same port are sent together.
+ *
+ * Statistics are gathered in local variables and added to the flows and to
+ * 'dp' once per batch, with a single clock reading for the whole batch. */
 static void
 dp_netdev_port_input(struct dp_netdev *dp, struct dp_netdev_port *port,
-                     struct ofpbuf *packet)
-{
-    struct dp_netdev_flow *flow;
-    struct flow key;
+                     struct ofpbuf packets[], size_t n_packets)
+{
+    struct dp_netdev_flow *flows[DP_NETDEV_RX_BATCH];
+    long long int n_hit = 0, n_missed = 0;
+    long long int now = time_msec();
+    size_t i, j;
+
+    for (i = 0; i < n_packets; i++) {
+        struct ofpbuf *packet = &packets[i];
+        uint32_t storage[FLOW_U32S];
+        struct miniflow mf;
+        uint32_t hash;
+
+        flows[i] = NULL;
+        if (packet->size < ETH_HEADER_LEN) {
+            continue;
+        }
+        hash = miniflow_extract(packet, 0, 0, NULL, port->port_no, &mf,
+                                storage);
+        flows[i] = dp_netdev_lookup_miniflow(dp, &mf, hash);
+        if (flows[i]) {
+            n_hit++;
+        } else {
+            struct flow key;
 
-    if (packet->size < ETH_HEADER_LEN) {
-        return;
+            miniflow_expand(&mf, &key);
+            n_missed++;
+            dp_netdev_output_userspace(dp, packet, DPIF_UC_MISS, &key, NULL);
+        }
     }
-    flow_extract(packet, 0, 0, NULL, port->port_no, &key);
-    flow = dp_netdev_lookup_flow(dp, &key);
-    if (flow) {
-        dp_netdev_flow_used(flow, packet);
-        dp_netdev_execute_actions(dp, packet, &key,
-                                  flow->actions, flow->actions_len);
-        dp->n_hit++;
-    } else {
-        dp->n_missed++;
-        dp_netdev_output_userspace(dp, packet, DPIF_UC_MISS, &key, NULL);
+    dp->n_hit += n_hit;
+    dp->n_missed += n_missed;
+
+    /* Execute each flow's actions once, over all of its packets. */
+    for (i = 0; i < n_packets; i++) {
+        struct dp_netdev_flow *flow = flows[i];
+        struct ofpbuf *batch[DP_NETDEV_RX_BATCH];
+        size_t n_batch;
+
+        if (!flow) {
+            continue;
+        }
+
+        n_batch = 0;
+        for (j = i; j < n_packets; j++) {
+            if (flows[j] == flow) {
+                batch[n_batch++] = &packets[j];
+                flows[j] = NULL;
+            }
+        }
+
+        /* The flow table is exact-match, so 'flow->key' is the flow of every
+         * packet in 'batch'. */
+        dp_netdev_flow_used(flow, batch, n_batch, now);
+        dp_netdev_execute_program(dp, &flow->program, batch, n_batch,
+                                  &flow->key, NULL);
     }
+
+    dp_netdev_flush_tx(dp);
 }
 
 static void
 dpif_netdev_run(struct dpif *dpif)
 {
     struct dp_netdev *dp = get_dp_netdev(dpif);
+    struct ofpbuf packets[DP_NETDEV_RX_BATCH];
     struct dp_netdev_port *port;
-    struct ofpbuf packet;
+    size_t n_init = 0;
+    size_t i;
 
-    ofpbuf_init(&packet, DP_NETDEV_HEADROOM + VLAN_ETH_HEADER_LEN + max_mtu);
+    if (!list_is_empty(&dp->tnl_ports) && time_msec() >= dp->tnl_refresh) {
+        LIST_FOR_EACH (port, node, &dp->port_list) {
+            dp_netdev_port_update_in4(dp, port);
+        }
+        dp->tnl_refresh = time_msec() + DP_NETDEV_TNL_REFRESH_MSEC;
+    }
 
     LIST_FOR_EACH (port, node, &dp->port_list) {
-        int error;
-
-        /* Reset packet contents. */
-        ofpbuf_clear(&packet);
-        ofpbuf_reserve(&packet, DP_NETDEV_HEADROOM);
-
-        error = netdev_recv(port->netdev, &packet);
-        if (!error) {
-            dp_netdev_port_input(dp, port, &packet);
-        } else if (error != EAGAIN && error != EOPNOTSUPP) {
-            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
-            VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
-                        netdev_get_name(port->netdev), strerror(error));
+        size_t n;
+
+        for (n = 0; n < DP_NETDEV_RX_BATCH; n++) {
+            struct ofpbuf *packet = &packets[n];
+            int error;
+
+            if (n < n_init) {
+                /* Reset packet contents. */
+                ofpbuf_clear(packet);
+                ofpbuf_reserve(packet, DP_NETDEV_HEADROOM);
+            } else {
+                ofpbuf_init_pooled(packet, VLAN_ETH_HEADER_LEN + max_mtu,
+                                   DP_NETDEV_HEADROOM);
+                n_init++;
+            }
+
+            error = netdev_recv(port->netdev, packet);
+            if (error) {
+                if (error != EAGAIN && error != EOPNOTSUPP) {
+                    static struct vlog_rate_limit rl
+                        = VLOG_RATE_LIMIT_INIT(1, 5);
+                    VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
+                                netdev_get_name(port->netdev),
+                                strerror(error));
+                }
+                break;
+            }
+        }
+
+        if (n) {
+            dp_netdev_port_input(dp, port, packets, n);
         }
     }
-    ofpbuf_uninit(&packet);
+
+    for (i = 0; i < n_init; i++) {
+        ofpbuf_uninit(&packets[i]);
+    }
 }
 
 static void
@@ -1101,16 +1420,6 @@ dp_netdev_set_dl(struct ofpbuf *packet, const struct ovs_key_ethernet *eth_key)
     memcpy(eh->eth_dst, eth_key->eth_dst, sizeof eh->eth_dst);
 }
 
-static void
-dp_netdev_output_port(struct dp_netdev *dp, struct ofpbuf *packet,
-                      uint32_t out_port)
-{
-    struct dp_netdev_port *p = dp->ports[out_port];
-    if (p) {
-        netdev_send(p->netdev, packet);
-    }
-}
-
 static int
 dp_netdev_output_userspace(struct dp_netdev *dp, const struct ofpbuf *packet,
                            int queue_no, const struct flow *flow,
@@ -1130,7 +1439,7 @@ dp_netdev_output_userspace(struct dp_netdev *dp, const struct ofpbuf *packet,
         if (userdata) {
             buf_size += NLA_ALIGN(userdata->nla_len);
         }
-        ofpbuf_init(buf, buf_size);
+        ofpbuf_init_pooled(buf, buf_size, 0);
 
         /* Put ODP flow. */
         odp_flow_key_from_flow(buf, flow, flow->in_port);
@@ -1160,23 +1469,99 @@ dp_netdev_output_userspace(struct dp_netdev *dp, const struct ofpbuf *packet,
     }
 }
 
+/* Decodes the OVS_KEY_ATTR_* attribute 'a', the argument to an
+ * OVS_ACTION_ATTR_SET action, into 'op'.  Returns false if the action has no
+ * effect in this datapath. */
+static bool
+dp_netdev_compile_set(struct dp_netdev_op *op, const struct nlattr *a)
+{
+    enum ovs_key_attr type = nl_attr_type(a);
+
+    switch (type) {
+    case OVS_KEY_ATTR_PRIORITY:
+    case OVS_KEY_ATTR_SKB_MARK:
+        /* not implemented */
+        return false;
+
+    case OVS_KEY_ATTR_TUNNEL:
+        op->type = DP_NETDEV_OP_SET_TUNNEL;
+        return odp_tun_key_from_attr(a, &op->u.tunnel) != ODP_FIT_ERROR;
+
+    case OVS_KEY_ATTR_ETHERNET:
+        op->type = DP_NETDEV_OP_SET_ETHERNET;
+        op->u.ethernet = *(const struct ovs_key_ethernet *)
+            nl_attr_get_unspec(a, sizeof(struct ovs_key_ethernet));
+        return true;
+
+    case OVS_KEY_ATTR_IPV4:
+        op->type = DP_NETDEV_OP_SET_IPV4;
+        op->u.ipv4 = *(const struct ovs_key_ipv4 *)
+            nl_attr_get_unspec(a, sizeof(struct ovs_key_ipv4));
+        return true;
+
+    case OVS_KEY_ATTR_IPV6:
+        op->type = DP_NETDEV_OP_SET_IPV6;
+        op->u.ipv6 = *(const struct ovs_key_ipv6 *)
+            nl_attr_get_unspec(a, sizeof(struct ovs_key_ipv6));
+        return true;
+
+    case OVS_KEY_ATTR_TCP:
+        op->type = DP_NETDEV_OP_SET_TCP;
+        op->u.tcp = *(const struct ovs_key_tcp *)
+            nl_attr_get_unspec(a, sizeof(struct ovs_key_tcp));
+        return true;
+
+    case OVS_KEY_ATTR_UDP:
+        op->type = DP_NETDEV_OP_SET_UDP;
+        op->u.udp = *(const struct ovs_key_udp *)
+            nl_attr_get_unspec(a, sizeof(struct ovs_key_udp));
+        return true;
+
+    case OVS_KEY_ATTR_MPLS:
+        op->type = DP_NETDEV_OP_SET_MPLS;
+        op->u.mpls_lse = nl_attr_get_be32(a);
+        return true;
+
+    case OVS_KEY_ATTR_UNSPEC:
+    case OVS_KEY_ATTR_ENCAP:
+    case OVS_KEY_ATTR_ETHERTYPE:
+    case OVS_KEY_ATTR_IN_PORT:
+    case OVS_KEY_ATTR_VLAN:
+    case OVS_KEY_ATTR_ICMP:
+    case OVS_KEY_ATTR_ICMPV6:
+    case OVS_KEY_ATTR_ARP:
+    case OVS_KEY_ATTR_ND:
+    case OVS_KEY_ATTR_DP_HASH:
+    case OVS_KEY_ATTR_RECIRC_ID:
+    case __OVS_KEY_ATTR_MAX:
+    default:
+        NOT_REACHED();
+    }
+}
+
+static bool
+dp_netdev_op_is_set(const struct dp_netdev_op *op)
+{
+    return op->type >= DP_NETDEV_OP_SET_ETHERNET
+           && op->type <= DP_NETDEV_OP_SET_TUNNEL;
+}
+
 static void
-dp_netdev_sample(struct dp_netdev *dp,
-                 struct ofpbuf *packet, struct flow *key,
-                 const struct nlattr *action)
+dp_netdev_compile_sample(struct dp_netdev_op *op, const struct dp_netdev *dp,
+                         const struct nlattr *action)
 {
     const struct nlattr *subactions = NULL;
     const struct nlattr *a;
     size_t left;
 
+    op->type = DP_NETDEV_OP_SAMPLE;
+    op->u.sample.probability = UINT32_MAX;
     NL_NESTED_FOR_EACH_UNSAFE (a, left, action) {
         int type = nl_attr_type(a);
 
         switch ((enum ovs_sample_attr) type) {
         case OVS_SAMPLE_ATTR_PROBABILITY:
-            if (random_uint32() >= nl_attr_get_u32(a)) {
-                return;
-            }
+            op->u.sample.probability = nl_attr_get_u32(a);
             break;
 
         case OVS_SAMPLE_ATTR_ACTIONS:
@@ -1190,137 +1575,698 @@ dp_netdev_sample(struct dp_netdev *dp,
         }
     }
 
-    dp_netdev_execute_actions(dp, packet, key, nl_attr_get(subactions),
-                              nl_attr_get_size(subactions));
+    op->u.sample.actions = xmalloc(sizeof *op->u.sample.actions);
+    dp_netdev_program_init(op->u.sample.actions, dp,
+                           nl_attr_get(subactions),
+                           nl_attr_get_size(subactions));
 }
 
+/* Points each output operation in 'program' to the port that it outputs to,
+ * as of now.  Output operations to tunnel ports get an outer header that is
+ * built when it is first needed, since it may refer to other ports. */
 static void
-dp_netdev_action_userspace(struct dp_netdev *dp,
-                          struct ofpbuf *packet, struct flow *key,
-                          const struct nlattr *a)
+dp_netdev_program_resolve_ports(struct dp_netdev_program *program,
+                                const struct dp_netdev *dp)
 {
-    const struct nlattr *userdata;
+    size_t i;
+
+    for (i = 0; i < program->n_ops; i++) {
+        struct dp_netdev_op *op = &program->ops[i];
+
+        if (op->type == DP_NETDEV_OP_OUTPUT) {
+            uint32_t port_no = op->u.output.port_no;
+            struct dp_netdev_port *port;
 
-    userdata = nl_attr_find_nested(a, OVS_USERSPACE_ATTR_USERDATA);
-    dp_netdev_output_userspace(dp, packet, DPIF_UC_ACTION, key, userdata);
+            port = port_no < MAX_PORTS ? dp->ports[port_no] : NULL;
+            op->u.output.port = port;
+            if (port && port->tnl_type != TNL_TYPE_NONE) {
+                if (!op->u.output.tnl_header) {
+                    op->u.output.tnl_header
+                        = xmalloc(sizeof *op->u.output.tnl_header);
+                }
+                op->u.output.tnl_header->expires = LLONG_MIN;
+            } else {
+                free(op->u.output.tnl_header);
+                op->u.output.tnl_header = NULL;
+            }
+        } else if (op->type == DP_NETDEV_OP_SAMPLE) {
+            dp_netdev_program_resolve_ports(op->u.sample.actions, dp);
+        }
+    }
+    program->port_serial = dp->serial;
 }
 
-static void
-execute_set_action(struct ofpbuf *packet, const struct nlattr *a)
+/* Sets the 'clone' flag on each output operation in 'program' that is followed
+ * by an operation that modifies the packet, either later in 'program' or, if
+ * 'modified_later' is true, after 'program' finishes.  Likewise sets it on
+ * each recirculation that is followed by any operation at all, where
+ * 'used_later' says whether the packet is used after 'program' finishes.
+ * Returns true if 'program' itself modifies the packet. */
+static bool
+dp_netdev_program_mark_clones(struct dp_netdev_program *program,
+                              bool modified_later, bool used_later)
 {
-    enum ovs_key_attr type = nl_attr_type(a);
-    const struct ovs_key_ipv4 *ipv4_key;
-    const struct ovs_key_ipv6 *ipv6_key;
-    const struct ovs_key_tcp *tcp_key;
-    const struct ovs_key_udp *udp_key;
+    bool modifies = false;
+    size_t i;
 
-    switch (type) {
-    case OVS_KEY_ATTR_PRIORITY:
-    case OVS_KEY_ATTR_SKB_MARK:
-    case OVS_KEY_ATTR_TUNNEL:
-        /* not implemented */
-        break;
+    for (i = program->n_ops; i-- > 0; ) {
+        struct dp_netdev_op *op = &program->ops[i];
+        bool used = used_later || i + 1 < program->n_ops;
 
-    case OVS_KEY_ATTR_ETHERNET:
-        dp_netdev_set_dl(packet,
-                   nl_attr_get_unspec(a, sizeof(struct ovs_key_ethernet)));
-        break;
+        switch (op->type) {
+        case DP_NETDEV_OP_OUTPUT:
+            op->u.output.clone = modified_later || modifies;
+            break;
 
-    case OVS_KEY_ATTR_IPV4:
-        ipv4_key = nl_attr_get_unspec(a, sizeof(struct ovs_key_ipv4));
-        packet_set_ipv4(packet, ipv4_key->ipv4_src, ipv4_key->ipv4_dst,
-                        ipv4_key->ipv4_tos, ipv4_key->ipv4_ttl);
-        break;
+        case DP_NETDEV_OP_USERSPACE:
+        case DP_NETDEV_OP_SET_TUNNEL:
+        case DP_NETDEV_OP_HASH:
+            break;
 
-    case OVS_KEY_ATTR_IPV6:
-        ipv6_key = nl_attr_get_unspec(a, sizeof(struct ovs_key_ipv6));
-        packet_set_ipv6(packet, ipv6_key->ipv6_proto, ipv6_key->ipv6_src,
-                        ipv6_key->ipv6_dst, ipv6_key->ipv6_tclass,
-                        ipv6_key->ipv6_label, ipv6_key->ipv6_hlimit);
-        break;
+        case DP_NETDEV_OP_SAMPLE:
+            if (dp_netdev_program_mark_clones(op->u.sample.actions,
+                                              modified_later || modifies,
+                                              used)) {
+                modifies = true;
+            }
+            break;
 
-    case OVS_KEY_ATTR_TCP:
-        tcp_key = nl_attr_get_unspec(a, sizeof(struct ovs_key_tcp));
-        packet_set_tcp_port(packet, tcp_key->tcp_src, tcp_key->tcp_dst);
-        break;
-
-     case OVS_KEY_ATTR_UDP:
-        udp_key = nl_attr_get_unspec(a, sizeof(struct ovs_key_udp));
-        packet_set_udp_port(packet, udp_key->udp_src, udp_key->udp_dst);
-        break;
-
-     case OVS_KEY_ATTR_MPLS:
-         set_mpls_lse(packet, nl_attr_get_be32(a));
-         break;
-
-     case OVS_KEY_ATTR_UNSPEC:
-     case OVS_KEY_ATTR_ENCAP:
-     case OVS_KEY_ATTR_ETHERTYPE:
-     case OVS_KEY_ATTR_IN_PORT:
-     case OVS_KEY_ATTR_VLAN:
-     case OVS_KEY_ATTR_ICMP:
-     case OVS_KEY_ATTR_ICMPV6:
-     case OVS_KEY_ATTR_ARP:
-     case OVS_KEY_ATTR_ND:
-     case __OVS_KEY_ATTR_MAX:
-     default:
-        NOT_REACHED();
+        case DP_NETDEV_OP_RECIRC:
+            /* The recirculated packet's actions may modify it, unless it is
+             * a copy. */
+            op->u.recirc.clone = used;
+            if (!used) {
+                modifies = true;
+            }
+            break;
+
+        case DP_NETDEV_OP_PUSH_VLAN:
+        case DP_NETDEV_OP_POP_VLAN:
+        case DP_NETDEV_OP_PUSH_MPLS:
+        case DP_NETDEV_OP_POP_MPLS:
+        case DP_NETDEV_OP_SET_ETHERNET:
+        case DP_NETDEV_OP_SET_IPV4:
+        case DP_NETDEV_OP_SET_IPV6:
+        case DP_NETDEV_OP_SET_TCP:
+        case DP_NETDEV_OP_SET_UDP:
+        case DP_NETDEV_OP_SET_MPLS:
+            modifies = true;
+            break;
+        }
     }
+    return modifies;
 }
 
+/* Compiles the 'actions_len' bytes of OVS_ACTION_ATTR_* attributes in
+ * 'actions' into 'program', for execution in 'dp'.  'program' may refer to
+ * 'actions', so 'actions' must not be freed before 'program'. */
 static void
-dp_netdev_execute_actions(struct dp_netdev *dp,
-                          struct ofpbuf *packet, struct flow *key,
-                          const struct nlattr *actions,
-                          size_t actions_len)
+dp_netdev_program_init(struct dp_netdev_program *program,
+                       const struct dp_netdev *dp,
+                       const struct nlattr *actions, size_t actions_len)
 {
     const struct nlattr *a;
+    size_t first_set;           /* Start of the current run of "set" ops. */
     unsigned int left;
+    size_t n;
 
+    n = 0;
     NL_ATTR_FOR_EACH_UNSAFE (a, left, actions, actions_len) {
+        n++;
+    }
+    program->ops = n ? xmalloc(n * sizeof *program->ops) : NULL;
+    program->n_ops = 0;
+
+    first_set = 0;
+    NL_ATTR_FOR_EACH_UNSAFE (a, left, actions, actions_len) {
+        struct dp_netdev_op *op = &program->ops[program->n_ops];
         int type = nl_attr_type(a);
 
         switch ((enum ovs_action_attr) type) {
         case OVS_ACTION_ATTR_OUTPUT:
-            dp_netdev_output_port(dp, packet, nl_attr_get_u32(a));
+            op->type = DP_NETDEV_OP_OUTPUT;
+            op->u.output.port_no = nl_attr_get_u32(a);
+            op->u.output.tnl_header = NULL;
             break;
 
         case OVS_ACTION_ATTR_USERSPACE:
-            dp_netdev_action_userspace(dp, packet, key, a);
+            op->type = DP_NETDEV_OP_USERSPACE;
+            op->u.userdata = nl_attr_find_nested(a,
+                                                 OVS_USERSPACE_ATTR_USERDATA);
             break;
 
         case OVS_ACTION_ATTR_PUSH_VLAN: {
             const struct ovs_action_push_vlan *vlan = nl_attr_get(a);
-            eth_push_vlan(packet, vlan->vlan_tci);
+            op->type = DP_NETDEV_OP_PUSH_VLAN;
+            op->u.vlan_tci = vlan->vlan_tci;
             break;
         }
 
         case OVS_ACTION_ATTR_POP_VLAN:
-            eth_pop_vlan(packet);
+            op->type = DP_NETDEV_OP_POP_VLAN;
             break;
 
-        case OVS_ACTION_ATTR_PUSH_MPLS: {
-            const struct ovs_action_push_mpls *mpls = nl_attr_get(a);
-            push_mpls(packet, mpls->mpls_ethertype, mpls->mpls_lse);
+        case OVS_ACTION_ATTR_PUSH_MPLS:
+            op->type = DP_NETDEV_OP_PUSH_MPLS;
+            op->u.push_mpls = *(const struct ovs_action_push_mpls *)
+                nl_attr_get(a);
             break;
-         }
 
         case OVS_ACTION_ATTR_POP_MPLS:
-            pop_mpls(packet, nl_attr_get_be16(a));
+            op->type = DP_NETDEV_OP_POP_MPLS;
+            op->u.ethertype = nl_attr_get_be16(a);
             break;
 
-        case OVS_ACTION_ATTR_SET:
-            execute_set_action(packet, nl_attr_get(a));
+        case OVS_ACTION_ATTR_SET: {
+            size_t i;
+
+            if (!dp_netdev_compile_set(op, nl_attr_get(a))) {
+                continue;
+            }
+
+            /* Each kind of "set" rewrites its own header fields in full, so
+             * within a run of them only the last one of each kind matters. */
+            for (i = first_set; i < program->n_ops; i++) {
+                if (program->ops[i].type == op->type) {
+                    program->ops[i] = *op;
+                    break;
+                }
+            }
+            if (i < program->n_ops) {
+                continue;
+            }
             break;
+        }
 
         case OVS_ACTION_ATTR_SAMPLE:
-            dp_netdev_sample(dp, packet, key, a);
+            dp_netdev_compile_sample(op, dp, a);
+            break;
+
+        case OVS_ACTION_ATTR_HASH: {
+            const struct ovs_action_hash *hash = nl_attr_get(a);
+
+            if (hash->hash_alg != OVS_HASH_ALG_L4) {
+                continue;
+            }
+            op->type = DP_NETDEV_OP_HASH;
+            op->u.hash_basis = hash->hash_basis;
+            break;
+        }
+
+        case OVS_ACTION_ATTR_RECIRC:
+            op->type = DP_NETDEV_OP_RECIRC;
+            op->u.recirc.recirc_id = nl_attr_get_u32(a);
             break;
 
         case OVS_ACTION_ATTR_UNSPEC:
         case __OVS_ACTION_ATTR_MAX:
             NOT_REACHED();
         }
+
+        program->n_ops++;
+        if (!dp_netdev_op_is_set(op)) {
+            first_set = program->n_ops;
+        }
+    }
+
+    dp_netdev_program_mark_clones(program, false, false);
+    dp_netdev_program_resolve_ports(program, dp);
+}
+
+static void
+dp_netdev_program_destroy(struct dp_netdev_program *program)
+{
+    size_t i;
+
+    for (i = 0; i < program->n_ops; i++) {
+        struct dp_netdev_op *op = &program->ops[i];
+
+        if (op->type == DP_NETDEV_OP_OUTPUT) {
+            free(op->u.output.tnl_header);
+        } else if (op->type == DP_NETDEV_OP_SAMPLE) {
+            dp_netdev_program_destroy(op->u.sample.actions);
+            free(op->u.sample.actions);
+        }
+    }
+    free(program->ops);
+    program->ops = NULL;
+    program->n_ops = 0;
+}
+
+/* Sends all of the packets queued for output on 'port' in one batch. */
+static void
+dp_netdev_port_flush_tx(struct dp_netdev_port *port)
+{
+    size_t i;
+
+    netdev_send_batch(port->netdev, port->tx_packets, port->n_tx);
+    for (i = 0; i < port->n_tx; i++) {
+        if (port->tx_owned[i]) {
+            ofpbuf_delete(port->tx_packets[i]);
+        }
+    }
+    port->n_tx = 0;
+}
+
+/* Sends the packets queued for output on every port in 'dp', then frees the
+ * copies made for recirculation.  Must be called before any packet passed to
+ * dp_netdev_execute_program() is modified or freed. */
+static void
+dp_netdev_flush_tx(struct dp_netdev *dp)
+{
+    struct dp_netdev_port *port;
+
+    LIST_FOR_EACH (port, node, &dp->port_list) {
+        if (port->n_tx) {
+            dp_netdev_port_flush_tx(port);
+        }
+    }
+    ofpbuf_list_delete(&dp->recirc_clones);
+}
+
+/* Queues 'packet' for output on 'port'.  If 'clone' is true, queues a copy of
+ * 'packet', so that the caller may go on to modify it. */
+static void
+dp_netdev_queue_tx(struct dp_netdev_port *port, struct ofpbuf *packet,
+                   bool clone)
+{
+    if (port->n_tx >= DP_NETDEV_TX_BATCH) {
+        dp_netdev_port_flush_tx(port);
+    }
+
+    if (clone) {
+        struct ofpbuf *copy = ofpbuf_new_pooled(packet->size, 0);
+
+        ofpbuf_put(copy, packet->data, packet->size);
+        packet = copy;
+    }
+    port->tx_packets[port->n_tx] = packet;
+    port->tx_owned[port->n_tx] = clone;
+    port->n_tx++;
+}
+
+/* Extracts the flow of each of the 'n_packets' packets in 'packets', which
+ * had flow 'key' before the operations executed so far modified them, and
+ * stores it in 'flow'.  The same operations were applied to every packet in
+ * the batch, so they all have the same flow.  Extracting each packet also
+ * updates its layer pointers, which push and pop operations leave stale. */
+static void
+dp_netdev_reextract(struct ofpbuf **packets, size_t n_packets,
+                    const struct flow *key, struct flow *flow)
+{
+    size_t i;
+
+    for (i = n_packets; i-- > 0; ) {
+        flow_extract(packets[i], key->skb_priority, key->skb_mark,
+                     &key->tunnel, key->in_port, flow);
+    }
+}
+
+/* Copies the 'n_packets' packets in 'packets' into 'copies', for operations
+ * that must leave the originals as they are, and returns 'copies'.  The
+ * copies stay around until dp_netdev_flush_tx(), since they may be queued for
+ * output. */
+static struct ofpbuf **
+dp_netdev_clone_packets(struct dp_netdev *dp, struct ofpbuf **packets,
+                        size_t n_packets, struct ofpbuf **copies)
+{
+    size_t i;
+
+    for (i = 0; i < n_packets; i++) {
+        struct ofpbuf *copy = ofpbuf_new_pooled(packets[i]->size,
+                                                DP_NETDEV_HEADROOM);
+
+        ofpbuf_put(copy, packets[i]->data, packets[i]->size);
+        list_push_back(&dp->recirc_clones, &copy->list_node);
+        copies[i] = copy;
+    }
+    return copies;
+}
+
+/* Looks up the 'n_packets' packets in 'packets', all of which have flow 'key',
+ * in 'dp''s flow table again and executes the actions of the flow that they
+ * match, or passes them to userspace as misses. */
+static void
+dp_netdev_input_again(struct dp_netdev *dp, struct ofpbuf **packets,
+                      size_t n_packets, struct flow *key)
+{
+    struct dp_netdev_flow *flow;
+    size_t i;
+
+    if (dp->recirc_depth >= DP_NETDEV_MAX_RECIRC_DEPTH) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+        VLOG_WARN_RL(&rl, "%s: packet dropped: recirculation depth exceeded",
+                     dp->name);
+        return;
+    }
+
+    flow = dp_netdev_lookup_flow(dp, key);
+    if (flow) {
+        dp->n_hit += n_packets;
+        dp_netdev_flow_used(flow, packets, n_packets, time_msec());
+        dp->recirc_depth++;
+        dp_netdev_execute_program(dp, &flow->program, packets, n_packets,
+                                  key,
+                                  key->tunnel.ip_dst ? &key->tunnel : NULL);
+        dp->recirc_depth--;
+    } else {
+        dp->n_missed += n_packets;
+        for (i = 0; i < n_packets; i++) {
+            dp_netdev_output_userspace(dp, packets[i], DPIF_UC_MISS, key,
+                                       NULL);
+        }
+    }
+}
+
+/* Looks up the 'n_packets' packets in 'packets' again with recirculation id
+ * 'recirc_id' and hash 'dp_hash', and executes the actions of the flow that
+ * they match.  'key' is their flow as received and 'tnl' their tunnel
+ * metadata, if any. */
+static void
+dp_netdev_recirculate(struct dp_netdev *dp, const struct dp_netdev_op *op,
+                      struct ofpbuf **packets, size_t n_packets,
+                      const struct flow *key, const struct flow_tnl *tnl,
+                      uint32_t dp_hash)
+{
+    struct ofpbuf *copies[DP_NETDEV_RX_BATCH];
+    struct flow recirc_key;
+
+    if (op->u.recirc.clone) {
+        /* Later operations need the packets as they are now. */
+        ovs_assert(n_packets <= ARRAY_SIZE(copies));
+        packets = dp_netdev_clone_packets(dp, packets, n_packets, copies);
+    }
+
+    dp_netdev_reextract(packets, n_packets, key, &recirc_key);
+    recirc_key.recirc_id = op->u.recirc.recirc_id;
+    recirc_key.dp_hash = dp_hash;
+    if (tnl) {
+        recirc_key.tunnel = *tnl;
+    } else {
+        memset(&recirc_key.tunnel, 0, sizeof recirc_key.tunnel);
+    }
+
+    dp_netdev_input_again(dp, packets, n_packets, &recirc_key);
+}
+
+/* Builds 'h' for sending packets with tunnel metadata 'tnl' on tunnel port
+ * 'port' in 'dp'.  Leaves 'h->underlay' null if no port in 'dp' routes to the
+ * remote IP or the remote IP's Ethernet address is not in the ARP cache.
+ *
+ * The host's routing table does not say which gateway a route uses, so the
+ * remote IP has to be on a directly connected subnet. */
+static void
+dp_netdev_tnl_header_build(struct dp_netdev_tnl_header *h,
+                           struct dp_netdev *dp,
+                           const struct dp_netdev_port *port,
+                           const struct flow_tnl *tnl)
+{
+    struct dp_netdev_port *underlay;
+    uint8_t eth_src[ETH_ADDR_LEN];
+    uint8_t eth_dst[ETH_ADDR_LEN];
+    char name[IFNAMSIZ];
+    struct in_addr in4;
+
+    memcpy(&h->tnl, tnl, sizeof h->tnl);
+    h->expires = time_msec() + DP_NETDEV_TNL_REFRESH_MSEC;
+    h->underlay = NULL;
+
+    if (!route_table_get_name(tnl->ip_dst, name)
+        || get_port_by_name(dp, name, &underlay)
+        || netdev_arp_lookup(underlay->netdev, tnl->ip_dst, eth_dst)) {
+        return;
+    }
+    if (tnl->ip_src) {
+        in4.s_addr = tnl->ip_src;
+    } else if (netdev_get_in4(underlay->netdev, &in4, NULL)) {
+        return;
+    }
+    netdev_get_etheraddr(underlay->netdev, eth_src);
+
+    tnl_header_build(&h->hdr, port->tnl_type, tnl, eth_src, eth_dst,
+                     in4.s_addr, port->tnl_dst_port);
+    h->underlay = underlay;
+}
+
+/* Encapsulates copies of the 'n_packets' packets in 'packets', all of which
+ * have flow 'key', with tunnel metadata 'tnl' for output operation 'op' to a
+ * tunnel port, then looks them up again as input on the port that the host
+ * routes the remote IP through.
+ *
+ * The packets may already be queued for output elsewhere, so encapsulating
+ * them in place is never safe. */
+static void
+dp_netdev_tnl_push(struct dp_netdev *dp, const struct dp_netdev_op *op,
+                   struct ofpbuf **packets, size_t n_packets,
+                   const struct flow *key, const struct flow_tnl *tnl)
+{
+    struct dp_netdev_tnl_header *h = op->u.output.tnl_header;
+    struct ofpbuf *copies[DP_NETDEV_RX_BATCH];
+    struct flow outer;
+    ovs_be16 udp_src;
+    size_t i;
+
+    if (!tnl || !tnl->ip_dst) {
+        return;
+    }
+
+    if (time_msec() >= h->expires || memcmp(&h->tnl, tnl, sizeof *tnl)) {
+        dp_netdev_tnl_header_build(h, dp, op->u.output.port, tnl);
+    }
+    if (!h->underlay) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+        VLOG_INFO_RL(&rl, "%s: packet dropped: no route or ARP entry for "
+                     "tunnel remote IP "IP_FMT, dp->name,
+                     IP_ARGS(tnl->ip_dst));
+        return;
+    }
+
+    ovs_assert(n_packets <= ARRAY_SIZE(copies));
+    packets = dp_netdev_clone_packets(dp, packets, n_packets, copies);
+
+    /* Like the kernel, vary the VXLAN source port with the inner flow, so
+     * that the underlay can spread flows across paths and queues. */
+    udp_src = htons(32768 + flow_hash(key, 0) % 28232);
+    for (i = n_packets; i-- > 0; ) {
+        tnl_header_push(packets[i], &h->hdr, udp_src);
+        flow_extract(packets[i], 0, 0, NULL, h->underlay->port_no, &outer);
+    }
+    dp_netdev_input_again(dp, packets, n_packets, &outer);
+}
+
+/* If 'packet', being output to internal port 'port', is a GRE or VXLAN packet
+ * addressed to 'port''s IP address, returns the tunnel port in 'dp' that
+ * takes it, stores the packet's tunnel metadata in 'tnl', and stores the
+ * length of its outer headers and of the inner packet in '*hlen' and
+ * '*inner_len'.  Otherwise, returns NULL. */
+static struct dp_netdev_port *
+dp_netdev_tnl_parse(const struct dp_netdev *dp,
+                    const struct dp_netdev_port *port,
+                    const struct ofpbuf *packet, struct flow_tnl *tnl,
+                    size_t *hlen, size_t *inner_len)
+{
+    struct dp_netdev_port *tnl_port;
+    enum tnl_type type;
+    ovs_be16 dst_port;
+
+    type = tnl_header_parse(packet, port->in4, tnl, &dst_port,
+                            hlen, inner_len);
+    if (type != TNL_TYPE_NONE) {
+        LIST_FOR_EACH (tnl_port, tnl_node, &dp->tnl_ports) {
+            if (tnl_port->tnl_type == type
+                && tnl_port->tnl_dst_port == dst_port) {
+                return tnl_port;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Queues the 'n_packets' packets in 'packets' for output operation 'op' to an
+ * internal port that has an IP address, except that tunnel packets addressed
+ * to it are decapsulated, from a copy as in dp_netdev_tnl_push(), and looked
+ * up again as input on their tunnel port instead.
+ *
+ * Earlier operations may have rewritten the packets' headers, so each packet
+ * is checked afresh rather than by its flow. */
+static void
+dp_netdev_output_or_decap(struct dp_netdev *dp, const struct dp_netdev_op *op,
+                          struct ofpbuf **packets, size_t n_packets)
+{
+    struct dp_netdev_port *port = op->u.output.port;
+    size_t i;
+
+    for (i = 0; i < n_packets; i++) {
+        struct ofpbuf *packet = packets[i];
+        struct dp_netdev_port *tnl_port;
+        size_t hlen, inner_len;
+        struct flow_tnl tnl;
+        struct flow inner;
+
+        tnl_port = dp_netdev_tnl_parse(dp, port, packet, &tnl,
+                                       &hlen, &inner_len);
+        if (!tnl_port) {
+            dp_netdev_queue_tx(port, packet, op->u.output.clone);
+            continue;
+        }
+
+        dp_netdev_clone_packets(dp, &packet, 1, &packet);
+        ofpbuf_pull(packet, hlen);
+        packet->size = inner_len;
+        flow_extract(packet, 0, 0, &tnl, tnl_port->port_no, &inner);
+        dp_netdev_input_again(dp, &packet, 1, &inner);
+    }
+}
+
+/* Executes 'program' on each of the 'n_packets' packets in 'packets', all of
+ * which have flow 'key' and tunnel metadata 'tnl', if it is nonnull.  Each
+ * operation is applied to every packet before the next operation starts.
+ *
+ * Output operations only queue packets.  The caller must send them with
+ * dp_netdev_flush_tx(). */
+static void
+dp_netdev_execute_program(struct dp_netdev *dp,
+                          struct dp_netdev_program *program,
+                          struct ofpbuf **packets, size_t n_packets,
+                          struct flow *key, const struct flow_tnl *tnl)
+{
+    uint32_t dp_hash = key->dp_hash;
+    size_t i, j;
+
+    if (program->port_serial != dp->serial) {
+        dp_netdev_program_resolve_ports(program, dp);
+    }
+
+    for (i = 0; i < program->n_ops; i++) {
+        const struct dp_netdev_op *op = &program->ops[i];
+
+        switch (op->type) {
+        case DP_NETDEV_OP_OUTPUT: {
+            struct dp_netdev_port *port = op->u.output.port;
+
+            if (!port) {
+                /* Nothing to do. */
+            } else if (port->tnl_type != TNL_TYPE_NONE) {
+                dp_netdev_tnl_push(dp, op, packets, n_packets, key, tnl);
+            } else if (port->in4 && !list_is_empty(&dp->tnl_ports)) {
+                dp_netdev_output_or_decap(dp, op, packets, n_packets);
+            } else {
+                for (j = 0; j < n_packets; j++) {
+                    dp_netdev_queue_tx(port, packets[j], op->u.output.clone);
+                }
+            }
+            break;
+        }
+
+        case DP_NETDEV_OP_USERSPACE:
+            for (j = 0; j < n_packets; j++) {
+                dp_netdev_output_userspace(dp, packets[j], DPIF_UC_ACTION,
+                                           key, op->u.userdata);
+            }
+            break;
+
+        case DP_NETDEV_OP_PUSH_VLAN:
+            for (j = 0; j < n_packets; j++) {
+                eth_push_vlan(packets[j], op->u.vlan_tci);
+            }
+            break;
+
+        case DP_NETDEV_OP_POP_VLAN:
+            for (j = 0; j < n_packets; j++) {
+                eth_pop_vlan(packets[j]);
+            }
+            break;
+
+        case DP_NETDEV_OP_PUSH_MPLS:
+            for (j = 0; j < n_packets; j++) {
+                push_mpls(packets[j], op->u.push_mpls.mpls_ethertype,
+                          op->u.push_mpls.mpls_lse);
+            }
+            break;
+
+        case DP_NETDEV_OP_POP_MPLS:
+            for (j = 0; j < n_packets; j++) {
+                pop_mpls(packets[j], op->u.ethertype);
+            }
+            break;
+
+        case DP_NETDEV_OP_SET_ETHERNET:
+            for (j = 0; j < n_packets; j++) {
+                dp_netdev_set_dl(packets[j], &op->u.ethernet);
+            }
+            break;
+
+        case DP_NETDEV_OP_SET_IPV4:
+            for (j = 0; j < n_packets; j++) {
+                packet_set_ipv4(packets[j], op->u.ipv4.ipv4_src,
+                                op->u.ipv4.ipv4_dst, op->u.ipv4.ipv4_tos,
+                                op->u.ipv4.ipv4_ttl);
+            }
+            break;
+
+        case DP_NETDEV_OP_SET_IPV6:
+            for (j = 0; j < n_packets; j++) {
+                packet_set_ipv6(packets[j], op->u.ipv6.ipv6_proto,
+                                op->u.ipv6.ipv6_src, op->u.ipv6.ipv6_dst,
+                                op->u.ipv6.ipv6_tclass, op->u.ipv6.ipv6_label,
+                                op->u.ipv6.ipv6_hlimit);
+            }
+            break;
+
+        case DP_NETDEV_OP_SET_TCP:
+            for (j = 0; j < n_packets; j++) {
+                packet_set_tcp_port(packets[j], op->u.tcp.tcp_src,
+                                    op->u.tcp.tcp_dst);
+            }
+            break;
+
+        case DP_NETDEV_OP_SET_UDP:
+            for (j = 0; j < n_packets; j++) {
+                packet_set_udp_port(packets[j], op->u.udp.udp_src,
+                                    op->u.udp.udp_dst);
+            }
+            break;
+
+        case DP_NETDEV_OP_SET_MPLS:
+            for (j = 0; j < n_packets; j++) {
+                set_mpls_lse(packets[j], op->u.mpls_lse);
+            }
+            break;
+
+        case DP_NETDEV_OP_SET_TUNNEL:
+            tnl = &op->u.tunnel;
+            break;
+
+        case DP_NETDEV_OP_SAMPLE:
+            for (j = 0; j < n_packets; j++) {
+                if (random_uint32() < op->u.sample.probability) {
+                    dp_netdev_execute_program(dp, op->u.sample.actions,
+                                              &packets[j], 1, key, tnl);
+                }
+            }
+            break;
+
+        case DP_NETDEV_OP_HASH: {
+            struct flow flow;
+
+            dp_netdev_reextract(packets, n_packets, key, &flow);
+            dp_hash = flow_hash_symmetric_l4(&flow, op->u.hash_basis);
+            if (!dp_hash) {
+                dp_hash = 1;    /* 0 means "not computed". */
+            }
+            break;
+        }
+
+        case DP_NETDEV_OP_RECIRC:
+            dp_netdev_recirculate(dp, op, packets, n_packets, key, tnl,
+                                  dp_hash);
+            break;
+
+        default:
+            NOT_REACHED();
+        }
     }
 }
 
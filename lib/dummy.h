@@ -19,6 +19,9 @@
 
 #include <stdbool.h>
 
+struct netdev;
+struct ofpbuf;
+
 /* For client programs to call directly to enable dummy support. */
 void dummy_enable(bool override);
 
@@ -27,4 +30,7 @@ void dpif_dummy_register(bool override);
 void netdev_dummy_register(bool override);
 void timeval_dummy_register(void);
 
+/* For tests that drive a dummy datapath without ovs-appctl. */
+int netdev_dummy_queue_packet(struct netdev *, const struct ofpbuf *);
+
 #endif /* dummy.h */
@@ -36,7 +36,7 @@ struct ofpbuf;
 /* This sequence number should be incremented whenever anything involving flows
  * or the wildcarding of flows changes.  This will cause build assertion
  * failures in places which likely need to be updated. */
-#define FLOW_WC_SEQ 20
+#define FLOW_WC_SEQ 21
 
 #define FLOW_N_REGS 8
 BUILD_ASSERT_DECL(FLOW_N_REGS <= NXM_NX_MAX_REGS);
@@ -91,6 +91,8 @@ struct flow {
                                    unless in DPIF code, in which case it
                                    is the datapath port number. */
     uint32_t skb_mark;          /* Packet mark. */
+    uint32_t dp_hash;           /* Datapath computed hash value. */
+    uint32_t recirc_id;         /* Must be exact match. */
     ovs_be32 mpls_lse;          /* MPLS label stack entry. */
     uint16_t mpls_depth;        /* Depth of MPLS stack. */
     ovs_be16 vlan_tci;          /* If 802.1Q, TCI | VLAN_CFI; otherwise 0. */
@@ -112,8 +114,8 @@ BUILD_ASSERT_DECL(sizeof(struct flow) % 4 == 0);
 #define FLOW_U32S (sizeof(struct flow) / 4)
 
 /* Remember to update FLOW_WC_SEQ when changing 'struct flow'. */
-//BUILD_ASSERT_DECL(sizeof(struct flow) == sizeof(struct flow_tnl) + 160 &&
-//                  FLOW_WC_SEQ == 20);
+//BUILD_ASSERT_DECL(sizeof(struct flow) == sizeof(struct flow_tnl) + 168 &&
+//                  FLOW_WC_SEQ == 21);
 
 /* Represents the metadata fields of struct flow. */
 struct flow_metadata {
@@ -262,6 +264,10 @@ struct miniflow {
 };
 
 void miniflow_init(struct miniflow *, const struct flow *);
+uint32_t miniflow_extract(struct ofpbuf *packet, uint32_t skb_priority,
+                          uint32_t skb_mark, const struct flow_tnl *,
+                          uint32_t in_port, struct miniflow *,
+                          uint32_t storage[FLOW_U32S]);
 void miniflow_clone(struct miniflow *, const struct miniflow *);
 void miniflow_destroy(struct miniflow *);
 
@@ -278,6 +284,7 @@ bool miniflow_equal_flow_in_minimask(const struct miniflow *a,
                                      const struct flow *b,
                                      const struct minimask *);
 uint32_t miniflow_hash(const struct miniflow *, uint32_t basis);
+uint32_t miniflow_crc_hash(const struct miniflow *, uint32_t basis);
 uint32_t miniflow_hash_in_minimask(const struct miniflow *,
                                    const struct minimask *, uint32_t basis);
 
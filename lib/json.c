@@ -88,11 +88,13 @@ enum json_parse_state {
 
 struct json_parser_node {
     struct json *json;
+    size_t first_elem;          /* Arena only: first element in 'elems'. */
 };
 
 /* A JSON parser. */
 struct json_parser {
     int flags;
+    struct json_arena *arena;   /* Allocate values here, if nonnull. */
 
     /* Lexical analysis. */
     enum json_lex_state lex_state;
@@ -108,11 +110,45 @@ struct json_parser {
     size_t height, allocated_height;
     char *member_name;
 
+    /* Arena only: elements of the arrays on 'stack', which are not copied into
+     * their arrays until the arrays are complete and their sizes known. */
+    struct json **elems;
+    size_t n_elems, allocated_elems;
+
     /* Parse status. */
     bool done;
     char *error;                /* Error message, if any, null if none yet. */
 };
 
+/* Memory from which a parser allocates a whole JSON tree.
+ *
+ * Memory comes from a list of chunks, each JSON_ARENA_CHUNK_SIZE bytes unless
+ * it holds a single large block, which are all freed together.  The only other
+ * memory that an arena-allocated tree uses is the bucket arrays of its
+ * objects' hash tables, which hmap allocates itself, so the arena also keeps a
+ * list of its objects to free those. */
+struct json_arena {
+    struct json_arena_chunk *chunks;    /* Most recently allocated first. */
+    char *next;                         /* Next free byte in current chunk. */
+    size_t left;                        /* Bytes available at 'next'. */
+    struct json_arena_object *objects;  /* All objects in the arena. */
+};
+
+struct json_arena_chunk {
+    struct json_arena_chunk *next;
+    /* Data follows, starting at offset JSON_ARENA_CHUNK_HDR. */
+};
+
+struct json_arena_object {
+    struct shash shash;
+    struct json_arena_object *next;
+};
+
+#define JSON_ARENA_ALIGN 8
+#define JSON_ARENA_CHUNK_HDR ROUND_UP(sizeof(struct json_arena_chunk), \
+                                      JSON_ARENA_ALIGN)
+#define JSON_ARENA_CHUNK_SIZE (64 * 1024 - JSON_ARENA_CHUNK_HDR)
+
 static struct json *json_create(enum json_type type);
 static void json_parser_input(struct json_parser *, struct json_token *);
 
@@ -193,6 +229,7 @@ void
 json_array_add(struct json *array_, struct json *element)
 {
     struct json_array *array = json_array(array_);
+    ovs_assert(!array_->in_arena);
     if (array->n >= array->n_allocated) {
         array->elems = x2nrealloc(array->elems, &array->n_allocated,
                                   sizeof *array->elems);
@@ -275,6 +312,7 @@ json_real_create(double real)
 void
 json_object_put(struct json *json, const char *name, struct json *value)
 {
+    ovs_assert(!json->in_arena);
     json_destroy(shash_replace(json->u.object, name, value));
 }
 
@@ -329,11 +367,14 @@ json_integer(const struct json *json)
 static void json_destroy_object(struct shash *object);
 static void json_destroy_array(struct json_array *array);
 
-/* Frees 'json' and everything it points to, recursively. */
+/* Frees 'json' and everything it points to, recursively.
+ *
+ * Does nothing if 'json' was allocated from a "struct json_arena", since the
+ * arena owns its memory. */
 void
 json_destroy(struct json *json)
 {
-    if (json) {
+    if (json && !json->in_arena) {
         switch (json->type) {
         case JSON_OBJECT:
             json_destroy_object(json->u.object);
@@ -577,6 +618,108 @@ json_equal(const struct json *a, const struct json *b)
     }
 }
 
+/* Arena allocation. */
+
+/* Creates and returns a new, empty arena for use with
+ * json_parser_create_arena() or json_from_string_arena(). */
+struct json_arena *
+json_arena_create(void)
+{
+    return xzalloc(sizeof(struct json_arena));
+}
+
+/* Frees 'arena' along with every JSON value allocated from it. */
+void
+json_arena_destroy(struct json_arena *arena)
+{
+    if (arena) {
+        struct json_arena_object *object;
+        struct json_arena_chunk *chunk, *next;
+
+        for (object = arena->objects; object; object = object->next) {
+            hmap_destroy(&object->shash.map);
+        }
+        for (chunk = arena->chunks; chunk; chunk = next) {
+            next = chunk->next;
+            free(chunk);
+        }
+        free(arena);
+    }
+}
+
+static void *
+json_arena_add_chunk(struct json_arena *arena, size_t size)
+{
+    struct json_arena_chunk *chunk;
+
+    chunk = xmalloc(JSON_ARENA_CHUNK_HDR + size);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    return (char *) chunk + JSON_ARENA_CHUNK_HDR;
+}
+
+static void *
+json_arena_alloc(struct json_arena *arena, size_t size)
+{
+    void *p;
+
+    size = ROUND_UP(size, JSON_ARENA_ALIGN);
+    if (size > arena->left) {
+        if (size > JSON_ARENA_CHUNK_SIZE / 4) {
+            /* Give a large block a chunk of its own, to avoid wasting the rest
+             * of the current chunk. */
+            return json_arena_add_chunk(arena, size);
+        }
+        arena->next = json_arena_add_chunk(arena, JSON_ARENA_CHUNK_SIZE);
+        arena->left = JSON_ARENA_CHUNK_SIZE;
+    }
+
+    p = arena->next;
+    arena->next += size;
+    arena->left -= size;
+    return p;
+}
+
+static char *
+json_arena_strdup(struct json_arena *arena, const char *s)
+{
+    size_t size = strlen(s) + 1;
+    return memcpy(json_arena_alloc(arena, size), s, size);
+}
+
+static struct shash *
+json_arena_shash_create(struct json_arena *arena)
+{
+    struct json_arena_object *object;
+
+    object = json_arena_alloc(arena, sizeof *object);
+    shash_init(&object->shash);
+    object->next = arena->objects;
+    arena->objects = object;
+    return &object->shash;
+}
+
+/* Equivalent to json_object_put() for an arena-allocated 'json'.  'name' must
+ * also be allocated from 'arena'. */
+static void
+json_arena_object_put(struct json_arena *arena, struct json *json,
+                      char *name, struct json *value)
+{
+    struct shash *object = json->u.object;
+    struct shash_node *node;
+
+    node = shash_find(object, name);
+    if (node) {
+        /* The old value belongs to the arena, so there's nothing to free. */
+        node->data = value;
+    } else {
+        node = json_arena_alloc(arena, sizeof *node);
+        node->name = name;
+        node->data = value;
+        hmap_insert(&object->map, &node->node, hash_string(name, 0));
+    }
+}
+
 /* Lexical analysis. */
 
 static void
@@ -984,6 +1127,70 @@ json_lex_input(struct json_parser *p, unsigned char c)
     ds_put_char(&p->buffer, c);
     return true;
 }
+
+static bool
+json_lex_is_number_char(unsigned char c)
+{
+    return isdigit(c) || c == '.' || c == 'e' || c == 'E'
+           || c == '-' || c == '+';
+}
+
+/* Consumes a run of bytes from the 'n' bytes at 'input' that json_lex_input()
+ * would handle without changing state: white space outside a token, or bytes
+ * that continue the current keyword, number, or string.  Returns the number
+ * of bytes consumed, which is 0 if the first byte needs json_lex_input().
+ *
+ * This avoids the per-byte dispatch in json_lex_input() for the long runs of
+ * string and number text that make up most of a large document. */
+static size_t
+json_lex_run(struct json_parser *p, const char *input, size_t n)
+{
+    const unsigned char *s = (const unsigned char *) input;
+    size_t i = 0;
+
+    switch (p->lex_state) {
+    case JSON_LEX_START:
+        for (; i < n; i++) {
+            if (s[i] == '\n') {
+                p->column_number = 0;
+                p->line_number++;
+            } else if (s[i] == ' ' || s[i] == '\t' || s[i] == '\r') {
+                p->column_number++;
+            } else {
+                break;
+            }
+        }
+        p->byte_number += i;
+        return i;
+
+    case JSON_LEX_STRING:
+        while (i < n && s[i] >= 0x20 && s[i] != '"' && s[i] != '\\') {
+            i++;
+        }
+        break;
+
+    case JSON_LEX_NUMBER:
+        while (i < n && json_lex_is_number_char(s[i])) {
+            i++;
+        }
+        break;
+
+    case JSON_LEX_KEYWORD:
+        while (i < n && isalpha(s[i])) {
+            i++;
+        }
+        break;
+
+    case JSON_LEX_ESCAPE:
+    default:
+        return 0;
+    }
+
+    ds_put_buffer(&p->buffer, input, i);
+    p->byte_number += i;
+    p->column_number += i;
+    return i;
+}
 
 /* Parsing. */
 
@@ -1009,6 +1216,18 @@ json_from_string(const char *string)
     return json_parser_finish(p);
 }
 
+/* Like json_from_string(), but allocates the returned JSON from 'arena'.  The
+ * caller must not free a successful result, which becomes invalid when 'arena'
+ * is destroyed.  On error, the caller must json_destroy() the returned string
+ * as usual. */
+struct json *
+json_from_string_arena(const char *string, struct json_arena *arena)
+{
+    struct json_parser *p = json_parser_create_arena(JSPF_TRAILER, arena);
+    json_parser_feed(p, string, strlen(string));
+    return json_parser_finish(p);
+}
+
 /* Reads the file named 'file_name', parses its contents as a JSON object or
  * array, and returns a newly allocated 'struct json'.  The caller must free
  * the returned structure with json_destroy() when it is no longer needed.
@@ -1077,12 +1296,33 @@ json_parser_create(int flags)
     return p;
 }
 
+/* Creates and returns a parser that allocates all of the JSON it parses from
+ * 'arena'.  See json.h for the rules that apply to the values it returns. */
+struct json_parser *
+json_parser_create_arena(int flags, struct json_arena *arena)
+{
+    struct json_parser *p = json_parser_create(flags);
+    p->arena = arena;
+    return p;
+}
+
+/* Returns the arena that 'p' allocates from, or NULL if 'p' was created with
+ * json_parser_create(). */
+struct json_arena *
+json_parser_get_arena(const struct json_parser *p)
+{
+    return p->arena;
+}
+
 size_t
 json_parser_feed(struct json_parser *p, const char *input, size_t n)
 {
     size_t i;
     for (i = 0; !p->done && i < n; ) {
-        if (json_lex_input(p, input[i])) {
+        size_t run = json_lex_run(p, &input[i], n - i);
+        if (run) {
+            i += run;
+        } else if (json_lex_input(p, input[i])) {
             p->byte_number++;
             if (input[i] == '\n') {
                 p->column_number = 0;
@@ -1151,7 +1391,10 @@ json_parser_abort(struct json_parser *p)
             json_destroy(p->stack[0].json);
         }
         free(p->stack);
-        free(p->member_name);
+        if (!p->arena) {
+            free(p->member_name);
+        }
+        free(p->elems);
         free(p->error);
         free(p);
     }
@@ -1163,16 +1406,52 @@ json_parser_top(struct json_parser *p)
     return &p->stack[p->height - 1];
 }
 
+/* Returns a new JSON value of the given 'type', allocated from p's arena if
+ * it has one.  The caller must initialize the value's 'u' member. */
+static struct json *
+json_parser_create_json(struct json_parser *p, enum json_type type)
+{
+    struct json *json;
+
+    if (p->arena) {
+        json = json_arena_alloc(p->arena, sizeof *json);
+        json->type = type;
+        json->in_arena = true;
+    } else {
+        json = json_create(type);
+    }
+    return json;
+}
+
+static char *
+json_parser_strdup(struct json_parser *p, const char *s)
+{
+    return p->arena ? json_arena_strdup(p->arena, s) : xstrdup(s);
+}
+
 static void
 json_parser_put_value(struct json_parser *p, struct json *value)
 {
     struct json_parser_node *node = json_parser_top(p);
     if (node->json->type == JSON_OBJECT) {
-        json_object_put(node->json, p->member_name, value);
-        free(p->member_name);
+        if (p->arena) {
+            json_arena_object_put(p->arena, node->json, p->member_name,
+                                  value);
+        } else {
+            json_object_put(node->json, p->member_name, value);
+            free(p->member_name);
+        }
         p->member_name = NULL;
     } else if (node->json->type == JSON_ARRAY) {
-        json_array_add(node->json, value);
+        if (p->arena) {
+            if (p->n_elems >= p->allocated_elems) {
+                p->elems = x2nrealloc(p->elems, &p->allocated_elems,
+                                      sizeof *p->elems);
+            }
+            p->elems[p->n_elems++] = value;
+        } else {
+            json_array_add(node->json, value);
+        }
     } else {
         NOT_REACHED();
     }
@@ -1196,6 +1475,7 @@ json_parser_push(struct json_parser *p,
 
         node = &p->stack[p->height++];
         node->json = new_json;
+        node->first_elem = p->n_elems;
         p->parse_state = new_state;
     } else {
         json_destroy(new_json);
@@ -1207,13 +1487,31 @@ json_parser_push(struct json_parser *p,
 static void
 json_parser_push_object(struct json_parser *p)
 {
-    json_parser_push(p, json_object_create(), JSON_PARSE_OBJECT_INIT);
+    struct json *object;
+
+    if (p->arena) {
+        object = json_parser_create_json(p, JSON_OBJECT);
+        object->u.object = json_arena_shash_create(p->arena);
+    } else {
+        object = json_object_create();
+    }
+    json_parser_push(p, object, JSON_PARSE_OBJECT_INIT);
 }
 
 static void
 json_parser_push_array(struct json_parser *p)
 {
-    json_parser_push(p, json_array_create_empty(), JSON_PARSE_ARRAY_INIT);
+    struct json *array;
+
+    if (p->arena) {
+        array = json_parser_create_json(p, JSON_ARRAY);
+        array->u.array.elems = NULL;
+        array->u.array.n = 0;
+        array->u.array.n_allocated = 0;
+    } else {
+        array = json_array_create_empty();
+    }
+    json_parser_push(p, array, JSON_PARSE_ARRAY_INIT);
 }
 
 static void
@@ -1224,15 +1522,15 @@ json_parse_value(struct json_parser *p, struct json_token *token,
 
     switch (token->type) {
     case T_FALSE:
-        value = json_boolean_create(false);
+        value = json_parser_create_json(p, JSON_FALSE);
         break;
 
     case T_NULL:
-        value = json_null_create();
+        value = json_parser_create_json(p, JSON_NULL);
         break;
 
     case T_TRUE:
-        value = json_boolean_create(true);
+        value = json_parser_create_json(p, JSON_TRUE);
         break;
 
     case '{':
@@ -1244,15 +1542,18 @@ json_parse_value(struct json_parser *p, struct json_token *token,
         return;
 
     case T_INTEGER:
-        value = json_integer_create(token->u.integer);
+        value = json_parser_create_json(p, JSON_INTEGER);
+        value->u.integer = token->u.integer;
         break;
 
     case T_REAL:
-        value = json_real_create(token->u.real);
+        value = json_parser_create_json(p, JSON_REAL);
+        value->u.real = token->u.real;
         break;
 
     case T_STRING:
-        value = json_string_create(token->u.string);
+        value = json_parser_create_json(p, JSON_STRING);
+        value->u.string = json_parser_strdup(p, token->u.string);
         break;
 
     case T_EOF:
@@ -1274,10 +1575,25 @@ json_parser_pop(struct json_parser *p)
 {
     struct json_parser_node *node;
 
-    /* Conserve memory. */
     node = json_parser_top(p);
     if (node->json->type == JSON_ARRAY) {
-        json_array_trim(node->json);
+        if (p->arena) {
+            /* Now that the array is complete, copy its elements into it. */
+            struct json_array *array = &node->json->u.array;
+            size_t n = p->n_elems - node->first_elem;
+
+            if (n) {
+                array->elems = json_arena_alloc(p->arena,
+                                                n * sizeof *array->elems);
+                memcpy(array->elems, &p->elems[node->first_elem],
+                       n * sizeof *array->elems);
+                array->n = array->n_allocated = n;
+                p->n_elems = node->first_elem;
+            }
+        } else {
+            /* Conserve memory. */
+            json_array_trim(node->json);
+        }
     }
 
     /* Pop off the top-of-stack. */
@@ -1325,7 +1641,7 @@ json_parser_input(struct json_parser *p, struct json_token *token)
         /* Fall through. */
     case JSON_PARSE_OBJECT_NAME:
         if (token->type == T_STRING) {
-            p->member_name = xstrdup(token->u.string);
+            p->member_name = json_parser_strdup(p, token->u.string);
             p->parse_state = JSON_PARSE_OBJECT_COLON;
         } else {
             json_error(p, "syntax error parsing object expecting string");
@@ -1387,6 +1703,7 @@ json_create(enum json_type type)
 {
     struct json *json = xmalloc(sizeof *json);
     json->type = type;
+    json->in_arena = false;
     return json;
 }
 
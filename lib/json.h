@@ -62,6 +62,7 @@ struct json_array {
 /* A JSON value. */
 struct json {
     enum json_type type;
+    bool in_arena;              /* Owned by a "struct json_arena"? */
     union {
         struct shash *object;   /* Contains "struct json *"s. */
         struct json_array array;
@@ -118,6 +119,28 @@ void json_parser_abort(struct json_parser *);
 struct json *json_from_string(const char *string);
 struct json *json_from_file(const char *file_name);
 struct json *json_from_stream(FILE *stream);
+
+/* Arena allocation.
+ *
+ * A parser created with json_parser_create_arena() allocates every value that
+ * it creates, including strings, array element vectors, and object members,
+ * from a "struct json_arena" instead of with individual calls to malloc().
+ * The whole tree is then freed at once by json_arena_destroy().
+ *
+ * A tree allocated from an arena is read-only: json_destroy() on any part of
+ * it does nothing, and it must not be passed to json_array_add(),
+ * json_object_put(), or other functions that modify a value.  Use
+ * json_clone() to obtain an ordinary copy that may be modified or outlive
+ * the arena.
+ *
+ * Parse errors are still reported as ordinary JSON_STRING values that the
+ * caller must free with json_destroy(). */
+struct json_arena *json_arena_create(void);
+void json_arena_destroy(struct json_arena *);
+
+struct json_parser *json_parser_create_arena(int flags, struct json_arena *);
+struct json_arena *json_parser_get_arena(const struct json_parser *);
+struct json *json_from_string_arena(const char *string, struct json_arena *);
 
 /* Serializing JSON. */
 
@@ -19,6 +19,9 @@
 #include "jsonrpc.h"
 
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "byteq.h"
 #include "dynamic-string.h"
@@ -28,6 +31,7 @@
 #include "ofpbuf.h"
 #include "poll-loop.h"
 #include "reconnect.h"
+#include "socket-util.h"
 #include "stream.h"
 #include "timeval.h"
 #include "vlog.h"
@@ -43,19 +47,41 @@ struct jsonrpc {
     struct byteq input;
     struct json_parser *parser;
     struct jsonrpc_msg *received;
+    bool use_arena;             /* See jsonrpc_use_arena(). */
 
     /* Output. */
     struct list output;         /* Contains "struct ofpbuf"s. */
     size_t backlog;
+
+    /* Worker threads (see jsonrpc_use_workers()). */
+    bool use_workers;
+    struct jsonrpc_job *parse_job; /* Parsing received data, if nonnull. */
+    unsigned int raw_received;  /* Bytes received without using 'input'. */
+    unsigned int recv_seqno;    /* 'job_seqno' when 'parse_job' checked. */
+    struct list pending;        /* "struct jsonrpc_job"s being serialized. */
+    size_t pending_bytes;       /* Serialized size of 'pending'. */
+    unsigned int send_seqno;    /* 'job_seqno' when 'pending' checked. */
 };
 
 /* Rate limit for error messages. */
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
 
+static struct json_parser *jsonrpc_parser_create(bool use_arena);
+static void jsonrpc_parser_abort(struct json_parser *);
+static char *jsonrpc_parser_finish(struct json_parser *,
+                                   struct jsonrpc_msg **);
 static void jsonrpc_received(struct jsonrpc *);
 static void jsonrpc_cleanup(struct jsonrpc *);
 static void jsonrpc_error(struct jsonrpc *, int error);
 
+static void jsonrpc_collect_sends(struct jsonrpc *);
+static void jsonrpc_send_to_workers(struct jsonrpc *, struct jsonrpc_msg *);
+static int jsonrpc_recv_from_workers(struct jsonrpc *, struct jsonrpc_msg **);
+static void jsonrpc_cancel_jobs(struct jsonrpc *);
+static bool jsonrpc_job_is_done(const struct jsonrpc_job *);
+static unsigned int jsonrpc_job_seqno(void);
+static void jsonrpc_job_wait(unsigned int seqno);
+
 /* This is just the same as stream_open() except that it uses the default
  * JSONRPC ports if none is specified. */
 int
@@ -89,10 +115,41 @@ jsonrpc_open(struct stream *stream)
     rpc->stream = stream;
     byteq_init(&rpc->input);
     list_init(&rpc->output);
+    list_init(&rpc->pending);
 
     return rpc;
 }
 
+/* Makes 'rpc' parse the data that it receives and serialize the messages that
+ * it sends in the worker threads configured with jsonrpc_set_worker_threads(),
+ * instead of in the thread that calls jsonrpc_recv() and jsonrpc_send().
+ * Messages are still received and sent in order.  Does nothing if no worker
+ * threads are configured.
+ *
+ * Once enabled, worker threads remain in use for the lifetime of 'rpc'. */
+void
+jsonrpc_use_workers(struct jsonrpc *rpc)
+{
+    if (jsonrpc_get_worker_threads()) {
+        rpc->use_workers = true;
+    }
+}
+
+/* Makes 'rpc' parse each message that it receives into a "struct json_arena"
+ * of its own, which the message owns, instead of allocating every JSON value
+ * in the message separately.  This makes large messages, such as database
+ * updates, much cheaper to parse and to free.
+ *
+ * The JSON in a message received this way is read-only (see json.h), so a
+ * caller that wants to modify any part of it, or to keep any part of it after
+ * destroying the message, must json_clone() that part first.  In particular,
+ * the caller must not steal the message's members by setting them to NULL. */
+void
+jsonrpc_use_arena(struct jsonrpc *rpc)
+{
+    rpc->use_arena = true;
+}
+
 /* Destroys 'rpc', closing the stream on which it is based, and frees its
  * memory. */
 void
@@ -114,6 +171,9 @@ jsonrpc_run(struct jsonrpc *rpc)
     }
 
     stream_run(rpc->stream);
+    if (rpc->use_workers) {
+        jsonrpc_collect_sends(rpc);
+    }
     while (!list_is_empty(&rpc->output)) {
         struct ofpbuf *buf = ofpbuf_from_list(rpc->output.next);
         int retval;
@@ -153,6 +213,9 @@ jsonrpc_wait(struct jsonrpc *rpc)
         if (!list_is_empty(&rpc->output)) {
             stream_send_wait(rpc->stream);
         }
+        if (!list_is_empty(&rpc->pending)) {
+            jsonrpc_job_wait(rpc->send_seqno);
+        }
     }
 }
 
@@ -175,12 +238,13 @@ jsonrpc_get_status(const struct jsonrpc *rpc)
 }
 
 /* Returns the number of bytes buffered by 'rpc' to be written to the
- * underlying stream.  Always returns 0 if 'rpc' has encountered an error or if
- * the remote end closed the connection. */
+ * underlying stream, including messages that worker threads have not yet
+ * finished serializing.  Always returns 0 if 'rpc' has encountered an error or
+ * if the remote end closed the connection. */
 size_t
 jsonrpc_get_backlog(const struct jsonrpc *rpc)
 {
-    return rpc->status ? 0 : rpc->backlog;
+    return rpc->status ? 0 : rpc->backlog + rpc->pending_bytes;
 }
 
 /* Returns the number of bytes that have been received on 'rpc''s underlying
@@ -188,7 +252,7 @@ jsonrpc_get_backlog(const struct jsonrpc *rpc)
 unsigned int
 jsonrpc_get_received_bytes(const struct jsonrpc *rpc)
 {
-    return rpc->input.head;
+    return rpc->input.head + rpc->raw_received;
 }
 
 /* Returns 'rpc''s name, that is, the name returned by stream_get_name() for
@@ -254,6 +318,11 @@ jsonrpc_send(struct jsonrpc *rpc, struct jsonrpc_msg *msg)
 
     jsonrpc_log_msg(rpc, "send", msg);
 
+    if (rpc->use_workers) {
+        jsonrpc_send_to_workers(rpc, msg);
+        return rpc->status;
+    }
+
     json = jsonrpc_msg_to_json(msg);
     s = json_to_string(json, 0);
     length = strlen(s);
@@ -295,6 +364,8 @@ jsonrpc_recv(struct jsonrpc *rpc, struct jsonrpc_msg **msgp)
     *msgp = NULL;
     if (rpc->status) {
         return rpc->status;
+    } else if (rpc->use_workers) {
+        return jsonrpc_recv_from_workers(rpc, msgp);
     }
 
     for (i = 0; i < 50; i++) {
@@ -326,7 +397,7 @@ jsonrpc_recv(struct jsonrpc *rpc, struct jsonrpc_msg **msgp)
             size_t n, used;
 
             if (!rpc->parser) {
-                rpc->parser = json_parser_create(0);
+                rpc->parser = jsonrpc_parser_create(rpc->use_arena);
             }
             n = byteq_tailroom(&rpc->input);
             used = json_parser_feed(rpc->parser,
@@ -357,6 +428,12 @@ jsonrpc_recv_wait(struct jsonrpc *rpc)
 {
     if (rpc->status || rpc->received || !byteq_is_empty(&rpc->input)) {
         (poll_immediate_wake)(rpc->name);
+    } else if (rpc->parse_job) {
+        if (jsonrpc_job_is_done(rpc->parse_job)) {
+            (poll_immediate_wake)(rpc->name);
+        } else {
+            jsonrpc_job_wait(rpc->recv_seqno);
+        }
     } else {
         stream_recv_wait(rpc->stream);
     }
@@ -381,7 +458,8 @@ jsonrpc_send_block(struct jsonrpc *rpc, struct jsonrpc_msg *msg)
 
     for (;;) {
         jsonrpc_run(rpc);
-        if (list_is_empty(&rpc->output) || rpc->status) {
+        if ((list_is_empty(&rpc->output) && list_is_empty(&rpc->pending))
+            || rpc->status) {
             return rpc->status;
         }
         jsonrpc_wait(rpc);
@@ -445,27 +523,66 @@ jsonrpc_transact_block(struct jsonrpc *rpc, struct jsonrpc_msg *request,
     return error;
 }
 
+static struct json_parser *
+jsonrpc_parser_create(bool use_arena)
+{
+    return (use_arena
+            ? json_parser_create_arena(0, json_arena_create())
+            : json_parser_create(0));
+}
+
 static void
-jsonrpc_received(struct jsonrpc *rpc)
+jsonrpc_parser_abort(struct json_parser *parser)
 {
-    struct jsonrpc_msg *msg;
+    if (parser) {
+        struct json_arena *arena = json_parser_get_arena(parser);
+
+        json_parser_abort(parser);
+        json_arena_destroy(arena);
+    }
+}
+
+/* Finishes parsing a message with 'parser', which was created with
+ * jsonrpc_parser_create(), and destroys 'parser'.  On success, stores the
+ * message in '*msgp' and returns NULL.  On failure, stores NULL in '*msgp'
+ * and returns an error message that the caller must free. */
+static char *
+jsonrpc_parser_finish(struct json_parser *parser, struct jsonrpc_msg **msgp)
+{
+    struct json_arena *arena = json_parser_get_arena(parser);
     struct json *json;
     char *error;
 
-    json = json_parser_finish(rpc->parser);
-    rpc->parser = NULL;
+    json = json_parser_finish(parser);
     if (json->type == JSON_STRING) {
-        VLOG_WARN_RL(&rl, "%s: error parsing stream: %s",
-                     rpc->name, json_string(json));
-        jsonrpc_error(rpc, EPROTO);
+        error = xasprintf("error parsing stream: %s", json_string(json));
         json_destroy(json);
-        return;
+        json_arena_destroy(arena);
+        *msgp = NULL;
+        return error;
+    }
+
+    error = jsonrpc_msg_from_json(json, msgp);
+    if (error) {
+        char *s = xasprintf("received bad JSON-RPC message: %s", error);
+        free(error);
+        json_arena_destroy(arena);
+        return s;
     }
+    (*msgp)->arena = arena;
+    return NULL;
+}
+
+static void
+jsonrpc_received(struct jsonrpc *rpc)
+{
+    struct jsonrpc_msg *msg;
+    char *error;
 
-    error = jsonrpc_msg_from_json(json, &msg);
+    error = jsonrpc_parser_finish(rpc->parser, &msg);
+    rpc->parser = NULL;
     if (error) {
-        VLOG_WARN_RL(&rl, "%s: received bad JSON-RPC message: %s",
-                     rpc->name, error);
+        VLOG_WARN_RL(&rl, "%s: %s", rpc->name, error);
         free(error);
         jsonrpc_error(rpc, EPROTO);
         return;
@@ -491,7 +608,7 @@ jsonrpc_cleanup(struct jsonrpc *rpc)
     stream_close(rpc->stream);
     rpc->stream = NULL;
 
-    json_parser_abort(rpc->parser);
+    jsonrpc_parser_abort(rpc->parser);
     rpc->parser = NULL;
 
     jsonrpc_msg_destroy(rpc->received);
@@ -499,6 +616,8 @@ jsonrpc_cleanup(struct jsonrpc *rpc)
 
     ofpbuf_list_delete(&rpc->output);
     rpc->backlog = 0;
+
+    jsonrpc_cancel_jobs(rpc);
 }
 
 static struct jsonrpc_msg *
@@ -513,6 +632,7 @@ jsonrpc_create(enum jsonrpc_msg_type type, const char *method,
     msg->result = result;
     msg->error = error;
     msg->id = id;
+    msg->arena = NULL;
     return msg;
 }
 
@@ -642,6 +762,7 @@ jsonrpc_msg_destroy(struct jsonrpc_msg *m)
         json_destroy(m->result);
         json_destroy(m->error);
         json_destroy(m->id);
+        json_arena_destroy(m->arena);
         free(m);
     }
 }
@@ -656,9 +777,54 @@ null_from_json_null(struct json *json)
     return json;
 }
 
+/* Removes and returns the member of 'json' named 'name', or returns NULL if
+ * there is none.  An object allocated from an arena can't be modified, so for
+ * one of those this just returns the member and leaves it in place. */
+static struct json *
+jsonrpc_take_member(struct json *json, const char *name)
+{
+    return (json->in_arena
+            ? shash_find_data(json_object(json), name)
+            : shash_find_and_delete(json_object(json), name));
+}
+
+/* Returns the first member of 'object' that is not part of a JSON-RPC message,
+ * or NULL if there is none. */
+static const struct shash_node *
+jsonrpc_unexpected_member(const struct shash *object)
+{
+    static const char *members[] = { "method", "params", "result", "error",
+                                     "id" };
+    const struct shash_node *node;
+
+    SHASH_FOR_EACH (node, object) {
+        size_t i;
+
+        for (i = 0; i < ARRAY_SIZE(members); i++) {
+            if (!strcmp(node->name, members[i])) {
+                break;
+            }
+        }
+        if (i >= ARRAY_SIZE(members)) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* Converts 'json' into a JSON-RPC message, taking ownership of 'json'.  On
+ * success, stores the message in '*msgp' and returns NULL.  On failure,
+ * stores NULL in '*msgp' and returns an error message that the caller must
+ * free.
+ *
+ * 'json' may be allocated from an arena (see json.h), in which case the
+ * message's members point into the arena, so the caller must keep the arena
+ * until it destroys the message, e.g. by storing it in the message's 'arena'
+ * member. */
 char *
 jsonrpc_msg_from_json(struct json *json, struct jsonrpc_msg **msgp)
 {
+    const struct shash_node *unexpected;
     struct json *method = NULL;
     struct jsonrpc_msg *msg = NULL;
     struct shash *object;
@@ -670,7 +836,7 @@ jsonrpc_msg_from_json(struct json *json, struct jsonrpc_msg **msgp)
     }
     object = json_object(json);
 
-    method = shash_find_and_delete(object, "method");
+    method = jsonrpc_take_member(json, "method");
     if (method && method->type != JSON_STRING) {
         error = xstrdup("method is not a JSON string");
         goto exit;
@@ -678,17 +844,18 @@ jsonrpc_msg_from_json(struct json *json, struct jsonrpc_msg **msgp)
 
     msg = xzalloc(sizeof *msg);
     msg->method = method ? xstrdup(method->u.string) : NULL;
-    msg->params = null_from_json_null(shash_find_and_delete(object, "params"));
-    msg->result = null_from_json_null(shash_find_and_delete(object, "result"));
-    msg->error = null_from_json_null(shash_find_and_delete(object, "error"));
-    msg->id = null_from_json_null(shash_find_and_delete(object, "id"));
+    msg->params = null_from_json_null(jsonrpc_take_member(json, "params"));
+    msg->result = null_from_json_null(jsonrpc_take_member(json, "result"));
+    msg->error = null_from_json_null(jsonrpc_take_member(json, "error"));
+    msg->id = null_from_json_null(jsonrpc_take_member(json, "id"));
     msg->type = (msg->result ? JSONRPC_REPLY
                  : msg->error ? JSONRPC_ERROR
                  : msg->id ? JSONRPC_REQUEST
                  : JSONRPC_NOTIFY);
-    if (!shash_is_empty(object)) {
+    unexpected = jsonrpc_unexpected_member(object);
+    if (unexpected) {
         error = xasprintf("message has unexpected member \"%s\"",
-                          shash_first(object)->name);
+                          unexpected->name);
         goto exit;
     }
     error = jsonrpc_msg_is_valid(msg);
@@ -712,6 +879,10 @@ jsonrpc_msg_to_json(struct jsonrpc_msg *m)
 {
     struct json *json = json_object_create();
 
+    /* The members of a message received with jsonrpc_use_arena() are
+     * read-only and can't be moved into 'json'. */
+    ovs_assert(!m->arena);
+
     if (m->method) {
         json_object_put(json, "method", json_string_create_nocopy(m->method));
     }
@@ -743,6 +914,418 @@ jsonrpc_msg_to_json(struct jsonrpc_msg *m)
     return json;
 }
 
+/* Worker threads.
+ *
+ * A jsonrpc for which jsonrpc_use_workers() has been called hands parsing of
+ * the data it receives and serialization of the messages it sends to a pool
+ * of worker threads shared by all jsonrpcs.  Everything else, including
+ * delivering messages to the caller, stays in the thread that owns the
+ * jsonrpc, so the caller sees the same behavior either way, only with less
+ * time spent per call when the messages are large.
+ *
+ * A jsonrpc has at most one parsing job outstanding at a time, so received
+ * messages stay in order, and any number of serialization jobs, which it
+ * keeps in 'pending' in the order the messages were sent and writes to the
+ * stream only from the front of that list. */
+
+enum jsonrpc_job_state {
+    JOB_QUEUED,                 /* In 'job_queue'. */
+    JOB_RUNNING,                /* Owned by a worker thread. */
+    JOB_DONE,                   /* Finished, waiting for its jsonrpc. */
+    JOB_CANCELED                /* Canceled while running. */
+};
+
+struct jsonrpc_job {
+    struct list queue_node;     /* In 'job_queue', if JOB_QUEUED. */
+    struct list rpc_node;       /* In jsonrpc's 'pending', if serializing. */
+    enum jsonrpc_job_state state; /* Protected by 'job_mutex'. */
+
+    /* Serialization: converts 'json' to 'string' of 'length' bytes.  The
+     * jsonrpc sets 'length' in advance, for jsonrpc_get_backlog(). */
+    struct json *json;
+    char *string;
+    size_t length;
+
+    /* Parsing: feeds the 'size' bytes in 'data' to 'parser', appending each
+     * complete message to 'msgs' or, on error, storing a description of it in
+     * 'error'.  The jsonrpc delivers messages starting at 'next_msg'. */
+    struct json_parser *parser;
+    bool use_arena;             /* Parse into arenas? */
+    char *data;
+    size_t size;
+    struct jsonrpc_msg **msgs;
+    size_t n_msgs, allocated_msgs;
+    size_t next_msg;
+    char *error;
+};
+
+/* Protects 'job_queue', 'job_seqno', and each job's 'state'. */
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static struct list job_queue = LIST_INITIALIZER(&job_queue);
+
+/* Incremented whenever a worker thread finishes a job.  A worker also writes
+ * a byte to 'job_fds[1]' to wake up the main thread, which drains
+ * 'job_fds[0]' in jsonrpc_job_seqno(). */
+static unsigned int job_seqno;
+static int job_fds[2] = { -1, -1 };
+
+/* Number of worker threads requested and started, respectively. */
+static unsigned int n_workers;
+static unsigned int n_started_workers;
+
+/* Sets the number of worker threads that jsonrpcs for which
+ * jsonrpc_use_workers() has been called share.  The threads are started
+ * lazily, when the first job is submitted, so it is safe to call this before
+ * daemonizing.  The number of threads can only be increased; 0, the default,
+ * disables worker threads. */
+void
+jsonrpc_set_worker_threads(unsigned int n)
+{
+#ifdef _WIN32
+    if (n) {
+        VLOG_WARN("JSON-RPC worker threads are not supported on this "
+                  "platform");
+    }
+#else
+    if (n > n_workers) {
+        n_workers = n;
+    }
+#endif
+}
+
+/* Returns the number of worker threads configured with
+ * jsonrpc_set_worker_threads(). */
+unsigned int
+jsonrpc_get_worker_threads(void)
+{
+    return n_workers;
+}
+
+/* Returns the current job sequence number, for passing to
+ * jsonrpc_job_wait() after checking for finished jobs. */
+static unsigned int
+jsonrpc_job_seqno(void)
+{
+    unsigned int seqno;
+
+    if (job_fds[0] >= 0) {
+        char buffer[512];
+
+        while (read(job_fds[0], buffer, sizeof buffer) > 0) {
+            continue;
+        }
+    }
+
+    pthread_mutex_lock(&job_mutex);
+    seqno = job_seqno;
+    pthread_mutex_unlock(&job_mutex);
+
+    return seqno;
+}
+
+/* Causes the poll loop to wake up when a worker thread finishes a job after
+ * jsonrpc_job_seqno() returned 'seqno'. */
+static void
+jsonrpc_job_wait(unsigned int seqno)
+{
+    bool changed;
+
+    pthread_mutex_lock(&job_mutex);
+    changed = seqno != job_seqno;
+    pthread_mutex_unlock(&job_mutex);
+
+    if (changed) {
+        poll_immediate_wake();
+    } else {
+        poll_fd_wait(job_fds[0], POLLIN);
+    }
+}
+
+static void
+jsonrpc_job_destroy(struct jsonrpc_job *job)
+{
+    size_t i;
+
+    json_destroy(job->json);
+    free(job->string);
+
+    jsonrpc_parser_abort(job->parser);
+    free(job->data);
+    for (i = job->next_msg; i < job->n_msgs; i++) {
+        jsonrpc_msg_destroy(job->msgs[i]);
+    }
+    free(job->msgs);
+    free(job->error);
+
+    free(job);
+}
+
+static void
+jsonrpc_job_serialize(struct jsonrpc_job *job)
+{
+    job->string = json_to_string(job->json, 0);
+    json_destroy(job->json);
+    job->json = NULL;
+}
+
+static void
+jsonrpc_job_parse(struct jsonrpc_job *job)
+{
+    size_t ofs = 0;
+
+    while (ofs < job->size && !job->error) {
+        if (!job->parser) {
+            job->parser = jsonrpc_parser_create(job->use_arena);
+        }
+        ofs += json_parser_feed(job->parser, job->data + ofs,
+                                job->size - ofs);
+        if (json_parser_is_done(job->parser)) {
+            struct jsonrpc_msg *msg;
+
+            job->error = jsonrpc_parser_finish(job->parser, &msg);
+            job->parser = NULL;
+            if (job->error) {
+                break;
+            }
+
+            if (job->n_msgs >= job->allocated_msgs) {
+                job->msgs = x2nrealloc(job->msgs, &job->allocated_msgs,
+                                       sizeof *job->msgs);
+            }
+            job->msgs[job->n_msgs++] = msg;
+        }
+    }
+}
+
+static void *
+jsonrpc_worker_main(void *arg OVS_UNUSED)
+{
+    for (;;) {
+        struct jsonrpc_job *job;
+        bool canceled;
+
+        pthread_mutex_lock(&job_mutex);
+        while (list_is_empty(&job_queue)) {
+            pthread_cond_wait(&job_cond, &job_mutex);
+        }
+        job = CONTAINER_OF(list_pop_front(&job_queue), struct jsonrpc_job,
+                           queue_node);
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&job_mutex);
+
+        if (job->json) {
+            jsonrpc_job_serialize(job);
+        } else {
+            jsonrpc_job_parse(job);
+        }
+
+        pthread_mutex_lock(&job_mutex);
+        canceled = job->state == JOB_CANCELED;
+        if (!canceled) {
+            job->state = JOB_DONE;
+            job_seqno++;
+        }
+        pthread_mutex_unlock(&job_mutex);
+
+        if (canceled) {
+            jsonrpc_job_destroy(job);
+        } else {
+            ignore(write(job_fds[1], "", 1));
+        }
+    }
+
+    return NULL;
+}
+
+static void
+jsonrpc_job_submit(struct jsonrpc_job *job)
+{
+    if (job_fds[0] < 0) {
+        xpipe_nonblocking(job_fds);
+    }
+    while (n_started_workers < n_workers) {
+        pthread_t thread;
+        int error;
+
+        error = pthread_create(&thread, NULL, jsonrpc_worker_main, NULL);
+        if (error) {
+            VLOG_FATAL("failed to create JSON-RPC worker thread (%s)",
+                       strerror(error));
+        }
+        pthread_detach(thread);
+        n_started_workers++;
+    }
+
+    pthread_mutex_lock(&job_mutex);
+    job->state = JOB_QUEUED;
+    list_push_back(&job_queue, &job->queue_node);
+    pthread_cond_signal(&job_cond);
+    pthread_mutex_unlock(&job_mutex);
+}
+
+static bool
+jsonrpc_job_is_done(const struct jsonrpc_job *job)
+{
+    bool done;
+
+    pthread_mutex_lock(&job_mutex);
+    done = job->state == JOB_DONE;
+    pthread_mutex_unlock(&job_mutex);
+
+    return done;
+}
+
+/* Frees 'job' or, if a worker thread is working on it, arranges for the worker
+ * thread to free it when it finishes. */
+static void
+jsonrpc_job_cancel(struct jsonrpc_job *job)
+{
+    pthread_mutex_lock(&job_mutex);
+    if (job->state == JOB_RUNNING) {
+        job->state = JOB_CANCELED;
+        job = NULL;
+    } else if (job->state == JOB_QUEUED) {
+        list_remove(&job->queue_node);
+    }
+    pthread_mutex_unlock(&job_mutex);
+
+    if (job) {
+        jsonrpc_job_destroy(job);
+    }
+}
+
+/* Cancels all of 'rpc''s outstanding jobs. */
+static void
+jsonrpc_cancel_jobs(struct jsonrpc *rpc)
+{
+    if (rpc->parse_job) {
+        jsonrpc_job_cancel(rpc->parse_job);
+        rpc->parse_job = NULL;
+    }
+    while (!list_is_empty(&rpc->pending)) {
+        struct jsonrpc_job *job;
+
+        job = CONTAINER_OF(list_pop_front(&rpc->pending), struct jsonrpc_job,
+                           rpc_node);
+        jsonrpc_job_cancel(job);
+    }
+    rpc->pending_bytes = 0;
+}
+
+static void
+jsonrpc_send_to_workers(struct jsonrpc *rpc, struct jsonrpc_msg *msg)
+{
+    struct jsonrpc_job *job = xzalloc(sizeof *job);
+
+    /* Converting 'msg' to JSON only moves pointers around.  Measuring it
+     * walks the whole message, but that is much cheaper than formatting it,
+     * which is left to the worker. */
+    job->json = jsonrpc_msg_to_json(msg);
+    job->length = json_serialized_length(job->json);
+    list_push_back(&rpc->pending, &job->rpc_node);
+    rpc->pending_bytes += job->length;
+    jsonrpc_job_submit(job);
+}
+
+/* Moves the messages that the worker threads have finished serializing from
+ * the front of 'rpc->pending' to 'rpc->output'. */
+static void
+jsonrpc_collect_sends(struct jsonrpc *rpc)
+{
+    rpc->send_seqno = jsonrpc_job_seqno();
+    while (!list_is_empty(&rpc->pending)) {
+        struct jsonrpc_job *job;
+        struct ofpbuf *buf;
+
+        job = CONTAINER_OF(list_front(&rpc->pending), struct jsonrpc_job,
+                           rpc_node);
+        if (!jsonrpc_job_is_done(job)) {
+            break;
+        }
+        list_remove(&job->rpc_node);
+        rpc->pending_bytes -= job->length;
+
+        buf = xmalloc(sizeof *buf);
+        ofpbuf_use(buf, job->string, job->length);
+        buf->size = job->length;
+        list_push_back(&rpc->output, &buf->list_node);
+        rpc->backlog += job->length;
+
+        job->string = NULL;
+        jsonrpc_job_destroy(job);
+    }
+}
+
+static int
+jsonrpc_recv_from_workers(struct jsonrpc *rpc, struct jsonrpc_msg **msgp)
+{
+    struct jsonrpc_job *job = rpc->parse_job;
+    char buffer[16384];
+    size_t size;
+
+    if (rpc->received) {
+        *msgp = rpc->received;
+        rpc->received = NULL;
+        return 0;
+    }
+
+    rpc->recv_seqno = jsonrpc_job_seqno();
+    if (job) {
+        if (!jsonrpc_job_is_done(job)) {
+            return EAGAIN;
+        } else if (job->next_msg < job->n_msgs) {
+            *msgp = job->msgs[job->next_msg++];
+            jsonrpc_log_msg(rpc, "received", *msgp);
+            return 0;
+        } else if (job->error) {
+            VLOG_WARN_RL(&rl, "%s: %s", rpc->name, job->error);
+            jsonrpc_error(rpc, EPROTO);
+            return rpc->status;
+        }
+
+        rpc->parser = job->parser;
+        job->parser = NULL;
+        rpc->parse_job = NULL;
+        jsonrpc_job_destroy(job);
+    }
+
+    size = byteq_tailroom(&rpc->input);
+    if (size) {
+        /* Data received before worker threads were enabled. */
+        memcpy(buffer, byteq_tail(&rpc->input), size);
+        byteq_advance_tail(&rpc->input, size);
+    } else {
+        int retval = stream_recv(rpc->stream, buffer, sizeof buffer);
+        if (retval < 0) {
+            if (retval == -EAGAIN) {
+                return EAGAIN;
+            } else {
+                VLOG_WARN_RL(&rl, "%s: receive error: %s",
+                             rpc->name, strerror(-retval));
+                jsonrpc_error(rpc, -retval);
+                return rpc->status;
+            }
+        } else if (retval == 0) {
+            jsonrpc_error(rpc, EOF);
+            return EOF;
+        }
+        rpc->raw_received += retval;
+        size = retval;
+    }
+
+    job = xzalloc(sizeof *job);
+    job->parser = rpc->parser;
+    job->use_arena = rpc->use_arena;
+    rpc->parser = NULL;
+    job->data = xmemdup(buffer, size);
+    job->size = size;
+    rpc->parse_job = job;
+    jsonrpc_job_submit(job);
+
+    return EAGAIN;
+}
+
 /* A JSON-RPC session with reconnection. */
 
 struct jsonrpc_session {
@@ -753,6 +1336,8 @@ struct jsonrpc_session {
     int last_error;
     unsigned int seqno;
     uint8_t dscp;
+    bool use_workers;           /* Call jsonrpc_use_workers() on 'rpc'? */
+    bool use_arena;             /* Call jsonrpc_use_arena() on 'rpc'? */
 };
 
 /* Creates and returns a jsonrpc_session to 'name', which should be a string
@@ -784,6 +1369,8 @@ jsonrpc_session_open(const char *name, bool retry)
     s->seqno = 0;
     s->dscp = 0;
     s->last_error = 0;
+    s->use_workers = false;
+    s->use_arena = false;
 
     if (!pstream_verify_name(name)) {
         reconnect_set_passive(s->reconnect, true, time_msec());
@@ -820,6 +1407,8 @@ jsonrpc_session_open_unreliably(struct jsonrpc *jsonrpc, uint8_t dscp)
     s->stream = NULL;
     s->pstream = NULL;
     s->seqno = 0;
+    s->use_workers = false;
+    s->use_arena = false;
 
     return s;
 }
@@ -896,6 +1485,12 @@ jsonrpc_session_run(struct jsonrpc_session *s)
             }
             reconnect_connected(s->reconnect, time_msec());
             s->rpc = jsonrpc_open(stream);
+            if (s->use_workers) {
+                jsonrpc_use_workers(s->rpc);
+            }
+            if (s->use_arena) {
+                jsonrpc_use_arena(s->rpc);
+            }
         } else if (error != EAGAIN) {
             reconnect_listen_error(s->reconnect, time_msec(), error);
             pstream_close(s->pstream);
@@ -936,6 +1531,12 @@ jsonrpc_session_run(struct jsonrpc_session *s)
             reconnect_connected(s->reconnect, time_msec());
             s->rpc = jsonrpc_open(s->stream);
             s->stream = NULL;
+            if (s->use_workers) {
+                jsonrpc_use_workers(s->rpc);
+            }
+            if (s->use_arena) {
+                jsonrpc_use_arena(s->rpc);
+            }
         } else if (error != EAGAIN) {
             reconnect_connect_failed(s->reconnect, time_msec(), error);
             stream_close(s->stream);
@@ -1134,3 +1735,27 @@ jsonrpc_session_set_dscp(struct jsonrpc_session *s,
         jsonrpc_session_force_reconnect(s);
     }
 }
+
+/* Makes 's' call jsonrpc_use_workers() on its current connection, if any, and
+ * on every connection that it makes or accepts later. */
+void
+jsonrpc_session_use_workers(struct jsonrpc_session *s)
+{
+    s->use_workers = true;
+    if (s->rpc) {
+        jsonrpc_use_workers(s->rpc);
+    }
+}
+
+/* Makes 's' call jsonrpc_use_arena() on its current connection, if any, and on
+ * every connection that it makes or accepts later.  See jsonrpc_use_arena()
+ * for the restrictions that this places on the messages that
+ * jsonrpc_session_recv() returns. */
+void
+jsonrpc_session_use_arena(struct jsonrpc_session *s)
+{
+    s->use_arena = true;
+    if (s->rpc) {
+        jsonrpc_use_arena(s->rpc);
+    }
+}
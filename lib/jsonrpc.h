@@ -45,6 +45,11 @@ int jsonrpc_pstream_open(const char *name, struct pstream **, uint8_t dscp);
 struct jsonrpc *jsonrpc_open(struct stream *);
 void jsonrpc_close(struct jsonrpc *);
 
+void jsonrpc_set_worker_threads(unsigned int n);
+unsigned int jsonrpc_get_worker_threads(void);
+void jsonrpc_use_workers(struct jsonrpc *);
+void jsonrpc_use_arena(struct jsonrpc *);
+
 void jsonrpc_run(struct jsonrpc *);
 void jsonrpc_wait(struct jsonrpc *);
 
@@ -77,6 +82,11 @@ struct jsonrpc_msg {
     struct json *result;        /* Successful reply only. */
     struct json *error;         /* Error reply only. */
     struct json *id;            /* Request or reply only. */
+
+    /* If nonnull, 'params', 'result', 'error', and 'id' were allocated from
+     * this arena, which jsonrpc_msg_destroy() frees (see
+     * jsonrpc_use_arena()). */
+    struct json_arena *arena;
 };
 
 struct jsonrpc_msg *jsonrpc_create_request(const char *method,
@@ -129,5 +139,7 @@ void jsonrpc_session_set_probe_interval(struct jsonrpc_session *,
                                         int probe_interval);
 void jsonrpc_session_set_dscp(struct jsonrpc_session *,
                               uint8_t dscp);
+void jsonrpc_session_use_workers(struct jsonrpc_session *);
+void jsonrpc_session_use_arena(struct jsonrpc_session *);
 
 #endif /* jsonrpc.h */
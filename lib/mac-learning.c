@@ -37,11 +37,21 @@ VLOG_DEFINE_THIS_MODULE(mac_learning);
 COVERAGE_DEFINE(mac_learning_learned);
 COVERAGE_DEFINE(mac_learning_expired);
 
+/* Hash buckets of a MAC learning table.
+ *
+ * The number of buckets only changes with every stripe write-locked, so a
+ * stripe lock is enough to protect a hash chain. */
+struct mac_table {
+    size_t mask;                /* Number of buckets minus 1. */
+    struct mac_entry **buckets;
+};
+
 /* Returns the number of seconds since 'e' (within 'ml') was last learned. */
 int
 mac_entry_age(const struct mac_learning *ml, const struct mac_entry *e)
 {
     time_t remaining = e->expires - time_now();
+
     return ml->idle_time - remaining;
 }
 
@@ -70,36 +80,134 @@ make_unknown_mac_tag(const struct mac_learning *ml,
     return tag_create_deterministic(mac_table_hash(ml, mac, vlan));
 }
 
+static struct mac_table *
+mac_table_create(size_t n_buckets)
+{
+    struct mac_table *table = xmalloc(sizeof *table);
+
+    table->mask = n_buckets - 1;
+    table->buckets = xcalloc(n_buckets, sizeof *table->buckets);
+    return table;
+}
+
+static void
+mac_table_destroy(struct mac_table *table)
+{
+    free(table->buckets);
+    free(table);
+}
+
+/* Returns the number of hash buckets to use for a table with at most
+ * 'max_entries' entries. */
+static size_t
+mac_table_n_buckets(size_t max_entries)
+{
+    size_t n = MAC_LEARNING_N_STRIPES;
+
+    while (n < max_entries) {
+        n *= 2;
+    }
+    return n;
+}
+
+/* Returns the stripe that contains the hash bucket for 'hash'.  The hash
+ * bucket for a given hash is always in the same stripe, because the number of
+ * buckets is a multiple of MAC_LEARNING_N_STRIPES. */
+static struct mac_stripe *
+mac_stripe(const struct mac_learning *ml, uint32_t hash)
+{
+    return CONST_CAST(struct mac_stripe *,
+                      &ml->stripes[hash & (MAC_LEARNING_N_STRIPES - 1)]);
+}
+
+/* Looks up the entry for 'mac' and 'vlan', which hash to 'hash', in 'ml'.
+ * The caller must hold the lock for the stripe that contains 'hash', for
+ * reading or for writing. */
 static struct mac_entry *
-mac_entry_lookup(const struct mac_learning *ml,
+mac_entry_lookup(const struct mac_learning *ml, uint32_t hash,
                  const uint8_t mac[ETH_ADDR_LEN], uint16_t vlan)
 {
     struct mac_entry *e;
 
-    HMAP_FOR_EACH_WITH_HASH (e, hmap_node, mac_table_hash(ml, mac, vlan),
-                             &ml->table) {
-        if (e->vlan == vlan && eth_addr_equals(e->mac, mac)) {
+    for (e = ml->table->buckets[hash & ml->table->mask]; e; e = e->hash_next) {
+        if (e->hash == hash && e->vlan == vlan
+            && eth_addr_equals(e->mac, mac)) {
             return e;
         }
     }
     return NULL;
 }
 
-/* If the LRU list is not empty, stores the least-recently-used entry in '*e'
- * and returns true.  Otherwise, if the LRU list is empty, stores NULL in '*e'
- * and return false. */
-static bool
-get_lru(struct mac_learning *ml, struct mac_entry **e)
+/* Moves 'e' to the back of 'ml''s LRU list and refreshes it.  The caller must
+ * hold 'e''s stripe lock for writing and 'ml->lru_mutex'. */
+static void
+mac_entry_make_mru(struct mac_learning *ml, struct mac_entry *e, time_t now)
 {
-    if (!list_is_empty(&ml->lrus)) {
-        *e = mac_entry_from_lru_node(ml->lrus.next);
-        return true;
-    } else {
-        *e = NULL;
-        return false;
+    list_remove(&e->lru_node);
+    list_push_back(&ml->lrus, &e->lru_node);
+    e->expires = now + ml->idle_time;
+}
+
+/* Refreshes 'e''s age, moving it to the back of 'ml''s LRU list unless it was
+ * already refreshed within the current second.  The caller must hold 'e''s
+ * stripe lock for writing. */
+static void
+mac_entry_refresh(struct mac_learning *ml, struct mac_entry *e, time_t now)
+{
+    if (e->expires != now + ml->idle_time) {
+        pthread_mutex_lock(&ml->lru_mutex);
+        mac_entry_make_mru(ml, e, now);
+        pthread_mutex_unlock(&ml->lru_mutex);
     }
 }
 
+/* Adds a new entry for 'mac' and 'vlan', which hash to 'hash', to 'ml', with
+ * tag 0, and returns it.  The caller must hold the entry's stripe lock for
+ * writing and 'ml->lru_mutex'. */
+static struct mac_entry *
+mac_entry_create(struct mac_learning *ml, uint32_t hash,
+                 const uint8_t mac[ETH_ADDR_LEN], uint16_t vlan, time_t now)
+{
+    struct mac_entry **bucket;
+    struct mac_entry *e;
+
+    e = xmalloc(sizeof *e);
+    e->hash = hash;
+    memcpy(e->mac, mac, ETH_ADDR_LEN);
+    e->vlan = vlan;
+    e->tag = 0;
+    e->port.p = NULL;
+    e->grat_arp_lock = TIME_MIN;
+    e->expires = now + ml->idle_time;
+
+    bucket = &ml->table->buckets[hash & ml->table->mask];
+    e->hash_next = *bucket;
+    *bucket = e;
+
+    list_push_back(&ml->lrus, &e->lru_node);
+    ml->n_entries++;
+
+    return e;
+}
+
+/* Removes 'e' from 'ml' and frees it.  The caller must hold 'e''s stripe lock
+ * for writing and 'ml->lru_mutex'. */
+static void
+mac_entry_remove(struct mac_learning *ml, struct mac_entry *e)
+{
+    struct mac_entry **bucket;
+
+    for (bucket = &ml->table->buckets[e->hash & ml->table->mask];
+         *bucket != e; bucket = &(*bucket)->hash_next) {
+        continue;
+    }
+    *bucket = e->hash_next;
+
+    list_remove(&e->lru_node);
+    ml->n_entries--;
+    free(e);
+}
+
 static unsigned int
 normalize_idle_time(unsigned int idle_time)
 {
@@ -115,12 +223,19 @@ struct mac_learning *
 mac_learning_create(unsigned int idle_time)
 {
     struct mac_learning *ml;
+    int i;
 
     ml = xmalloc(sizeof *ml);
+    ml->table = mac_table_create(mac_table_n_buckets(MAC_DEFAULT_MAX));
+    for (i = 0; i < MAC_LEARNING_N_STRIPES; i++) {
+        pthread_rwlock_init(&ml->stripes[i].rwlock, NULL);
+    }
+    pthread_mutex_init(&ml->lru_mutex, NULL);
     list_init(&ml->lrus);
-    hmap_init(&ml->table);
+    ml->n_entries = 0;
     ml->secret = random_uint32();
-    ml->flood_vlans = NULL;
+    ml->has_flood_vlans = false;
+    memset(ml->flood_vlans, 0, sizeof ml->flood_vlans);
     ml->idle_time = normalize_idle_time(idle_time);
     ml->max_entries = MAC_DEFAULT_MAX;
     return ml;
@@ -132,14 +247,17 @@ mac_learning_destroy(struct mac_learning *ml)
 {
     if (ml) {
         struct mac_entry *e, *next;
+        int i;
 
-        HMAP_FOR_EACH_SAFE (e, next, hmap_node, &ml->table) {
-            hmap_remove(&ml->table, &e->hmap_node);
+        LIST_FOR_EACH_SAFE (e, next, lru_node, &ml->lrus) {
             free(e);
         }
-        hmap_destroy(&ml->table);
+        mac_table_destroy(ml->table);
 
-        bitmap_free(ml->flood_vlans);
+        for (i = 0; i < MAC_LEARNING_N_STRIPES; i++) {
+            pthread_rwlock_destroy(&ml->stripes[i].rwlock);
+        }
+        pthread_mutex_destroy(&ml->lru_mutex);
         free(ml);
     }
 }
@@ -151,13 +269,22 @@ bool
 mac_learning_set_flood_vlans(struct mac_learning *ml,
                              const unsigned long *bitmap)
 {
-    if (vlan_bitmap_equal(ml->flood_vlans, bitmap)) {
-        return false;
-    } else {
-        bitmap_free(ml->flood_vlans);
-        ml->flood_vlans = vlan_bitmap_clone(bitmap);
-        return true;
+    bool changed;
+
+    mac_learning_lock(ml);
+    changed = !vlan_bitmap_equal(ml->has_flood_vlans ? ml->flood_vlans : NULL,
+                                 bitmap);
+    if (changed) {
+        ml->has_flood_vlans = bitmap != NULL;
+        if (bitmap) {
+            memcpy(ml->flood_vlans, bitmap, sizeof ml->flood_vlans);
+        } else {
+            memset(ml->flood_vlans, 0, sizeof ml->flood_vlans);
+        }
     }
+    mac_learning_unlock(ml);
+
+    return changed;
 }
 
 /* Changes the MAC aging timeout of 'ml' to 'idle_time' seconds. */
@@ -170,10 +297,14 @@ mac_learning_set_idle_time(struct mac_learning *ml, unsigned int idle_time)
         int delta;
 
         delta = (int) idle_time - (int) ml->idle_time;
+        mac_learning_lock(ml);
+        pthread_mutex_lock(&ml->lru_mutex);
         LIST_FOR_EACH (e, lru_node, &ml->lrus) {
             e->expires += delta;
         }
         ml->idle_time = idle_time;
+        pthread_mutex_unlock(&ml->lru_mutex);
+        mac_learning_unlock(ml);
     }
 }
 
@@ -182,15 +313,37 @@ mac_learning_set_idle_time(struct mac_learning *ml, unsigned int idle_time)
 void
 mac_learning_set_max_entries(struct mac_learning *ml, size_t max_entries)
 {
-    ml->max_entries = (max_entries < 10 ? 10
-                       : max_entries > 1000 * 1000 ? 1000 * 1000
-                       : max_entries);
+    size_t n_buckets;
+
+    max_entries = (max_entries < 10 ? 10
+                   : max_entries > 1000 * 1000 ? 1000 * 1000
+                   : max_entries);
+
+    mac_learning_lock(ml);
+    ml->max_entries = max_entries;
+
+    /* Grow the table, if necessary, to keep the hash chains short. */
+    n_buckets = mac_table_n_buckets(max_entries);
+    if (n_buckets > ml->table->mask + 1) {
+        struct mac_table *table = mac_table_create(n_buckets);
+        struct mac_entry *e;
+
+        LIST_FOR_EACH (e, lru_node, &ml->lrus) {
+            struct mac_entry **bucket = &table->buckets[e->hash & table->mask];
+
+            e->hash_next = *bucket;
+            *bucket = e;
+        }
+        mac_table_destroy(ml->table);
+        ml->table = table;
+    }
+    mac_learning_unlock(ml);
 }
 
 static bool
 is_learning_vlan(const struct mac_learning *ml, uint16_t vlan)
 {
-    return !ml->flood_vlans || !bitmap_is_set(ml->flood_vlans, vlan);
+    return !ml->has_flood_vlans || !bitmap_is_set(ml->flood_vlans, vlan);
 }
 
 /* Returns true if 'src_mac' may be learned on 'vlan' for 'ml'.
@@ -203,6 +356,217 @@ mac_learning_may_learn(const struct mac_learning *ml,
     return ml && is_learning_vlan(ml, vlan) && !eth_addr_is_multicast(src_mac);
 }
 
+/* Removes entries from the front of 'ml''s LRU list as long as it has more
+ * than the maximum number of entries or, if 'expire' is true, as long as the
+ * front entry has expired.  Adds the tags of removed entries to 'tags', if it
+ * is nonnull.
+ *
+ * The caller must not hold any of 'ml''s locks. */
+static void
+mac_learning_trim(struct mac_learning *ml, bool expire, struct tag_set *tags)
+{
+    time_t now = time_now();
+
+    for (;;) {
+        struct mac_stripe *stripe;
+        struct mac_entry *e;
+        bool done = false;
+
+        /* Find the stripe of the front entry.  Then, to respect the locking
+         * order, drop 'lru_mutex' and take it again after the stripe lock.
+         * The front entry might change in the meantime, in which case we
+         * just try again. */
+        pthread_mutex_lock(&ml->lru_mutex);
+        if (list_is_empty(&ml->lrus)) {
+            pthread_mutex_unlock(&ml->lru_mutex);
+            break;
+        }
+        e = mac_entry_from_lru_node(ml->lrus.next);
+        stripe = mac_stripe(ml, e->hash);
+        pthread_mutex_unlock(&ml->lru_mutex);
+
+        pthread_rwlock_wrlock(&stripe->rwlock);
+        pthread_mutex_lock(&ml->lru_mutex);
+        if (list_is_empty(&ml->lrus)) {
+            done = true;
+        } else {
+            e = mac_entry_from_lru_node(ml->lrus.next);
+            if (mac_stripe(ml, e->hash) != stripe) {
+                /* Try again. */
+            } else if (ml->n_entries > ml->max_entries
+                       || (expire && now >= e->expires)) {
+                if (expire && now >= e->expires) {
+                    COVERAGE_INC(mac_learning_expired);
+                }
+                if (tags) {
+                    tag_set_add(tags, e->tag);
+                }
+                mac_entry_remove(ml, e);
+            } else {
+                done = true;
+            }
+        }
+        pthread_mutex_unlock(&ml->lru_mutex);
+        pthread_rwlock_unlock(&stripe->rwlock);
+
+        if (done) {
+            break;
+        }
+    }
+}
+
+/* Learns that 'src_mac' in 'vlan' is on 'port', inserting a new entry into
+ * 'ml' or updating the existing one as necessary, and refreshes the entry's
+ * age.  The caller must have already verified, by calling
+ * mac_learning_may_learn(), that 'src_mac' and 'vlan' are learnable.
+ *
+ * 'grat_arp' says whether the packet that 'src_mac' came from is a gratuitous
+ * ARP and, if so, whether to lock the entry against changes (for a packet
+ * received on a non-bond port) or to leave the entry alone if it is locked
+ * (for one received on a bond).
+ *
+ * If the learned port changed, or if 'src_mac' was not known before, returns
+ * the tag that flows using the old information were tagged with.  Otherwise,
+ * returns 0.
+ *
+ * This function is thread-safe.  See the comment at the top of
+ * mac-learning.h. */
+tag_type
+mac_learning_update(struct mac_learning *ml,
+                    const uint8_t src_mac[ETH_ADDR_LEN], uint16_t vlan,
+                    void *port, enum mac_grat_arp grat_arp)
+{
+    uint32_t hash = mac_table_hash(ml, src_mac, vlan);
+    struct mac_stripe *stripe = mac_stripe(ml, hash);
+    tag_type old_tag = 0;
+    struct mac_entry *e;
+    time_t now = time_now();
+    bool overflow = false;
+    bool changed = false;
+    bool unchanged;
+
+    /* Fast path: the entry exists, does not need to change, and was already
+     * refreshed this second, so a read lock suffices. */
+    pthread_rwlock_rdlock(&stripe->rwlock);
+    e = mac_entry_lookup(ml, hash, src_mac, vlan);
+    unchanged = (e && grat_arp != MAC_GRAT_ARP_LOCK
+                 && (e->port.p == port
+                     || (grat_arp == MAC_GRAT_ARP_CHECK
+                         && mac_entry_is_grat_arp_locked(e)))
+                 && e->expires == now + ml->idle_time);
+    pthread_rwlock_unlock(&stripe->rwlock);
+    if (unchanged) {
+        return 0;
+    }
+
+    /* Slow path. */
+    pthread_rwlock_wrlock(&stripe->rwlock);
+    e = mac_entry_lookup(ml, hash, src_mac, vlan);
+    if (!e) {
+        pthread_mutex_lock(&ml->lru_mutex);
+        e = mac_entry_create(ml, hash, src_mac, vlan, now);
+        overflow = ml->n_entries > ml->max_entries;
+        pthread_mutex_unlock(&ml->lru_mutex);
+    } else if (grat_arp == MAC_GRAT_ARP_CHECK
+               && mac_entry_is_grat_arp_locked(e)) {
+        mac_entry_refresh(ml, e, now);
+        goto out;
+    }
+
+    if (grat_arp == MAC_GRAT_ARP_LOCK) {
+        mac_entry_set_grat_arp_lock(e);
+        changed = true;
+    }
+
+    if (mac_entry_is_new(e) || e->port.p != port) {
+        old_tag = mac_learning_changed(ml, e);
+        e->port.p = port;
+        changed = true;
+    }
+
+    if (changed) {
+        /* Always make a new or changed entry the most recently used, even if
+         * it was already refreshed this second. */
+        pthread_mutex_lock(&ml->lru_mutex);
+        mac_entry_make_mru(ml, e, now);
+        pthread_mutex_unlock(&ml->lru_mutex);
+    } else {
+        mac_entry_refresh(ml, e, now);
+    }
+
+out:
+    pthread_rwlock_unlock(&stripe->rwlock);
+
+    if (overflow) {
+        mac_learning_trim(ml, false, NULL);
+    }
+    return old_tag;
+}
+
+/* Looks up MAC 'dst' for VLAN 'vlan' in 'ml'.  If it is present, stores a
+ * copy of its entry in '*info' and returns true, otherwise returns false.  If
+ * 'tag' is nonnull, then the tag that associates 'dst' and 'vlan' with its
+ * currently learned port will be OR'd into '*tag'.
+ *
+ * This function is thread-safe.  See the comment at the top of
+ * mac-learning.h. */
+bool
+mac_learning_get(const struct mac_learning *ml,
+                 const uint8_t dst[ETH_ADDR_LEN], uint16_t vlan,
+                 struct mac_entry_info *info, tag_type *tag)
+{
+    struct mac_stripe *stripe;
+    struct mac_entry *e;
+    uint32_t hash;
+    bool found;
+
+    if (eth_addr_is_multicast(dst) || !is_learning_vlan(ml, vlan)) {
+        /* See mac_learning_lookup() for why there is no tag. */
+        return false;
+    }
+
+    hash = mac_table_hash(ml, dst, vlan);
+    stripe = mac_stripe(ml, hash);
+    pthread_rwlock_rdlock(&stripe->rwlock);
+    e = mac_entry_lookup(ml, hash, dst, vlan);
+    found = e != NULL;
+    if (found) {
+        info->port = e->port.p;
+        info->grat_arp_lock = e->grat_arp_lock;
+        info->tag = e->tag;
+    }
+    pthread_rwlock_unlock(&stripe->rwlock);
+
+    if (tag) {
+        *tag |= found ? info->tag : make_unknown_mac_tag(ml, dst, vlan);
+    }
+    return found;
+}
+
+/* Gives the caller exclusive access to 'ml', for using the functions that work
+ * with "struct mac_entry" pointers and for iterating through 'ml->lrus'.  Other
+ * threads' mac_learning_get() and mac_learning_update() calls wait until the
+ * caller calls mac_learning_unlock(). */
+void
+mac_learning_lock(struct mac_learning *ml)
+{
+    int i;
+
+    for (i = 0; i < MAC_LEARNING_N_STRIPES; i++) {
+        pthread_rwlock_wrlock(&ml->stripes[i].rwlock);
+    }
+}
+
+void
+mac_learning_unlock(struct mac_learning *ml)
+{
+    int i;
+
+    for (i = MAC_LEARNING_N_STRIPES - 1; i >= 0; i--) {
+        pthread_rwlock_unlock(&ml->stripes[i].rwlock);
+    }
+}
+
 /* Searches 'ml' for and returns a MAC learning entry for 'src_mac' in 'vlan',
  * inserting a new entry if necessary.  The caller must have already verified,
  * by calling mac_learning_may_learn(), that 'src_mac' and 'vlan' are
@@ -212,35 +576,30 @@ mac_learning_may_learn(const struct mac_learning *ml,
  * mac_entry_is_new()), then the caller must pass the new entry to
  * mac_learning_changed().  The caller must also initialize the new entry's
  * 'port' member.  Otherwise calling those functions is at the caller's
- * discretion. */
+ * discretion.
+ *
+ * The caller must hold mac_learning_lock(), unless no other thread is using
+ * 'ml'. */
 struct mac_entry *
 mac_learning_insert(struct mac_learning *ml,
                     const uint8_t src_mac[ETH_ADDR_LEN], uint16_t vlan)
 {
+    uint32_t hash = mac_table_hash(ml, src_mac, vlan);
+    time_t now = time_now();
     struct mac_entry *e;
 
-    e = mac_entry_lookup(ml, src_mac, vlan);
+    pthread_mutex_lock(&ml->lru_mutex);
+    e = mac_entry_lookup(ml, hash, src_mac, vlan);
     if (!e) {
-        uint32_t hash = mac_table_hash(ml, src_mac, vlan);
-
-        if (hmap_count(&ml->table) >= ml->max_entries) {
-            get_lru(ml, &e);
-            mac_learning_expire(ml, e);
+        if (ml->n_entries >= ml->max_entries && !list_is_empty(&ml->lrus)) {
+            mac_entry_remove(ml, mac_entry_from_lru_node(ml->lrus.next));
         }
-
-        e = xmalloc(sizeof *e);
-        hmap_insert(&ml->table, &e->hmap_node, hash);
-        memcpy(e->mac, src_mac, ETH_ADDR_LEN);
-        e->vlan = vlan;
-        e->tag = 0;
-        e->grat_arp_lock = TIME_MIN;
+        e = mac_entry_create(ml, hash, src_mac, vlan, now);
     } else {
-        list_remove(&e->lru_node);
+        /* Mark 'e' as recently used. */
+        mac_entry_make_mru(ml, e, now);
     }
-
-    /* Mark 'e' as recently used. */
-    list_push_back(&ml->lrus, &e->lru_node);
-    e->expires = time_now() + ml->idle_time;
+    pthread_mutex_unlock(&ml->lru_mutex);
 
     return e;
 }
@@ -266,7 +625,10 @@ mac_learning_changed(struct mac_learning *ml, struct mac_entry *e)
 /* Looks up MAC 'dst' for VLAN 'vlan' in 'ml' and returns the associated MAC
  * learning entry, if any.  If 'tag' is nonnull, then the tag that associates
  * 'dst' and 'vlan' with its currently learned port will be OR'd into
- * '*tag'. */
+ * '*tag'.
+ *
+ * The caller must hold mac_learning_lock(), unless no other thread is using
+ * 'ml'.  mac_learning_get() is the thread-safe alternative. */
 struct mac_entry *
 mac_learning_lookup(const struct mac_learning *ml,
                     const uint8_t dst[ETH_ADDR_LEN], uint16_t vlan,
@@ -281,7 +643,8 @@ mac_learning_lookup(const struct mac_learning *ml,
          * rarely that we revalidate every flow when it changes. */
         return NULL;
     } else {
-        struct mac_entry *e = mac_entry_lookup(ml, dst, vlan);
+        uint32_t hash = mac_table_hash(ml, dst, vlan);
+        struct mac_entry *e = mac_entry_lookup(ml, hash, dst, vlan);
 
         ovs_assert(e == NULL || e->tag != 0);
         if (tag) {
@@ -292,13 +655,16 @@ mac_learning_lookup(const struct mac_learning *ml,
     }
 }
 
-/* Expires 'e' from the 'ml' hash table. */
+/* Expires 'e' from the 'ml' hash table.
+ *
+ * The caller must hold mac_learning_lock(), unless no other thread is using
+ * 'ml'. */
 void
 mac_learning_expire(struct mac_learning *ml, struct mac_entry *e)
 {
-    hmap_remove(&ml->table, &e->hmap_node);
-    list_remove(&e->lru_node);
-    free(e);
+    pthread_mutex_lock(&ml->lru_mutex);
+    mac_entry_remove(ml, e);
+    pthread_mutex_unlock(&ml->lru_mutex);
 }
 
 /* Expires all the mac-learning entries in 'ml'.  If not NULL, the tags in 'ml'
@@ -308,38 +674,35 @@ mac_learning_expire(struct mac_learning *ml, struct mac_entry *e)
 void
 mac_learning_flush(struct mac_learning *ml, struct tag_set *tags)
 {
-    struct mac_entry *e;
-    while (get_lru(ml, &e)){
+    mac_learning_lock(ml);
+    pthread_mutex_lock(&ml->lru_mutex);
+    while (!list_is_empty(&ml->lrus)) {
+        struct mac_entry *e = mac_entry_from_lru_node(ml->lrus.next);
+
         if (tags) {
             tag_set_add(tags, e->tag);
         }
-        mac_learning_expire(ml, e);
+        mac_entry_remove(ml, e);
     }
-    hmap_shrink(&ml->table);
+    pthread_mutex_unlock(&ml->lru_mutex);
+    mac_learning_unlock(ml);
 }
 
 void
 mac_learning_run(struct mac_learning *ml, struct tag_set *set)
 {
-    struct mac_entry *e;
-    while (get_lru(ml, &e)
-           && (hmap_count(&ml->table) > ml->max_entries
-               || time_now() >= e->expires)) {
-        COVERAGE_INC(mac_learning_expired);
-        if (set) {
-            tag_set_add(set, e->tag);
-        }
-        mac_learning_expire(ml, e);
-    }
+    mac_learning_trim(ml, true, set);
 }
 
 void
 mac_learning_wait(struct mac_learning *ml)
 {
-    if (hmap_count(&ml->table) > ml->max_entries) {
+    pthread_mutex_lock(&ml->lru_mutex);
+    if (ml->n_entries > ml->max_entries) {
         poll_immediate_wake();
     } else if (!list_is_empty(&ml->lrus)) {
         struct mac_entry *e = mac_entry_from_lru_node(ml->lrus.next);
         poll_timer_wait_until(e->expires * 1000LL);
     }
+    pthread_mutex_unlock(&ml->lru_mutex);
 }
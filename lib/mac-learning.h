@@ -17,13 +17,40 @@
 #ifndef MAC_LEARNING_H
 #define MAC_LEARNING_H 1
 
+#include <pthread.h>
 #include <time.h>
-#include "hmap.h"
+#include "bitmap.h"
 #include "list.h"
 #include "packets.h"
 #include "tag.h"
 #include "timeval.h"
 
+/* MAC learning table.
+ *
+ * Thread-safety
+ * =============
+ *
+ * Any number of threads may call mac_learning_may_learn(), mac_learning_get(),
+ * and mac_learning_update() concurrently with each other and with any other
+ * function.  mac_learning_get() only read-locks the stripe of the table that
+ * holds the entry.  So does mac_learning_update() when a packet merely
+ * confirms what the table already knows and the entry was already refreshed
+ * within the current second, which is the common case.  Otherwise,
+ * mac_learning_update() write-locks the entry's stripe.
+ *
+ * mac_learning_run(), mac_learning_wait(), mac_learning_flush(), and the
+ * configuration functions take whatever locks they need.  They must be called
+ * from the single thread that owns 'ml' (in ofproto-dpif, the main thread).
+ *
+ * The remaining functions, which return or take pointers to "struct
+ * mac_entry", as well as iteration over 'lrus', require the owning thread to
+ * hold mac_learning_lock(), unless no other thread can be using 'ml'.  While
+ * that lock is held, mac_learning_get() in other threads waits.
+ *
+ * 'lrus' is in order of the time at which each entry was last learned or
+ * refreshed, to the nearest second.  Entries refreshed within the same second
+ * keep their relative order. */
+
 struct mac_learning;
 
 /* Default maximum size of a MAC learning table, in entries. */
@@ -36,9 +63,14 @@ struct mac_learning;
  * relearning based on a reflection from a bond slave. */
 #define MAC_GRAT_ARP_LOCK_TIME 5
 
+/* Number of independently locked stripes in a MAC learning table.  Must be a
+ * power of 2. */
+#define MAC_LEARNING_N_STRIPES 16
+
 /* A MAC learning table entry. */
 struct mac_entry {
-    struct hmap_node hmap_node; /* Node in a mac_learning hmap. */
+    struct mac_entry *hash_next; /* Next entry in hash chain. */
+    uint32_t hash;              /* Hash of 'mac' and 'vlan'. */
     struct list lru_node;       /* Element in 'lrus' list. */
     time_t expires;             /* Expiration time. */
     time_t grat_arp_lock;       /* Gratuitous ARP lock expiration time. */
@@ -76,13 +108,49 @@ static inline bool mac_entry_is_grat_arp_locked(const struct mac_entry *mac)
     return time_now() < mac->grat_arp_lock;
 }
 
+/* A copy of the parts of a MAC learning entry that mac_learning_get()
+ * returns. */
+struct mac_entry_info {
+    void *port;                 /* Learned port. */
+    time_t grat_arp_lock;       /* Gratuitous ARP lock expiration time. */
+    tag_type tag;               /* Tag for the learned port. */
+};
+
+/* Returns true if a gratuitous ARP lock is in effect on 'info'. */
+static inline bool
+mac_entry_info_is_grat_arp_locked(const struct mac_entry_info *info)
+{
+    return time_now() < info->grat_arp_lock;
+}
+
+/* How mac_learning_update() treats a packet with respect to gratuitous ARP
+ * locks. */
+enum mac_grat_arp {
+    MAC_GRAT_ARP_NONE,          /* Not a gratuitous ARP: ignore locks. */
+    MAC_GRAT_ARP_LOCK,          /* Learn, then lock the entry. */
+    MAC_GRAT_ARP_CHECK          /* Learn only if the entry is not locked. */
+};
+
+/* One stripe of a MAC learning table's hash buckets.  Stripe 'i' covers the
+ * buckets whose indexes are congruent to 'i' modulo MAC_LEARNING_N_STRIPES. */
+struct mac_stripe {
+    pthread_rwlock_t rwlock;
+};
+
 /* MAC learning table. */
 struct mac_learning {
-    struct hmap table;          /* Learning table. */
+    struct mac_table *table;    /* Hash buckets. */
+    struct mac_stripe stripes[MAC_LEARNING_N_STRIPES];
+
+    pthread_mutex_t lru_mutex;  /* Protects the members below. */
     struct list lrus;           /* In-use entries, least recently used at the
                                    front, most recently used at the back. */
+    size_t n_entries;           /* Number of entries in 'lrus'. */
+
     uint32_t secret;            /* Secret for randomizing hash table. */
-    unsigned long *flood_vlans; /* Bitmap of learning disabled VLANs. */
+    bool has_flood_vlans;       /* Is learning disabled on any VLAN? */
+    unsigned long flood_vlans[DIV_ROUND_UP(4096, BITMAP_ULONG_BITS)];
+                                /* Bitmap of learning disabled VLANs. */
     unsigned int idle_time;     /* Max age before deleting an entry. */
     size_t max_entries;         /* Max number of learned MACs. */
 };
@@ -100,10 +168,22 @@ bool mac_learning_set_flood_vlans(struct mac_learning *,
 void mac_learning_set_idle_time(struct mac_learning *, unsigned int idle_time);
 void mac_learning_set_max_entries(struct mac_learning *, size_t max_entries);
 
-/* Learning. */
+/* Thread-safe learning and lookup. */
 bool mac_learning_may_learn(const struct mac_learning *,
                             const uint8_t src_mac[ETH_ADDR_LEN],
                             uint16_t vlan);
+tag_type mac_learning_update(struct mac_learning *,
+                             const uint8_t src_mac[ETH_ADDR_LEN],
+                             uint16_t vlan, void *port, enum mac_grat_arp);
+bool mac_learning_get(const struct mac_learning *,
+                      const uint8_t dst[ETH_ADDR_LEN], uint16_t vlan,
+                      struct mac_entry_info *, tag_type *);
+
+/* Exclusive access. */
+void mac_learning_lock(struct mac_learning *);
+void mac_learning_unlock(struct mac_learning *);
+
+/* Learning. */
 struct mac_entry *mac_learning_insert(struct mac_learning *,
                                       const uint8_t src[ETH_ADDR_LEN],
                                       uint16_t vlan);
@@ -1267,6 +1267,7 @@ const struct netdev_class netdev_bsd_class = {
     netdev_bsd_drain,
 
     netdev_bsd_send,
+    NULL,                       /* send_batch */
     netdev_bsd_send_wait,
 
     netdev_bsd_set_etheraddr,
@@ -1328,6 +1329,7 @@ const struct netdev_class netdev_tap_class = {
     netdev_bsd_drain,
 
     netdev_bsd_send,
+    NULL,                       /* send_batch */
     netdev_bsd_send_wait,
 
     netdev_bsd_set_etheraddr,
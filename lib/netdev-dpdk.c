@@ -1124,6 +1124,7 @@ static struct netdev_class netdev_dpdk_class = {
     NULL,                       /* get_tunnel_config */
 
     netdev_dpdk_send,           /* send */
+    NULL,                       /* send_batch */
     NULL,                       /* send_wait */
 
     netdev_dpdk_set_etheraddr,
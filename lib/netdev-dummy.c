@@ -20,6 +20,7 @@
 
 #include <errno.h>
 
+#include "csum.h"
 #include "flow.h"
 #include "list.h"
 #include "netdev-provider.h"
@@ -28,9 +29,13 @@
 #include "ofp-print.h"
 #include "ofpbuf.h"
 #include "packets.h"
+#include "pcap-file.h"
 #include "poll-loop.h"
+#include "random.h"
 #include "shash.h"
+#include "smap.h"
 #include "sset.h"
+#include "token-bucket.h"
 #include "unixctl.h"
 #include "vlog.h"
 
@@ -52,6 +57,38 @@ struct netdev_dev_dummy {
 
     struct list devs;           /* List of child "netdev_dummy"s. */
     int ifindex;
+    struct in_addr address, netmask; /* IPv4 address, if 'address' nonzero. */
+
+    /* Traffic source configured through "options", if any. */
+    struct dummy_source *source;
+};
+
+/* How a dummy_source chooses the next packet to send. */
+enum dummy_source_dist {
+    DUMMY_DIST_SEQUENTIAL,      /* Each packet in turn. */
+    DUMMY_DIST_RANDOM,          /* Uniformly at random. */
+    DUMMY_DIST_ZIPF             /* Zipf distribution, packet 0 most likely. */
+};
+
+/* A traffic source that makes a dummy netdev receive packets as fast as the
+ * datapath polls it (or at a fixed rate), without a unixctl round trip for
+ * each packet.  The packets come from a pcap file replayed in a loop or from
+ * a set of synthesized flows, and are all held in memory. */
+struct dummy_source {
+    struct smap options;        /* Options that created this source. */
+
+    struct ofpbuf **packets;    /* Packets to send. */
+    size_t n_packets;
+    size_t next;                /* Next packet for DUMMY_DIST_SEQUENTIAL. */
+
+    enum dummy_source_dist dist;
+    uint32_t *zipf_cdf;         /* For DUMMY_DIST_ZIPF, scaled to UINT32_MAX. */
+
+    unsigned long long int remaining; /* Packets left, if 'limited'. */
+    bool limited;
+
+    struct token_bucket bucket; /* Rate limit, if 'rate' is nonzero. */
+    unsigned int rate;          /* In packets per second. */
 };
 
 struct netdev_dummy {
@@ -71,6 +108,16 @@ static int netdev_dev_dummy_update_flags(struct netdev_dev_dummy *,
                                          enum netdev_flags off,
                                          enum netdev_flags on,
                                          enum netdev_flags *old_flagsp);
+static int dummy_source_create(const struct smap *args,
+                               struct dummy_source **);
+static void dummy_source_destroy(struct dummy_source *);
+static bool dummy_source_matches(const struct dummy_source *,
+                                 const struct smap *args);
+static void dummy_source_get_config(const struct dummy_source *,
+                                    struct smap *args);
+static int dummy_source_recv(struct netdev_dev_dummy *, void *buffer,
+                             size_t size);
+static void dummy_source_wait(struct dummy_source *);
 
 static bool
 is_dummy_class(const struct netdev_class *class)
@@ -130,6 +177,7 @@ netdev_dummy_destroy(struct netdev_dev *netdev_dev_)
 
     shash_find_and_delete(&dummy_netdev_devs,
                           netdev_dev_get_name(netdev_dev_));
+    dummy_source_destroy(netdev_dev->source);
     free(netdev_dev);
 }
 
@@ -141,6 +189,9 @@ netdev_dummy_get_config(struct netdev_dev *netdev_dev_, struct smap *args)
     if (netdev_dev->ifindex >= 0) {
         smap_add_format(args, "ifindex", "%d", netdev_dev->ifindex);
     }
+    if (netdev_dev->source) {
+        dummy_source_get_config(netdev_dev->source, args);
+    }
     return 0;
 }
 
@@ -149,9 +200,25 @@ netdev_dummy_set_config(struct netdev_dev *netdev_dev_,
                         const struct smap *args)
 {
     struct netdev_dev_dummy *netdev_dev = netdev_dev_dummy_cast(netdev_dev_);
+    int error;
 
     netdev_dev->ifindex = smap_get_int(args, "ifindex", -EOPNOTSUPP);
-    return 0;
+
+    /* Recreate the traffic source only if its options changed, so that
+     * unrelated reconfiguration does not reload a pcap file or restart a
+     * source that sends a limited number of packets. */
+    if (netdev_dev->source
+        && dummy_source_matches(netdev_dev->source, args)) {
+        return 0;
+    }
+
+    dummy_source_destroy(netdev_dev->source);
+    error = dummy_source_create(args, &netdev_dev->source);
+    if (error) {
+        VLOG_WARN("%s: could not configure traffic source (%s)",
+                  netdev_dev_get_name(netdev_dev_), strerror(error));
+    }
+    return error;
 }
 
 static int
@@ -195,7 +262,10 @@ netdev_dummy_recv(struct netdev *netdev_, void *buffer, size_t size)
     size_t packet_size;
 
     if (list_is_empty(&netdev->recv_queue)) {
-        return -EAGAIN;
+        struct netdev_dev_dummy *dev =
+            netdev_dev_dummy_cast(netdev_get_dev(netdev_));
+
+        return dev->source ? dummy_source_recv(dev, buffer, size) : -EAGAIN;
     }
 
     packet = ofpbuf_from_list(list_pop_front(&netdev->recv_queue));
@@ -216,6 +286,13 @@ netdev_dummy_recv_wait(struct netdev *netdev_)
     struct netdev_dummy *netdev = netdev_dummy_cast(netdev_);
     if (!list_is_empty(&netdev->recv_queue)) {
         poll_immediate_wake();
+    } else {
+        struct netdev_dev_dummy *dev =
+            netdev_dev_dummy_cast(netdev_get_dev(netdev_));
+
+        if (dev->source) {
+            dummy_source_wait(dev->source);
+        }
     }
 }
 
@@ -266,6 +343,35 @@ netdev_dummy_get_etheraddr(const struct netdev *netdev,
     return 0;
 }
 
+static int
+netdev_dummy_get_in4(const struct netdev *netdev, struct in_addr *address,
+                     struct in_addr *netmask)
+{
+    const struct netdev_dev_dummy *dev =
+        netdev_dev_dummy_cast(netdev_get_dev(netdev));
+
+    if (!dev->address.s_addr) {
+        return EADDRNOTAVAIL;
+    }
+    *address = dev->address;
+    *netmask = dev->netmask;
+    return 0;
+}
+
+static int
+netdev_dummy_set_in4(struct netdev *netdev, struct in_addr address,
+                     struct in_addr netmask)
+{
+    struct netdev_dev_dummy *dev =
+        netdev_dev_dummy_cast(netdev_get_dev(netdev));
+
+    dev->address = address;
+    dev->netmask = netmask;
+    netdev_dev_dummy_poll_notify(dev);
+
+    return 0;
+}
+
 static int
 netdev_dummy_get_mtu(const struct netdev *netdev, int *mtup)
 {
@@ -361,6 +467,355 @@ netdev_dev_dummy_poll_notify(struct netdev_dev_dummy *dev)
     }
 }
 
+/* Traffic sources.
+ *
+ * A dummy netdev with one of the following options receives packets from an
+ * in-memory dummy_source whenever its recv_queue is empty:
+ *
+ *   - "replay_pcap=FILE" replays the packets in pcap file FILE in a loop.
+ *
+ *   - "gen_flows=N" sends UDP packets in N different flows, which differ in
+ *     their IPv4 source address (10.0.0.0 plus the flow number).  The
+ *     "gen_size" option sets their size in bytes, including the Ethernet
+ *     header, from 60 (the default) to 65535.
+ *
+ * Further options apply to either kind of source:
+ *
+ *   - "source_dist" chooses the next packet "sequential"ly (the default),
+ *     "random"ly, or with a "zipf" distribution that favors the first packets
+ *     in the file or the lowest-numbered flows.
+ *
+ *   - "source_rate=PPS" limits the source to PPS packets per second.
+ *     Otherwise, every poll of the netdev yields a packet.
+ *
+ *   - "source_count=N" stops the source after it sends N packets.
+ */
+
+static const char *const dummy_source_keys[] = {
+    "replay_pcap", "gen_flows", "gen_size",
+    "source_dist", "source_rate", "source_count",
+};
+
+static int
+dummy_source_load_pcap(struct dummy_source *source, const char *file_name)
+{
+    size_t allocated_packets = 0;
+    FILE *file;
+    int error;
+
+    file = pcap_open(file_name, "rb");
+    if (!file) {
+        return EINVAL;
+    }
+
+    error = 0;
+    for (;;) {
+        struct ofpbuf *packet;
+        int c;
+
+        /* Check for end of file here, so that pcap_read() does not log a
+         * warning at the end of every file. */
+        c = getc(file);
+        if (c == EOF) {
+            break;
+        }
+        ungetc(c, file);
+
+        error = pcap_read(file, &packet);
+        if (error) {
+            error = error == EOF ? EINVAL : error;
+            break;
+        }
+
+        if (source->n_packets >= allocated_packets) {
+            source->packets = x2nrealloc(source->packets, &allocated_packets,
+                                         sizeof *source->packets);
+        }
+        source->packets[source->n_packets++] = packet;
+    }
+    fclose(file);
+
+    if (!error && !source->n_packets) {
+        VLOG_WARN("%s: pcap file contains no packets", file_name);
+        error = EINVAL;
+    }
+    return error;
+}
+
+static struct ofpbuf *
+dummy_source_compose(uint32_t flow_id, size_t size)
+{
+    static const uint8_t eth_src[ETH_ADDR_LEN] = {
+        0x50, 0x54, 0x00, 0x00, 0x00, 0x01
+    };
+    static const uint8_t eth_dst[ETH_ADDR_LEN] = {
+        0x50, 0x54, 0x00, 0x00, 0x00, 0x02
+    };
+    struct ofpbuf *packet;
+    struct udp_header *udp;
+    struct ip_header *ip;
+    struct flow flow;
+
+    memset(&flow, 0, sizeof flow);
+    memcpy(flow.dl_src, eth_src, ETH_ADDR_LEN);
+    memcpy(flow.dl_dst, eth_dst, ETH_ADDR_LEN);
+    flow.dl_type = htons(ETH_TYPE_IP);
+    flow.nw_src = htonl(0x0a000000 + flow_id);
+    flow.nw_dst = htonl(0xc0a80001);
+    flow.nw_proto = IPPROTO_UDP;
+    flow.nw_ttl = 64;
+    flow.tp_src = htons(1024);
+    flow.tp_dst = htons(2048);
+
+    packet = ofpbuf_new(size);
+    flow_compose(packet, &flow);
+    if (packet->size < size) {
+        ofpbuf_put_zeros(packet, size - packet->size);
+    }
+
+    /* flow_compose() does not know about the padding. */
+    ip = packet->l3;
+    ip->ip_tot_len = htons((char *) ofpbuf_tail(packet) - (char *) ip);
+    ip->ip_csum = 0;
+    ip->ip_csum = csum(ip, sizeof *ip);
+    udp = packet->l4;
+    udp->udp_len = htons((char *) ofpbuf_tail(packet) - (char *) udp);
+
+    return packet;
+}
+
+static void
+dummy_source_init_zipf(struct dummy_source *source)
+{
+    double total, sum;
+    size_t i;
+
+    total = 0.0;
+    for (i = 0; i < source->n_packets; i++) {
+        total += 1.0 / (i + 1);
+    }
+
+    source->zipf_cdf = xmalloc(source->n_packets * sizeof *source->zipf_cdf);
+    sum = 0.0;
+    for (i = 0; i < source->n_packets; i++) {
+        sum += 1.0 / (i + 1);
+        source->zipf_cdf[i] = sum / total * UINT32_MAX;
+    }
+    source->zipf_cdf[source->n_packets - 1] = UINT32_MAX;
+}
+
+static int
+dummy_source_create(const struct smap *args, struct dummy_source **sourcep)
+{
+    const char *pcap_file = smap_get(args, "replay_pcap");
+    const char *n_flows_s = smap_get(args, "gen_flows");
+    const char *dist = smap_get(args, "source_dist");
+    const char *count = smap_get(args, "source_count");
+    struct dummy_source *source;
+    unsigned int n_flows;
+    int rate, error;
+    size_t i;
+
+    *sourcep = NULL;
+    if (!pcap_file && !n_flows_s) {
+        return 0;
+    }
+
+    source = xzalloc(sizeof *source);
+    smap_init(&source->options);
+    for (i = 0; i < ARRAY_SIZE(dummy_source_keys); i++) {
+        const char *value = smap_get(args, dummy_source_keys[i]);
+        if (value) {
+            smap_add(&source->options, dummy_source_keys[i], value);
+        }
+    }
+
+    error = EINVAL;
+    if (!dist || !strcmp(dist, "sequential")) {
+        source->dist = DUMMY_DIST_SEQUENTIAL;
+    } else if (!strcmp(dist, "random")) {
+        source->dist = DUMMY_DIST_RANDOM;
+    } else if (!strcmp(dist, "zipf")) {
+        source->dist = DUMMY_DIST_ZIPF;
+    } else {
+        goto error;
+    }
+
+    rate = smap_get_int(args, "source_rate", 0);
+    if (rate < 0) {
+        goto error;
+    } else if (rate) {
+        /* The bucket holds 1000 tokens per packet and up to 10 ms of
+         * traffic. */
+        source->rate = rate;
+        token_bucket_init(&source->bucket, rate,
+                          MAX(1000, MIN(UINT_MAX / 10, rate) * 10));
+    }
+
+    if (count) {
+        if (!str_to_ullong(count, 10, &source->remaining)) {
+            goto error;
+        }
+        source->limited = true;
+    }
+
+    if (pcap_file && n_flows_s) {
+        goto error;
+    } else if (pcap_file) {
+        error = dummy_source_load_pcap(source, pcap_file);
+        if (error) {
+            goto error;
+        }
+    } else {
+        int size = smap_get_int(args, "gen_size", ETH_TOTAL_MIN);
+
+        if (!str_to_uint(n_flows_s, 10, &n_flows)
+            || !n_flows || n_flows > 1u << 24
+            || size < ETH_TOTAL_MIN || size > UINT16_MAX) {
+            goto error;
+        }
+        source->packets = xmalloc(n_flows * sizeof *source->packets);
+        for (i = 0; i < n_flows; i++) {
+            source->packets[i] = dummy_source_compose(i, size);
+        }
+        source->n_packets = n_flows;
+    }
+
+    if (source->dist == DUMMY_DIST_ZIPF) {
+        dummy_source_init_zipf(source);
+    }
+
+    *sourcep = source;
+    return 0;
+
+error:
+    dummy_source_destroy(source);
+    return error;
+}
+
+static void
+dummy_source_destroy(struct dummy_source *source)
+{
+    if (source) {
+        size_t i;
+
+        for (i = 0; i < source->n_packets; i++) {
+            ofpbuf_delete(source->packets[i]);
+        }
+        free(source->packets);
+        free(source->zipf_cdf);
+        smap_destroy(&source->options);
+        free(source);
+    }
+}
+
+/* Returns true if 'args' would create a source identical to 'source'. */
+static bool
+dummy_source_matches(const struct dummy_source *source,
+                     const struct smap *args)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(dummy_source_keys); i++) {
+        const char *a = smap_get(&source->options, dummy_source_keys[i]);
+        const char *b = smap_get(args, dummy_source_keys[i]);
+
+        if (a ? !b || strcmp(a, b) : b != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void
+dummy_source_get_config(const struct dummy_source *source, struct smap *args)
+{
+    const struct smap_node *node;
+
+    SMAP_FOR_EACH (node, &source->options) {
+        smap_add(args, node->key, node->value);
+    }
+}
+
+static const struct ofpbuf *
+dummy_source_next(struct dummy_source *source)
+{
+    size_t idx;
+
+    switch (source->dist) {
+    case DUMMY_DIST_SEQUENTIAL:
+        idx = source->next++;
+        if (source->next >= source->n_packets) {
+            source->next = 0;
+        }
+        break;
+
+    case DUMMY_DIST_RANDOM:
+        idx = random_uint32() % source->n_packets;
+        break;
+
+    case DUMMY_DIST_ZIPF: {
+        uint32_t r = random_uint32();
+        size_t low = 0, high = source->n_packets - 1;
+
+        /* Find the first packet whose cumulative probability is >= 'r'. */
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (source->zipf_cdf[mid] < r) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        idx = low;
+        break;
+    }
+
+    default:
+        NOT_REACHED();
+    }
+
+    return source->packets[idx];
+}
+
+static int
+dummy_source_recv(struct netdev_dev_dummy *dev, void *buffer, size_t size)
+{
+    struct dummy_source *source = dev->source;
+    const struct ofpbuf *packet;
+
+    if ((source->limited && !source->remaining)
+        || (source->rate && !token_bucket_withdraw(&source->bucket, 1000))) {
+        return -EAGAIN;
+    }
+
+    packet = dummy_source_next(source);
+    if (source->limited) {
+        source->remaining--;
+    }
+    if (packet->size > size) {
+        return -EMSGSIZE;
+    }
+
+    memcpy(buffer, packet->data, packet->size);
+    dev->stats.rx_packets++;
+    dev->stats.rx_bytes += packet->size;
+
+    return packet->size;
+}
+
+static void
+dummy_source_wait(struct dummy_source *source)
+{
+    if (source->limited && !source->remaining) {
+        /* Nothing more to send. */
+    } else if (source->rate) {
+        token_bucket_wait(&source->bucket, 1000);
+    } else {
+        poll_immediate_wake();
+    }
+}
+
 static const struct netdev_class dummy_class = {
     "dummy",
     NULL,                       /* init */
@@ -382,6 +837,7 @@ static const struct netdev_class dummy_class = {
     netdev_dummy_drain,
 
     netdev_dummy_send,          /* send */
+    NULL,                       /* send_batch */
     NULL,                       /* send_wait */
 
     netdev_dummy_set_etheraddr,
@@ -410,8 +866,8 @@ static const struct netdev_class dummy_class = {
     NULL,                       /* dump_queues */
     NULL,                       /* dump_queue_stats */
 
-    NULL,                       /* get_in4 */
-    NULL,                       /* set_in4 */
+    netdev_dummy_get_in4,
+    netdev_dummy_set_in4,
     NULL,                       /* get_in6 */
     NULL,                       /* add_router */
     NULL,                       /* get_next_hop */
@@ -463,6 +919,41 @@ eth_from_packet_or_flow(const char *s)
     return packet;
 }
 
+/* Queues a copy of 'packet' for reception on each open, listening instance of
+ * 'dummy_dev'.  Returns the number of copies queued. */
+static int
+netdev_dummy_queue_packet__(struct netdev_dev_dummy *dummy_dev,
+                            const struct ofpbuf *packet)
+{
+    struct netdev_dummy *dev;
+    int n_listeners;
+
+    dummy_dev->stats.rx_packets++;
+    dummy_dev->stats.rx_bytes += packet->size;
+
+    n_listeners = 0;
+    LIST_FOR_EACH (dev, node, &dummy_dev->devs) {
+        if (dev->listening) {
+            struct ofpbuf *copy = ofpbuf_new_pooled(packet->size, 0);
+
+            ofpbuf_put(copy, packet->data, packet->size);
+            list_push_back(&dev->recv_queue, &copy->list_node);
+            n_listeners++;
+        }
+    }
+    return n_listeners;
+}
+
+/* Queues a copy of 'packet' to be received on dummy network device 'netdev',
+ * as if by the "netdev-dummy/receive" command.  Returns the number of
+ * listeners that will receive it. */
+int
+netdev_dummy_queue_packet(struct netdev *netdev, const struct ofpbuf *packet)
+{
+    return netdev_dummy_queue_packet__(
+        netdev_dev_dummy_cast(netdev_get_dev(netdev)), packet);
+}
+
 static void
 netdev_dummy_receive(struct unixctl_conn *conn,
                      int argc, const char *argv[], void *aux OVS_UNUSED)
@@ -479,7 +970,6 @@ netdev_dummy_receive(struct unixctl_conn *conn,
 
     n_listeners = 0;
     for (i = 2; i < argc; i++) {
-        struct netdev_dummy *dev;
         struct ofpbuf *packet;
 
         packet = eth_from_packet_or_flow(argv[i]);
@@ -488,17 +978,7 @@ netdev_dummy_receive(struct unixctl_conn *conn,
             return;
         }
 
-        dummy_dev->stats.rx_packets++;
-        dummy_dev->stats.rx_bytes += packet->size;
-
-        n_listeners = 0;
-        LIST_FOR_EACH (dev, node, &dummy_dev->devs) {
-            if (dev->listening) {
-                struct ofpbuf *copy = ofpbuf_clone(packet);
-                list_push_back(&dev->recv_queue, &copy->list_node);
-                n_listeners++;
-            }
-        }
+        n_listeners = netdev_dummy_queue_packet__(dummy_dev, packet);
         ofpbuf_delete(packet);
     }
 
@@ -557,6 +1037,33 @@ netdev_dummy_set_admin_state(struct unixctl_conn *conn, int argc,
     unixctl_command_reply(conn, "OK");
 }
 
+static void
+netdev_dummy_ip4addr(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                     const char *argv[], void *aux OVS_UNUSED)
+{
+    struct netdev_dev_dummy *dummy_dev;
+    ovs_be32 ip;
+    int plen;
+
+    dummy_dev = shash_find_data(&dummy_netdev_devs, argv[1]);
+    if (!dummy_dev) {
+        unixctl_command_reply_error(conn, "Unknown Dummy Interface");
+        return;
+    }
+
+    if (sscanf(argv[2], IP_SCAN_FMT"/%d", IP_SCAN_ARGS(&ip), &plen)
+        != IP_SCAN_COUNT + 1
+        || plen < 0 || plen > 32) {
+        unixctl_command_reply_error(conn, "Invalid IP address/prefix length");
+        return;
+    }
+
+    dummy_dev->address.s_addr = ip;
+    dummy_dev->netmask.s_addr = plen ? htonl(UINT32_MAX << (32 - plen)) : 0;
+    netdev_dev_dummy_poll_notify(dummy_dev);
+    unixctl_command_reply(conn, "OK");
+}
+
 void
 netdev_dummy_register(bool override)
 {
@@ -565,6 +1072,8 @@ netdev_dummy_register(bool override)
     unixctl_command_register("netdev-dummy/set-admin-state",
                              "[netdev] up|down", 1, 2,
                              netdev_dummy_set_admin_state, NULL);
+    unixctl_command_register("netdev-dummy/ip4addr", "NAME IP/PLEN", 2, 2,
+                             netdev_dummy_ip4addr, NULL);
 
     if (override) {
         struct sset types;
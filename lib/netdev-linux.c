@@ -977,6 +977,93 @@ netdev_linux_send(struct netdev *netdev_, const void *data, size_t size)
     }
 }
 
+/* Sends the 'n_packets' packets in 'packets' on 'netdev'.  When the packets
+ * go out through the AF_PACKET socket, this sends up to NETDEV_LINUX_BATCH of
+ * them with each sendmmsg() system call.  Tap devices have no batched write,
+ * so they get one write() per packet as usual. */
+static int
+netdev_linux_send_batch(struct netdev *netdev_, struct ofpbuf **packets,
+                        size_t n_packets)
+{
+    size_t i = 0;
+    int error = 0;
+
+#ifdef HAVE_SENDMMSG
+    if (netdev_linux_cast(netdev_)->fd < 0 && n_packets > 1) {
+        enum { NETDEV_LINUX_BATCH = 32 };
+        struct mmsghdr mmsgs[NETDEV_LINUX_BATCH];
+        struct iovec iovs[NETDEV_LINUX_BATCH];
+        struct sockaddr_ll sll;
+        int ifindex;
+        int sock;
+
+        sock = af_packet_sock();
+        if (sock < 0) {
+            return -sock;
+        }
+
+        error = get_ifindex(netdev_, &ifindex);
+        if (error) {
+            return error;
+        }
+
+        memset(&sll, 0, sizeof sll);
+        sll.sll_family = AF_PACKET;
+        sll.sll_ifindex = ifindex;
+
+        while (i < n_packets) {
+            size_t n = MIN(n_packets - i, NETDEV_LINUX_BATCH);
+            int retval;
+            size_t j;
+
+            memset(mmsgs, 0, n * sizeof *mmsgs);
+            for (j = 0; j < n; j++) {
+                struct msghdr *msg = &mmsgs[j].msg_hdr;
+
+                iovs[j].iov_base = packets[i + j]->data;
+                iovs[j].iov_len = packets[i + j]->size;
+                msg->msg_name = &sll;
+                msg->msg_namelen = sizeof sll;
+                msg->msg_iov = &iovs[j];
+                msg->msg_iovlen = 1;
+            }
+
+            retval = sendmmsg(sock, mmsgs, n, 0);
+            if (retval < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                /* Let netdev_linux_send() sort out the error for the first
+                 * unsent packet, and then try the rest one at a time. */
+                break;
+            }
+
+            for (j = 0; j < retval; j++) {
+                if (mmsgs[j].msg_len != packets[i + j]->size) {
+                    VLOG_WARN_RL(&rl, "sent partial Ethernet packet "
+                                 "(%u bytes of %"PRIuSIZE") on %s",
+                                 mmsgs[j].msg_len, packets[i + j]->size,
+                                 netdev_get_name(netdev_));
+                    if (!error) {
+                        error = EMSGSIZE;
+                    }
+                }
+            }
+            i += retval;
+        }
+    }
+#endif
+
+    for (; i < n_packets; i++) {
+        int retval = netdev_linux_send(netdev_, packets[i]->data,
+                                       packets[i]->size);
+        if (retval && !error) {
+            error = retval;
+        }
+    }
+    return error;
+}
+
 /* Registers with the poll loop to wake up from the next call to poll_block()
  * when the packet transmission queue has sufficient room to transmit a packet
  * with netdev_send().
@@ -2500,6 +2587,7 @@ netdev_linux_change_seq(const struct netdev *netdev)
     netdev_linux_drain,                                         \
                                                                 \
     netdev_linux_send,                                          \
+    netdev_linux_send_batch,                                    \
     netdev_linux_send_wait,                                     \
                                                                 \
     netdev_linux_set_etheraddr,                                 \
@@ -222,6 +222,19 @@ struct netdev_class {
      * working properly over 'netdev'.) */
     int (*send)(struct netdev *netdev, const void *buffer, size_t size);
 
+    /* Sends the 'n_packets' packets in 'packets' on 'netdev', in order, with
+     * as few system calls or device operations as possible.  Returns 0 if
+     * every packet was sent, otherwise the positive errno value that ->send()
+     * would have returned for the first packet that could not be sent.  A
+     * failure does not stop later packets from being attempted.
+     *
+     * The caller retains ownership of the packets in all cases.
+     *
+     * May be null, in which case netdev_send_batch() calls ->send() for each
+     * packet. */
+    int (*send_batch)(struct netdev *netdev, struct ofpbuf **packets,
+                      size_t n_packets);
+
     /* Registers with the poll loop to wake up from the next call to
      * poll_block() when the packet transmission queue for 'netdev' has
      * sufficient room to transmit a packet with netdev_send().
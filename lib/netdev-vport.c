@@ -635,6 +635,7 @@ get_stats(const struct netdev *netdev, struct netdev_stats *stats)
     NULL,                       /* drain */                 \
                                                             \
     NULL,                       /* send */                  \
+    NULL,                       /* send_batch */            \
     NULL,                       /* send_wait */             \
                                                             \
     netdev_vport_set_etheraddr,                             \
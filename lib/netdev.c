@@ -443,6 +443,40 @@ netdev_send(struct netdev *netdev, const struct ofpbuf *buffer)
     return error;
 }
 
+/* Sends the 'n_packets' packets in 'packets' on 'netdev', in order.  This has
+ * the same effect as calling netdev_send() on each packet, but network devices
+ * that support it send the whole batch at once.  Returns 0 if every packet was
+ * sent, otherwise the positive errno value for the first packet that could not
+ * be sent.
+ *
+ * The caller retains ownership of the packets in all cases. */
+int
+netdev_send_batch(struct netdev *netdev, struct ofpbuf **packets,
+                  size_t n_packets)
+{
+    int (*send_batch)(struct netdev *, struct ofpbuf **, size_t);
+    int error;
+
+    send_batch = netdev_get_dev(netdev)->netdev_class->send_batch;
+    if (send_batch) {
+        error = send_batch(netdev, packets, n_packets);
+        if (!error) {
+            COVERAGE_ADD(netdev_sent, n_packets);
+        }
+    } else {
+        size_t i;
+
+        error = 0;
+        for (i = 0; i < n_packets; i++) {
+            int retval = netdev_send(netdev, packets[i]);
+            if (retval && !error) {
+                error = retval;
+            }
+        }
+    }
+    return error;
+}
+
 /* Registers with the poll loop to wake up from the next call to poll_block()
  * when the packet transmission queue has sufficient room to transmit a packet
  * with netdev_send().
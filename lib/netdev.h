@@ -137,6 +137,8 @@ void netdev_recv_wait(struct netdev *);
 int netdev_drain(struct netdev *);
 
 int netdev_send(struct netdev *, const struct ofpbuf *);
+int netdev_send_batch(struct netdev *, struct ofpbuf **packets,
+                      size_t n_packets);
 void netdev_send_wait(struct netdev *);
 
 /* Hardware address. */
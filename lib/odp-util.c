@@ -76,6 +76,8 @@ odp_action_len(uint16_t type)
     case OVS_ACTION_ATTR_POP_VLAN: return 0;
     case OVS_ACTION_ATTR_PUSH_MPLS: return sizeof(struct ovs_action_push_mpls);
     case OVS_ACTION_ATTR_POP_MPLS: return sizeof(ovs_be16);
+    case OVS_ACTION_ATTR_RECIRC: return sizeof(uint32_t);
+    case OVS_ACTION_ATTR_HASH: return sizeof(struct ovs_action_hash);
     case OVS_ACTION_ATTR_SET: return -2;
     case OVS_ACTION_ATTR_SAMPLE: return -2;
 
@@ -98,6 +100,8 @@ ovs_key_attr_to_string(enum ovs_key_attr attr)
     case OVS_KEY_ATTR_PRIORITY: return "skb_priority";
     case OVS_KEY_ATTR_SKB_MARK: return "skb_mark";
     case OVS_KEY_ATTR_TUNNEL: return "tunnel";
+    case OVS_KEY_ATTR_DP_HASH: return "dp_hash";
+    case OVS_KEY_ATTR_RECIRC_ID: return "recirc_id";
     case OVS_KEY_ATTR_IN_PORT: return "in_port";
     case OVS_KEY_ATTR_ETHERNET: return "eth";
     case OVS_KEY_ATTR_VLAN: return "vlan";
@@ -425,6 +429,19 @@ format_odp_action(struct ds *ds, const struct nlattr *a)
     case OVS_ACTION_ATTR_SAMPLE:
         format_odp_sample_action(ds, a);
         break;
+    case OVS_ACTION_ATTR_RECIRC:
+        ds_put_format(ds, "recirc(%#"PRIx32")", nl_attr_get_u32(a));
+        break;
+    case OVS_ACTION_ATTR_HASH: {
+        const struct ovs_action_hash *hash = nl_attr_get(a);
+
+        if (hash->hash_alg == OVS_HASH_ALG_L4) {
+            ds_put_format(ds, "hash(hash_l4(%"PRIu32"))", hash->hash_basis);
+        } else {
+            format_generic_odp_action(ds, a);
+        }
+        break;
+    }
     case OVS_ACTION_ATTR_UNSPEC:
     case __OVS_ACTION_ATTR_MAX:
     default:
@@ -639,6 +656,31 @@ parse_odp_action(const char *s, const struct simap *port_names,
         return 8;
     }
 
+    {
+        uint32_t recirc_id;
+        int n = -1;
+
+        if (sscanf(s, "recirc(%"SCNi32")%n", &recirc_id, &n) > 0 && n > 0) {
+            nl_msg_put_u32(actions, OVS_ACTION_ATTR_RECIRC, recirc_id);
+            return n;
+        }
+    }
+
+    {
+        struct ovs_action_hash hash;
+        uint32_t basis;
+        int n = -1;
+
+        if (sscanf(s, "hash(hash_l4(%"SCNi32"))%n", &basis, &n) > 0
+            && n > 0) {
+            hash.hash_alg = OVS_HASH_ALG_L4;
+            hash.hash_basis = basis;
+            nl_msg_put_unspec(actions, OVS_ACTION_ATTR_HASH,
+                              &hash, sizeof hash);
+            return n;
+        }
+    }
+
     {
         double percentage;
         int n = -1;
@@ -731,6 +773,8 @@ odp_flow_key_attr_len(uint16_t type)
     case OVS_KEY_ATTR_ENCAP: return -2;
     case OVS_KEY_ATTR_PRIORITY: return 4;
     case OVS_KEY_ATTR_SKB_MARK: return 4;
+    case OVS_KEY_ATTR_DP_HASH: return 4;
+    case OVS_KEY_ATTR_RECIRC_ID: return 4;
     case OVS_KEY_ATTR_TUNNEL: return -2;
     case OVS_KEY_ATTR_IN_PORT: return 4;
     case OVS_KEY_ATTR_ETHERNET: return sizeof(struct ovs_key_ethernet);
@@ -863,6 +907,15 @@ tun_key_from_attr(const struct nlattr *attr, struct flow_tnl *tun)
     return ODP_FIT_PERFECT;
 }
 
+/* Parses OVS_KEY_ATTR_TUNNEL attribute 'attr' into 'tun', which need not be
+ * initialized. */
+enum odp_key_fitness
+odp_tun_key_from_attr(const struct nlattr *attr, struct flow_tnl *tun)
+{
+    memset(tun, 0, sizeof *tun);
+    return tun_key_from_attr(attr, tun);
+}
+
 static void
 tun_key_to_attr(struct ofpbuf *a, const struct flow_tnl *tun_key)
 {
@@ -976,6 +1029,8 @@ format_odp_key_attr(const struct nlattr *a, const struct nlattr *ma,
 
     case OVS_KEY_ATTR_PRIORITY:
     case OVS_KEY_ATTR_SKB_MARK:
+    case OVS_KEY_ATTR_DP_HASH:
+    case OVS_KEY_ATTR_RECIRC_ID:
         ds_put_format(ds, "%#"PRIx32, nl_attr_get_u32(a));
         if (!is_exact) {
             ds_put_format(ds, "/%#"PRIx32, nl_attr_get_u32(ma));
@@ -1519,6 +1574,45 @@ parse_odp_key_mask_attr(const char *s, const struct simap *port_names,
         }
     }
 
+    {
+        unsigned long long int hash;
+        unsigned long long int hash_mask;
+        int n = -1;
+
+        if (mask && sscanf(s, "dp_hash(%lli/%lli)%n", &hash,
+                   &hash_mask, &n) > 0 && n > 0) {
+            nl_msg_put_u32(key, OVS_KEY_ATTR_DP_HASH, hash);
+            nl_msg_put_u32(mask, OVS_KEY_ATTR_DP_HASH, hash_mask);
+            return n;
+        } else if (sscanf(s, "dp_hash(%lli)%n", &hash, &n) > 0 && n > 0) {
+            nl_msg_put_u32(key, OVS_KEY_ATTR_DP_HASH, hash);
+            if (mask) {
+                nl_msg_put_u32(mask, OVS_KEY_ATTR_DP_HASH, UINT32_MAX);
+            }
+            return n;
+        }
+    }
+
+    {
+        unsigned long long int recirc_id;
+        unsigned long long int recirc_id_mask;
+        int n = -1;
+
+        if (mask && sscanf(s, "recirc_id(%lli/%lli)%n", &recirc_id,
+                   &recirc_id_mask, &n) > 0 && n > 0) {
+            nl_msg_put_u32(key, OVS_KEY_ATTR_RECIRC_ID, recirc_id);
+            nl_msg_put_u32(mask, OVS_KEY_ATTR_RECIRC_ID, recirc_id_mask);
+            return n;
+        } else if (sscanf(s, "recirc_id(%lli)%n", &recirc_id, &n) > 0
+                   && n > 0) {
+            nl_msg_put_u32(key, OVS_KEY_ATTR_RECIRC_ID, recirc_id);
+            if (mask) {
+                nl_msg_put_u32(mask, OVS_KEY_ATTR_RECIRC_ID, UINT32_MAX);
+            }
+            return n;
+        }
+    }
+
     {
         char tun_id_s[32];
         int tos, tos_mask, ttl, ttl_mask;
@@ -2338,6 +2432,14 @@ odp_flow_key_from_flow__(struct ofpbuf *buf, const struct flow *data,
 
     nl_msg_put_u32(buf, OVS_KEY_ATTR_SKB_MARK, data->skb_mark);
 
+    if (flow->recirc_id) {
+        nl_msg_put_u32(buf, OVS_KEY_ATTR_RECIRC_ID, data->recirc_id);
+    }
+
+    if (flow->dp_hash) {
+        nl_msg_put_u32(buf, OVS_KEY_ATTR_DP_HASH, data->dp_hash);
+    }
+
     /* Add an ingress port attribute if this is a mask or 'odp_in_port'
      * is not the magical value "OVSP_NONE". */
     if (is_mask || odp_in_port != OVSP_NONE) {
@@ -2904,6 +3006,16 @@ odp_flow_key_to_flow(const struct nlattr *key, size_t key_len,
         expected_attrs |= UINT64_C(1) << OVS_KEY_ATTR_SKB_MARK;
     }
 
+    if (present_attrs & (UINT64_C(1) << OVS_KEY_ATTR_RECIRC_ID)) {
+        flow->recirc_id = nl_attr_get_u32(attrs[OVS_KEY_ATTR_RECIRC_ID]);
+        expected_attrs |= UINT64_C(1) << OVS_KEY_ATTR_RECIRC_ID;
+    }
+
+    if (present_attrs & (UINT64_C(1) << OVS_KEY_ATTR_DP_HASH)) {
+        flow->dp_hash = nl_attr_get_u32(attrs[OVS_KEY_ATTR_DP_HASH]);
+        expected_attrs |= UINT64_C(1) << OVS_KEY_ATTR_DP_HASH;
+    }
+
     if (present_attrs & (UINT64_C(1) << OVS_KEY_ATTR_TUNNEL)) {
         enum odp_key_fitness res;
 
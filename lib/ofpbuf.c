@@ -16,6 +16,7 @@
 
 #include <config.h>
 #include "ofpbuf.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include "dynamic-string.h"
@@ -106,21 +107,198 @@ ofpbuf_init(struct ofpbuf *b, size_t size)
     ofpbuf_use(b, size ? xmalloc(size) : NULL, size);
 }
 
+/* Packet buffer pool.
+ *
+ * The userspace datapath allocates and frees a buffer for every packet that
+ * it receives.  To keep malloc() out of that path, each thread keeps free
+ * lists of data buffers in a few power-of-2 size classes.  Buffers are aligned
+ * on cache line boundaries, so that the packet headers at the start of a
+ * buffer with cache-aligned headroom do not straddle lines needlessly.
+ *
+ * A pooled buffer goes back to the pool of whichever thread calls
+ * ofpbuf_uninit() on it, so a buffer received on one thread and freed on
+ * another simply migrates.  Each free list is capped at
+ * OFPBUF_POOL_MAX_FREE buffers; buffers beyond that are freed.  The free lists
+ * of a thread are freed when it exits. */
+
+#define OFPBUF_POOL_MIN_SHIFT 11        /* Smallest class is 2 kB. */
+#define OFPBUF_POOL_N_CLASSES 4         /* 2, 4, 8, and 16 kB. */
+#define OFPBUF_POOL_MAX_FREE 128        /* Max free buffers per class. */
+#define OFPBUF_POOL_ALIGN 64            /* Alignment of each buffer. */
+
+/* A free buffer.  Overlays the start of the buffer's data. */
+struct ofpbuf_pool_free {
+    struct ofpbuf_pool_free *next;
+};
+
+struct ofpbuf_pool {
+    struct ofpbuf_pool_free *free[OFPBUF_POOL_N_CLASSES];
+    unsigned int n_free[OFPBUF_POOL_N_CLASSES];
+};
+
+static pthread_key_t ofpbuf_pool_key;
+static pthread_once_t ofpbuf_pool_once = PTHREAD_ONCE_INIT;
+
+static void
+ofpbuf_pool_destroy(void *pool_)
+{
+    struct ofpbuf_pool *pool = pool_;
+    int class;
+
+    for (class = 0; class < OFPBUF_POOL_N_CLASSES; class++) {
+        struct ofpbuf_pool_free *f, *next;
+
+        for (f = pool->free[class]; f; f = next) {
+            next = f->next;
+            free(((void **) f)[-1]);
+        }
+    }
+    free(pool);
+}
+
+static void
+ofpbuf_pool_init(void)
+{
+    int error = pthread_key_create(&ofpbuf_pool_key, ofpbuf_pool_destroy);
+    if (error) {
+        ovs_abort(error, "pthread_key_create failed");
+    }
+}
+
+/* Returns the calling thread's buffer pool, creating it if necessary. */
+static struct ofpbuf_pool *
+ofpbuf_pool_get(void)
+{
+    struct ofpbuf_pool *pool;
+
+    pthread_once(&ofpbuf_pool_once, ofpbuf_pool_init);
+    pool = pthread_getspecific(ofpbuf_pool_key);
+    if (!pool) {
+        int error;
+
+        pool = xzalloc(sizeof *pool);
+        error = pthread_setspecific(ofpbuf_pool_key, pool);
+        if (error) {
+            ovs_abort(error, "pthread_setspecific failed");
+        }
+    }
+    return pool;
+}
+
+static size_t
+ofpbuf_pool_class_size(int class)
+{
+    return (size_t) 1 << (OFPBUF_POOL_MIN_SHIFT + class);
+}
+
+/* Returns the smallest size class that holds 'size' bytes, or -1 if 'size' is
+ * too big for the pool. */
+static int
+ofpbuf_pool_class(size_t size)
+{
+    int class;
+
+    for (class = 0; class < OFPBUF_POOL_N_CLASSES; class++) {
+        if (size <= ofpbuf_pool_class_size(class)) {
+            return class;
+        }
+    }
+    return -1;
+}
+
+static void *
+ofpbuf_pool_alloc(int class)
+{
+    struct ofpbuf_pool *pool = ofpbuf_pool_get();
+    struct ofpbuf_pool_free *f = pool->free[class];
+    void *raw;
+    char *p;
+
+    if (f) {
+        pool->free[class] = f->next;
+        pool->n_free[class]--;
+        return f;
+    }
+
+    /* Over-allocate so that the buffer can be aligned, and keep the pointer
+     * that malloc() returned just before the aligned buffer. */
+    raw = xmalloc(ofpbuf_pool_class_size(class) + OFPBUF_POOL_ALIGN);
+    p = (char *) ROUND_UP((uintptr_t) raw + sizeof(void *), OFPBUF_POOL_ALIGN);
+    ((void **) p)[-1] = raw;
+    return p;
+}
+
+static void
+ofpbuf_pool_release(void *base, size_t allocated)
+{
+    struct ofpbuf_pool *pool = ofpbuf_pool_get();
+    int class = ofpbuf_pool_class(allocated);
+
+    if (pool->n_free[class] < OFPBUF_POOL_MAX_FREE) {
+        struct ofpbuf_pool_free *f = base;
+
+        f->next = pool->free[class];
+        pool->free[class] = f;
+        pool->n_free[class]++;
+    } else {
+        free(((void **) base)[-1]);
+    }
+}
+
+/* Initializes 'b' as an empty ofpbuf with room for at least 'size' bytes of
+ * data following 'headroom' bytes of headroom, taking its memory from the
+ * calling thread's buffer pool when 'size + headroom' fits in a pool buffer.
+ *
+ * Use this for buffers that are allocated and freed at a high rate, such as
+ * received packets.  Freeing 'b' with ofpbuf_uninit() returns its memory to
+ * the pool.  If 'b' later has to grow, its data moves to a malloc()'d
+ * buffer and its pool buffer is returned. */
+void
+ofpbuf_init_pooled(struct ofpbuf *b, size_t size, size_t headroom)
+{
+    int class = ofpbuf_pool_class(size + headroom);
+
+    if (class >= 0) {
+        ofpbuf_use__(b, ofpbuf_pool_alloc(class), ofpbuf_pool_class_size(class),
+                     OFPBUF_POOL);
+    } else {
+        ofpbuf_init(b, size + headroom);
+    }
+    ofpbuf_reserve(b, headroom);
+}
+
+/* Creates and returns a new ofpbuf initialized with ofpbuf_init_pooled().
+ * Only the data comes from the pool; 'b' itself is malloc()'d. */
+struct ofpbuf *
+ofpbuf_new_pooled(size_t size, size_t headroom)
+{
+    struct ofpbuf *b = xmalloc(sizeof *b);
+    ofpbuf_init_pooled(b, size, headroom);
+    return b;
+}
+
 /* Frees memory that 'b' points to. */
 void
 ofpbuf_uninit(struct ofpbuf *b)
 {
-    if (b && b->source == OFPBUF_MALLOC) {
-        free(b->base);
+    if (b) {
+        if (b->source == OFPBUF_MALLOC) {
+            free(b->base);
+        } else if (b->source == OFPBUF_POOL) {
+            ofpbuf_pool_release(b->base, b->allocated);
+        }
     }
 }
 
 /* Returns a pointer that may be passed to free() to accomplish the same thing
  * as ofpbuf_uninit(b).  The return value is a null pointer if ofpbuf_uninit()
- * would not free any memory. */
+ * would not free any memory.
+ *
+ * 'b' must not have been initialized with ofpbuf_init_pooled(). */
 void *
 ofpbuf_get_uninit_pointer(struct ofpbuf *b)
 {
+    ovs_assert(!b || b->source != OFPBUF_POOL);
     return b && b->source == OFPBUF_MALLOC ? b->base : NULL;
 }
 
@@ -284,6 +462,13 @@ ofpbuf_resize__(struct ofpbuf *b, size_t new_headroom, size_t new_tailroom)
         ofpbuf_copy__(b, new_base, new_headroom, new_tailroom);
         break;
 
+    case OFPBUF_POOL:
+        b->source = OFPBUF_MALLOC;
+        new_base = xmalloc(new_allocated);
+        ofpbuf_copy__(b, new_base, new_headroom, new_tailroom);
+        ofpbuf_pool_release(b->base, b->allocated);
+        break;
+
     default:
         NOT_REACHED();
     }
@@ -537,9 +722,8 @@ ofpbuf_steal_data(struct ofpbuf *b)
         p = b->data;
     } else {
         p = xmemdup(b->data, b->size);
-        if (b->source == OFPBUF_MALLOC) {
-            free(b->base);
-        }
+        ofpbuf_uninit(b);
+        b->source = OFPBUF_MALLOC;
     }
     b->base = b->data = NULL;
     return p;
@@ -69,6 +69,7 @@ struct ovsdb_idl {
     struct json *monitor_request_id;
     unsigned int last_monitor_request_seqno;
     unsigned int change_seqno;
+    unsigned int track_seqno;   /* change_seqno at ovsdb_idl_track_clear(). */
     bool verify_write_only;
 
     /* Database locking. */
@@ -127,6 +128,10 @@ static void ovsdb_idl_insert_row(struct ovsdb_idl_row *, const struct json *);
 static void ovsdb_idl_delete_row(struct ovsdb_idl_row *);
 static bool ovsdb_idl_modify_row(struct ovsdb_idl_row *, const struct json *);
 
+static bool ovsdb_idl_track_is_set(const struct ovsdb_idl_table *);
+static void ovsdb_idl_row_track_change(struct ovsdb_idl_row *,
+                                       enum ovsdb_idl_change);
+
 static bool ovsdb_idl_row_is_orphan(const struct ovsdb_idl_row *);
 static struct ovsdb_idl_row *ovsdb_idl_row_create__(
     const struct ovsdb_idl_table_class *);
@@ -184,6 +189,10 @@ ovsdb_idl_create(const char *remote, const struct ovsdb_idl_class *class,
     idl = xzalloc(sizeof *idl);
     idl->class = class;
     idl->session = jsonrpc_session_open(remote, retry);
+    /* The IDL only reads the messages it receives, copying what it keeps into
+     * its own rows, so it can let the database's updates be parsed into
+     * arenas. */
+    jsonrpc_session_use_arena(idl->session);
     shash_init(&idl->table_by_name);
     idl->tables = xmalloc(class->n_tables * sizeof *idl->tables);
     for (i = 0; i < class->n_tables; i++) {
@@ -204,6 +213,8 @@ ovsdb_idl_create(const char *remote, const struct ovsdb_idl_class *class,
         }
         hmap_init(&table->rows);
         table->idl = idl;
+        memset(table->change_seqno, 0, sizeof table->change_seqno);
+        list_init(&table->track_list);
     }
     idl->last_monitor_request_seqno = UINT_MAX;
     hmap_init(&idl->outstanding_txns);
@@ -220,6 +231,7 @@ ovsdb_idl_destroy(struct ovsdb_idl *idl)
 
         ovs_assert(!idl->txn);
         ovsdb_idl_clear(idl);
+        ovsdb_idl_track_clear(idl);
         jsonrpc_session_close(idl->session);
 
         for (i = 0; i < idl->class->n_tables; i++) {
@@ -247,17 +259,22 @@ ovsdb_idl_clear(struct ovsdb_idl *idl)
     for (i = 0; i < idl->class->n_tables; i++) {
         struct ovsdb_idl_table *table = &idl->tables[i];
         struct ovsdb_idl_row *row, *next_row;
+        bool track;
 
         if (hmap_is_empty(&table->rows)) {
             continue;
         }
 
         changed = true;
+        track = ovsdb_idl_track_is_set(table);
         HMAP_FOR_EACH_SAFE (row, next_row, hmap_node, &table->rows) {
             struct ovsdb_idl_arc *arc, *next_arc;
 
             if (!ovsdb_idl_row_is_orphan(row)) {
                 ovsdb_idl_row_unparse(row);
+                if (track) {
+                    ovsdb_idl_row_track_change(row, OVSDB_IDL_CHANGE_DELETE);
+                }
             }
             LIST_FOR_EACH_SAFE (arc, next_arc, src_node, &row->src_arcs) {
                 free(arc);
@@ -535,6 +552,79 @@ ovsdb_idl_omit(struct ovsdb_idl *idl, const struct ovsdb_idl_column *column)
 {
     *ovsdb_idl_get_mode(idl, column) = 0;
 }
+
+/* Turns on OVSDB_IDL_TRACK for 'column' in 'idl', so that changes to
+ * 'column' are tracked (see "Change tracking" in ovsdb-idl.h).  If 'column'
+ * is not already being replicated with OVSDB_IDL_ALERT, this also turns on
+ * OVSDB_IDL_MONITOR and OVSDB_IDL_ALERT for it, as ovsdb_idl_add_column()
+ * does.
+ *
+ * This function should be called between ovsdb_idl_create() and the first call
+ * to ovsdb_idl_run().
+ */
+void
+ovsdb_idl_track_add_column(struct ovsdb_idl *idl,
+                           const struct ovsdb_idl_column *column)
+{
+    if (!(*ovsdb_idl_get_mode(idl, column) & OVSDB_IDL_ALERT)) {
+        ovsdb_idl_add_column(idl, column);
+    }
+    *ovsdb_idl_get_mode(idl, column) |= OVSDB_IDL_TRACK;
+}
+
+/* Turns on OVSDB_IDL_TRACK for every column in 'idl' that is currently set up
+ * to be replicated with OVSDB_IDL_ALERT.  Columns that the client omitted or
+ * treats as write-only are not tracked.
+ *
+ * This function should be called between ovsdb_idl_create() and the first call
+ * to ovsdb_idl_run().
+ */
+void
+ovsdb_idl_track_add_all(struct ovsdb_idl *idl)
+{
+    size_t i, j;
+
+    ovs_assert(!idl->change_seqno);
+
+    for (i = 0; i < idl->class->n_tables; i++) {
+        struct ovsdb_idl_table *table = &idl->tables[i];
+
+        for (j = 0; j < table->class->n_columns; j++) {
+            if (table->modes[j] & OVSDB_IDL_ALERT) {
+                table->modes[j] |= OVSDB_IDL_TRACK;
+            }
+        }
+    }
+}
+
+/* Forgets all of the changes tracked so far in 'idl' and frees the tracked
+ * rows that were deleted.  Afterward, ovsdb_idl_track_get_first() returns
+ * null for every table until ovsdb_idl_run() processes another change.
+ *
+ * The per-row and per-table sequence numbers are not reset, so a client may
+ * still compare them against a sequence number it saved earlier. */
+void
+ovsdb_idl_track_clear(struct ovsdb_idl *idl)
+{
+    size_t i;
+
+    for (i = 0; i < idl->class->n_tables; i++) {
+        struct ovsdb_idl_table *table = &idl->tables[i];
+        struct ovsdb_idl_row *row, *next;
+
+        LIST_FOR_EACH_SAFE (row, next, track_node, &table->track_list) {
+            list_init(&row->track_node);
+            free(row->updated);
+            row->updated = NULL;
+            if (hmap_node_is_null(&row->hmap_node)) {
+                /* ovsdb_idl_row_destroy() left this row for us to free. */
+                free(row);
+            }
+        }
+        list_init(&table->track_list);
+    }
+    idl->track_seqno = idl->change_seqno;
+}
 
 static void
 ovsdb_idl_send_monitor_request(struct ovsdb_idl *idl)
@@ -737,13 +827,18 @@ ovsdb_idl_process_update(struct ovsdb_idl_table *table,
 }
 
 /* Returns true if a column with mode OVSDB_IDL_MODE_RW changed, false
- * otherwise. */
+ * otherwise.
+ *
+ * If 'change' is OVSDB_IDL_CHANGE_MODIFY, also records the modification of any
+ * tracked column for change tracking. */
 static bool
-ovsdb_idl_row_update(struct ovsdb_idl_row *row, const struct json *row_json)
+ovsdb_idl_row_update(struct ovsdb_idl_row *row, const struct json *row_json,
+                     enum ovsdb_idl_change change)
 {
     struct ovsdb_idl_table *table = row->table;
     struct shash_node *node;
     bool changed = false;
+    bool tracked = false;
 
     SHASH_FOR_EACH (node, json_object(row_json)) {
         const char *column_name = node->name;
@@ -768,6 +863,14 @@ ovsdb_idl_row_update(struct ovsdb_idl_row *row, const struct json *row_json)
                 if (table->modes[column_idx] & OVSDB_IDL_ALERT) {
                     changed = true;
                 }
+                if (change == OVSDB_IDL_CHANGE_MODIFY
+                    && table->modes[column_idx] & OVSDB_IDL_TRACK) {
+                    if (!row->updated) {
+                        row->updated = bitmap_allocate(table->class->n_columns);
+                    }
+                    bitmap_set1(row->updated, column_idx);
+                    changed = tracked = true;
+                }
             } else {
                 /* Didn't really change but the OVSDB monitor protocol always
                  * includes every value in a row. */
@@ -783,6 +886,9 @@ ovsdb_idl_row_update(struct ovsdb_idl_row *row, const struct json *row_json)
             ovsdb_error_destroy(error);
         }
     }
+    if (tracked) {
+        ovsdb_idl_row_track_change(row, OVSDB_IDL_CHANGE_MODIFY);
+    }
     return changed;
 }
 
@@ -936,6 +1042,7 @@ ovsdb_idl_row_create__(const struct ovsdb_idl_table_class *class)
     list_init(&row->src_arcs);
     list_init(&row->dst_arcs);
     hmap_node_nullify(&row->txn_node);
+    list_init(&row->track_node);
     return row;
 }
 
@@ -955,7 +1062,14 @@ ovsdb_idl_row_destroy(struct ovsdb_idl_row *row)
     if (row) {
         ovsdb_idl_row_clear_old(row);
         hmap_remove(&row->table->rows, &row->hmap_node);
-        free(row);
+        if (list_is_empty(&row->track_node)) {
+            free(row->updated);
+            free(row);
+        } else {
+            /* The client hasn't seen this row's deletion yet, so leave it on
+             * its table's track list for ovsdb_idl_track_clear() to free. */
+            hmap_node_nullify(&row->hmap_node);
+        }
     }
 }
 
@@ -970,8 +1084,11 @@ ovsdb_idl_insert_row(struct ovsdb_idl_row *row, const struct json *row_json)
     for (i = 0; i < class->n_columns; i++) {
         ovsdb_datum_init_default(&row->old[i], &class->columns[i].type);
     }
-    ovsdb_idl_row_update(row, row_json);
+    ovsdb_idl_row_update(row, row_json, OVSDB_IDL_CHANGE_INSERT);
     ovsdb_idl_row_parse(row);
+    if (ovsdb_idl_track_is_set(row->table)) {
+        ovsdb_idl_row_track_change(row, OVSDB_IDL_CHANGE_INSERT);
+    }
 
     ovsdb_idl_row_reparse_backrefs(row);
 }
@@ -979,6 +1096,9 @@ ovsdb_idl_insert_row(struct ovsdb_idl_row *row, const struct json *row_json)
 static void
 ovsdb_idl_delete_row(struct ovsdb_idl_row *row)
 {
+    if (ovsdb_idl_track_is_set(row->table)) {
+        ovsdb_idl_row_track_change(row, OVSDB_IDL_CHANGE_DELETE);
+    }
     ovsdb_idl_row_unparse(row);
     ovsdb_idl_row_clear_arcs(row, true);
     ovsdb_idl_row_clear_old(row);
@@ -998,7 +1118,7 @@ ovsdb_idl_modify_row(struct ovsdb_idl_row *row, const struct json *row_json)
 
     ovsdb_idl_row_unparse(row);
     ovsdb_idl_row_clear_arcs(row, true);
-    changed = ovsdb_idl_row_update(row, row_json);
+    changed = ovsdb_idl_row_update(row, row_json, OVSDB_IDL_CHANGE_MODIFY);
     ovsdb_idl_row_parse(row);
 
     return changed;
@@ -1190,6 +1310,169 @@ ovsdb_idl_row_is_synthetic(const struct ovsdb_idl_row *row)
 {
     return row->table == NULL;
 }
+
+/* Change tracking. */
+
+/* Returns true if any column in 'table' has OVSDB_IDL_TRACK set. */
+static bool
+ovsdb_idl_track_is_set(const struct ovsdb_idl_table *table)
+{
+    size_t i;
+
+    for (i = 0; i < table->class->n_columns; i++) {
+        if (table->modes[i] & OVSDB_IDL_TRACK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Records that 'row' is undergoing a change of the given type.  The change is
+ * stamped with the value that ovsdb_idl_get_seqno() will return once the
+ * update that contains it has been processed, and 'row' moves to the end of
+ * its table's track list. */
+static void
+ovsdb_idl_row_track_change(struct ovsdb_idl_row *row,
+                           enum ovsdb_idl_change change)
+{
+    struct ovsdb_idl_table *table = row->table;
+    unsigned int seqno = table->idl->change_seqno + 1;
+
+    row->change_seqno[change] = table->change_seqno[change] = seqno;
+    if (!list_is_empty(&row->track_node)) {
+        list_remove(&row->track_node);
+    }
+    list_push_back(&table->track_list, &row->track_node);
+}
+
+/* Returns the sequence number of the most recent change of type 'change' to
+ * any row in 'table_class''s table in 'idl', or 0 if there has been no such
+ * change (or the table has no tracked columns). */
+unsigned int
+ovsdb_idl_table_get_seqno(const struct ovsdb_idl *idl,
+                          const struct ovsdb_idl_table_class *table_class,
+                          enum ovsdb_idl_change change)
+{
+    ovs_assert(change < OVSDB_IDL_CHANGE_MAX);
+    return ovsdb_idl_table_from_class(idl, table_class)->change_seqno[change];
+}
+
+/* Returns the sequence number of the most recent change of type 'change' to
+ * 'row', or 0 if there has been no such change. */
+unsigned int
+ovsdb_idl_row_get_seqno(const struct ovsdb_idl_row *row,
+                        enum ovsdb_idl_change change)
+{
+    ovs_assert(change < OVSDB_IDL_CHANGE_MAX);
+    return row->change_seqno[change];
+}
+
+/* Returns the sequence number of the most recent change of any type to
+ * 'row', or 0 if there has been no change. */
+unsigned int
+ovsdb_idl_row_get_last_seqno(const struct ovsdb_idl_row *row)
+{
+    unsigned int seqno = 0;
+    int i;
+
+    for (i = 0; i < OVSDB_IDL_CHANGE_MAX; i++) {
+        seqno = MAX(seqno, row->change_seqno[i]);
+    }
+    return seqno;
+}
+
+/* Returns true if 'row' was deleted since the last call to
+ * ovsdb_idl_track_clear(), false otherwise.  A deleted row's columns must not
+ * be accessed. */
+bool
+ovsdb_idl_row_is_deleted(const struct ovsdb_idl_row *row)
+{
+    unsigned int deleted = row->change_seqno[OVSDB_IDL_CHANGE_DELETE];
+
+    return (deleted > row->table->idl->track_seqno
+            && deleted > row->change_seqno[OVSDB_IDL_CHANGE_INSERT]);
+}
+
+/* Returns true if 'row' was inserted since the last call to
+ * ovsdb_idl_track_clear() and has not since been deleted, false otherwise. */
+bool
+ovsdb_idl_row_is_new(const struct ovsdb_idl_row *row)
+{
+    return (row->change_seqno[OVSDB_IDL_CHANGE_INSERT]
+            > row->table->idl->track_seqno
+            && !ovsdb_idl_row_is_deleted(row));
+}
+
+/* Returns true if tracked 'column' in 'row' was modified since the last call
+ * to ovsdb_idl_track_clear(), false otherwise.  The initial values of the
+ * columns in a newly inserted row do not count as modifications. */
+bool
+ovsdb_idl_track_is_updated(const struct ovsdb_idl_row *row,
+                           const struct ovsdb_idl_column *column)
+{
+    size_t column_idx = column - row->table->class->columns;
+
+    ovs_assert(column_idx < row->table->class->n_columns);
+    return row->updated && bitmap_is_set(row->updated, column_idx);
+}
+
+/* Returns the least recently changed row among those changed in
+ * 'table_class''s table in 'idl' since the last call to
+ * ovsdb_idl_track_clear(), or a null pointer if no row has changed. */
+const struct ovsdb_idl_row *
+ovsdb_idl_track_get_first(const struct ovsdb_idl *idl,
+                          const struct ovsdb_idl_table_class *table_class)
+{
+    struct ovsdb_idl_table *table
+        = ovsdb_idl_table_from_class(idl, table_class);
+
+    if (list_is_empty(&table->track_list)) {
+        return NULL;
+    }
+    return CONTAINER_OF(list_front(&table->track_list),
+                        struct ovsdb_idl_row, track_node);
+}
+
+/* Like ovsdb_idl_track_get_first(), but skips rows whose most recent change
+ * happened at or before 'seqno', a value previously obtained from
+ * ovsdb_idl_get_seqno().  Because the track list is ordered by the time of
+ * each row's latest change, iterating onward with ovsdb_idl_track_get_next()
+ * visits exactly the rows that changed after 'seqno'. */
+const struct ovsdb_idl_row *
+ovsdb_idl_track_get_first_since(const struct ovsdb_idl *idl,
+                                const struct ovsdb_idl_table_class *table_class,
+                                unsigned int seqno)
+{
+    struct ovsdb_idl_table *table
+        = ovsdb_idl_table_from_class(idl, table_class);
+    const struct ovsdb_idl_row *first = NULL;
+    struct list *node;
+
+    for (node = table->track_list.prev; node != &table->track_list;
+         node = node->prev) {
+        const struct ovsdb_idl_row *row;
+
+        row = CONTAINER_OF(node, struct ovsdb_idl_row, track_node);
+        if (ovsdb_idl_row_get_last_seqno(row) <= seqno) {
+            break;
+        }
+        first = row;
+    }
+    return first;
+}
+
+/* Returns the tracked row that changed after 'row' in its table, or a null
+ * pointer if 'row' is the most recently changed one. */
+const struct ovsdb_idl_row *
+ovsdb_idl_track_get_next(const struct ovsdb_idl_row *row)
+{
+    const struct list *next = row->track_node.next;
+
+    if (list_is_empty(&row->track_node) || next == &row->table->track_list) {
+        return NULL;
+    }
+    return CONTAINER_OF(next, struct ovsdb_idl_row, track_node);
+}
 
 /* Transactions. */
 
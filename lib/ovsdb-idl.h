@@ -91,6 +91,7 @@ int ovsdb_idl_get_last_error(const struct ovsdb_idl *);
  */
 #define OVSDB_IDL_MONITOR (1 << 0) /* Monitor this column? */
 #define OVSDB_IDL_ALERT   (1 << 1) /* Alert client when column updated? */
+#define OVSDB_IDL_TRACK   (1 << 2) /* Track changes to this column? */
 
 void ovsdb_idl_add_column(struct ovsdb_idl *, const struct ovsdb_idl_column *);
 void ovsdb_idl_add_table(struct ovsdb_idl *,
@@ -116,6 +117,56 @@ const struct ovsdb_datum *ovsdb_idl_get(const struct ovsdb_idl_row *,
                                         enum ovsdb_atomic_type value_type);
 
 bool ovsdb_idl_row_is_synthetic(const struct ovsdb_idl_row *);
+
+/* Change tracking.
+ *
+ * ovsdb_idl_get_seqno() only tells a client that something in the database
+ * changed.  A client that wants to know what changed, so that it can process
+ * an update in time proportional to the size of the change rather than the
+ * size of the database, can enable change tracking on some or all columns
+ * with ovsdb_idl_track_add_column() or ovsdb_idl_track_add_all().
+ *
+ * Each row in a table that has at least one tracked column records the value
+ * that ovsdb_idl_get_seqno() took on when the row was last inserted, modified
+ * (in a tracked column), or deleted.  Each table records the most recent of
+ * each of these across all of its rows.  Rows that changed are kept in a
+ * per-table list, ordered from least to most recently changed, until the
+ * client calls ovsdb_idl_track_clear().
+ *
+ * A tracked row that has been deleted remains on its table's list until
+ * ovsdb_idl_track_clear(), so that the client can learn its UUID, but none of
+ * its columns may be accessed.  ovsdb_idl_track_clear() frees such rows, so
+ * the client must not keep pointers to them afterward. */
+enum ovsdb_idl_change {
+    OVSDB_IDL_CHANGE_INSERT,
+    OVSDB_IDL_CHANGE_MODIFY,
+    OVSDB_IDL_CHANGE_DELETE,
+    OVSDB_IDL_CHANGE_MAX
+};
+
+void ovsdb_idl_track_add_column(struct ovsdb_idl *,
+                                const struct ovsdb_idl_column *);
+void ovsdb_idl_track_add_all(struct ovsdb_idl *);
+void ovsdb_idl_track_clear(struct ovsdb_idl *);
+
+unsigned int ovsdb_idl_table_get_seqno(
+    const struct ovsdb_idl *, const struct ovsdb_idl_table_class *,
+    enum ovsdb_idl_change);
+unsigned int ovsdb_idl_row_get_seqno(const struct ovsdb_idl_row *,
+                                     enum ovsdb_idl_change);
+unsigned int ovsdb_idl_row_get_last_seqno(const struct ovsdb_idl_row *);
+bool ovsdb_idl_row_is_new(const struct ovsdb_idl_row *);
+bool ovsdb_idl_row_is_deleted(const struct ovsdb_idl_row *);
+bool ovsdb_idl_track_is_updated(const struct ovsdb_idl_row *,
+                                const struct ovsdb_idl_column *);
+
+const struct ovsdb_idl_row *ovsdb_idl_track_get_first(
+    const struct ovsdb_idl *, const struct ovsdb_idl_table_class *);
+const struct ovsdb_idl_row *ovsdb_idl_track_get_first_since(
+    const struct ovsdb_idl *, const struct ovsdb_idl_table_class *,
+    unsigned int seqno);
+const struct ovsdb_idl_row *ovsdb_idl_track_get_next(
+    const struct ovsdb_idl_row *);
 
 /* Transactions.
  *
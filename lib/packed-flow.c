@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+#include "packed-flow.h"
+#include <string.h>
+#include "cpu.h"
+#include "crc32c.h"
+#include "hash.h"
+#include "util.h"
+
+#if CPU_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+struct packed_flow_impl {
+    const char *name;
+    bool (*init)(void);         /* Returns true if supported. */
+    bool (*equal_masked)(const uint32_t *a, const uint32_t *b,
+                         const uint32_t *mask, size_t n);
+    uint32_t (*hash)(const uint32_t *p, size_t n, uint32_t basis);
+};
+
+/* Portable implementation. */
+
+/* CRC32C tables for processing four bytes at a time ("slicing by 4"). */
+static uint32_t crc_tables[4][256];
+
+static bool
+portable_init(void)
+{
+    if (!crc_tables[0][1]) {
+        int i, j;
+
+        for (i = 0; i < 256; i++) {
+            uint8_t byte = i;
+
+            crc_tables[0][i] = crc32c_extend(0, &byte, 1);
+        }
+        for (i = 0; i < 256; i++) {
+            for (j = 1; j < 4; j++) {
+                uint32_t prev = crc_tables[j - 1][i];
+
+                crc_tables[j][i] = (prev >> 8) ^ crc_tables[0][prev & 0xff];
+            }
+        }
+    }
+    return true;
+}
+
+static bool
+portable_equal_masked(const uint32_t *a, const uint32_t *b,
+                      const uint32_t *mask, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if ((a[i] ^ b[i]) & mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Hashes the words in 'p' with CRC32C, taking each word's bytes from least to
+ * most significant, as the x86 "crc32" instruction does, then finishes with
+ * the Murmur mixing step so that the low bits are well distributed. */
+static uint32_t
+portable_hash(const uint32_t *p, size_t n, uint32_t basis)
+{
+    uint32_t crc = basis;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        crc ^= p[i];
+        crc = (crc_tables[3][crc & 0xff]
+               ^ crc_tables[2][(crc >> 8) & 0xff]
+               ^ crc_tables[1][(crc >> 16) & 0xff]
+               ^ crc_tables[0][crc >> 24]);
+    }
+    return mhash_finish(crc, n * 4);
+}
+
+#if CPU_X86_DISPATCH
+/* x86 implementations. */
+
+static uint32_t __attribute__((target("sse4.2")))
+sse42_hash(const uint32_t *p, size_t n, uint32_t basis)
+{
+    uint32_t crc = basis;
+    size_t i = 0;
+
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+
+    /* Two words at a time, in the same byte order as the one-word loop. */
+    for (; i + 2 <= n; i += 2) {
+        uint64_t pair;
+
+        memcpy(&pair, &p[i], sizeof pair);
+        crc64 = _mm_crc32_u64(crc64, pair);
+    }
+    crc = crc64;
+#endif
+    for (; i < n; i++) {
+        crc = _mm_crc32_u32(crc, p[i]);
+    }
+    return mhash_finish(crc, n * 4);
+}
+
+static bool __attribute__((target("sse4.2")))
+sse42_equal_masked(const uint32_t *a, const uint32_t *b,
+                   const uint32_t *mask, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *) &a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i *) &b[i]);
+        __m128i vm = _mm_loadu_si128((const __m128i *) &mask[i]);
+
+        if (!_mm_testz_si128(_mm_xor_si128(va, vb), vm)) {
+            return false;
+        }
+    }
+    return portable_equal_masked(&a[i], &b[i], &mask[i], n - i);
+}
+
+static bool __attribute__((target("avx2")))
+avx2_equal_masked(const uint32_t *a, const uint32_t *b,
+                  const uint32_t *mask, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i va = _mm256_loadu_si256((const __m256i *) &a[i]);
+        __m256i vb = _mm256_loadu_si256((const __m256i *) &b[i]);
+        __m256i vm = _mm256_loadu_si256((const __m256i *) &mask[i]);
+
+        if (!_mm256_testz_si256(_mm256_xor_si256(va, vb), vm)) {
+            return false;
+        }
+    }
+
+    /* Finish here rather than in sse42_equal_masked(), to avoid the penalty
+     * for mixing AVX and legacy SSE instructions. */
+    if (i + 4 <= n) {
+        __m128i va = _mm_loadu_si128((const __m128i *) &a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i *) &b[i]);
+        __m128i vm = _mm_loadu_si128((const __m128i *) &mask[i]);
+
+        if (!_mm_testz_si128(_mm_xor_si128(va, vb), vm)) {
+            return false;
+        }
+        i += 4;
+    }
+    for (; i < n; i++) {
+        if ((a[i] ^ b[i]) & mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif  /* CPU_X86_DISPATCH */
+
+/* In order of preference. */
+static const struct packed_flow_impl impls[] = {
+#if CPU_X86_DISPATCH
+    { "avx2", cpu_has_avx2,
+      avx2_equal_masked, sse42_hash },
+    { "sse4.2", cpu_has_sse42,
+      sse42_equal_masked, sse42_hash },
+#endif
+    { "portable", portable_init,
+      portable_equal_masked, portable_hash },
+};
+
+static const struct packed_flow_impl *impl;
+
+static const struct packed_flow_impl *
+get_impl(void)
+{
+    if (!impl) {
+        size_t i;
+
+        /* Every thread that races here picks the same implementation and
+         * initializes it to the same state. */
+        for (i = 0; i < ARRAY_SIZE(impls); i++) {
+            if (impls[i].init()) {
+                impl = &impls[i];
+                break;
+            }
+        }
+    }
+    return impl;
+}
+
+/* Returns true if 'a' and 'b', each of which has 'n' words, are equal in the
+ * bits that are 1-bits in 'mask', false if they differ. */
+bool
+packed_flow_equal_masked(const uint32_t *a, const uint32_t *b,
+                         const uint32_t *mask, size_t n)
+{
+    return get_impl()->equal_masked(a, b, mask, n);
+}
+
+/* Returns a hash of the bits of the 'n' words in 'p' that are 1-bits in
+ * 'mask', given 'basis'.  The result is the same as hashing each masked word
+ * with mhash_add() in order, then calling mhash_finish() on the total number
+ * of bytes.
+ *
+ * Each mhash_add() depends on the previous one, so there is nothing to gain
+ * from SIMD here and all CPUs share this implementation.  Use
+ * packed_flow_hash() where the hash values need not match mhash. */
+uint32_t
+packed_flow_hash_masked(const uint32_t *p, const uint32_t *mask, size_t n,
+                        uint32_t basis)
+{
+    uint32_t hash = basis;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        hash = mhash_add(hash, p[i] & mask[i]);
+    }
+    return mhash_finish(hash, n * 4);
+}
+
+/* Returns a hash of the 'n' words in 'p', given 'basis'.
+ *
+ * This hash is based on CRC32C, which is much cheaper than hash_words() on
+ * CPUs with the SSE4.2 "crc32" instruction, and still fast elsewhere.  Its
+ * values differ from hash_words(), so it is only suitable for tables whose
+ * users all agree to use it. */
+uint32_t
+packed_flow_hash(const uint32_t *p, size_t n, uint32_t basis)
+{
+    return get_impl()->hash(p, n, basis);
+}
+
+/* Returns the name of the implementation in use. */
+const char *
+packed_flow_get_impl(void)
+{
+    return get_impl()->name;
+}
+
+/* Switches to the implementation named 'name', if it is built in and the CPU
+ * supports it.  Returns true if successful, false otherwise. */
+bool
+packed_flow_set_impl(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(impls); i++) {
+        if (!strcmp(impls[i].name, name) && impls[i].init()) {
+            impl = &impls[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns the name of the 'idx'th built-in implementation, or NULL if 'idx'
+ * is out of range.  The implementation might not be supported by this CPU. */
+const char *
+packed_flow_impl_name(size_t idx)
+{
+    return idx < ARRAY_SIZE(impls) ? impls[idx].name : NULL;
+}
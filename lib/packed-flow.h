@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_FLOW_H
+#define PACKED_FLOW_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Packed flow kernels.
+ *
+ * A "packed flow" is an array of uint32_t words from a "struct flow", such as
+ * the 'values' of a miniflow or minimask, or the words of a flow gathered at
+ * the offsets of a minimask's 1-bits.  These functions are the inner loops of
+ * classifier and datapath lookups.
+ *
+ * packed_flow_equal_masked() and packed_flow_hash() have a portable
+ * implementation and, on x86, SSE4.2 and AVX2 implementations.  The fastest
+ * one that the CPU supports is selected the first time either is called.
+ * Every implementation returns exactly the same results, so in particular hash
+ * values never depend on the CPU. */
+
+bool packed_flow_equal_masked(const uint32_t *a, const uint32_t *b,
+                              const uint32_t *mask, size_t n);
+uint32_t packed_flow_hash_masked(const uint32_t *p, const uint32_t *mask,
+                                 size_t n, uint32_t basis);
+uint32_t packed_flow_hash(const uint32_t *p, size_t n, uint32_t basis);
+
+/* For testing and benchmarking. */
+const char *packed_flow_get_impl(void);
+bool packed_flow_set_impl(const char *name);
+const char *packed_flow_impl_name(size_t idx);
+
+#endif /* packed-flow.h */
@@ -626,27 +626,34 @@ eth_compose(struct ofpbuf *b, const uint8_t eth_dst[ETH_ADDR_LEN],
     return data;
 }
 
-static void
-packet_set_ipv4_addr(struct ofpbuf *packet, ovs_be32 *addr, ovs_be32 new_addr)
+/* Returns the L4 checksum field in 'packet', whose L4 protocol is 'proto', if
+ * it has one that covers the IP addresses, otherwise NULL. */
+static ovs_be16 *
+packet_l4_csum(struct ofpbuf *packet, uint8_t proto)
 {
-    struct ip_header *nh = packet->l3;
-
-    if (nh->ip_proto == IPPROTO_TCP && packet->l7) {
+    if (proto == IPPROTO_TCP && packet->l7) {
         struct tcp_header *th = packet->l4;
 
-        th->tcp_csum = recalc_csum32(th->tcp_csum, *addr, new_addr);
-    } else if (nh->ip_proto == IPPROTO_UDP && packet->l7) {
+        return &th->tcp_csum;
+    } else if (proto == IPPROTO_UDP && packet->l7) {
         struct udp_header *uh = packet->l4;
 
-        if (uh->udp_csum) {
-            uh->udp_csum = recalc_csum32(uh->udp_csum, *addr, new_addr);
-            if (!uh->udp_csum) {
-                uh->udp_csum = htons(0xffff);
-            }
-        }
+        /* A zero UDP checksum means that the sender did not compute one. */
+        return uh->udp_csum ? &uh->udp_csum : NULL;
+    } else {
+        return NULL;
+    }
+}
+
+/* Stores the checksum for 'partial' into '*csump', the L4 checksum field of a
+ * packet whose L4 protocol is 'proto'. */
+static void
+packet_finish_l4_csum(ovs_be16 *csump, uint8_t proto, uint32_t partial)
+{
+    *csump = csum_update_finish(partial);
+    if (proto == IPPROTO_UDP && !*csump) {
+        *csump = htons(0xffff);
     }
-    nh->ip_csum = recalc_csum32(nh->ip_csum, *addr, new_addr);
-    *addr = new_addr;
 }
 
 /* Returns true, if packet contains at least one routing header where
@@ -733,37 +740,6 @@ packet_rh_present(struct ofpbuf *packet)
     return false;
 }
 
-static void
-packet_update_csum128(struct ofpbuf *packet, uint8_t proto,
-                     ovs_be32 addr[4], const ovs_be32 new_addr[4])
-{
-    if (proto == IPPROTO_TCP && packet->l7) {
-        struct tcp_header *th = packet->l4;
-
-        th->tcp_csum = recalc_csum128(th->tcp_csum, addr, new_addr);
-    } else if (proto == IPPROTO_UDP && packet->l7) {
-        struct udp_header *uh = packet->l4;
-
-        if (uh->udp_csum) {
-            uh->udp_csum = recalc_csum128(uh->udp_csum, addr, new_addr);
-            if (!uh->udp_csum) {
-                uh->udp_csum = htons(0xffff);
-            }
-        }
-    }
-}
-
-static void
-packet_set_ipv6_addr(struct ofpbuf *packet, uint8_t proto,
-                     struct in6_addr *addr, const ovs_be32 new_addr[4],
-                     bool recalculate_csum)
-{
-    if (recalculate_csum) {
-        packet_update_csum128(packet, proto, (ovs_be32 *)addr, new_addr);
-    }
-    memcpy(addr, new_addr, sizeof(*addr));
-}
-
 static void
 packet_set_ipv6_flow_label(ovs_be32 *flow_label, ovs_be32 flow_key)
 {
@@ -785,29 +761,50 @@ packet_set_ipv4(struct ofpbuf *packet, ovs_be32 src, ovs_be32 dst,
                 uint8_t tos, uint8_t ttl)
 {
     struct ip_header *nh = packet->l3;
+    ovs_be16 *l4_csump = NULL;
+    uint32_t ip_csum, l4_csum = 0;
+
+    if (nh->ip_src == src && nh->ip_dst == dst
+        && nh->ip_tos == tos && nh->ip_ttl == ttl) {
+        return;
+    }
+
+    /* Accumulate every change, then fold each checksum only once. */
+    ip_csum = csum_update_init(nh->ip_csum);
+    if (nh->ip_src != src || nh->ip_dst != dst) {
+        l4_csump = packet_l4_csum(packet, nh->ip_proto);
+        if (l4_csump) {
+            l4_csum = csum_update_init(*l4_csump);
+        }
+    }
 
     if (nh->ip_src != src) {
-        packet_set_ipv4_addr(packet, &nh->ip_src, src);
+        ip_csum = csum_update32(ip_csum, nh->ip_src, src);
+        l4_csum = csum_update32(l4_csum, nh->ip_src, src);
+        nh->ip_src = src;
     }
 
     if (nh->ip_dst != dst) {
-        packet_set_ipv4_addr(packet, &nh->ip_dst, dst);
+        ip_csum = csum_update32(ip_csum, nh->ip_dst, dst);
+        l4_csum = csum_update32(l4_csum, nh->ip_dst, dst);
+        nh->ip_dst = dst;
     }
 
     if (nh->ip_tos != tos) {
-        uint8_t *field = &nh->ip_tos;
-
-        nh->ip_csum = recalc_csum16(nh->ip_csum, htons((uint16_t) *field),
-                                    htons((uint16_t) tos));
-        *field = tos;
+        ip_csum = csum_update16(ip_csum, htons((uint16_t) nh->ip_tos),
+                                htons((uint16_t) tos));
+        nh->ip_tos = tos;
     }
 
     if (nh->ip_ttl != ttl) {
-        uint8_t *field = &nh->ip_ttl;
+        ip_csum = csum_update16(ip_csum, htons(nh->ip_ttl << 8),
+                                htons(ttl << 8));
+        nh->ip_ttl = ttl;
+    }
 
-        nh->ip_csum = recalc_csum16(nh->ip_csum, htons(*field << 8),
-                                    htons(ttl << 8));
-        *field = ttl;
+    nh->ip_csum = csum_update_finish(ip_csum);
+    if (l4_csump) {
+        packet_finish_l4_csum(l4_csump, nh->ip_proto, l4_csum);
     }
 }
 
@@ -821,14 +818,37 @@ packet_set_ipv6(struct ofpbuf *packet, uint8_t proto, const ovs_be32 src[4],
                 uint8_t key_hl)
 {
     struct ip6_hdr *nh = packet->l3;
+    bool src_changed = memcmp(&nh->ip6_src, src, sizeof(ovs_be32[4])) != 0;
+    bool dst_changed = memcmp(&nh->ip6_dst, dst, sizeof(ovs_be32[4])) != 0;
+    ovs_be16 *l4_csump = NULL;
+    uint32_t l4_csum = 0;
+
+    /* With a routing header, the L4 checksum covers the final destination,
+     * not the one in the IPv6 header. */
+    if (dst_changed && packet_rh_present(packet)) {
+        dst_changed = false;
+        memcpy(&nh->ip6_dst, dst, sizeof(ovs_be32[4]));
+    }
 
-    if (memcmp(&nh->ip6_src, src, sizeof(ovs_be32[4]))) {
-        packet_set_ipv6_addr(packet, proto, &nh->ip6_src, src, true);
+    if (src_changed || dst_changed) {
+        l4_csump = packet_l4_csum(packet, proto);
+        if (l4_csump) {
+            l4_csum = csum_update_init(*l4_csump);
+        }
     }
 
-    if (memcmp(&nh->ip6_dst, dst, sizeof(ovs_be32[4]))) {
-        packet_set_ipv6_addr(packet, proto, &nh->ip6_dst, dst,
-                             !packet_rh_present(packet));
+    if (src_changed) {
+        l4_csum = csum_update128(l4_csum, (ovs_be32 *) &nh->ip6_src, src);
+        memcpy(&nh->ip6_src, src, sizeof(ovs_be32[4]));
+    }
+
+    if (dst_changed) {
+        l4_csum = csum_update128(l4_csum, (ovs_be32 *) &nh->ip6_dst, dst);
+        memcpy(&nh->ip6_dst, dst, sizeof(ovs_be32[4]));
+    }
+
+    if (l4_csump) {
+        packet_finish_l4_csum(l4_csump, proto, l4_csum);
     }
 
     packet_set_ipv6_tc(&nh->ip6_flow, key_tc);
@@ -838,12 +858,21 @@ packet_set_ipv6(struct ofpbuf *packet, uint8_t proto, const ovs_be32 src[4],
     nh->ip6_hlim = key_hl;
 }
 
+/* Updates 'packet''s L4 source and destination ports, at 'srcp' and 'dstp',
+ * to 'src' and 'dst', and its L4 checksum at 'csump' to match.  'proto' is
+ * the L4 protocol. */
 static void
-packet_set_port(ovs_be16 *port, ovs_be16 new_port, ovs_be16 *csum)
+packet_set_ports(ovs_be16 *srcp, ovs_be16 *dstp, ovs_be16 *csump,
+                 uint8_t proto, ovs_be16 src, ovs_be16 dst)
 {
-    if (*port != new_port) {
-        *csum = recalc_csum16(*csum, *port, new_port);
-        *port = new_port;
+    if (*srcp != src || *dstp != dst) {
+        uint32_t partial = csum_update_init(*csump);
+
+        partial = csum_update16(partial, *srcp, src);
+        partial = csum_update16(partial, *dstp, dst);
+        *srcp = src;
+        *dstp = dst;
+        packet_finish_l4_csum(csump, proto, partial);
     }
 }
 
@@ -855,8 +884,8 @@ packet_set_tcp_port(struct ofpbuf *packet, ovs_be16 src, ovs_be16 dst)
 {
     struct tcp_header *th = packet->l4;
 
-    packet_set_port(&th->tcp_src, src, &th->tcp_csum);
-    packet_set_port(&th->tcp_dst, dst, &th->tcp_csum);
+    packet_set_ports(&th->tcp_src, &th->tcp_dst, &th->tcp_csum, IPPROTO_TCP,
+                     src, dst);
 }
 
 /* Sets the UDP source and destination port ('src' and 'dst' respectively) of
@@ -868,18 +897,213 @@ packet_set_udp_port(struct ofpbuf *packet, ovs_be16 src, ovs_be16 dst)
     struct udp_header *uh = packet->l4;
 
     if (uh->udp_csum) {
-        packet_set_port(&uh->udp_src, src, &uh->udp_csum);
-        packet_set_port(&uh->udp_dst, dst, &uh->udp_csum);
-
-        if (!uh->udp_csum) {
-            uh->udp_csum = htons(0xffff);
-        }
+        packet_set_ports(&uh->udp_src, &uh->udp_dst, &uh->udp_csum,
+                         IPPROTO_UDP, src, dst);
     } else {
         uh->udp_src = src;
         uh->udp_dst = dst;
     }
 }
 
+/* Builds in 'h' the outer headers for encapsulating packets as 'type' with
+ * tunnel metadata 'tnl', from Ethernet address 'eth_src' and IPv4 address
+ * 'ip_src' to Ethernet address 'eth_dst'.  'udp_dst' is the UDP destination
+ * port for VXLAN.  The IP length and checksum, the GRE checksum, and the UDP
+ * source port and length depend on the packet, so tnl_header_push() fills
+ * them in. */
+void
+tnl_header_build(struct tnl_header *h, enum tnl_type type,
+                 const struct flow_tnl *tnl,
+                 const uint8_t eth_src[ETH_ADDR_LEN],
+                 const uint8_t eth_dst[ETH_ADDR_LEN],
+                 ovs_be32 ip_src, ovs_be16 udp_dst)
+{
+    struct eth_header *eth;
+    struct ip_header *ip;
+    uint8_t *l4;
+
+    ovs_assert(type != TNL_TYPE_NONE);
+    memset(h->header, 0, sizeof h->header);
+    h->type = type;
+
+    eth = (struct eth_header *) h->header;
+    memcpy(eth->eth_dst, eth_dst, ETH_ADDR_LEN);
+    memcpy(eth->eth_src, eth_src, ETH_ADDR_LEN);
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    ip = (struct ip_header *) (eth + 1);
+    ip->ip_ihl_ver = IP_IHL_VER(5, 4);
+    ip->ip_tos = tnl->ip_tos;
+    ip->ip_frag_off = (tnl->flags & FLOW_TNL_F_DONT_FRAGMENT
+                       ? htons(IP_DONT_FRAGMENT) : htons(0));
+    ip->ip_ttl = tnl->ip_ttl ? tnl->ip_ttl : 64;
+    ip->ip_src = ip_src;
+    ip->ip_dst = tnl->ip_dst;
+
+    l4 = (uint8_t *) (ip + 1);
+    if (type == TNL_TYPE_GRE) {
+        struct gre_base_hdr *gre = (struct gre_base_hdr *) l4;
+        ovs_be32 *options = (ovs_be32 *) (gre + 1);
+
+        ip->ip_proto = IPPROTO_GRE;
+        gre->protocol = htons(ETH_TYPE_TEB);
+        if (tnl->flags & FLOW_TNL_F_CSUM) {
+            gre->flags |= htons(GRE_CSUM);
+            *options++ = htonl(0);
+        }
+        if (tnl->flags & FLOW_TNL_F_KEY) {
+            gre->flags |= htons(GRE_KEY);
+            *options++ = htonl(ntohll(tnl->tun_id));
+        }
+        h->size = (uint8_t *) options - h->header;
+    } else {
+        struct udp_header *udp = (struct udp_header *) l4;
+        struct vxlanhdr *vxh = (struct vxlanhdr *) (udp + 1);
+
+        ip->ip_proto = IPPROTO_UDP;
+        udp->udp_dst = udp_dst;
+        vxh->vx_flags = htonl(VXLAN_FLAGS);
+        vxh->vx_vni = htonl(ntohll(tnl->tun_id) << 8);
+        h->size = (uint8_t *) (vxh + 1) - h->header;
+    }
+
+    h->ip_csum = csum_continue(0, ip, IP_HEADER_LEN);
+}
+
+/* Pushes the outer headers in 'h' onto 'packet' and fills in the fields that
+ * depend on the packet.  'udp_src' is the UDP source port for VXLAN. */
+void
+tnl_header_push(struct ofpbuf *packet, const struct tnl_header *h,
+                ovs_be16 udp_src)
+{
+    struct ip_header *ip;
+    uint8_t *l4;
+
+    ofpbuf_push(packet, h->header, h->size);
+    ip = (struct ip_header *) ((uint8_t *) packet->data + ETH_HEADER_LEN);
+    ip->ip_tot_len = htons(packet->size - ETH_HEADER_LEN);
+    ip->ip_csum = csum_finish(csum_add16(h->ip_csum, ip->ip_tot_len));
+
+    l4 = (uint8_t *) (ip + 1);
+    if (h->type == TNL_TYPE_VXLAN) {
+        struct udp_header *udp = (struct udp_header *) l4;
+
+        udp->udp_src = udp_src;
+        udp->udp_len = htons(packet->size - ETH_HEADER_LEN - IP_HEADER_LEN);
+    } else {
+        struct gre_base_hdr *gre = (struct gre_base_hdr *) l4;
+
+        if (gre->flags & htons(GRE_CSUM)) {
+            ovs_be16 *gre_csum = (ovs_be16 *) (gre + 1);
+
+            *gre_csum = csum(gre, (uint8_t *) ofpbuf_tail(packet) - l4);
+        }
+    }
+}
+
+/* If 'packet' is a GRE or VXLAN packet addressed to 'ip_dst', stores its
+ * tunnel metadata in '*tnl', its UDP destination port (for VXLAN, otherwise
+ * 0) in '*udp_dst', and the length of its outer headers and of the inner
+ * packet in '*hlen' and '*inner_len', and returns its type.  Otherwise,
+ * including if 'packet' is truncated or has a bad GRE checksum, returns
+ * TNL_TYPE_NONE. */
+enum tnl_type
+tnl_header_parse(const struct ofpbuf *packet, ovs_be32 ip_dst,
+                 struct flow_tnl *tnl, ovs_be16 *udp_dst,
+                 size_t *hlen, size_t *inner_len)
+{
+    const struct eth_header *eth = packet->data;
+    const struct ip_header *ip;
+    const uint8_t *l4, *l4_end;
+    enum tnl_type type;
+    size_t ip_len;
+
+    if (packet->size < ETH_HEADER_LEN + IP_HEADER_LEN
+        || eth->eth_type != htons(ETH_TYPE_IP)) {
+        return TNL_TYPE_NONE;
+    }
+    ip = (const struct ip_header *) (eth + 1);
+    ip_len = ntohs(ip->ip_tot_len);
+    if (ip->ip_ihl_ver != IP_IHL_VER(5, 4)
+        || ip->ip_dst != ip_dst
+        || IP_IS_FRAGMENT(ip->ip_frag_off)
+        || ip_len < IP_HEADER_LEN
+        || ip_len > packet->size - ETH_HEADER_LEN) {
+        return TNL_TYPE_NONE;
+    }
+    l4 = (const uint8_t *) (ip + 1);
+    l4_end = (const uint8_t *) ip + ip_len;
+
+    memset(tnl, 0, sizeof *tnl);
+    tnl->ip_src = ip->ip_src;
+    tnl->ip_dst = ip->ip_dst;
+    tnl->ip_tos = ip->ip_tos;
+    tnl->ip_ttl = ip->ip_ttl;
+    if (ip->ip_frag_off & htons(IP_DONT_FRAGMENT)) {
+        tnl->flags |= FLOW_TNL_F_DONT_FRAGMENT;
+    }
+    *udp_dst = htons(0);
+
+    if (ip->ip_proto == IPPROTO_GRE) {
+        const struct gre_base_hdr *gre = (const struct gre_base_hdr *) l4;
+        const ovs_be32 *options = (const ovs_be32 *) (gre + 1);
+        uint16_t flags;
+
+        if (l4_end - l4 < GRE_HEADER_LEN) {
+            return TNL_TYPE_NONE;
+        }
+        flags = ntohs(gre->flags);
+        if (flags & ~(GRE_CSUM | GRE_KEY | GRE_SEQ)
+            || gre->protocol != htons(ETH_TYPE_TEB)
+            || l4_end - l4 < (GRE_HEADER_LEN
+                              + 4 * (!!(flags & GRE_CSUM)
+                                     + !!(flags & GRE_KEY)
+                                     + !!(flags & GRE_SEQ)))) {
+            return TNL_TYPE_NONE;
+        }
+        if (flags & GRE_CSUM) {
+            if (csum(gre, l4_end - l4)) {
+                return TNL_TYPE_NONE;
+            }
+            tnl->flags |= FLOW_TNL_F_CSUM;
+            options++;
+        }
+        if (flags & GRE_KEY) {
+            tnl->tun_id = htonll(ntohl(*options));
+            tnl->flags |= FLOW_TNL_F_KEY;
+            options++;
+        }
+        if (flags & GRE_SEQ) {
+            options++;
+        }
+        l4 = (const uint8_t *) options;
+        type = TNL_TYPE_GRE;
+    } else if (ip->ip_proto == IPPROTO_UDP) {
+        const struct udp_header *udp = (const struct udp_header *) l4;
+        const struct vxlanhdr *vxh = (const struct vxlanhdr *) (udp + 1);
+
+        if (l4_end - l4 < UDP_HEADER_LEN + VXLAN_HEADER_LEN
+            || vxh->vx_flags != htonl(VXLAN_FLAGS)
+            || vxh->vx_vni & htonl(0xff)) {
+            return TNL_TYPE_NONE;
+        }
+        tnl->tun_id = htonll(ntohl(vxh->vx_vni) >> 8);
+        tnl->flags |= FLOW_TNL_F_KEY;
+        *udp_dst = udp->udp_dst;
+        l4 = (const uint8_t *) (vxh + 1);
+        type = TNL_TYPE_VXLAN;
+    } else {
+        return TNL_TYPE_NONE;
+    }
+
+    if (l4_end - l4 < ETH_HEADER_LEN) {
+        return TNL_TYPE_NONE;
+    }
+    *hlen = l4 - (const uint8_t *) packet->data;
+    *inner_len = l4_end - l4;
+    return type;
+}
+
 /* If 'packet' is a TCP packet, returns the TCP flags.  Otherwise, returns 0.
  *
  * 'flow' must be the flow corresponding to 'packet' and 'packet''s header
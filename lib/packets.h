@@ -200,6 +200,7 @@ ovs_be32 set_mpls_lse_values(uint8_t ttl, uint8_t tc, uint8_t bos,
 #define ETH_TYPE_RARP          0x8035
 #define ETH_TYPE_MPLS          0x8847
 #define ETH_TYPE_MPLS_MCAST    0x8848
+#define ETH_TYPE_TEB           0x6558 /* Transparent Ethernet Bridging. */
 
 static inline bool eth_type_mpls(ovs_be16 eth_type)
 {
@@ -422,6 +423,10 @@ void ip_format_masked(ovs_be32 ip, ovs_be32 mask, struct ds *);
 #define IPPROTO_SCTP 132
 #endif
 
+#ifndef IPPROTO_GRE
+#define IPPROTO_GRE 47
+#endif
+
 /* TOS fields. */
 #define IP_ECN_NOT_ECT 0x0
 #define IP_ECN_ECT_1 0x01
@@ -482,6 +487,50 @@ struct udp_header {
 };
 BUILD_ASSERT_DECL(UDP_HEADER_LEN == sizeof(struct udp_header));
 
+#define GRE_CSUM 0x8000         /* Checksum present. */
+#define GRE_KEY  0x2000         /* Key present. */
+#define GRE_SEQ  0x1000         /* Sequence number present. */
+#define GRE_VERSION 0x0007
+
+/* GRE header (RFC 2890), without the optional checksum, key, and sequence
+ * number fields that follow it in that order. */
+#define GRE_HEADER_LEN 4
+struct gre_base_hdr {
+    ovs_be16 flags;
+    ovs_be16 protocol;
+};
+BUILD_ASSERT_DECL(GRE_HEADER_LEN == sizeof(struct gre_base_hdr));
+
+#define VXLAN_FLAGS 0x08000000  /* The VNI is valid. */
+
+/* VXLAN header (RFC 7348).  The VNI is in the upper 24 bits of 'vx_vni'. */
+#define VXLAN_HEADER_LEN 8
+struct vxlanhdr {
+    ovs_be32 vx_flags;
+    ovs_be32 vx_vni;
+};
+BUILD_ASSERT_DECL(VXLAN_HEADER_LEN == sizeof(struct vxlanhdr));
+
+/* Outer headers for encapsulating Ethernet frames in GRE or VXLAN over IPv4,
+ * built once with tnl_header_build() and then pushed onto any number of
+ * packets with tnl_header_push(). */
+enum tnl_type {
+    TNL_TYPE_NONE,
+    TNL_TYPE_GRE,
+    TNL_TYPE_VXLAN
+};
+
+/* Longest outer header: Ethernet, IPv4, UDP, and VXLAN. */
+#define TNL_HEADER_MAX (ETH_HEADER_LEN + IP_HEADER_LEN + UDP_HEADER_LEN \
+                        + VXLAN_HEADER_LEN)
+
+struct tnl_header {
+    enum tnl_type type;
+    uint32_t ip_csum;           /* Partial IP checksum, without length. */
+    size_t size;                /* Number of bytes in 'header'. */
+    uint8_t header[TNL_HEADER_MAX];
+};
+
 #define TCP_FIN 0x01
 #define TCP_SYN 0x02
 #define TCP_RST 0x04
@@ -617,6 +666,17 @@ void packet_set_ipv6(struct ofpbuf *, uint8_t proto, const ovs_be32 src[4],
 void packet_set_tcp_port(struct ofpbuf *, ovs_be16 src, ovs_be16 dst);
 void packet_set_udp_port(struct ofpbuf *, ovs_be16 src, ovs_be16 dst);
 
+void tnl_header_build(struct tnl_header *, enum tnl_type,
+                      const struct flow_tnl *,
+                      const uint8_t eth_src[ETH_ADDR_LEN],
+                      const uint8_t eth_dst[ETH_ADDR_LEN],
+                      ovs_be32 ip_src, ovs_be16 udp_dst);
+void tnl_header_push(struct ofpbuf *, const struct tnl_header *,
+                     ovs_be16 udp_src);
+enum tnl_type tnl_header_parse(const struct ofpbuf *, ovs_be32 ip_dst,
+                               struct flow_tnl *, ovs_be16 *udp_dst,
+                               size_t *hlen, size_t *inner_len);
+
 uint8_t packet_get_tcp_flags(const struct ofpbuf *, const struct flow *);
 void packet_format_tcp_flags(struct ds *, uint8_t);
 
@@ -59,7 +59,7 @@ pcap_open(const char *file_name, const char *mode)
     }
 
     if (mode[0] == 'r') {
-        if (!pcap_read_header(file)) {
+        if (pcap_read_header(file)) {
             fclose(file);
             return NULL;
         }
@@ -652,6 +652,7 @@ rconn_send_with_limit(struct rconn *rc, struct ofpbuf *b,
         return rconn_send(rc, b, counter);
     } else {
         COVERAGE_INC(rconn_overflow);
+        counter->n_dropped++;
         ofpbuf_delete(b);
         return EAGAIN;
     }
@@ -929,6 +930,7 @@ try_send(struct rconn *rc)
     COVERAGE_INC(rconn_sent);
     rc->packets_sent++;
     if (counter) {
+        counter->n_sent++;
         rconn_packet_counter_dec(counter, n_bytes);
     }
     return 0;
@@ -94,6 +94,10 @@ struct rconn_packet_counter {
     unsigned int n_packets;     /* Number of packets queued. */
     unsigned int n_bytes;       /* Number of bytes queued. */
     int ref_cnt;                /* Number of owners. */
+
+    /* Statistics. */
+    unsigned long long int n_sent;    /* Packets passed on to the vconn. */
+    unsigned long long int n_dropped; /* Dropped by rconn_send_with_limit(). */
 };
 
 struct rconn_packet_counter *rconn_packet_counter_create(void);
@@ -17,11 +17,13 @@
 #include <config.h>
 #include "stream-fd.h"
 #include <errno.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "fatal-signal.h"
 #include "leak-checker.h"
@@ -247,6 +249,26 @@ fd_send(struct stream *stream, const void *buffer, size_t n)
             : -errno);
 }
 
+#ifndef _WIN32
+static ssize_t
+fd_sendv(struct stream *stream, const struct iovec *iovs, size_t n_iovs)
+{
+    struct stream_fd *s = stream_fd_cast(stream);
+    ssize_t retval;
+
+    if (STRESS(stream_flaky_send)) {
+        return -EIO;
+    }
+
+    retval = writev(s->fd, iovs, MIN(n_iovs, IOV_MAX));
+    return (retval > 0 ? retval
+            : retval == 0 ? -EAGAIN
+            : -errno);
+}
+#else
+#define fd_sendv NULL
+#endif
+
 static void
 fd_wait(struct stream *stream, enum stream_wait_type wait)
 {
@@ -274,6 +296,7 @@ static const struct stream_class stream_fd_class = {
     fd_connect,                 /* connect */
     fd_recv,                    /* recv */
     fd_send,                    /* send */
+    fd_sendv,                   /* sendv */
     NULL,                       /* run */
     NULL,                       /* run_wait */
     fd_wait,                    /* wait */
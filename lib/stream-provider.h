@@ -116,6 +116,20 @@ struct stream_class {
      * accepted for transmission, it should return -EAGAIN immediately. */
     ssize_t (*send)(struct stream *stream, const void *buffer, size_t n);
 
+    /* Tries to send the data in the 'n_iovs' buffers in 'iovs', in order, on
+     * 'stream' as if by a single call to the send function, and returns the
+     * number of bytes sent or a negative errno value, with the same meanings
+     * as for the send function.  A partial send need not end on an iovec
+     * boundary.
+     *
+     * The sendv function will not be passed iovecs whose total length is
+     * zero.
+     *
+     * May be null if 'stream' cannot do better than sending one buffer at a
+     * time with the send function. */
+    ssize_t (*sendv)(struct stream *stream,
+                     const struct iovec *iovs, size_t n_iovs);
+
     /* Allows 'stream' to perform maintenance activities, such as flushing
      * output buffers.
      *
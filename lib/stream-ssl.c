@@ -657,30 +657,59 @@ ssl_do_tx(struct stream *stream)
     }
 }
 
+/* Starts transmitting 'txbuf', which the caller must have allocated, on
+ * 'stream', taking ownership of it.  Whatever cannot be written immediately
+ * is finished later by ssl_run(). */
+static ssize_t
+ssl_send_txbuf(struct stream *stream, struct ofpbuf *txbuf)
+{
+    struct ssl_stream *sslv = ssl_stream_cast(stream);
+    size_t n = txbuf->size;
+    int error;
+
+    sslv->txbuf = txbuf;
+    error = ssl_do_tx(stream);
+    switch (error) {
+    case 0:
+        ssl_clear_txbuf(sslv);
+        return n;
+    case EAGAIN:
+        leak_checker_claim(txbuf);
+        return n;
+    default:
+        ssl_clear_txbuf(sslv);
+        return -error;
+    }
+}
+
 static ssize_t
 ssl_send(struct stream *stream, const void *buffer, size_t n)
 {
     struct ssl_stream *sslv = ssl_stream_cast(stream);
 
+    return (sslv->txbuf
+            ? -EAGAIN
+            : ssl_send_txbuf(stream, ofpbuf_clone_data(buffer, n)));
+}
+
+/* Gathers 'iovs' into a single buffer so that they go out in as few SSL
+ * records, and as few system calls, as possible. */
+static ssize_t
+ssl_sendv(struct stream *stream, const struct iovec *iovs, size_t n_iovs)
+{
+    struct ssl_stream *sslv = ssl_stream_cast(stream);
+    struct ofpbuf *txbuf;
+    size_t i;
+
     if (sslv->txbuf) {
         return -EAGAIN;
-    } else {
-        int error;
-
-        sslv->txbuf = ofpbuf_clone_data(buffer, n);
-        error = ssl_do_tx(stream);
-        switch (error) {
-        case 0:
-            ssl_clear_txbuf(sslv);
-            return n;
-        case EAGAIN:
-            leak_checker_claim(buffer);
-            return n;
-        default:
-            sslv->txbuf = NULL;
-            return -error;
-        }
     }
+
+    txbuf = ofpbuf_new(iovec_len(iovs, n_iovs));
+    for (i = 0; i < n_iovs; i++) {
+        ofpbuf_put(txbuf, iovs[i].iov_base, iovs[i].iov_len);
+    }
+    return ssl_send_txbuf(stream, txbuf);
 }
 
 static void
@@ -762,6 +791,7 @@ const struct stream_class ssl_stream_class = {
     ssl_connect,                /* connect */
     ssl_recv,                   /* recv */
     ssl_send,                   /* send */
+    ssl_sendv,                  /* sendv */
     ssl_run,                    /* run */
     ssl_run_wait,               /* run_wait */
     ssl_wait,                   /* wait */
@@ -393,6 +393,33 @@ stream_send(struct stream *stream, const void *buffer, size_t n)
             : (stream->class->send)(stream, buffer, n));
 }
 
+/* Tries to send the data in the 'n_iovs' buffers in 'iovs', in order, on
+ * 'stream', and returns the number of bytes sent or a negative errno value,
+ * like stream_send().  A partial send need not end on an iovec boundary.
+ *
+ * Streams that support it send all of the buffers with a single system call
+ * (or a single SSL record), which is much cheaper than calling stream_send()
+ * on each of them.  Other streams send only the first nonempty buffer. */
+int
+stream_sendv(struct stream *stream, const struct iovec *iovs, size_t n_iovs)
+{
+    int retval = stream_connect(stream);
+    size_t i;
+
+    if (retval) {
+        return -retval;
+    } else if (iovec_is_empty(iovs, n_iovs)) {
+        return 0;
+    } else if (stream->class->sendv) {
+        return (stream->class->sendv)(stream, iovs, n_iovs);
+    }
+
+    for (i = 0; !iovs[i].iov_len; i++) {
+        continue;
+    }
+    return (stream->class->send)(stream, iovs[i].iov_base, iovs[i].iov_len);
+}
+
 /* Allows 'stream' to perform maintenance activities, such as flushing
  * output buffers. */
 void
@@ -43,6 +43,7 @@ ovs_be16 stream_get_local_port(const struct stream *);
 int stream_connect(struct stream *);
 int stream_recv(struct stream *, void *buffer, size_t n);
 int stream_send(struct stream *, const void *buffer, size_t n);
+int stream_sendv(struct stream *, const struct iovec *, size_t n_iovs);
 
 void stream_run(struct stream *);
 void stream_run_wait(struct stream *);
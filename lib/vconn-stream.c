@@ -20,9 +20,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "fatal-signal.h"
 #include "leak-checker.h"
+#include "list.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
@@ -35,14 +37,30 @@
 
 VLOG_DEFINE_THIS_MODULE(vconn_stream);
 
-/* Active stream socket vconn. */
+/* Active stream socket vconn.
+ *
+ * vconn_stream_send() writes a message to the stream right away if nothing is
+ * already waiting to be sent.  Otherwise, it queues the message, and
+ * vconn_stream_run() later writes out everything queued with a single
+ * stream_sendv() call.  Thus, when a controller connection is backlogged, for
+ * example by a burst of packet-ins, it takes one system call (or SSL record)
+ * per poll loop iteration instead of one per message. */
+
+/* Maximum number of bytes queued for transmission.  vconn_stream_send()
+ * refuses new messages with EAGAIN once this many are queued. */
+#define VCONN_STREAM_MAX_TX_BYTES (64 * 1024)
+
+/* Maximum number of messages written by a single stream_sendv() call. */
+#define VCONN_STREAM_MAX_IOVS 64
 
 struct vconn_stream
 {
     struct vconn vconn;
     struct stream *stream;
     struct ofpbuf *rxbuf;
-    struct ofpbuf *txbuf;
+    struct list txq;            /* Contains "struct ofpbuf"s to send. */
+    size_t tx_bytes;            /* Number of bytes in 'txq'. */
+    int tx_error;               /* Error from last send, as errno value. */
     int n_packets;
 };
 
@@ -50,7 +68,8 @@ static struct vconn_class stream_vconn_class;
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(10, 25);
 
-static void vconn_stream_clear_txbuf(struct vconn_stream *);
+static int vconn_stream_flush(struct vconn_stream *);
+static void vconn_stream_clear_txq(struct vconn_stream *);
 
 static struct vconn *
 vconn_stream_new(struct stream *stream, int connect_status,
@@ -62,7 +81,9 @@ vconn_stream_new(struct stream *stream, int connect_status,
     vconn_init(&s->vconn, &stream_vconn_class, connect_status,
                stream_get_name(stream), allowed_versions);
     s->stream = stream;
-    s->txbuf = NULL;
+    list_init(&s->txq);
+    s->tx_bytes = 0;
+    s->tx_error = 0;
     s->rxbuf = NULL;
     s->n_packets = 0;
     s->vconn.remote_ip = stream_get_remote_ip(stream);
@@ -113,8 +134,12 @@ vconn_stream_close(struct vconn *vconn)
                               THIS_MODULE, vconn_get_name(vconn));
     }
 
+    /* Give messages queued just before closing, e.g. by a utility that sends
+     * a request and exits, a chance to go out. */
+    vconn_stream_flush(s);
+
     stream_close(s->stream);
-    vconn_stream_clear_txbuf(s);
+    vconn_stream_clear_txq(s);
     ofpbuf_delete(s->rxbuf);
     free(s);
 }
@@ -189,62 +214,101 @@ vconn_stream_recv(struct vconn *vconn, struct ofpbuf **bufferp)
 }
 
 static void
-vconn_stream_clear_txbuf(struct vconn_stream *s)
+vconn_stream_clear_txq(struct vconn_stream *s)
 {
-    ofpbuf_delete(s->txbuf);
-    s->txbuf = NULL;
+    ofpbuf_list_delete(&s->txq);
+    s->tx_bytes = 0;
+}
+
+/* Tries to write the messages queued on 's' to its stream, as many as
+ * possible at once.  Returns 0 if the queue is now empty, EAGAIN if some
+ * messages remain, or some other positive errno value if the stream failed,
+ * in which case the queue is discarded. */
+static int
+vconn_stream_flush(struct vconn_stream *s)
+{
+    struct iovec iovs[VCONN_STREAM_MAX_IOVS];
+    struct ofpbuf *msg;
+    size_t n_iovs;
+    ssize_t retval;
+
+    n_iovs = 0;
+    LIST_FOR_EACH (msg, list_node, &s->txq) {
+        iovs[n_iovs].iov_base = msg->data;
+        iovs[n_iovs].iov_len = msg->size;
+        if (++n_iovs >= ARRAY_SIZE(iovs)) {
+            break;
+        }
+    }
+    if (!n_iovs) {
+        return 0;
+    }
+
+    retval = stream_sendv(s->stream, iovs, n_iovs);
+    if (retval < 0) {
+        if (retval == -EAGAIN) {
+            return EAGAIN;
+        }
+        VLOG_ERR_RL(&rl, "send: %s", strerror(-retval));
+        vconn_stream_clear_txq(s);
+        return -retval;
+    }
+
+    /* Free the messages that were sent completely and trim the first one
+     * that was not, if any. */
+    s->tx_bytes -= retval;
+    while (retval > 0) {
+        msg = ofpbuf_from_list(list_front(&s->txq));
+        if (retval < msg->size) {
+            ofpbuf_pull(msg, retval);
+            break;
+        }
+        retval -= msg->size;
+        list_remove(&msg->list_node);
+        ofpbuf_delete(msg);
+    }
+    return list_is_empty(&s->txq) ? 0 : EAGAIN;
 }
 
 static int
 vconn_stream_send(struct vconn *vconn, struct ofpbuf *buffer)
 {
     struct vconn_stream *s = vconn_stream_cast(vconn);
-    ssize_t retval;
 
-    if (s->txbuf) {
+    if (s->tx_error) {
+        return s->tx_error;
+    } else if (s->tx_bytes >= VCONN_STREAM_MAX_TX_BYTES) {
         return EAGAIN;
     }
 
-    retval = stream_send(s->stream, buffer->data, buffer->size);
-    if (retval == buffer->size) {
-        ofpbuf_delete(buffer);
-        return 0;
-    } else if (retval >= 0 || retval == -EAGAIN) {
-        leak_checker_claim(buffer);
-        s->txbuf = buffer;
-        if (retval > 0) {
+    if (list_is_empty(&s->txq)) {
+        ssize_t retval = stream_send(s->stream, buffer->data, buffer->size);
+        if (retval == buffer->size) {
+            ofpbuf_delete(buffer);
+            return 0;
+        } else if (retval > 0) {
             ofpbuf_pull(buffer, retval);
+        } else if (retval != -EAGAIN) {
+            return -retval;
         }
-        return 0;
-    } else {
-        return -retval;
     }
+
+    leak_checker_claim(buffer);
+    list_push_back(&s->txq, &buffer->list_node);
+    s->tx_bytes += buffer->size;
+    return 0;
 }
 
 static void
 vconn_stream_run(struct vconn *vconn)
 {
     struct vconn_stream *s = vconn_stream_cast(vconn);
-    ssize_t retval;
+    int error;
 
     stream_run(s->stream);
-    if (!s->txbuf) {
-        return;
-    }
-
-    retval = stream_send(s->stream, s->txbuf->data, s->txbuf->size);
-    if (retval < 0) {
-        if (retval != -EAGAIN) {
-            VLOG_ERR_RL(&rl, "send: %s", strerror(-retval));
-            vconn_stream_clear_txbuf(s);
-            return;
-        }
-    } else if (retval > 0) {
-        ofpbuf_pull(s->txbuf, retval);
-        if (!s->txbuf->size) {
-            vconn_stream_clear_txbuf(s);
-            return;
-        }
+    error = vconn_stream_flush(s);
+    if (error && error != EAGAIN) {
+        s->tx_error = error;
     }
 }
 
@@ -254,7 +318,7 @@ vconn_stream_run_wait(struct vconn *vconn)
     struct vconn_stream *s = vconn_stream_cast(vconn);
 
     stream_run_wait(s->stream);
-    if (s->txbuf) {
+    if (!list_is_empty(&s->txq)) {
         stream_send_wait(s->stream);
     }
 }
@@ -269,10 +333,10 @@ vconn_stream_wait(struct vconn *vconn, enum vconn_wait_type wait)
         break;
 
     case WAIT_SEND:
-        if (!s->txbuf) {
-            stream_send_wait(s->stream);
+        if (s->tx_error || s->tx_bytes < VCONN_STREAM_MAX_TX_BYTES) {
+            poll_immediate_wake();
         } else {
-            /* Nothing to do: need to drain txbuf first.
+            /* Nothing to do: need to drain txq first.
              * vconn_stream_run_wait() will arrange to wake up when there room
              * to send data, so there's no point in calling poll_fd_wait()
              * redundantly here. */
@@ -19,6 +19,7 @@
 #include "connmgr.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #include "coverage.h"
@@ -56,6 +57,11 @@ struct ofconn {
     enum ofconn_type type;      /* Type. */
     enum ofproto_band band;     /* In-band or out-of-band? */
     bool enable_async_msgs;     /* Initially enable async messages? */
+    unsigned int n_buffers;     /* Number of packet buffers in 'pktbuf'. */
+    size_t buffer_bytes;        /* Max bytes of packet data in 'pktbuf'. */
+    int rate_limit;             /* Configured packet-in rate, 0 if none. */
+    int burst_limit;            /* Configured packet-in burst, 0 if none. */
+    bool adaptive_rate_limit;   /* Adapt packet-in rate to the controller? */
 
 /* State that should be cleared from one connection to the next. */
 
@@ -69,10 +75,27 @@ struct ofconn {
     struct ofpbuf *blocked;     /* Postponed OpenFlow message, if any. */
     bool retry;                 /* True if 'blocked' is ready to try again. */
 
-    /* OFPT_PACKET_IN related data. */
+    /* OFPT_PACKET_IN related data.
+     *
+     * At most OFCONN_PACKET_IN_MAX packet-ins may be queued on 'rconn'.
+     * Further packet-ins are dropped. */
+#define OFCONN_PACKET_IN_MAX 100
     struct rconn_packet_counter *packet_in_counter; /* # queued on 'rconn'. */
 #define N_SCHEDULERS 2
     struct pinsched *schedulers[N_SCHEDULERS];
+
+    /* Packet-in flow control.  See ofconn_run_flow_control().
+     *
+     * Once every OFCONN_FC_INTERVAL ms, an adaptive packet-in rate limit is
+     * adjusted within the range OFCONN_FC_MIN_RATE...OFCONN_FC_MAX_RATE
+     * packets per second. */
+#define OFCONN_FC_INTERVAL 1000
+    long long int fc_time;      /* Time of the last update, in msec. */
+    unsigned long long int fc_n_sent;     /* Packet-ins sent by 'fc_time'. */
+    unsigned long long int fc_n_limited;  /* Packet-ins queued by pinsched. */
+    unsigned long long int fc_n_overflow; /* Packet-ins dropped by 'rconn'. */
+    unsigned int drain_rate;    /* Packet-ins per second sent to controller. */
+    bool fc_sampled;            /* 'drain_rate' has been sampled. */
     struct pktbuf *pktbuf;         /* OpenFlow packet buffers. */
     int miss_send_len;             /* Bytes to send of buffered packets. */
     uint16_t controller_id;     /* Connection controller ID. */
@@ -114,7 +137,22 @@ static void ofconn_wait(struct ofconn *, bool handling_openflow);
 static const char *ofconn_get_target(const struct ofconn *);
 static char *ofconn_make_name(const struct connmgr *, const char *target);
 
-static void ofconn_set_rate_limit(struct ofconn *, int rate, int burst);
+static void ofconn_set_rate_limit(struct ofconn *, int rate, int burst,
+                                  bool adaptive);
+static int ofconn_initial_rate(const struct ofconn *);
+static void ofconn_run_flow_control(struct ofconn *);
+
+/* Packet-in statistics for an ofconn, totaled across its rconn and its
+ * pinscheds. */
+struct ofconn_packet_in_stats {
+    unsigned int n_queued;            /* Waiting to be sent. */
+    unsigned long long int n_sent;    /* Passed on to the controller. */
+    unsigned long long int n_limited; /* Queued for rate limiting. */
+    unsigned long long int n_dropped; /* Dropped because a queue was full. */
+};
+
+static void ofconn_get_packet_in_stats(const struct ofconn *,
+                                       struct ofconn_packet_in_stats *);
 
 static void ofconn_send(const struct ofconn *, struct ofpbuf *,
                         struct rconn_packet_counter *);
@@ -131,6 +169,7 @@ struct ofservice {
     int probe_interval;         /* Max idle time before probing, in seconds. */
     int rate_limit;             /* Max packet-in rate in packets per second. */
     int burst_limit;            /* Limit on accumulating packet credits. */
+    bool adaptive_rate_limit;   /* Adapt 'rate_limit' to the controller? */
     bool enable_async_msgs;     /* Initially enable async messages? */
     uint8_t dscp;               /* DSCP Value for controller connection */
     uint32_t allowed_versions;  /* OpenFlow protocol versions that may
@@ -312,7 +351,8 @@ connmgr_run(struct connmgr *mgr,
             ofconn = ofconn_create(mgr, rconn, OFCONN_SERVICE,
                                    ofservice->enable_async_msgs);
             ofconn_set_rate_limit(ofconn, ofservice->rate_limit,
-                                  ofservice->burst_limit);
+                                  ofservice->burst_limit,
+                                  ofservice->adaptive_rate_limit);
         } else if (retval != EAGAIN) {
             VLOG_WARN_RL(&rl, "accept failed (%s)", strerror(retval));
         }
@@ -442,6 +482,7 @@ connmgr_get_controller_info(struct connmgr *mgr, struct shash *info)
 
         if (!shash_find(info, target)) {
             struct ofproto_controller_info *cinfo = xmalloc(sizeof *cinfo);
+            struct ofconn_packet_in_stats pin_stats;
             time_t now = time_now();
             time_t last_connection = rconn_get_last_connection(rconn);
             time_t last_disconnect = rconn_get_last_disconnect(rconn);
@@ -475,6 +516,40 @@ connmgr_get_controller_info(struct connmgr *mgr, struct shash *info)
                 cinfo->pairs.values[cinfo->pairs.n++]
                     = xasprintf("%ld", (long int) (now - last_disconnect));
             }
+
+            if (ofconn->pktbuf) {
+                struct pktbuf_stats stats;
+
+                pktbuf_get_stats(ofconn->pktbuf, &stats);
+                cinfo->pairs.keys[cinfo->pairs.n] = "packet_buffer_hits";
+                cinfo->pairs.values[cinfo->pairs.n++]
+                    = xasprintf("%llu", stats.n_hits);
+                cinfo->pairs.keys[cinfo->pairs.n] = "packet_buffer_misses";
+                cinfo->pairs.values[cinfo->pairs.n++]
+                    = xasprintf("%llu", stats.n_misses);
+                cinfo->pairs.keys[cinfo->pairs.n] = "packet_buffer_overwrites";
+                cinfo->pairs.values[cinfo->pairs.n++]
+                    = xasprintf("%llu", stats.n_overwrites);
+            }
+
+            ofconn_get_packet_in_stats(ofconn, &pin_stats);
+            cinfo->pairs.keys[cinfo->pairs.n] = "packet_in_queue_depth";
+            cinfo->pairs.values[cinfo->pairs.n++]
+                = xasprintf("%u", pin_stats.n_queued);
+            cinfo->pairs.keys[cinfo->pairs.n] = "packet_in_drain_rate";
+            cinfo->pairs.values[cinfo->pairs.n++]
+                = xasprintf("%u", ofconn->drain_rate);
+            cinfo->pairs.keys[cinfo->pairs.n] = "packet_in_dropped";
+            cinfo->pairs.values[cinfo->pairs.n++]
+                = xasprintf("%llu", pin_stats.n_dropped);
+            if (ofconn->schedulers[0]) {
+                int rate, burst;
+
+                pinsched_get_limits(ofconn->schedulers[0], &rate, &burst);
+                cinfo->pairs.keys[cinfo->pairs.n] = "packet_in_rate_limit";
+                cinfo->pairs.values[cinfo->pairs.n++]
+                    = xasprintf("%d", rate);
+            }
         }
     }
 }
@@ -647,7 +722,7 @@ add_controller(struct connmgr *mgr, const char *target, uint8_t dscp,
 
     ofconn = ofconn_create(mgr, rconn_create(5, 8, dscp, allowed_versions),
                            OFCONN_PRIMARY, true);
-    ofconn->pktbuf = pktbuf_create();
+    ofconn->pktbuf = pktbuf_create(ofconn->n_buffers, ofconn->buffer_bytes);
     rconn_connect(ofconn->rconn, target, name);
     hmap_insert(&mgr->controllers, &ofconn->hmap_node, hash_string(target, 0));
 
@@ -960,6 +1035,15 @@ ofconn_set_controller_id(struct ofconn *ofconn, uint16_t controller_id)
     ofconn->controller_id = controller_id;
 }
 
+/* Returns the number of packet buffers that 'ofconn' offers to its peer. */
+unsigned int
+ofconn_get_n_buffers(const struct ofconn *ofconn)
+{
+    return (ofconn->pktbuf
+            ? pktbuf_capacity(ofconn->pktbuf)
+            : ofconn->n_buffers);
+}
+
 /* Returns the default miss send length for 'ofconn'. */
 int
 ofconn_get_miss_send_len(const struct ofconn *ofconn)
@@ -1085,6 +1169,8 @@ ofconn_create(struct connmgr *mgr, struct rconn *rconn, enum ofconn_type type,
     ofconn->rconn = rconn;
     ofconn->type = type;
     ofconn->enable_async_msgs = enable_async_msgs;
+    ofconn->n_buffers = PKTBUF_DEFAULT_CNT;
+    ofconn->buffer_bytes = PKTBUF_DEFAULT_BYTES;
 
     list_init(&ofconn->opgroups);
 
@@ -1126,14 +1212,27 @@ ofconn_flush(struct ofconn *ofconn)
         if (ofconn->schedulers[i]) {
             int rate, burst;
 
-            pinsched_get_limits(ofconn->schedulers[i], &rate, &burst);
+            if (ofconn->adaptive_rate_limit) {
+                /* Forget what was learned about the old connection. */
+                rate = ofconn_initial_rate(ofconn);
+                burst = ofconn->burst_limit;
+            } else {
+                pinsched_get_limits(ofconn->schedulers[i], &rate, &burst);
+            }
             pinsched_destroy(ofconn->schedulers[i]);
             ofconn->schedulers[i] = pinsched_create(rate, burst);
         }
     }
+    ofconn->fc_time = time_msec();
+    ofconn->fc_n_sent = 0;
+    ofconn->fc_n_limited = 0;
+    ofconn->fc_n_overflow = 0;
+    ofconn->drain_rate = 0;
+    ofconn->fc_sampled = false;
     if (ofconn->pktbuf) {
         pktbuf_destroy(ofconn->pktbuf);
-        ofconn->pktbuf = pktbuf_create();
+        ofconn->pktbuf = pktbuf_create(ofconn->n_buffers,
+                                       ofconn->buffer_bytes);
     }
     ofconn->miss_send_len = (ofconn->type == OFCONN_PRIMARY
                              ? OFP_DEFAULT_MISS_SEND_LEN
@@ -1204,6 +1303,8 @@ ofconn_destroy(struct ofconn *ofconn)
 static void
 ofconn_reconfigure(struct ofconn *ofconn, const struct ofproto_controller *c)
 {
+    unsigned int n_buffers;
+    size_t buffer_bytes;
     int probe_interval;
 
     ofconn->band = c->band;
@@ -1214,7 +1315,22 @@ ofconn_reconfigure(struct ofconn *ofconn, const struct ofproto_controller *c)
     probe_interval = c->probe_interval ? MAX(c->probe_interval, 5) : 0;
     rconn_set_probe_interval(ofconn->rconn, probe_interval);
 
-    ofconn_set_rate_limit(ofconn, c->rate_limit, c->burst_limit);
+    ofconn_set_rate_limit(ofconn, c->rate_limit, c->burst_limit,
+                          c->adaptive_rate_limit);
+
+    /* Packets already buffered are lost if the buffers are resized. */
+    n_buffers = c->n_buffers ? c->n_buffers : PKTBUF_DEFAULT_CNT;
+    buffer_bytes = c->buffer_bytes ? c->buffer_bytes : PKTBUF_DEFAULT_BYTES;
+    if (ofconn->n_buffers != n_buffers
+        || ofconn->buffer_bytes != buffer_bytes) {
+        ofconn->n_buffers = n_buffers;
+        ofconn->buffer_bytes = buffer_bytes;
+        if (ofconn->pktbuf) {
+            pktbuf_destroy(ofconn->pktbuf);
+            ofconn->pktbuf = pktbuf_create(ofconn->n_buffers,
+                                           ofconn->buffer_bytes);
+        }
+    }
 
     /* If dscp value changed reconnect. */
     if (c->dscp != rconn_get_dscp(ofconn->rconn)) {
@@ -1239,6 +1355,9 @@ ofconn_run(struct ofconn *ofconn,
     struct connmgr *mgr = ofconn->connmgr;
     size_t i;
 
+    if (rconn_is_connected(ofconn->rconn)) {
+        ofconn_run_flow_control(ofconn);
+    }
     for (i = 0; i < N_SCHEDULERS; i++) {
         pinsched_run(ofconn->schedulers[i], do_send_packet_in, ofconn);
     }
@@ -1285,6 +1404,9 @@ ofconn_wait(struct ofconn *ofconn, bool handling_openflow)
     for (i = 0; i < N_SCHEDULERS; i++) {
         pinsched_wait(ofconn->schedulers[i]);
     }
+    if (ofconn->adaptive_rate_limit && rconn_is_connected(ofconn->rconn)) {
+        poll_timer_wait_until(ofconn->fc_time + OFCONN_FC_INTERVAL);
+    }
     rconn_run_wait(ofconn->rconn);
     if (handling_openflow && ofconn_may_recv(ofconn)) {
         rconn_recv_wait(ofconn->rconn);
@@ -1341,11 +1463,34 @@ ofconn_make_name(const struct connmgr *mgr, const char *target)
     return xasprintf("%s<->%s", mgr->name, target);
 }
 
+/* Returns the packet-in rate limit, in packets per second, with which
+ * 'ofconn' starts out on a new connection, or 0 if 'ofconn' does not limit
+ * the rate of packet-ins.  An adaptive rate limit without a configured rate
+ * starts out at the maximum, so that a controller that keeps up is never
+ * throttled. */
+static int
+ofconn_initial_rate(const struct ofconn *ofconn)
+{
+    return (ofconn->rate_limit > 0 ? ofconn->rate_limit
+            : ofconn->adaptive_rate_limit ? OFCONN_FC_MAX_RATE
+            : 0);
+}
+
 static void
-ofconn_set_rate_limit(struct ofconn *ofconn, int rate, int burst)
+ofconn_set_rate_limit(struct ofconn *ofconn, int rate, int burst,
+                      bool adaptive)
 {
     int i;
 
+    if (ofconn->rate_limit == rate && ofconn->burst_limit == burst
+        && ofconn->adaptive_rate_limit == adaptive) {
+        return;
+    }
+    ofconn->rate_limit = rate;
+    ofconn->burst_limit = burst;
+    ofconn->adaptive_rate_limit = adaptive;
+
+    rate = ofconn_initial_rate(ofconn);
     for (i = 0; i < N_SCHEDULERS; i++) {
         struct pinsched **s = &ofconn->schedulers[i];
 
@@ -1362,6 +1507,132 @@ ofconn_set_rate_limit(struct ofconn *ofconn, int rate, int burst)
     }
 }
 
+static void
+ofconn_get_packet_in_stats(const struct ofconn *ofconn,
+                           struct ofconn_packet_in_stats *stats)
+{
+    const struct rconn_packet_counter *counter = ofconn->packet_in_counter;
+    int i;
+
+    stats->n_queued = counter->n_packets;
+    stats->n_sent = counter->n_sent;
+    stats->n_limited = 0;
+    stats->n_dropped = counter->n_dropped;
+    for (i = 0; i < N_SCHEDULERS; i++) {
+        struct pinsched_stats ps_stats;
+
+        pinsched_get_stats(ofconn->schedulers[i], &ps_stats);
+        stats->n_queued += ps_stats.n_queued;
+        stats->n_limited += ps_stats.n_limited;
+        stats->n_dropped += ps_stats.n_queue_dropped;
+    }
+}
+
+/* Returns the rate, in packet-ins per second, at which a controller is taking
+ * packet-ins, given that it took 'n_sent' of them over the last 'elapsed'
+ * msecs and that 'drain_rate' was the rate before that.  The rate is an
+ * exponentially weighted moving average, so that a single slow or fast
+ * interval does not throw it off.  The first sample after a (re)connection,
+ * indicated by 'sampled' being false, has nothing to average with, so it
+ * becomes the rate as is. */
+unsigned int
+ofconn_fc_drain_rate(unsigned int drain_rate, bool sampled,
+                     unsigned long long int n_sent, long long int elapsed)
+{
+    unsigned long long int sample;
+
+    sample = elapsed > 0 ? n_sent * 1000 / elapsed : 0;
+    if (sampled) {
+        sample = (3ULL * drain_rate + sample) / 4;
+    }
+    return MIN(sample, UINT_MAX);
+}
+
+/* Returns the new adaptive packet-in rate limit for a controller whose limit
+ * is currently 'rate' and which is taking packet-ins at 'drain_rate':
+ *
+ *     - If 'n_queued' packet-ins are backing up on the rconn, that is, at
+ *       least half of OFCONN_PACKET_IN_MAX, or if 'overflowed' is true
+ *       because the rconn dropped some since the last update, then the
+ *       controller cannot keep up, so the limit drops a little below
+ *       'drain_rate'.  The backlog then moves into the pinsched queues, which
+ *       are bounded by the burst limit and share out drops fairly among
+ *       ports, instead of being dropped indiscriminately when the rconn
+ *       overflows.
+ *
+ *     - If the rconn is nearly empty but 'limited' is true because the limit
+ *       held some packet-ins back since the last update, then the controller
+ *       has room for more, so the limit rises by 1/8.
+ *
+ * The result is always between OFCONN_FC_MIN_RATE and OFCONN_FC_MAX_RATE.
+ *
+ * The rconn has no way to measure the controller's round-trip time while it
+ * is busy, so the rconn backlog, which is the queuing delay multiplied by the
+ * drain rate, stands in for it. */
+int
+ofconn_fc_rate_limit(int rate, unsigned int drain_rate, unsigned int n_queued,
+                     bool overflowed, bool limited)
+{
+    int new_rate = rate;
+
+    if (n_queued >= OFCONN_PACKET_IN_MAX / 2 || overflowed) {
+        new_rate = MIN(rate, drain_rate) / 8 * 7;
+    } else if (n_queued < OFCONN_PACKET_IN_MAX / 4 && limited) {
+        new_rate = rate + rate / 8;
+    }
+    new_rate = MAX(new_rate, OFCONN_FC_MIN_RATE);
+    new_rate = MIN(new_rate, OFCONN_FC_MAX_RATE);
+
+    return new_rate;
+}
+
+/* Once every OFCONN_FC_INTERVAL ms, updates the rate at which 'ofconn''s
+ * controller is taking packet-ins and, if 'ofconn' has an adaptive rate limit,
+ * adjusts the limit with ofconn_fc_rate_limit(). */
+static void
+ofconn_run_flow_control(struct ofconn *ofconn)
+{
+    const struct rconn_packet_counter *counter = ofconn->packet_in_counter;
+    struct ofconn_packet_in_stats stats;
+    long long int now, elapsed;
+
+    now = time_msec();
+    elapsed = now - ofconn->fc_time;
+    if (elapsed < OFCONN_FC_INTERVAL) {
+        return;
+    }
+
+    ofconn_get_packet_in_stats(ofconn, &stats);
+    ofconn->drain_rate = ofconn_fc_drain_rate(ofconn->drain_rate,
+                                              ofconn->fc_sampled,
+                                              stats.n_sent - ofconn->fc_n_sent,
+                                              elapsed);
+    ofconn->fc_sampled = true;
+
+    if (ofconn->adaptive_rate_limit && ofconn->schedulers[0]) {
+        int rate, burst, new_rate;
+
+        pinsched_get_limits(ofconn->schedulers[0], &rate, &burst);
+        new_rate = ofconn_fc_rate_limit(
+            rate, ofconn->drain_rate, counter->n_packets,
+            counter->n_dropped > ofconn->fc_n_overflow,
+            stats.n_limited > ofconn->fc_n_limited);
+        if (new_rate != rate) {
+            int i;
+
+            for (i = 0; i < N_SCHEDULERS; i++) {
+                pinsched_set_limits(ofconn->schedulers[i], new_rate,
+                                    ofconn->burst_limit);
+            }
+        }
+    }
+
+    ofconn->fc_time = now;
+    ofconn->fc_n_sent = stats.n_sent;
+    ofconn->fc_n_limited = stats.n_limited;
+    ofconn->fc_n_overflow = counter->n_dropped;
+}
+
 static void
 ofconn_send(const struct ofconn *ofconn, struct ofpbuf *msg,
             struct rconn_packet_counter *counter)
@@ -1444,7 +1715,7 @@ do_send_packet_in(struct ofpbuf *ofp_packet_in, void *ofconn_)
     struct ofconn *ofconn = ofconn_;
 
     rconn_send_with_limit(ofconn->rconn, ofp_packet_in,
-                          ofconn->packet_in_counter, 100);
+                          ofconn->packet_in_counter, OFCONN_PACKET_IN_MAX);
 }
 
 /* Takes 'pin', composes an OpenFlow packet-in message from it, and passes it
@@ -1726,6 +1997,7 @@ ofservice_reconfigure(struct ofservice *ofservice,
     ofservice->probe_interval = c->probe_interval;
     ofservice->rate_limit = c->rate_limit;
     ofservice->burst_limit = c->burst_limit;
+    ofservice->adaptive_rate_limit = c->adaptive_rate_limit;
     ofservice->enable_async_msgs = c->enable_async_msgs;
     ofservice->dscp = c->dscp;
 }
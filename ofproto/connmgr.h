@@ -112,6 +112,7 @@ void ofconn_set_controller_id(struct ofconn *, uint16_t controller_id);
 void ofconn_set_invalid_ttl_to_controller(struct ofconn *, bool);
 bool ofconn_get_invalid_ttl_to_controller(struct ofconn *);
 
+unsigned int ofconn_get_n_buffers(const struct ofconn *);
 int ofconn_get_miss_send_len(const struct ofconn *);
 void ofconn_set_miss_send_len(struct ofconn *, int miss_send_len);
 
@@ -140,6 +141,17 @@ void connmgr_send_flow_removed(struct connmgr *,
 void connmgr_send_packet_in(struct connmgr *,
                             const struct ofputil_packet_in *);
 
+/* Packet-in flow control.  These are the building blocks of the adaptive
+ * packet-in rate limit, exposed so that they can be tested on their own. */
+#define OFCONN_FC_MIN_RATE 100
+#define OFCONN_FC_MAX_RATE 100000
+
+unsigned int ofconn_fc_drain_rate(unsigned int drain_rate, bool sampled,
+                                  unsigned long long int n_sent,
+                                  long long int elapsed);
+int ofconn_fc_rate_limit(int rate, unsigned int drain_rate,
+                         unsigned int n_queued, bool overflowed, bool limited);
+
 /* Fail-open settings. */
 enum ofproto_fail_mode connmgr_get_fail_mode(const struct connmgr *);
 void connmgr_set_fail_mode(struct connmgr *, enum ofproto_fail_mode);
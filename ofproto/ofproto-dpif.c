@@ -189,6 +189,7 @@ static void bundle_destroy(struct ofbundle *);
 static void bundle_del_port(struct ofport_dpif *);
 static void bundle_run(struct ofbundle *);
 static void bundle_wait(struct ofbundle *);
+static void flood_cache_invalidate(struct ofproto_dpif *);
 static struct ofbundle *lookup_input_bundle(const struct ofproto_dpif *,
                                             uint16_t in_port, bool warn,
                                             struct ofport_dpif **in_ofportp);
@@ -203,6 +204,16 @@ static struct ofbundle ofpp_none_bundle = {
     .vlan_mode = PORT_VLAN_TRUNK
 };
 
+/* The bundles to which xlate_normal() floods a packet in 'vlan': those that
+ * include 'vlan', are floodable, and do not output mirrored traffic, in the
+ * order of their ofproto's 'bundles'.  Flooding skips the input bundle. */
+struct flood_vlan {
+    struct hmap_node hmap_node; /* In struct ofproto_dpif's 'flood_vlans'. */
+    uint16_t vlan;              /* Key. */
+    struct ofbundle **bundles;
+    size_t n_bundles;
+};
+
 static void stp_run(struct ofproto_dpif *ofproto);
 static void stp_wait(struct ofproto_dpif *ofproto);
 static int set_stp_port(struct ofport *,
@@ -248,6 +259,17 @@ struct xlate_out {
     uint16_t nf_output_iface;   /* Output interface index for NetFlow. */
     mirror_mask_t mirrors;      /* Bitmap of associated mirrors. */
 
+    /* The hash that a bond reported for each output to one of its slaves, so
+     * that facet_account() can account the traffic to the bond's bucket
+     * without hashing the flow again.  If there are more such outputs than
+     * fit, 'n_bond_hashes' is SIZE_MAX and facet_account() falls back to
+     * hashing. */
+    struct xlate_bond_hash {
+        uint32_t odp_port;      /* Bond slave's datapath port number. */
+        uint32_t hash;          /* From bond_choose_output_slave(). */
+    } bond_hashes[4];
+    size_t n_bond_hashes;
+
     uint64_t odp_actions_stub[256 / 8];
     struct ofpbuf odp_actions;
 };
@@ -712,6 +734,13 @@ struct ofproto_dpif {
     bool has_mirrors;
     bool has_bonded_bundles;
 
+    /* Flooding.  Built on demand, discarded by flood_cache_invalidate(). */
+    struct hmap flood_vlans;    /* Contains "struct flood_vlan"s. */
+    uint16_t *all_ports;        /* Ports for OFPP_ALL, or NULL if not built. */
+    size_t n_all_ports;
+    uint16_t *flood_ports;      /* Ports for OFPP_FLOOD, if 'all_ports'. */
+    size_t n_flood_ports;
+
     /* Facets. */
     struct classifier facets;     /* Contains 'struct facet's. */
     struct hmap subfacets;
@@ -1405,6 +1434,10 @@ construct(struct ofproto *ofproto_)
         ofproto->mirrors[i] = NULL;
     }
     ofproto->has_bonded_bundles = false;
+    hmap_init(&ofproto->flood_vlans);
+    ofproto->all_ports = NULL;
+    ofproto->flood_ports = NULL;
+    ofproto->n_all_ports = ofproto->n_flood_ports = 0;
 
     classifier_init(&ofproto->facets);
     hmap_init(&ofproto->subfacets);
@@ -1588,6 +1621,8 @@ destruct(struct ofproto *ofproto_)
     dpif_sflow_destroy(ofproto->sflow);
     hmap_destroy(&ofproto->bundles);
     mac_learning_destroy(ofproto->ml);
+    flood_cache_invalidate(ofproto);
+    hmap_destroy(&ofproto->flood_vlans);
 
     classifier_destroy(&ofproto->facets);
     hmap_destroy(&ofproto->subfacets);
@@ -1852,6 +1887,7 @@ port_construct(struct ofport *port_)
     int error;
 
     ofproto->backer->need_revalidate = REV_RECONFIGURE;
+    flood_cache_invalidate(ofproto);
     port->bundle = NULL;
     port->cfm = NULL;
     port->tag = tag_create_random();
@@ -1934,6 +1970,7 @@ port_destruct(struct ofport *port_)
     sset_find_and_delete(&ofproto->ports, devname);
     sset_find_and_delete(&ofproto->ghost_ports, devname);
     ofproto->backer->need_revalidate = REV_RECONFIGURE;
+    flood_cache_invalidate(ofproto);
     bundle_remove(port_);
     set_cfm(port_, NULL);
     if (port->stp_port) {
@@ -1973,8 +2010,11 @@ port_reconfigured(struct ofport *port_, enum ofputil_port_config old_config)
                    OFPUTIL_PC_NO_PACKET_IN)) {
         ofproto->backer->need_revalidate = REV_RECONFIGURE;
 
-        if (changed & OFPUTIL_PC_NO_FLOOD && port->bundle) {
-            bundle_update(port->bundle);
+        if (changed & OFPUTIL_PC_NO_FLOOD) {
+            flood_cache_invalidate(ofproto);
+            if (port->bundle) {
+                bundle_update(port->bundle);
+            }
         }
     }
 }
@@ -2428,6 +2468,7 @@ bundle_flush_macs(struct ofbundle *bundle, bool all_ofprotos)
     struct mac_entry *mac, *next_mac;
 
     ofproto->backer->need_revalidate = REV_RECONFIGURE;
+    mac_learning_lock(ml);
     LIST_FOR_EACH_SAFE (mac, next_mac, lru_node, &ml->lrus) {
         if (mac->port.p == bundle) {
             if (all_ofprotos) {
@@ -2437,11 +2478,13 @@ bundle_flush_macs(struct ofbundle *bundle, bool all_ofprotos)
                     if (o != ofproto) {
                         struct mac_entry *e;
 
+                        mac_learning_lock(o->ml);
                         e = mac_learning_lookup(o->ml, mac->mac, mac->vlan,
                                                 NULL);
                         if (e) {
                             mac_learning_expire(o->ml, e);
                         }
+                        mac_learning_unlock(o->ml);
                     }
                 }
             }
@@ -2449,6 +2492,7 @@ bundle_flush_macs(struct ofbundle *bundle, bool all_ofprotos)
             mac_learning_expire(ml, mac);
         }
     }
+    mac_learning_unlock(ml);
 }
 
 static struct ofbundle *
@@ -2488,6 +2532,7 @@ bundle_update(struct ofbundle *bundle)
 {
     struct ofport_dpif *port;
 
+    flood_cache_invalidate(bundle->ofproto);
     bundle->floodable = true;
     LIST_FOR_EACH (port, bundle_node, &bundle->ports) {
         if (port->up.pp.config & OFPUTIL_PC_NO_FLOOD
@@ -2562,6 +2607,7 @@ bundle_destroy(struct ofbundle *bundle)
     }
 
     ofproto = bundle->ofproto;
+    flood_cache_invalidate(ofproto);
     for (i = 0; i < MAX_MIRRORS; i++) {
         struct ofmirror *m = ofproto->mirrors[i];
         if (m) {
@@ -2600,6 +2646,9 @@ bundle_set(struct ofproto *ofproto_, void *aux,
     size_t i;
     bool ok;
 
+    /* Any change to a bundle can change where packets are flooded. */
+    flood_cache_invalidate(ofproto);
+
     if (!s) {
         bundle_destroy(bundle_lookup(ofproto, aux));
         return 0;
@@ -2822,6 +2871,7 @@ bundle_send_learning_packets(struct ofbundle *bundle)
     struct mac_entry *e;
 
     error = n_packets = n_errors = 0;
+    mac_learning_lock(ofproto->ml);
     LIST_FOR_EACH (e, lru_node, &ofproto->ml->lrus) {
         if (e->port.p != bundle) {
             struct ofpbuf *learning_packet;
@@ -2844,6 +2894,7 @@ bundle_send_learning_packets(struct ofbundle *bundle)
             n_packets++;
         }
     }
+    mac_learning_unlock(ofproto->ml);
 
     if (n_errors) {
         static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
@@ -3056,6 +3107,7 @@ mirror_set(struct ofproto *ofproto_, void *aux,
 
     ofproto->backer->need_revalidate = REV_RECONFIGURE;
     ofproto->has_mirrors = true;
+    flood_cache_invalidate(ofproto);
     mac_learning_flush(ofproto->ml,
                        &ofproto->backer->revalidate_set);
     mirror_update_dups(ofproto);
@@ -3085,6 +3137,7 @@ mirror_destroy(struct ofmirror *mirror)
         bundle->dst_mirrors &= ~mirror_bit;
         bundle->mirror_out &= ~mirror_bit;
     }
+    flood_cache_invalidate(ofproto);
 
     hmapx_destroy(&mirror->srcs);
     hmapx_destroy(&mirror->dsts);
@@ -4186,6 +4239,12 @@ handle_miss_upcalls(struct dpif_backer *backer, struct dpif_upcall *upcalls,
     }
     ovs_assert(n_ops <= ARRAY_SIZE(flow_miss_ops));
 
+    /* Install the flows that "learn" actions produced for this batch, so
+     * that they are in place before the next batch is translated. */
+    HMAP_FOR_EACH (miss, hmap_node, &todo) {
+        ofproto_flush_learned_flows(&miss->ofproto->up);
+    }
+
     /* Execute batch. */
     for (i = 0; i < n_ops; i++) {
         dpif_ops[i] = &flow_miss_ops[i].dpif_op;
@@ -4906,6 +4965,7 @@ static void
 facet_account(struct facet *facet)
 {
     struct ofproto_dpif *ofproto = ofproto_dpif_cast(facet->rule->up.ofproto);
+    struct ofport_dpif *port;
     const struct nlattr *a;
     unsigned int left;
     ovs_be16 vlan_tci;
@@ -4916,6 +4976,20 @@ facet_account(struct facet *facet)
     }
     n_bytes = facet->byte_count - facet->accounted_bytes;
 
+    if (facet->xout.n_bond_hashes != SIZE_MAX) {
+        size_t i;
+
+        for (i = 0; i < facet->xout.n_bond_hashes; i++) {
+            const struct xlate_bond_hash *bh = &facet->xout.bond_hashes[i];
+
+            port = get_odp_port(ofproto, bh->odp_port);
+            if (port && port->bundle && port->bundle->bond) {
+                bond_account_hash(port->bundle->bond, bh->hash, n_bytes);
+            }
+        }
+        return;
+    }
+
     /* This loop feeds byte counters to bond_account() for rebalancing to use
      * as a basis.  We also need to track the actual VLAN on which the packet
      * is going to be sent to ensure that it matches the one passed to
@@ -4928,7 +5002,6 @@ facet_account(struct facet *facet)
     NL_ATTR_FOR_EACH_UNSAFE (a, left, facet->xout.odp_actions.data,
                              facet->xout.odp_actions.size) {
         const struct ovs_action_push_vlan *vlan;
-        struct ofport_dpif *port;
 
         switch (nl_attr_type(a)) {
         case OVS_ACTION_ATTR_OUTPUT:
@@ -5205,6 +5278,9 @@ facet_revalidate(struct facet *facet)
     facet->xout.has_fin_timeout = xout.has_fin_timeout;
     facet->xout.nf_output_iface = xout.nf_output_iface;
     facet->xout.mirrors = xout.mirrors;
+    memcpy(facet->xout.bond_hashes, xout.bond_hashes,
+           sizeof facet->xout.bond_hashes);
+    facet->xout.n_bond_hashes = xout.n_bond_hashes;
     facet->nf_flow.output_iface = facet->xout.nf_output_iface;
 
     if (facet->rule != new_rule) {
@@ -6119,7 +6195,7 @@ compose_output_action__(struct xlate_ctx *ctx, uint16_t ofp_port,
 
     /* If 'struct flow' gets additional metadata, we'll need to zero it out
      * before traversing a patch port. */
-    BUILD_ASSERT_DECL(FLOW_WC_SEQ == 20);
+    BUILD_ASSERT_DECL(FLOW_WC_SEQ == 21);
 
     if (!ofport) {
         xlate_report(ctx, "Nonexistent output port");
@@ -6155,6 +6231,8 @@ compose_output_action__(struct xlate_ctx *ctx, uint16_t ofp_port,
         ctx->xin->flow.metadata = htonll(0);
         memset(&ctx->xin->flow.tunnel, 0, sizeof ctx->xin->flow.tunnel);
         memset(ctx->xin->flow.regs, 0, sizeof ctx->xin->flow.regs);
+        ctx->xin->flow.dp_hash = 0;
+        ctx->xin->flow.recirc_id = 0;
 
         in_port = get_ofp_port(ctx->ofproto, ctx->xin->flow.in_port);
         special = process_special(ctx, &ctx->xin->flow, in_port,
@@ -6361,22 +6439,103 @@ xlate_ofpact_resubmit(struct xlate_ctx *ctx,
     xlate_table_action(ctx, in_port, table_id, false);
 }
 
+/* Flooding.
+ *
+ * Visiting every port or bundle to decide where to flood a packet is
+ * expensive on a bridge with thousands of ports, so 'ofproto' keeps the
+ * answers, computed on first use.  Any change to the set of ports or bundles,
+ * to a port's OFPUTIL_PC_NO_FLOOD bit, or to a bundle's VLANs, 'floodable',
+ * or 'mirror_out' must call flood_cache_invalidate() to discard them. */
+
 static void
-flood_packets(struct xlate_ctx *ctx, bool all)
+flood_cache_invalidate(struct ofproto_dpif *ofproto)
+{
+    struct flood_vlan *fv, *next_fv;
+
+    HMAP_FOR_EACH_SAFE (fv, next_fv, hmap_node, &ofproto->flood_vlans) {
+        hmap_remove(&ofproto->flood_vlans, &fv->hmap_node);
+        free(fv->bundles);
+        free(fv);
+    }
+
+    free(ofproto->all_ports);
+    free(ofproto->flood_ports);
+    ofproto->all_ports = NULL;
+    ofproto->flood_ports = NULL;
+    ofproto->n_all_ports = ofproto->n_flood_ports = 0;
+}
+
+/* Returns the bundles to which to flood packets in 'vlan' in 'ofproto'. */
+static const struct flood_vlan *
+flood_vlan_get(struct ofproto_dpif *ofproto, uint16_t vlan)
 {
+    uint32_t hash = hash_int(vlan, 0);
+    struct ofbundle *bundle;
+    struct flood_vlan *fv;
+
+    HMAP_FOR_EACH_WITH_HASH (fv, hmap_node, hash, &ofproto->flood_vlans) {
+        if (fv->vlan == vlan) {
+            return fv;
+        }
+    }
+
+    fv = xmalloc(sizeof *fv);
+    fv->vlan = vlan;
+    fv->bundles = xmalloc(hmap_count(&ofproto->bundles) * sizeof *fv->bundles);
+    fv->n_bundles = 0;
+    HMAP_FOR_EACH (bundle, hmap_node, &ofproto->bundles) {
+        if (ofbundle_includes_vlan(bundle, vlan)
+            && bundle->floodable
+            && !bundle->mirror_out) {
+            fv->bundles[fv->n_bundles++] = bundle;
+        }
+    }
+    hmap_insert(&ofproto->flood_vlans, &fv->hmap_node, hash);
+
+    return fv;
+}
+
+static void
+flood_ports_build(struct ofproto_dpif *ofproto)
+{
+    size_t n_ports = hmap_count(&ofproto->up.ports);
     struct ofport_dpif *ofport;
 
-    HMAP_FOR_EACH (ofport, up.hmap_node, &ctx->ofproto->up.ports) {
+    ofproto->all_ports = xmalloc(n_ports * sizeof *ofproto->all_ports);
+    ofproto->flood_ports = xmalloc(n_ports * sizeof *ofproto->flood_ports);
+    HMAP_FOR_EACH (ofport, up.hmap_node, &ofproto->up.ports) {
         uint16_t ofp_port = ofport->up.ofp_port;
 
-        if (ofp_port == ctx->xin->flow.in_port) {
+        ofproto->all_ports[ofproto->n_all_ports++] = ofp_port;
+        if (!(ofport->up.pp.config & OFPUTIL_PC_NO_FLOOD)) {
+            ofproto->flood_ports[ofproto->n_flood_ports++] = ofp_port;
+        }
+    }
+}
+
+static void
+flood_packets(struct xlate_ctx *ctx, bool all)
+{
+    struct ofproto_dpif *ofproto = ctx->ofproto;
+    const uint16_t *ports;
+    size_t n_ports;
+    size_t i;
+
+    if (!ofproto->all_ports) {
+        flood_ports_build(ofproto);
+    }
+    ports = all ? ofproto->all_ports : ofproto->flood_ports;
+    n_ports = all ? ofproto->n_all_ports : ofproto->n_flood_ports;
+
+    for (i = 0; i < n_ports; i++) {
+        if (ports[i] == ctx->xin->flow.in_port) {
             continue;
         }
 
         if (all) {
-            compose_output_action__(ctx, ofp_port, false);
-        } else if (!(ofport->up.pp.config & OFPUTIL_PC_NO_FLOOD)) {
-            compose_output_action(ctx, ofp_port);
+            compose_output_action__(ctx, ports[i], false);
+        } else {
+            compose_output_action(ctx, ports[i]);
         }
     }
 
@@ -6725,11 +6884,9 @@ static void
 xlate_learn_action(struct xlate_ctx *ctx,
                    const struct ofpact_learn *learn)
 {
-    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 1);
     struct ofputil_flow_mod fm;
     uint64_t ofpacts_stub[1024 / 8];
     struct ofpbuf ofpacts;
-    int error;
 
     ctx->xout->has_learn = true;
 
@@ -6741,13 +6898,7 @@ xlate_learn_action(struct xlate_ctx *ctx,
 
     ofpbuf_use_stack(&ofpacts, ofpacts_stub, sizeof ofpacts_stub);
     learn_execute(learn, &ctx->xin->flow, &fm, &ofpacts);
-
-    error = ofproto_flow_mod(&ctx->ofproto->up, &fm);
-    if (error && !VLOG_DROP_WARN(&rl)) {
-        VLOG_WARN("learning action failed to modify flow table (%s)",
-                  ofperr_get_name(error));
-    }
-
+    ofproto_learn_flow(&ctx->ofproto->up, &fm);
     ofpbuf_uninit(&ofpacts);
 }
 
@@ -7206,12 +7357,7 @@ xlate_actions(struct xlate_in *xin, struct xlate_out *xout)
     wc->masks.nw_frag |= FLOW_NW_FRAG_MASK;
     is_icmp = is_icmpv4(&ctx.xin->flow) || is_icmpv6(&ctx.xin->flow);
 
-    if (tnl_port_should_receive(&ctx.xin->flow)) {
-        memset(&wc->masks.tunnel, 0xff, sizeof wc->masks.tunnel);
-        /* skb_mark is currently used only by tunnels but that will likely
-         * change in the future. */
-        memset(&wc->masks.skb_mark, 0xff, sizeof wc->masks.skb_mark);
-    }
+    tnl_wc_init(&ctx.xin->flow, wc);
 
     /* Disable most wildcarding for NetFlow. */
     if (xin->ofproto->netflow) {
@@ -7225,6 +7371,7 @@ xlate_actions(struct xlate_in *xin, struct xlate_out *xout)
     ctx.xout->has_fin_timeout = false;
     ctx.xout->nf_output_iface = NF_OUT_DROP;
     ctx.xout->mirrors = 0;
+    ctx.xout->n_bond_hashes = 0;
 
     ofpbuf_use_stub(&ctx.xout->odp_actions, ctx.xout->odp_actions_stub,
                     sizeof ctx.xout->odp_actions_stub);
@@ -7390,6 +7537,8 @@ xlate_out_copy(struct xlate_out *dst, const struct xlate_out *src)
     dst->has_fin_timeout = src->has_fin_timeout;
     dst->nf_output_iface = src->nf_output_iface;
     dst->mirrors = src->mirrors;
+    memcpy(dst->bond_hashes, src->bond_hashes, sizeof dst->bond_hashes);
+    dst->n_bond_hashes = src->n_bond_hashes;
 
     ofpbuf_use_stub(&dst->odp_actions, dst->odp_actions_stub,
                     sizeof dst->odp_actions_stub);
@@ -7515,6 +7664,8 @@ output_normal(struct xlate_ctx *ctx, const struct ofbundle *out_bundle,
               uint16_t vlan)
 {
     struct ofport_dpif *port;
+    uint32_t bond_hash = 0;
+    size_t actions_size;
     uint16_t vid;
     ovs_be16 tci, old_tci;
 
@@ -7523,7 +7674,8 @@ output_normal(struct xlate_ctx *ctx, const struct ofbundle *out_bundle,
         port = ofbundle_get_a_port(out_bundle);
     } else {
         port = bond_choose_output_slave(out_bundle->bond, &ctx->xin->flow,
-                                        &ctx->xout->wc, vid, &ctx->xout->tags);
+                                        &ctx->xout->wc, vid, &ctx->xout->tags,
+                                        &bond_hash);
         if (!port) {
             /* No slaves enabled, so drop packet. */
             return;
@@ -7540,8 +7692,23 @@ output_normal(struct xlate_ctx *ctx, const struct ofbundle *out_bundle,
     }
     ctx->xin->flow.vlan_tci = tci;
 
+    actions_size = ctx->xout->odp_actions.size;
     compose_output_action(ctx, port->up.ofp_port);
     ctx->xin->flow.vlan_tci = old_tci;
+
+    if (out_bundle->bond && ctx->xout->odp_actions.size > actions_size) {
+        struct xlate_out *xout = ctx->xout;
+
+        if (xout->n_bond_hashes < ARRAY_SIZE(xout->bond_hashes)) {
+            struct xlate_bond_hash *bh;
+
+            bh = &xout->bond_hashes[xout->n_bond_hashes++];
+            bh->odp_port = port->odp_port;
+            bh->hash = bond_hash;
+        } else {
+            xout->n_bond_hashes = SIZE_MAX;
+        }
+    }
 }
 
 static int
@@ -7731,7 +7898,8 @@ update_learning_table(struct ofproto_dpif *ofproto,
                       const struct flow *flow, struct flow_wildcards *wc,
                       int vlan, struct ofbundle *in_bundle)
 {
-    struct mac_entry *mac;
+    enum mac_grat_arp grat_arp;
+    tag_type tag;
 
     /* Don't learn the OFPP_NONE port. */
     if (in_bundle == &ofpp_none_bundle) {
@@ -7742,18 +7910,15 @@ update_learning_table(struct ofproto_dpif *ofproto,
         return;
     }
 
-    mac = mac_learning_insert(ofproto->ml, flow->dl_src, vlan);
-    if (is_gratuitous_arp(flow, wc)) {
-        /* We don't want to learn from gratuitous ARP packets that are
-         * reflected back over bond slaves so we lock the learning table. */
-        if (!in_bundle->bond) {
-            mac_entry_set_grat_arp_lock(mac);
-        } else if (mac_entry_is_grat_arp_locked(mac)) {
-            return;
-        }
-    }
+    /* We don't want to learn from gratuitous ARP packets that are reflected
+     * back over bond slaves so we lock the learning table. */
+    grat_arp = (!is_gratuitous_arp(flow, wc) ? MAC_GRAT_ARP_NONE
+                : !in_bundle->bond ? MAC_GRAT_ARP_LOCK
+                : MAC_GRAT_ARP_CHECK);
 
-    if (mac_entry_is_new(mac) || mac->port.p != in_bundle) {
+    tag = mac_learning_update(ofproto->ml, flow->dl_src, vlan, in_bundle,
+                              grat_arp);
+    if (tag) {
         /* The log messages here could actually be useful in debugging,
          * so keep the rate limit relatively high. */
         static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(30, 300);
@@ -7762,9 +7927,7 @@ update_learning_table(struct ofproto_dpif *ofproto,
                     ofproto->up.name, ETH_ADDR_ARGS(flow->dl_src),
                     in_bundle->name, vlan);
 
-        mac->port.p = in_bundle;
-        tag_set_add(&ofproto->backer->revalidate_set,
-                    mac_learning_changed(ofproto->ml, mac));
+        tag_set_add(&ofproto->backer->revalidate_set, tag);
     }
 }
 
@@ -7841,7 +8004,7 @@ is_admissible(struct xlate_ctx *ctx, struct ofport_dpif *in_port,
     }
 
     if (in_bundle->bond) {
-        struct mac_entry *mac;
+        struct mac_entry_info mac;
 
         switch (bond_check_admissibility(in_bundle->bond, in_port,
                                          flow->dl_dst, &ctx->xout->tags)) {
@@ -7853,10 +8016,10 @@ is_admissible(struct xlate_ctx *ctx, struct ofport_dpif *in_port,
             return false;
 
         case BV_DROP_IF_MOVED:
-            mac = mac_learning_lookup(ofproto->ml, flow->dl_src, vlan, NULL);
-            if (mac && mac->port.p != in_bundle &&
-                (!is_gratuitous_arp(flow, &ctx->xout->wc)
-                 || mac_entry_is_grat_arp_locked(mac))) {
+            if (mac_learning_get(ofproto->ml, flow->dl_src, vlan, &mac, NULL)
+                && mac.port != in_bundle
+                && (!is_gratuitous_arp(flow, &ctx->xout->wc)
+                    || mac_entry_info_is_grat_arp_locked(&mac))) {
                 xlate_report(ctx, "SLB bond thinks this packet looped back, "
                             "dropping");
                 return false;
@@ -7874,7 +8037,7 @@ xlate_normal(struct xlate_ctx *ctx)
     struct flow_wildcards *wc = &ctx->xout->wc;
     struct ofport_dpif *in_port;
     struct ofbundle *in_bundle;
-    struct mac_entry *mac;
+    struct mac_entry_info mac;
     uint16_t vlan;
     uint16_t vid;
 
@@ -7936,25 +8099,23 @@ xlate_normal(struct xlate_ctx *ctx)
     }
 
     /* Determine output bundle. */
-    mac = mac_learning_lookup(ctx->ofproto->ml, ctx->xin->flow.dl_dst, vlan,
-                              &ctx->xout->tags);
-    if (mac) {
-        if (mac->port.p != in_bundle) {
+    if (mac_learning_get(ctx->ofproto->ml, ctx->xin->flow.dl_dst, vlan, &mac,
+                         &ctx->xout->tags)) {
+        if (mac.port != in_bundle) {
             xlate_report(ctx, "forwarding to learned port");
-            output_normal(ctx, mac->port.p, vlan);
+            output_normal(ctx, mac.port, vlan);
         } else {
             xlate_report(ctx, "learned port is input port, dropping");
         }
     } else {
-        struct ofbundle *bundle;
+        const struct flood_vlan *fv;
+        size_t i;
 
         xlate_report(ctx, "no learned MAC for destination, flooding");
-        HMAP_FOR_EACH (bundle, hmap_node, &ctx->ofproto->bundles) {
-            if (bundle != in_bundle
-                && ofbundle_includes_vlan(bundle, vlan)
-                && bundle->floodable
-                && !bundle->mirror_out) {
-                output_normal(ctx, bundle, vlan);
+        fv = flood_vlan_get(ctx->ofproto, vlan);
+        for (i = 0; i < fv->n_bundles; i++) {
+            if (fv->bundles[i] != in_bundle) {
+                output_normal(ctx, fv->bundles[i], vlan);
             }
         }
         ctx->xout->nf_output_iface = NF_OUT_FLOOD;
@@ -8241,6 +8402,7 @@ ofproto_unixctl_fdb_show(struct unixctl_conn *conn, int argc OVS_UNUSED,
     }
 
     ds_put_cstr(&ds, " port  VLAN  MAC                Age\n");
+    mac_learning_lock(ofproto->ml);
     LIST_FOR_EACH (e, lru_node, &ofproto->ml->lrus) {
         struct ofbundle *bundle = e->port.p;
         ds_put_format(&ds, "%5d  %4d  "ETH_ADDR_FMT"  %3d\n",
@@ -8248,6 +8410,7 @@ ofproto_unixctl_fdb_show(struct unixctl_conn *conn, int argc OVS_UNUSED,
                       e->vlan, ETH_ADDR_ARGS(e->mac),
                       mac_entry_age(ofproto->ml, e));
     }
+    mac_learning_unlock(ofproto->ml);
     unixctl_command_reply(conn, ds_cstr(&ds));
     ds_destroy(&ds);
 }
@@ -8509,6 +8672,7 @@ ofproto_trace(struct ofproto_dpif *ofproto, const struct flow *flow,
         trace.xin.report_hook = trace_report;
 
         xlate_actions(&trace.xin, &trace.xout);
+        ofproto_flush_learned_flows(&ofproto->up);
 
         ds_put_char(ds, '\n');
         trace_format_flow(ds, 0, "Final flow", &trace);
@@ -43,7 +43,6 @@
 #include "openflow/openflow.h"
 #include "packets.h"
 #include "pinsched.h"
-#include "pktbuf.h"
 #include "poll-loop.h"
 #include "random.h"
 #include "shash.h"
@@ -58,6 +57,8 @@ VLOG_DEFINE_THIS_MODULE(ofproto);
 
 COVERAGE_DEFINE(ofproto_error);
 COVERAGE_DEFINE(ofproto_flush);
+COVERAGE_DEFINE(ofproto_learn_coalesced);
+COVERAGE_DEFINE(ofproto_learn_refreshed);
 COVERAGE_DEFINE(ofproto_no_packet_in);
 COVERAGE_DEFINE(ofproto_packet_out);
 COVERAGE_DEFINE(ofproto_queue_req);
@@ -198,6 +199,13 @@ static bool rule_is_modifiable(const struct rule *);
 static enum ofperr add_flow(struct ofproto *, struct ofconn *,
                             const struct ofputil_flow_mod *,
                             const struct ofp_header *);
+static enum ofperr add_flow__(struct ofproto *, struct ofconn *,
+                              const struct ofputil_flow_mod *,
+                              const struct ofp_header *,
+                              struct ofopgroup *);
+static enum ofperr modify_flow_strict(struct ofproto *, struct ofconn *,
+                                      const struct ofputil_flow_mod *,
+                                      const struct ofp_header *);
 static void delete_flow__(struct rule *, struct ofopgroup *);
 static bool handle_openflow(struct ofconn *, struct ofpbuf *);
 static enum ofperr handle_flow_mod__(struct ofproto *, struct ofconn *,
@@ -209,6 +217,7 @@ static uint64_t pick_datapath_id(const struct ofproto *);
 static uint64_t pick_fallback_dpid(void);
 static void ofproto_destroy__(struct ofproto *);
 static void update_mtu(struct ofproto *, struct ofport *);
+static void learned_flows_clear(struct ofproto *);
 
 /* unixctl. */
 static void ofproto_unixctl_init(void);
@@ -428,6 +437,7 @@ ofproto_create(const char *datapath_name, const char *datapath_type,
     list_init(&ofproto->pending);
     ofproto->n_pending = 0;
     hmap_init(&ofproto->deletions);
+    hmap_init(&ofproto->learned_flows);
     ofproto->n_add = ofproto->n_delete = ofproto->n_modify = 0;
     ofproto->first_op = ofproto->last_op = LLONG_MIN;
     ofproto->next_op_report = LLONG_MAX;
@@ -1046,6 +1056,8 @@ ofproto_destroy__(struct ofproto *ofproto)
     free(ofproto->tables);
 
     hmap_destroy(&ofproto->deletions);
+    learned_flows_clear(ofproto);
+    hmap_destroy(&ofproto->learned_flows);
 
     free(ofproto->vlan_bitmap);
 
@@ -1155,6 +1167,7 @@ ofproto_run(struct ofproto *p)
     if (error && error != EAGAIN) {
         VLOG_ERR_RL(&rl, "%s: run failed (%s)", p->name, strerror(error));
     }
+    ofproto_flush_learned_flows(p);
 
     if (p->ofproto_class->port_poll) {
         char *devname;
@@ -1283,6 +1296,9 @@ ofproto_wait(struct ofproto *p)
             poll_immediate_wake();
         }
     }
+    if (!hmap_is_empty(&p->learned_flows)) {
+        poll_immediate_wake();
+    }
 
     switch (p->state) {
     case S_OPENFLOW:
@@ -1573,6 +1589,167 @@ ofproto_flow_mod(struct ofproto *ofproto, const struct ofputil_flow_mod *fm)
     return handle_flow_mod__(ofproto, NULL, fm, NULL);
 }
 
+/* A flow produced by a "learn" action that has not yet been installed. */
+struct learned_flow {
+    struct hmap_node hmap_node; /* In struct ofproto's 'learned_flows'. */
+    struct ofputil_flow_mod fm; /* Owns 'fm.ofpacts'. */
+};
+
+static uint32_t
+learned_flow_hash(const struct ofputil_flow_mod *fm)
+{
+    return match_hash(&fm->match, hash_2words(fm->priority, fm->table_id));
+}
+
+static struct learned_flow *
+learned_flow_find(const struct ofproto *ofproto,
+                  const struct ofputil_flow_mod *fm)
+{
+    struct learned_flow *lf;
+
+    HMAP_FOR_EACH_WITH_HASH (lf, hmap_node, learned_flow_hash(fm),
+                             &ofproto->learned_flows) {
+        if (lf->fm.priority == fm->priority
+            && lf->fm.table_id == fm->table_id
+            && match_equal(&lf->fm.match, &fm->match)) {
+            return lf;
+        }
+    }
+    return NULL;
+}
+
+static bool
+learned_flow_equal(const struct ofputil_flow_mod *a,
+                   const struct ofputil_flow_mod *b)
+{
+    return (a->new_cookie == b->new_cookie
+            && a->idle_timeout == b->idle_timeout
+            && a->hard_timeout == b->hard_timeout
+            && a->flags == b->flags
+            && ofpacts_equal(a->ofpacts, a->ofpacts_len,
+                             b->ofpacts, b->ofpacts_len));
+}
+
+static void
+learned_flows_clear(struct ofproto *ofproto)
+{
+    struct learned_flow *lf, *next;
+
+    HMAP_FOR_EACH_SAFE (lf, next, hmap_node, &ofproto->learned_flows) {
+        hmap_remove(&ofproto->learned_flows, &lf->hmap_node);
+        free(lf->fm.ofpacts);
+        free(lf);
+    }
+}
+
+/* Installs 'fm', which must be an OFPFC_MODIFY_STRICT produced by
+ * learn_execute(), on behalf of a "learn" action.  The caller retains
+ * ownership of 'fm' and its actions.
+ *
+ * This is much cheaper than ofproto_flow_mod() for the common case where the
+ * same flow is learned over and over again:
+ *
+ *   - If 'fm' would not change the rule that it matches, other than to reset
+ *     its timeouts, then the rule is refreshed in place.  A relearn counts as
+ *     a use of the rule, so this resets its idle timer as well as its hard
+ *     timer.
+ *
+ *   - Otherwise, 'fm' is queued and installed by the next call to
+ *     ofproto_flush_learned_flows(), along with the rest of the batch.  Later
+ *     learns of the same match, priority, and table replace earlier ones in
+ *     the batch, so each distinct flow costs at most one flow table operation
+ *     per batch. */
+void
+ofproto_learn_flow(struct ofproto *ofproto, const struct ofputil_flow_mod *fm)
+{
+    struct learned_flow *lf;
+    struct rule *rule;
+
+    lf = learned_flow_find(ofproto, fm);
+    if (lf) {
+        COVERAGE_INC(ofproto_learn_coalesced);
+        if (!learned_flow_equal(&lf->fm, fm)) {
+            free(lf->fm.ofpacts);
+            lf->fm = *fm;
+            lf->fm.ofpacts = xmemdup(fm->ofpacts, fm->ofpacts_len);
+        }
+        return;
+    }
+
+    rule = (fm->table_id < ofproto->n_tables
+            ? rule_from_cls_rule(classifier_find_match_exactly(
+                                     &ofproto->tables[fm->table_id].cls,
+                                     &fm->match, fm->priority))
+            : NULL);
+    if (rule && !rule->pending && rule_is_modifiable(rule)
+        && rule->flow_cookie == fm->new_cookie
+        && ofpacts_equal(rule->ofpacts, rule->ofpacts_len,
+                         fm->ofpacts, fm->ofpacts_len)) {
+        long long int now = time_msec();
+
+        COVERAGE_INC(ofproto_learn_refreshed);
+        rule->modified = now;
+        rule->used = MAX(rule->used, now);
+        return;
+    }
+
+    lf = xmalloc(sizeof *lf);
+    lf->fm = *fm;
+    lf->fm.ofpacts = xmemdup(fm->ofpacts, fm->ofpacts_len);
+    hmap_insert(&ofproto->learned_flows, &lf->hmap_node,
+                learned_flow_hash(fm));
+}
+
+/* Installs all of the flows queued by ofproto_learn_flow().  Flows that are
+ * new to the flow table are added as a single group of operations; flows that
+ * modify an existing rule take the usual OFPFC_MODIFY_STRICT path.
+ *
+ * ofproto_run() calls this, but an ofproto implementation should also call it
+ * after translating each batch of packets, so that flows learned from one
+ * batch take effect before the next one is translated. */
+void
+ofproto_flush_learned_flows(struct ofproto *ofproto)
+{
+    static struct vlog_rate_limit learn_rl = VLOG_RATE_LIMIT_INIT(5, 1);
+    struct learned_flow *lf, *next;
+    struct ofopgroup *group;
+
+    if (hmap_is_empty(&ofproto->learned_flows)) {
+        return;
+    }
+
+    group = ofopgroup_create_unattached(ofproto);
+    HMAP_FOR_EACH_SAFE (lf, next, hmap_node, &ofproto->learned_flows) {
+        const struct ofputil_flow_mod *fm = &lf->fm;
+        struct rule *rule;
+        int error;
+
+        rule = (fm->table_id < ofproto->n_tables
+                ? rule_from_cls_rule(classifier_find_match_exactly(
+                                         &ofproto->tables[fm->table_id].cls,
+                                         &fm->match, fm->priority))
+                : NULL);
+        if (ofproto->n_pending >= 50) {
+            error = OFPROTO_POSTPONE;
+        } else if (rule) {
+            error = modify_flow_strict(ofproto, NULL, fm, NULL);
+        } else if (fm->new_cookie != htonll(UINT64_MAX)) {
+            error = add_flow__(ofproto, NULL, fm, NULL, group);
+        } else {
+            error = 0;
+        }
+        if (error && !VLOG_DROP_WARN(&learn_rl)) {
+            VLOG_WARN("%s: learning action failed to modify flow table (%s)",
+                      ofproto->name, ofperr_get_name(error));
+        }
+
+        hmap_remove(&ofproto->learned_flows, &lf->hmap_node);
+        free(lf->fm.ofpacts);
+        free(lf);
+    }
+    ofopgroup_submit(group);
+}
+
 /* Searches for a rule with matching criteria exactly equal to 'target' in
  * ofproto's table 0 and, if it finds one, deletes it.
  *
@@ -2217,7 +2394,7 @@ handle_features_request(struct ofconn *ofconn, const struct ofp_header *oh)
     }
 
     features.datapath_id = ofproto->datapath_id;
-    features.n_buffers = pktbuf_capacity();
+    features.n_buffers = ofconn_get_n_buffers(ofconn);
     features.n_tables = n_tables;
     features.capabilities = (OFPUTIL_C_FLOW_STATS | OFPUTIL_C_TABLE_STATS |
                              OFPUTIL_C_PORT_STATS | OFPUTIL_C_QUEUE_STATS);
@@ -2356,6 +2533,7 @@ handle_packet_out(struct ofconn *ofconn, const struct ofp_header *oh)
     if (!error) {
         error = p->ofproto_class->packet_out(p, payload, &flow,
                                              po.ofpacts, po.ofpacts_len);
+        ofproto_flush_learned_flows(p);
     }
     ofpbuf_delete(payload);
 
@@ -3081,6 +3259,17 @@ is_flow_deletion_pending(const struct ofproto *ofproto,
 static enum ofperr
 add_flow(struct ofproto *ofproto, struct ofconn *ofconn,
          const struct ofputil_flow_mod *fm, const struct ofp_header *request)
+{
+    return add_flow__(ofproto, ofconn, fm, request, NULL);
+}
+
+/* Implementation of add_flow().  If 'batch' is nonnull, the new rule's
+ * operation is added to it and it is the caller's responsibility to submit
+ * it; otherwise, a group of its own is created and submitted. */
+static enum ofperr
+add_flow__(struct ofproto *ofproto, struct ofconn *ofconn,
+           const struct ofputil_flow_mod *fm, const struct ofp_header *request,
+           struct ofopgroup *batch)
 {
     struct oftable *table;
     struct ofopgroup *group;
@@ -3193,7 +3382,9 @@ add_flow(struct ofproto *ofproto, struct ofconn *ofconn,
             evict = NULL;
         }
 
-        group = ofopgroup_create(ofproto, ofconn, request, fm->buffer_id);
+        group = (batch
+                 ? batch
+                 : ofopgroup_create(ofproto, ofconn, request, fm->buffer_id));
         op = ofoperation_create(group, rule, OFOPERATION_ADD, 0);
         op->victim = victim;
 
@@ -3204,7 +3395,9 @@ add_flow(struct ofproto *ofproto, struct ofconn *ofconn,
         } else if (evict) {
             delete_flow__(evict, group);
         }
-        ofopgroup_submit(group);
+        if (!batch) {
+            ofopgroup_submit(group);
+        }
     }
 
 exit:
@@ -45,8 +45,8 @@ struct ofproto_controller_info {
     bool is_connected;
     enum ofp12_controller_role role;
     struct {
-        const char *keys[4];
-        const char *values[4];
+        const char *keys[12];
+        const char *values[12];
         size_t n;
     } pairs;
 };
@@ -140,6 +140,11 @@ struct ofproto_controller {
     /* OpenFlow packet-in rate-limiting. */
     int rate_limit;             /* Max packet-in rate in packets per second. */
     int burst_limit;            /* Limit on accumulating packet credits. */
+    bool adaptive_rate_limit;   /* Adjust 'rate_limit' to the controller? */
+
+    /* OpenFlow packet buffering.  0 selects the default. */
+    unsigned int n_buffers;     /* Number of packet buffers. */
+    size_t buffer_bytes;        /* Max bytes of packet data in buffers. */
 
     uint8_t dscp;               /* DSCP value for controller connection. */
 };
@@ -21,6 +21,7 @@
 #include <arpa/inet.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "hash.h"
 #include "hmap.h"
 #include "ofpbuf.h"
@@ -33,6 +34,13 @@
 #include "token-bucket.h"
 #include "vconn.h"
 
+/* Maximum number of packets that pinsched_run() releases from a single port's
+ * queue in a row before moving on to the next port in round-robin order.
+ * Releasing packets in short bursts, instead of one at a time, lets the
+ * connection batch them into a single write while still keeping one busy port
+ * from starving the others. */
+#define PINSCHED_PORT_BURST 8
+
 struct pinqueue {
     struct hmap_node node;      /* In struct pinsched's 'queues' hmap. */
     uint16_t port_no;           /* Port number. */
@@ -47,9 +55,7 @@ struct pinsched {
     struct hmap queues;         /* Contains "struct pinqueue"s. */
     int n_queued;               /* Sum over queues[*].n. */
     struct pinqueue *next_txq;  /* Next pinqueue check in round-robin. */
-
-    /* Transmission queue. */
-    int n_txq;                  /* No. of packets waiting in rconn for tx. */
+    int n_burst;                /* Packets released from 'next_txq' so far. */
 
     /* Statistics reporting. */
     unsigned long long n_normal;        /* # txed w/o rate limit queuing. */
@@ -66,6 +72,7 @@ advance_txq(struct pinsched *ps)
             ? hmap_next(&ps->queues, &ps->next_txq->node)
             : hmap_first(&ps->queues));
     ps->next_txq = next ? CONTAINER_OF(next, struct pinqueue, node) : NULL;
+    ps->n_burst = 0;
 }
 
 static struct ofpbuf *
@@ -96,6 +103,9 @@ adjust_limits(int *rate_limit, int *burst_limit)
 static void
 pinqueue_destroy(struct pinsched *ps, struct pinqueue *q)
 {
+    if (ps->next_txq == q) {
+        advance_txq(ps);
+    }
     hmap_remove(&ps->queues, &q->node);
     free(q);
 }
@@ -153,7 +163,8 @@ drop_packet(struct pinsched *ps)
     }
 }
 
-/* Remove and return the next packet to transmit (in round-robin order). */
+/* Remove and return the next packet to transmit.  Each queue in turn, in
+ * round-robin order, yields up to PINSCHED_PORT_BURST packets. */
 static struct ofpbuf *
 get_tx_packet(struct pinsched *ps)
 {
@@ -166,9 +177,10 @@ get_tx_packet(struct pinsched *ps)
 
     q = ps->next_txq;
     packet = dequeue_packet(ps, q);
-    advance_txq(ps);
     if (q->n == 0) {
         pinqueue_destroy(ps, q);
+    } else if (++ps->n_burst >= PINSCHED_PORT_BURST) {
+        advance_txq(ps);
     }
 
     return packet;
@@ -252,7 +264,7 @@ pinsched_create(int rate_limit, int burst_limit)
     hmap_init(&ps->queues);
     ps->n_queued = 0;
     ps->next_txq = NULL;
-    ps->n_txq = 0;
+    ps->n_burst = 0;
     ps->n_normal = 0;
     ps->n_limited = 0;
     ps->n_queue_dropped = 0;
@@ -300,5 +312,20 @@ pinsched_set_limits(struct pinsched *ps, int rate_limit, int burst_limit)
 unsigned int
 pinsched_count_txqlen(const struct pinsched *ps)
 {
-    return ps ? ps->n_txq : 0;
+    return ps ? ps->n_queued : 0;
+}
+
+/* Stores statistics for 'ps' into '*stats'.  If 'ps' is null, all of the
+ * statistics are zero. */
+void
+pinsched_get_stats(const struct pinsched *ps, struct pinsched_stats *stats)
+{
+    if (ps) {
+        stats->n_queued = ps->n_queued;
+        stats->n_normal = ps->n_normal;
+        stats->n_limited = ps->n_limited;
+        stats->n_queue_dropped = ps->n_queue_dropped;
+    } else {
+        memset(stats, 0, sizeof *stats);
+    }
 }
@@ -34,4 +34,13 @@ void pinsched_wait(struct pinsched *);
 
 unsigned int pinsched_count_txqlen(const struct pinsched *);
 
+struct pinsched_stats {
+    unsigned int n_queued;              /* # currently queued to send. */
+    unsigned long long n_normal;        /* # txed w/o rate limit queuing. */
+    unsigned long long n_limited;       /* # queued for rate limiting. */
+    unsigned long long n_queue_dropped; /* # dropped due to queue overflow. */
+};
+
+void pinsched_get_stats(const struct pinsched *, struct pinsched_stats *);
+
 #endif /* pinsched.h */
@@ -19,6 +19,7 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include "coverage.h"
+#include "list.h"
 #include "ofp-util.h"
 #include "ofpbuf.h"
 #include "timeval.h"
@@ -30,6 +31,7 @@ VLOG_DEFINE_THIS_MODULE(pktbuf);
 
 COVERAGE_DEFINE(pktbuf_buffer_unknown);
 COVERAGE_DEFINE(pktbuf_null_cookie);
+COVERAGE_DEFINE(pktbuf_overwrite);
 COVERAGE_DEFINE(pktbuf_retrieved);
 COVERAGE_DEFINE(pktbuf_reuse_error);
 
@@ -37,17 +39,22 @@ COVERAGE_DEFINE(pktbuf_reuse_error);
  * into a buffer number (low bits) and a cookie (high bits).  The buffer number
  * is an index into an array of buffers.  The cookie distinguishes between
  * different packets that have occupied a single buffer.  Thus, the more
- * buffers we have, the lower-quality the cookie... */
-#define PKTBUF_BITS     8
-#define PKTBUF_MASK     (PKTBUF_CNT - 1)
-#define PKTBUF_CNT      (1u << PKTBUF_BITS)
+ * buffers we have, the lower-quality the cookie...
+ *
+ * The number of buffer number bits depends on the pktbuf's capacity, but it is
+ * never less than PKTBUF_MIN_BITS.  That way, the ID returned by
+ * pktbuf_get_null(), whose cookie is all-1-bits in every such split, never
+ * names a real buffer. */
+#define PKTBUF_MIN_BITS 8
+BUILD_ASSERT_DECL(PKTBUF_MIN_CNT == 1u << PKTBUF_MIN_BITS);
+BUILD_ASSERT_DECL(IS_POW2(PKTBUF_MAX_CNT));
 
-#define COOKIE_BITS     (32 - PKTBUF_BITS)
-#define COOKIE_MAX      ((1u << COOKIE_BITS) - 1)
+#define NULL_ID         (UINT32_MAX << PKTBUF_MIN_BITS)
 
 #define OVERWRITE_MSECS 5000
 
 struct packet {
+    struct list list_node;      /* In pktbuf's 'free' or 'lru' list. */
     struct ofpbuf *buffer;
     uint32_t cookie;
     long long int timeout;
@@ -55,40 +62,101 @@ struct packet {
 };
 
 struct pktbuf {
-    struct packet packets[PKTBUF_CNT];
-    unsigned int buffer_idx;
-    unsigned int null_idx;
-};
+    struct packet *packets;     /* Array of 'mask + 1' packets. */
+    uint32_t mask;              /* Number of packets, minus 1. */
+    int bits;                   /* Number of 1-bits in 'mask'. */
+    uint32_t cookie_max;        /* Largest cookie, reserved for NULL_ID. */
 
-int
-pktbuf_capacity(void)
-{
-    return PKTBUF_CNT;
-}
+    struct list free;           /* Empty 'packets', least recently used first.
+                                 */
+    struct list lru;            /* Full 'packets', oldest first. */
+    unsigned int n_packets;     /* Number of full 'packets'. */
+    size_t n_bytes;             /* Bytes of packet data in full 'packets'. */
+    size_t max_bytes;           /* Limit on 'n_bytes'. */
 
+    struct pktbuf_stats stats;
+};
+
+/* Creates and returns a new pktbuf that can hold up to 'n_buffers' packets
+ * (rounded up to a power of 2 between PKTBUF_MIN_CNT and PKTBUF_MAX_CNT,
+ * inclusive) that add up to no more than 'max_bytes' bytes of packet data. */
 struct pktbuf *
-pktbuf_create(void)
+pktbuf_create(unsigned int n_buffers, size_t max_bytes)
 {
-    return xzalloc(sizeof *pktbuf_create());
+    struct pktbuf *pb;
+    uint32_t n, i;
+
+    n = MIN(MAX(n_buffers, PKTBUF_MIN_CNT), PKTBUF_MAX_CNT);
+    n = IS_POW2(n) ? n : 1u << log_2_ceil(n);
+
+    pb = xzalloc(sizeof *pb);
+    pb->packets = xcalloc(n, sizeof *pb->packets);
+    pb->mask = n - 1;
+    pb->bits = log_2_floor(n);
+    pb->cookie_max = UINT32_MAX >> pb->bits;
+    list_init(&pb->free);
+    list_init(&pb->lru);
+    for (i = 0; i < n; i++) {
+        list_push_back(&pb->free, &pb->packets[i].list_node);
+    }
+    pb->max_bytes = max_bytes;
+    return pb;
 }
 
 void
 pktbuf_destroy(struct pktbuf *pb)
 {
     if (pb) {
-        size_t i;
+        struct packet *p;
 
-        for (i = 0; i < PKTBUF_CNT; i++) {
-            ofpbuf_delete(pb->packets[i].buffer);
+        LIST_FOR_EACH (p, list_node, &pb->lru) {
+            ofpbuf_delete(p->buffer);
         }
+        free(pb->packets);
         free(pb);
     }
 }
 
+/* Returns the number of packets that 'pb' can hold. */
+unsigned int
+pktbuf_capacity(const struct pktbuf *pb)
+{
+    return pb->mask + 1;
+}
+
+/* Returns the maximum number of bytes of packet data that 'pb' holds. */
+size_t
+pktbuf_max_bytes(const struct pktbuf *pb)
+{
+    return pb->max_bytes;
+}
+
 static unsigned int
-make_id(unsigned int buffer_idx, unsigned int cookie)
+make_id(const struct pktbuf *pb, unsigned int buffer_idx, unsigned int cookie)
+{
+    return buffer_idx | (cookie << pb->bits);
+}
+
+/* Returns the packet in 'pb' that 'id' refers to, or a null pointer if 'id'
+ * does not refer to a packet that is currently buffered. */
+static struct packet *
+lookup_packet(const struct pktbuf *pb, uint32_t id)
+{
+    struct packet *p = &pb->packets[id & pb->mask];
+
+    return p->buffer && p->cookie == id >> pb->bits ? p : NULL;
+}
+
+/* Empties 'p', which must be full, and makes it available for reuse.  The
+ * caller takes ownership of the packet data that 'p' held. */
+static void
+free_packet(struct pktbuf *pb, struct packet *p)
 {
-    return buffer_idx | (cookie << PKTBUF_BITS);
+    pb->n_packets--;
+    pb->n_bytes -= p->buffer->size;
+    p->buffer = NULL;
+    list_remove(&p->list_node);
+    list_push_back(&pb->free, &p->list_node);
 }
 
 /* Attempts to allocate an OpenFlow packet buffer id within 'pb'.  The packet
@@ -101,31 +169,51 @@ make_id(unsigned int buffer_idx, unsigned int cookie)
  * its input port number (buffers do expire after a time, so this is not
  * guaranteed to be true forever).  On failure, returns UINT32_MAX.
  *
+ * The packet is stored in an empty buffer if there is one and 'pb' has room
+ * for 'buffer_size' more bytes.  Otherwise, the packets that have been in 'pb'
+ * longest are dropped to make room, but only those that have been there for
+ * at least OVERWRITE_MSECS.
+ *
  * The caller retains ownership of 'buffer'. */
 uint32_t
 pktbuf_save(struct pktbuf *pb, const void *buffer, size_t buffer_size,
             uint16_t in_port)
 {
-    struct packet *p = &pb->packets[pb->buffer_idx];
-    pb->buffer_idx = (pb->buffer_idx + 1) & PKTBUF_MASK;
-    if (p->buffer) {
-        if (time_msec() < p->timeout) {
+    long long int now = time_msec();
+    struct ofpbuf *victim;
+    struct packet *p;
+
+    if (buffer_size > pb->max_bytes) {
+        return UINT32_MAX;
+    }
+
+    while (list_is_empty(&pb->free)
+           || pb->n_bytes + buffer_size > pb->max_bytes) {
+        p = CONTAINER_OF(list_front(&pb->lru), struct packet, list_node);
+        if (now < p->timeout) {
             return UINT32_MAX;
         }
-        ofpbuf_delete(p->buffer);
+        victim = p->buffer;
+        free_packet(pb, p);
+        ofpbuf_delete(victim);
+        pb->stats.n_overwrites++;
+        COVERAGE_INC(pktbuf_overwrite);
     }
 
+    p = CONTAINER_OF(list_pop_front(&pb->free), struct packet, list_node);
+    list_push_back(&pb->lru, &p->list_node);
+
     /* Don't use maximum cookie value since all-1-bits ID is special. */
-    if (++p->cookie >= COOKIE_MAX) {
+    if (++p->cookie >= pb->cookie_max) {
         p->cookie = 0;
     }
     p->buffer = ofpbuf_clone_data_with_headroom(buffer, buffer_size,
                                                 sizeof(struct ofp10_packet_in));
-
-
-    p->timeout = time_msec() + OVERWRITE_MSECS;
+    p->timeout = now + OVERWRITE_MSECS;
     p->in_port = in_port;
-    return make_id(p - pb->packets, p->cookie);
+    pb->n_packets++;
+    pb->n_bytes += buffer_size;
+    return make_id(pb, p - pb->packets, p->cookie);
 }
 
 /*
@@ -151,7 +239,7 @@ pktbuf_save(struct pktbuf *pb, const void *buffer, size_t buffer_size,
 uint32_t
 pktbuf_get_null(void)
 {
-    return make_id(0, COOKIE_MAX);
+    return NULL_ID;
 }
 
 /* Attempts to retrieve a saved packet with the given 'id' from 'pb'.  Returns
@@ -188,32 +276,37 @@ pktbuf_retrieve(struct pktbuf *pb, uint32_t id, struct ofpbuf **bufferp,
         return OFPERR_OFPBRC_BUFFER_UNKNOWN;
     }
 
-    p = &pb->packets[id & PKTBUF_MASK];
-    if (p->cookie == id >> PKTBUF_BITS) {
-        struct ofpbuf *buffer = p->buffer;
-        if (buffer) {
-            *bufferp = buffer;
-            if (in_port) {
-                *in_port = p->in_port;
-            }
-            p->buffer = NULL;
-            COVERAGE_INC(pktbuf_retrieved);
-            return 0;
-        } else {
-            COVERAGE_INC(pktbuf_reuse_error);
-            VLOG_WARN_RL(&rl, "attempt to reuse buffer %08"PRIx32, id);
-            error = OFPERR_OFPBRC_BUFFER_EMPTY;
-        }
-    } else if (id >> PKTBUF_BITS != COOKIE_MAX) {
-        COVERAGE_INC(pktbuf_buffer_unknown);
-        VLOG_WARN_RL(&rl, "cookie mismatch: %08"PRIx32" != %08"PRIx32,
-                     id, (id & PKTBUF_MASK) | (p->cookie << PKTBUF_BITS));
-        error = OFPERR_OFPBRC_BUFFER_UNKNOWN;
-    } else {
+    if (id == NULL_ID) {
         COVERAGE_INC(pktbuf_null_cookie);
         VLOG_INFO_RL(&rl, "Received null cookie %08"PRIx32" (this is normal "
                      "if the switch was recently in fail-open mode)", id);
         error = 0;
+        goto error;
+    }
+
+    p = lookup_packet(pb, id);
+    if (p) {
+        *bufferp = p->buffer;
+        if (in_port) {
+            *in_port = p->in_port;
+        }
+        free_packet(pb, p);
+        pb->stats.n_hits++;
+        COVERAGE_INC(pktbuf_retrieved);
+        return 0;
+    }
+
+    p = &pb->packets[id & pb->mask];
+    pb->stats.n_misses++;
+    if (p->cookie == id >> pb->bits) {
+        COVERAGE_INC(pktbuf_reuse_error);
+        VLOG_WARN_RL(&rl, "attempt to reuse buffer %08"PRIx32, id);
+        error = OFPERR_OFPBRC_BUFFER_EMPTY;
+    } else {
+        COVERAGE_INC(pktbuf_buffer_unknown);
+        VLOG_WARN_RL(&rl, "cookie mismatch: %08"PRIx32" != %08"PRIx32,
+                     id, make_id(pb, id & pb->mask, p->cookie));
+        error = OFPERR_OFPBRC_BUFFER_UNKNOWN;
     }
 error:
     *bufferp = NULL;
@@ -226,10 +319,13 @@ error:
 void
 pktbuf_discard(struct pktbuf *pb, uint32_t id)
 {
-    struct packet *p = &pb->packets[id & PKTBUF_MASK];
-    if (p->cookie == id >> PKTBUF_BITS) {
-        ofpbuf_delete(p->buffer);
-        p->buffer = NULL;
+    struct packet *p = lookup_packet(pb, id);
+
+    if (p) {
+        struct ofpbuf *buffer = p->buffer;
+
+        free_packet(pb, p);
+        ofpbuf_delete(buffer);
     }
 }
 
@@ -238,17 +334,12 @@ pktbuf_discard(struct pktbuf *pb, uint32_t id)
 unsigned int
 pktbuf_count_packets(const struct pktbuf *pb)
 {
-    int n = 0;
-
-    if (pb) {
-        int i;
-
-        for (i = 0; i < PKTBUF_CNT; i++) {
-            if (pb->packets[i].buffer) {
-                n++;
-            }
-        }
-    }
+    return pb ? pb->n_packets : 0;
+}
 
-    return n;
+/* Stores statistics for 'pb' into '*stats'. */
+void
+pktbuf_get_stats(const struct pktbuf *pb, struct pktbuf_stats *stats)
+{
+    *stats = pb->stats;
 }
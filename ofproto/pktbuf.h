@@ -25,10 +25,27 @@
 struct pktbuf;
 struct ofpbuf;
 
-int pktbuf_capacity(void);
-
-struct pktbuf *pktbuf_create(void);
+/* Range and default for the number of packet buffers in a pktbuf.  The
+ * number is always a power of 2. */
+#define PKTBUF_MIN_CNT 256
+#define PKTBUF_MAX_CNT 65536
+#define PKTBUF_DEFAULT_CNT PKTBUF_MIN_CNT
+
+/* Default limit on the total number of bytes of packet data in a pktbuf. */
+#define PKTBUF_DEFAULT_BYTES (4 * 1024 * 1024)
+
+struct pktbuf_stats {
+    unsigned long long int n_hits;       /* Packets retrieved. */
+    unsigned long long int n_misses;     /* Retrievals of unknown or reused
+                                          * buffer ids. */
+    unsigned long long int n_overwrites; /* Packets dropped from the buffer
+                                          * before they were retrieved. */
+};
+
+struct pktbuf *pktbuf_create(unsigned int n_buffers, size_t max_bytes);
 void pktbuf_destroy(struct pktbuf *);
+unsigned int pktbuf_capacity(const struct pktbuf *);
+size_t pktbuf_max_bytes(const struct pktbuf *);
 uint32_t pktbuf_save(struct pktbuf *, const void *buffer, size_t buffer_size,
                      uint16_t in_port);
 uint32_t pktbuf_get_null(void);
@@ -37,5 +54,6 @@ enum ofperr pktbuf_retrieve(struct pktbuf *, uint32_t id,
 void pktbuf_discard(struct pktbuf *, uint32_t id);
 
 unsigned int pktbuf_count_packets(const struct pktbuf *);
+void pktbuf_get_stats(const struct pktbuf *, struct pktbuf_stats *);
 
 #endif /* pktbuf.h */
@@ -53,7 +53,17 @@ struct tnl_port {
     struct tnl_match match;
 };
 
-static struct hmap tnl_match_map = HMAP_INITIALIZER(&tnl_match_map);
+/* A tunnel port may leave its local IP address ('ip_src') unset, to accept
+ * packets sent to any of the host's addresses, and may take its key from the
+ * flow ('in_key_flow') instead of requiring a particular key.  Each of the
+ * four combinations gets its own map, so that tnl_find() can search for a
+ * packet's tunnel with a single exact-match probe of each map that has any
+ * ports.  Maps are indexed by the TNL_MATCH_* bits that describe the fields
+ * that their ports wildcard, and a map with no ports is NULL. */
+#define TNL_MATCH_ANY_LOCAL_IP 1 /* 'ip_src' is 0. */
+#define TNL_MATCH_ANY_KEY 2      /* 'in_key_flow' is true, 'in_key' is 0. */
+#define N_TNL_MATCH_TYPES 4
+static struct hmap *tnl_match_maps[N_TNL_MATCH_TYPES];
 
 /* Returned to callers when their ofport will never be used to receive or send
  * tunnel traffic. Alternatively, we could ask the caller to delete their
@@ -64,9 +74,10 @@ static struct tnl_port void_tnl_port;
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
 static struct vlog_rate_limit dbg_rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
-static struct tnl_port *tnl_find(struct tnl_match *);
-static struct tnl_port *tnl_find_exact(struct tnl_match *);
-static uint32_t tnl_hash(struct tnl_match *);
+static struct tnl_port *tnl_find(const struct tnl_match *);
+static struct tnl_port *tnl_find_exact(const struct tnl_match *);
+static struct hmap **tnl_match_map(const struct tnl_match *);
+static uint32_t tnl_hash(const struct tnl_match *);
 static void tnl_match_fmt(const struct tnl_match *, struct ds *);
 static char *tnl_port_fmt(const struct tnl_port *);
 static void tnl_port_mod_log(const struct tnl_port *, const char *action);
@@ -79,6 +90,7 @@ tnl_port_add__(const struct ofport *ofport, uint32_t odp_port,
     const struct netdev_tunnel_config *cfg;
     struct tnl_port *existing_port;
     struct tnl_port *tnl_port;
+    struct hmap **map;
 
     cfg = netdev_get_tunnel_config(ofport->netdev);
     ovs_assert(cfg);
@@ -108,8 +120,12 @@ tnl_port_add__(const struct ofport *ofport, uint32_t odp_port,
         return &void_tnl_port;
     }
 
-    hmap_insert(&tnl_match_map, &tnl_port->match_node,
-                tnl_hash(&tnl_port->match));
+    map = tnl_match_map(&tnl_port->match);
+    if (!*map) {
+        *map = xmalloc(sizeof **map);
+        hmap_init(*map);
+    }
+    hmap_insert(*map, &tnl_port->match_node, tnl_hash(&tnl_port->match));
     tnl_port_mod_log(tnl_port, "adding");
     return tnl_port;
 }
@@ -153,8 +169,15 @@ void
 tnl_port_del(struct tnl_port *tnl_port)
 {
     if (tnl_port && tnl_port != &void_tnl_port) {
+        struct hmap **map = tnl_match_map(&tnl_port->match);
+
         tnl_port_mod_log(tnl_port, "removing");
-        hmap_remove(&tnl_match_map, &tnl_port->match_node);
+        hmap_remove(*map, &tnl_port->match_node);
+        if (hmap_is_empty(*map)) {
+            hmap_destroy(*map);
+            free(*map);
+            *map = NULL;
+        }
         free(tnl_port);
     }
 }
@@ -242,6 +265,8 @@ tnl_port_send(const struct tnl_port *tnl_port, struct flow *flow,
 
     if (!cfg->out_key_flow) {
         flow->tunnel.tun_id = cfg->out_key;
+    } else {
+        memset(&wc->masks.tunnel.tun_id, 0xff, sizeof wc->masks.tunnel.tun_id);
     }
 
     if (cfg->ttl_inherit && is_ip_any(flow)) {
@@ -289,62 +314,108 @@ tnl_port_send(const struct tnl_port *tnl_port, struct flow *flow,
     return tnl_port->match.odp_port;
 }
 
+/* Un-wildcards in 'wc' the fields of 'flow' that tunnel processing examines:
+ * the fields that tnl_port_receive() compares against the tunnel ports that
+ * exist, and the ECN bits that the caller uses to decapsulate ECN.
+ *
+ * The remote IP address and skb_mark are compared for every tunnel.  The
+ * local IP address and the key are compared only if some tunnel port
+ * specifies them. */
+void
+tnl_wc_init(const struct flow *flow, struct flow_wildcards *wc)
+{
+    int i;
+
+    if (!tnl_port_should_receive(flow)) {
+        return;
+    }
+
+    for (i = 0; i < N_TNL_MATCH_TYPES; i++) {
+        if (tnl_match_maps[i]) {
+            wc->masks.tunnel.ip_src = htonl(UINT32_MAX);
+            if (!(i & TNL_MATCH_ANY_LOCAL_IP)) {
+                wc->masks.tunnel.ip_dst = htonl(UINT32_MAX);
+            }
+            if (!(i & TNL_MATCH_ANY_KEY)) {
+                wc->masks.tunnel.tun_id = htonll(UINT64_MAX);
+            }
+        }
+    }
+    /* skb_mark is currently used only by tunnels but that will likely
+     * change in the future. */
+    wc->masks.skb_mark = UINT32_MAX;
+
+    wc->masks.tunnel.ip_tos |= IP_ECN_MASK;
+    if (is_ip_any(flow)
+        && (flow->tunnel.ip_tos & IP_ECN_MASK) == IP_ECN_CE) {
+        wc->masks.nw_tos |= IP_ECN_MASK;
+    }
+}
+
 static uint32_t
-tnl_hash(struct tnl_match *match)
+tnl_hash(const struct tnl_match *match)
 {
     BUILD_ASSERT_DECL(sizeof *match % sizeof(uint32_t) == 0);
-    return hash_words((uint32_t *) match, sizeof *match / sizeof(uint32_t), 0);
+    return hash_words((const uint32_t *) match,
+                      sizeof *match / sizeof(uint32_t), 0);
+}
+
+/* Returns the slot in 'tnl_match_maps' for tunnel ports that wildcard the
+ * same fields as 'match'. */
+static struct hmap **
+tnl_match_map(const struct tnl_match *match)
+{
+    return &tnl_match_maps[(match->ip_src ? 0 : TNL_MATCH_ANY_LOCAL_IP)
+                           | (match->in_key_flow ? TNL_MATCH_ANY_KEY : 0)];
 }
 
 static struct tnl_port *
-tnl_find_exact(struct tnl_match *match)
+tnl_find_exact(const struct tnl_match *match)
 {
+    struct hmap *map = *tnl_match_map(match);
     struct tnl_port *tnl_port;
 
-    HMAP_FOR_EACH_WITH_HASH (tnl_port, match_node, tnl_hash(match),
-                             &tnl_match_map) {
-        if (!memcmp(match, &tnl_port->match, sizeof *match)) {
-            return tnl_port;
+    if (map) {
+        HMAP_FOR_EACH_WITH_HASH (tnl_port, match_node, tnl_hash(match), map) {
+            if (!memcmp(match, &tnl_port->match, sizeof *match)) {
+                return tnl_port;
+            }
         }
     }
     return NULL;
 }
 
+/* Returns the tunnel port that should receive packets described by 'match_',
+ * which must have every field set and 'in_key_flow' false.  A tunnel with a
+ * local IP address takes precedence over one without, and then a tunnel with
+ * a key takes precedence over one that takes its key from the flow. */
 static struct tnl_port *
-tnl_find(struct tnl_match *match_)
+tnl_find(const struct tnl_match *match_)
 {
-    struct tnl_match match = *match_;
-    struct tnl_port *tnl_port;
-
-    /* remote_ip, local_ip, in_key */
-    tnl_port = tnl_find_exact(&match);
-    if (tnl_port) {
-        return tnl_port;
-    }
-
-    /* remote_ip, in_key */
-    match.ip_src = 0;
-    tnl_port = tnl_find_exact(&match);
-    if (tnl_port) {
-        return tnl_port;
-    }
-    match.ip_src = match_->ip_src;
-
-    /* remote_ip, local_ip */
-    match.in_key = 0;
-    match.in_key_flow = true;
-    tnl_port = tnl_find_exact(&match);
-    if (tnl_port) {
-        return tnl_port;
-    }
-
-    /* remote_ip */
-    match.ip_src = 0;
-    tnl_port = tnl_find_exact(&match);
-    if (tnl_port) {
-        return tnl_port;
+    int i;
+
+    /* TNL_MATCH_ANY_KEY is the high bit, so this probes remote_ip, local_ip,
+     * in_key; then remote_ip, in_key; then remote_ip, local_ip; then
+     * remote_ip alone. */
+    for (i = 0; i < N_TNL_MATCH_TYPES; i++) {
+        if (tnl_match_maps[i]) {
+            struct tnl_match match = *match_;
+            struct tnl_port *tnl_port;
+
+            if (i & TNL_MATCH_ANY_LOCAL_IP) {
+                match.ip_src = 0;
+            }
+            if (i & TNL_MATCH_ANY_KEY) {
+                match.in_key = 0;
+                match.in_key_flow = true;
+            }
+
+            tnl_port = tnl_find_exact(&match);
+            if (tnl_port) {
+                return tnl_port;
+            }
+        }
     }
-
     return NULL;
 }
 
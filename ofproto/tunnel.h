@@ -40,6 +40,7 @@ void tnl_port_del(struct tnl_port *);
 const struct ofport *tnl_port_receive(struct flow *);
 uint32_t tnl_port_send(const struct tnl_port *, struct flow *,
                        struct flow_wildcards *wc);
+void tnl_wc_init(const struct flow *, struct flow_wildcards *);
 
 /* Returns true if 'flow' should be submitted to tnl_port_receive(). */
 static inline bool
@@ -19,6 +19,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <unistd.h>
 
 #include "bitmap.h"
@@ -26,6 +27,7 @@
 #include "log.h"
 #include "json.h"
 #include "lockfile.h"
+#include "ofpbuf.h"
 #include "ovsdb.h"
 #include "ovsdb-error.h"
 #include "row.h"
@@ -46,6 +48,10 @@ VLOG_DEFINE_THIS_MODULE(ovsdb_file);
  * compacting fails. */
 #define COMPACT_RETRY_MSEC      (60 * 1000)      /* 1 minute. */
 
+/* Whether snapshots written by compaction use a binary record for the data
+ * (see "Binary snapshots" below) instead of a JSON record. */
+static bool use_binary_snapshots;
+
 /* A transaction being converted to JSON for writing to a file. */
 struct ovsdb_file_txn {
     struct json *json;          /* JSON for the whole transaction. */
@@ -70,6 +76,11 @@ static struct ovsdb_error *ovsdb_file_open__(const char *file_name,
 static struct ovsdb_error *ovsdb_file_txn_from_json(
     struct ovsdb *, const struct json *, bool converting,
     long long int *date, struct ovsdb_txn **);
+static struct ovsdb_error *ovsdb_file_txn_from_binary(
+    struct ovsdb *, const struct ofpbuf *, bool converting,
+    long long int *date, char **comment, struct ovsdb_txn **);
+static struct ofpbuf *ovsdb_file_db_to_binary(const struct ovsdb *,
+                                              const char *comment);
 static struct ovsdb_error *ovsdb_file_create(struct ovsdb *,
                                              struct ovsdb_log *,
                                              const char *file_name,
@@ -189,8 +200,10 @@ ovsdb_file_open__(const char *file_name,
     struct ovsdb_schema *schema = NULL;
     struct ovsdb_error *error;
     struct ovsdb_log *log;
+    struct ofpbuf *binary;
     struct json *json;
     struct ovsdb *db = NULL;
+    bool converting;
 
     /* In read-only mode there is no ovsdb_file so 'filep' must be null. */
     ovs_assert(!(read_only && filep));
@@ -203,16 +216,34 @@ ovsdb_file_open__(const char *file_name,
     }
 
     db = ovsdb_create(schema ? schema : ovsdb_schema_clone(alternate_schema));
+    converting = alternate_schema != NULL;
 
     oldest_commit = LLONG_MAX;
     n_transactions = 0;
-    while ((error = ovsdb_log_read(log, &json)) == NULL && json) {
+    for (;;) {
+        struct json_arena *arena;
         struct ovsdb_txn *txn;
         long long int date;
 
-        error = ovsdb_file_txn_from_json(db, json, alternate_schema != NULL,
-                                         &date, &txn);
-        json_destroy(json);
+        /* Each record is only converted into a transaction and then thrown
+         * away, so parse it into an arena that can be freed all at once. */
+        arena = json_arena_create();
+        error = ovsdb_log_read_any_arena(log, arena, &json, &binary);
+        if (error || (!json && !binary)) {
+            json_arena_destroy(arena);
+            break;
+        }
+
+        if (json) {
+            error = ovsdb_file_txn_from_json(db, json, converting,
+                                             &date, &txn);
+            json_arena_destroy(arena);
+        } else {
+            json_arena_destroy(arena);
+            error = ovsdb_file_txn_from_binary(db, binary, converting,
+                                               &date, NULL, &txn);
+            ofpbuf_delete(binary);
+        }
         if (error) {
             ovsdb_log_unread(log);
             break;
@@ -457,6 +488,17 @@ ovsdb_file_save_copy__(const char *file_name, int locking,
     }
 
     /* Write data. */
+    if (use_binary_snapshots) {
+        struct ofpbuf *binary = ovsdb_file_db_to_binary(db, comment);
+
+        error = ovsdb_log_write_binary(log, binary->data, binary->size);
+        ofpbuf_delete(binary);
+        if (!error) {
+            error = ovsdb_log_commit(log);
+        }
+        goto exit;
+    }
+
     ovsdb_file_txn_init(&ftxn);
     SHASH_FOR_EACH (node, &db->tables) {
         const struct ovsdb_table *table = node->data;
@@ -488,6 +530,9 @@ exit:
  * nonnull, then it is added along with the data contents and can be viewed
  * with "ovsdb-tool show-log".
  *
+ * The data is written as a binary record if ovsdb_file_set_binary_snapshots()
+ * has enabled it, otherwise as JSON.
+ *
  * 'locking' is passed along to ovsdb_log_open() untouched. */
 struct ovsdb_error *
 ovsdb_file_save_copy(const char *file_name, int locking,
@@ -804,3 +849,720 @@ ovsdb_file_txn_commit(struct json *json, const char *comment,
 
     return NULL;
 }
+
+
+/* Binary snapshots.
+ *
+ * A database file normally consists of JSON records: the schema followed by
+ * one record per transaction.  Compaction rewrites the file as the schema plus
+ * a single record that inserts every row.  Reading that record back as JSON
+ * dominates startup time for large databases, so compaction can instead write
+ * it as a binary log record whose contents are laid out as follows, with all
+ * integers in the host's native byte order:
+ *
+ *     u32 byte order marker (BINARY_MAGIC)
+ *     u32 format version (BINARY_VERSION)
+ *     i64 date, as in the "_date" member of a JSON record
+ *     u32 number of strings, followed by each string as a u32 length and
+ *         that many bytes, without a null terminator
+ *     u32 index of the comment in the string table
+ *     u32 number of tables, followed by each table:
+ *         u32 index of the table's name in the string table
+ *         u32 number of columns, followed by each column:
+ *             u32 index of the column's name in the string table
+ *             u8 key type, u8 value type (enum ovsdb_atomic_type)
+ *         u32 number of rows, followed by each row:
+ *             16-byte row UUID
+ *             for each column: u32 number of elements, then that many keys,
+ *             then (for maps) that many values
+ *
+ * Atoms are stored in native form: integers and reals as 8 bytes, booleans as
+ * 1 byte, UUIDs as 16 bytes.  A string atom is a u32 index into the string
+ * table, so that each distinct string is stored only once.
+ *
+ * Binary records are not portable between hosts of different byte order, and
+ * only snapshots use them: transactions appended afterward are still JSON. */
+
+#define BINARY_MAGIC 0x01020304
+#define BINARY_VERSION 1
+
+/* Enables or disables writing binary snapshots when a database file is
+ * compacted or copied.  Binary snapshots are always accepted when reading. */
+void
+ovsdb_file_set_binary_snapshots(bool enable)
+{
+    use_binary_snapshots = enable;
+}
+
+/* A binary snapshot under construction. */
+struct ovsdb_file_binary {
+    struct ofpbuf strings;      /* String table, without its count. */
+    struct shash string_index;  /* Maps from string to index in 'strings'. */
+    uint32_t n_strings;         /* Number of strings in 'strings'. */
+    struct ofpbuf tables;       /* Tables, without their count. */
+    uint32_t n_tables;          /* Number of tables in 'tables'. */
+};
+
+static void
+binary_put_u32(struct ofpbuf *b, uint32_t x)
+{
+    ofpbuf_put(b, &x, sizeof x);
+}
+
+static uint32_t
+binary_intern(struct ovsdb_file_binary *bin, const char *s)
+{
+    struct shash_node *node = shash_find(&bin->string_index, s);
+    uint32_t idx;
+
+    if (node) {
+        return (uintptr_t) node->data;
+    }
+
+    idx = bin->n_strings++;
+    shash_add(&bin->string_index, s, (void *) (uintptr_t) idx);
+    binary_put_u32(&bin->strings, strlen(s));
+    ofpbuf_put(&bin->strings, s, strlen(s));
+    return idx;
+}
+
+static void
+binary_put_atoms(struct ovsdb_file_binary *bin, const union ovsdb_atom *atoms,
+                 unsigned int n, enum ovsdb_atomic_type type)
+{
+    struct ofpbuf *b = &bin->tables;
+    unsigned int i;
+
+    switch (type) {
+    case OVSDB_TYPE_VOID:
+        break;
+
+    case OVSDB_TYPE_INTEGER:
+        for (i = 0; i < n; i++) {
+            ofpbuf_put(b, &atoms[i].integer, sizeof atoms[i].integer);
+        }
+        break;
+
+    case OVSDB_TYPE_REAL:
+        for (i = 0; i < n; i++) {
+            ofpbuf_put(b, &atoms[i].real, sizeof atoms[i].real);
+        }
+        break;
+
+    case OVSDB_TYPE_BOOLEAN:
+        for (i = 0; i < n; i++) {
+            uint8_t boolean = atoms[i].boolean;
+            ofpbuf_put(b, &boolean, sizeof boolean);
+        }
+        break;
+
+    case OVSDB_TYPE_STRING:
+        for (i = 0; i < n; i++) {
+            binary_put_u32(b, binary_intern(bin, atoms[i].string));
+        }
+        break;
+
+    case OVSDB_TYPE_UUID:
+        for (i = 0; i < n; i++) {
+            ofpbuf_put(b, &atoms[i].uuid, sizeof atoms[i].uuid);
+        }
+        break;
+
+    case OVSDB_N_TYPES:
+    default:
+        NOT_REACHED();
+    }
+}
+
+static void
+binary_put_table(struct ovsdb_file_binary *bin,
+                 const struct ovsdb_table *table)
+{
+    const struct ovsdb_column **columns;
+    const struct shash_node *node;
+    const struct ovsdb_row *row;
+    size_t n_columns;
+    size_t i;
+
+    /* Only persistent columns are saved, as in ovsdb_file_txn_add_row(). */
+    columns = xmalloc(shash_count(&table->schema->columns) * sizeof *columns);
+    n_columns = 0;
+    SHASH_FOR_EACH (node, &table->schema->columns) {
+        const struct ovsdb_column *column = node->data;
+
+        if (column->index != OVSDB_COL_UUID && column->persistent) {
+            columns[n_columns++] = column;
+        }
+    }
+
+    binary_put_u32(&bin->tables, binary_intern(bin, table->schema->name));
+    binary_put_u32(&bin->tables, n_columns);
+    for (i = 0; i < n_columns; i++) {
+        const struct ovsdb_type *type = &columns[i]->type;
+        uint8_t types[2];
+
+        types[0] = type->key.type;
+        types[1] = type->value.type;
+        binary_put_u32(&bin->tables, binary_intern(bin, columns[i]->name));
+        ofpbuf_put(&bin->tables, types, sizeof types);
+    }
+
+    binary_put_u32(&bin->tables, hmap_count(&table->rows));
+    HMAP_FOR_EACH (row, hmap_node, &table->rows) {
+        ofpbuf_put(&bin->tables, ovsdb_row_get_uuid(row), sizeof(struct uuid));
+        for (i = 0; i < n_columns; i++) {
+            const struct ovsdb_column *column = columns[i];
+            const struct ovsdb_datum *datum = &row->fields[column->index];
+
+            binary_put_u32(&bin->tables, datum->n);
+            binary_put_atoms(bin, datum->keys, datum->n,
+                             column->type.key.type);
+            binary_put_atoms(bin, datum->values, datum->n,
+                             column->type.value.type);
+        }
+    }
+    bin->n_tables++;
+
+    free(columns);
+}
+
+/* Returns a binary snapshot of the contents of 'db', with 'comment' (which may
+ * be null) attached.  The caller must free the returned buffer. */
+static struct ofpbuf *
+ovsdb_file_db_to_binary(const struct ovsdb *db, const char *comment)
+{
+    struct ovsdb_file_binary bin;
+    const struct shash_node *node;
+    uint32_t comment_idx;
+    struct ofpbuf *record;
+    int64_t date;
+
+    ofpbuf_init(&bin.strings, 0);
+    shash_init(&bin.string_index);
+    bin.n_strings = 0;
+    ofpbuf_init(&bin.tables, 0);
+    bin.n_tables = 0;
+
+    comment_idx = binary_intern(&bin, comment ? comment : "");
+    SHASH_FOR_EACH (node, &db->tables) {
+        const struct ovsdb_table *table = node->data;
+
+        if (hmap_count(&table->rows)) {
+            binary_put_table(&bin, table);
+        }
+    }
+
+    record = ofpbuf_new(28 + bin.strings.size + bin.tables.size);
+    binary_put_u32(record, BINARY_MAGIC);
+    binary_put_u32(record, BINARY_VERSION);
+    date = time_wall();
+    ofpbuf_put(record, &date, sizeof date);
+    binary_put_u32(record, bin.n_strings);
+    ofpbuf_put(record, bin.strings.data, bin.strings.size);
+    binary_put_u32(record, comment_idx);
+    binary_put_u32(record, bin.n_tables);
+    ofpbuf_put(record, bin.tables.data, bin.tables.size);
+
+    ofpbuf_uninit(&bin.strings);
+    shash_destroy(&bin.string_index);
+    ofpbuf_uninit(&bin.tables);
+
+    return record;
+}
+
+/* Pulls 'n' bytes from the front of 'b' into 'dst'. */
+static struct ovsdb_error *
+binary_pull(struct ofpbuf *b, void *dst, size_t n)
+{
+    const void *src = ofpbuf_try_pull(b, n);
+
+    if (!src) {
+        return ovsdb_syntax_error(NULL, NULL, "binary snapshot is truncated");
+    }
+    memcpy(dst, src, n);
+    return NULL;
+}
+
+static struct ovsdb_error *
+binary_pull_u32(struct ofpbuf *b, uint32_t *x)
+{
+    return binary_pull(b, x, sizeof *x);
+}
+
+/* Pulls a u32 count from 'b' into '*n', verifying that 'b' has room for at
+ * least 'min_size' bytes for each of the '*n' items that follow, so that a
+ * corrupt count cannot cause a huge allocation. */
+static struct ovsdb_error *
+binary_pull_count(struct ofpbuf *b, size_t min_size, uint32_t *n)
+{
+    struct ovsdb_error *error = binary_pull_u32(b, n);
+
+    if (!error && min_size && *n > b->size / min_size) {
+        error = ovsdb_syntax_error(NULL, NULL, "binary snapshot count %"PRIu32
+                                   " exceeds remaining data", *n);
+    }
+    return error;
+}
+
+static struct ovsdb_error *
+binary_pull_string(struct ofpbuf *b, char **strings, uint32_t n_strings,
+                   const char **sp)
+{
+    struct ovsdb_error *error;
+    uint32_t idx;
+
+    error = binary_pull_u32(b, &idx);
+    if (error) {
+        return error;
+    } else if (idx >= n_strings) {
+        return ovsdb_syntax_error(NULL, NULL, "binary snapshot string index "
+                                  "%"PRIu32" out of range", idx);
+    }
+    *sp = strings[idx];
+    return NULL;
+}
+
+/* Pulls 'n' atoms of the given 'type' from 'b' into 'atoms'.  On failure, the
+ * atoms that were successfully pulled are destroyed. */
+static struct ovsdb_error *
+binary_pull_atoms(struct ofpbuf *b, char **strings, uint32_t n_strings,
+                  enum ovsdb_atomic_type type,
+                  union ovsdb_atom *atoms, unsigned int n)
+{
+    struct ovsdb_error *error = NULL;
+    unsigned int i;
+
+    switch (type) {
+    case OVSDB_TYPE_VOID:
+        break;
+
+    case OVSDB_TYPE_INTEGER:
+        for (i = 0; !error && i < n; i++) {
+            error = binary_pull(b, &atoms[i].integer, sizeof atoms[i].integer);
+        }
+        break;
+
+    case OVSDB_TYPE_REAL:
+        for (i = 0; !error && i < n; i++) {
+            error = binary_pull(b, &atoms[i].real, sizeof atoms[i].real);
+        }
+        break;
+
+    case OVSDB_TYPE_BOOLEAN:
+        for (i = 0; !error && i < n; i++) {
+            uint8_t boolean;
+
+            error = binary_pull(b, &boolean, sizeof boolean);
+            if (!error && boolean > 1) {
+                error = ovsdb_syntax_error(NULL, NULL, "binary snapshot "
+                                           "contains invalid boolean");
+            }
+            atoms[i].boolean = boolean;
+        }
+        break;
+
+    case OVSDB_TYPE_STRING:
+        for (i = 0; i < n; i++) {
+            const char *s;
+
+            error = binary_pull_string(b, strings, n_strings, &s);
+            if (error) {
+                while (i-- > 0) {
+                    free(atoms[i].string);
+                }
+                break;
+            }
+            atoms[i].string = xstrdup(s);
+        }
+        break;
+
+    case OVSDB_TYPE_UUID:
+        for (i = 0; !error && i < n; i++) {
+            error = binary_pull(b, &atoms[i].uuid, sizeof atoms[i].uuid);
+        }
+        break;
+
+    case OVSDB_N_TYPES:
+    default:
+        NOT_REACHED();
+    }
+
+    return error;
+}
+
+/* Pulls a datum whose keys and values have the specified types from 'b' into
+ * 'datum'.  The datum is not checked against any column's type. */
+static struct ovsdb_error *
+binary_pull_datum(struct ofpbuf *b, char **strings, uint32_t n_strings,
+                  const struct ovsdb_type *type, struct ovsdb_datum *datum)
+{
+    struct ovsdb_error *error;
+    uint32_t n;
+
+    ovsdb_datum_init_empty(datum);
+
+    error = binary_pull_count(b, 1, &n);
+    if (error || !n) {
+        return error;
+    }
+
+    datum->keys = xmalloc(n * sizeof *datum->keys);
+    error = binary_pull_atoms(b, strings, n_strings, type->key.type,
+                              datum->keys, n);
+    if (error) {
+        free(datum->keys);
+        ovsdb_datum_init_empty(datum);
+        return error;
+    }
+
+    if (type->value.type != OVSDB_TYPE_VOID) {
+        datum->values = xmalloc(n * sizeof *datum->values);
+        error = binary_pull_atoms(b, strings, n_strings, type->value.type,
+                                  datum->values, n);
+        if (error) {
+            uint32_t i;
+
+            for (i = 0; i < n; i++) {
+                ovsdb_atom_destroy(&datum->keys[i], type->key.type);
+            }
+            free(datum->keys);
+            free(datum->values);
+            ovsdb_datum_init_empty(datum);
+            return error;
+        }
+    }
+    datum->n = n;
+
+    return NULL;
+}
+
+/* A column as described in a binary snapshot. */
+struct binary_column {
+    const struct ovsdb_column *column; /* Column in schema, or null to skip. */
+    struct ovsdb_type type;            /* Column's type in the snapshot. */
+};
+
+static struct ovsdb_error *
+binary_pull_column(struct ofpbuf *b, char **strings, uint32_t n_strings,
+                   const struct ovsdb_table *table, bool converting,
+                   struct binary_column *bc)
+{
+    struct ovsdb_error *error;
+    const char *column_name;
+    uint8_t types[2];
+
+    error = binary_pull_string(b, strings, n_strings, &column_name);
+    if (!error) {
+        error = binary_pull(b, types, sizeof types);
+    }
+    if (error) {
+        return error;
+    }
+
+    if (!ovsdb_atomic_type_is_valid(types[0]) || types[0] == OVSDB_TYPE_VOID
+        || !ovsdb_atomic_type_is_valid(types[1])) {
+        return ovsdb_syntax_error(NULL, NULL, "binary snapshot column %s has "
+                                  "invalid type", column_name);
+    }
+    ovsdb_base_type_init(&bc->type.key, types[0]);
+    ovsdb_base_type_init(&bc->type.value, types[1]);
+    bc->type.n_min = 0;
+    bc->type.n_max = UINT_MAX;
+
+    bc->column = (table
+                  ? ovsdb_table_schema_get_column(table->schema, column_name)
+                  : NULL);
+    if (!bc->column) {
+        if (table && !converting) {
+            return ovsdb_syntax_error(NULL, "unknown column",
+                                      "No column %s in table %s.",
+                                      column_name, table->schema->name);
+        }
+    } else if (bc->column->index < OVSDB_N_STD_COLUMNS) {
+        return ovsdb_syntax_error(NULL, NULL, "binary snapshot may not "
+                                  "contain column %s", column_name);
+    } else if (bc->column->type.key.type != types[0]
+               || bc->column->type.value.type != types[1]) {
+        return ovsdb_syntax_error(NULL, NULL, "column %s in table %s has "
+                                  "type %s:%s in binary snapshot but %s:%s "
+                                  "in schema", column_name,
+                                  table->schema->name,
+                                  ovsdb_atomic_type_to_string(types[0]),
+                                  ovsdb_atomic_type_to_string(types[1]),
+                                  ovsdb_atomic_type_to_string(
+                                      bc->column->type.key.type),
+                                  ovsdb_atomic_type_to_string(
+                                      bc->column->type.value.type));
+    }
+    return NULL;
+}
+
+/* Pulls the datum for 'bc' from 'b' and, if 'row' is nonnull and 'bc' is a
+ * column in the schema, stores it into 'row' after checking that it is valid
+ * for the column's type. */
+static struct ovsdb_error *
+binary_pull_field(struct ofpbuf *b, char **strings, uint32_t n_strings,
+                  const struct binary_column *bc, struct ovsdb_row *row)
+{
+    struct ovsdb_error *error;
+    struct ovsdb_datum datum;
+
+    error = binary_pull_datum(b, strings, n_strings, &bc->type, &datum);
+    if (!error && row && bc->column) {
+        const struct ovsdb_type *type = &bc->column->type;
+
+        if (datum.n < type->n_min || datum.n > type->n_max) {
+            error = ovsdb_syntax_error(NULL, NULL, "column %s must have %u "
+                                       "to %u members but %u are present",
+                                       bc->column->name, type->n_min,
+                                       type->n_max, datum.n);
+        } else {
+            error = ovsdb_datum_sort(&datum, type->key.type);
+            if (!error) {
+                error = ovsdb_datum_check_constraints(&datum, type);
+            }
+        }
+        if (!error) {
+            ovsdb_datum_swap(&row->fields[bc->column->index], &datum);
+        }
+    }
+    ovsdb_datum_destroy(&datum, &bc->type);
+
+    return error;
+}
+
+static struct ovsdb_error *
+binary_pull_table(struct ofpbuf *b, char **strings, uint32_t n_strings,
+                  struct ovsdb *db, struct ovsdb_txn *txn, bool converting)
+{
+    struct binary_column *columns;
+    struct ovsdb_table *table;
+    struct ovsdb_error *error;
+    const char *table_name;
+    uint32_t n_columns;
+    uint32_t n_rows;
+    uint32_t i, j;
+
+    error = binary_pull_string(b, strings, n_strings, &table_name);
+    if (error) {
+        return error;
+    }
+    table = shash_find_data(&db->tables, table_name);
+    if (!table && !converting) {
+        return ovsdb_syntax_error(NULL, "unknown table",
+                                  "No table named %s.", table_name);
+    }
+
+    error = binary_pull_count(b, sizeof(uint32_t) + 2, &n_columns);
+    if (error) {
+        return error;
+    }
+    columns = xmalloc(n_columns * sizeof *columns);
+    for (i = 0; i < n_columns; i++) {
+        error = binary_pull_column(b, strings, n_strings, table, converting,
+                                   &columns[i]);
+        if (error) {
+            goto exit;
+        }
+    }
+
+    error = binary_pull_count(b, sizeof(struct uuid), &n_rows);
+    for (i = 0; !error && i < n_rows; i++) {
+        struct ovsdb_row *row = NULL;
+        struct uuid row_uuid;
+
+        error = binary_pull(b, &row_uuid, sizeof row_uuid);
+        if (error) {
+            break;
+        }
+
+        if (table) {
+            if (ovsdb_table_get_row(table, &row_uuid)) {
+                error = ovsdb_syntax_error(NULL, NULL, "binary snapshot "
+                                           "inserts row "UUID_FMT" that "
+                                           "already exists",
+                                           UUID_ARGS(&row_uuid));
+                break;
+            }
+            row = ovsdb_row_create(table);
+            *ovsdb_row_get_uuid_rw(row) = row_uuid;
+        }
+
+        for (j = 0; !error && j < n_columns; j++) {
+            error = binary_pull_field(b, strings, n_strings, &columns[j],
+                                      row);
+        }
+
+        if (row) {
+            if (error) {
+                ovsdb_row_destroy(row);
+            } else {
+                ovsdb_txn_row_insert(txn, row);
+            }
+        }
+    }
+
+exit:
+    free(columns);
+    return error;
+}
+
+/* Converts binary snapshot 'record' to an ovsdb_txn for 'db', storing the new
+ * transaction in '*txnp'.  Returns NULL if successful, otherwise an error.
+ * 'converting' and 'date' have the same meaning as for
+ * ovsdb_file_txn_from_json().
+ *
+ * If 'commentp' is nonnull, then on success the snapshot's comment, or NULL if
+ * it has none, is stored in '*commentp'.  The caller must free it. */
+static struct ovsdb_error *
+ovsdb_file_txn_from_binary(struct ovsdb *db, const struct ofpbuf *record,
+                           bool converting, long long int *date,
+                           char **commentp, struct ovsdb_txn **txnp)
+{
+    struct ovsdb_txn *txn = NULL;
+    struct ovsdb_error *error;
+    char **strings = NULL;
+    uint32_t n_strings = 0;
+    const char *comment;
+    uint32_t n_tables;
+    uint32_t magic;
+    uint32_t version;
+    int64_t date64;
+    struct ofpbuf b;
+    uint32_t i;
+
+    *txnp = NULL;
+    *date = LLONG_MAX;
+    if (commentp) {
+        *commentp = NULL;
+    }
+
+    ofpbuf_use_const(&b, record->data, record->size);
+    error = binary_pull_u32(&b, &magic);
+    if (!error && magic != BINARY_MAGIC) {
+        error = ovsdb_syntax_error(NULL, NULL, "binary snapshot has bad magic "
+                                   "number %#"PRIx32" (written on a host "
+                                   "with different byte order?)", magic);
+    }
+    if (!error) {
+        error = binary_pull_u32(&b, &version);
+        if (!error && version != BINARY_VERSION) {
+            error = ovsdb_syntax_error(NULL, NULL, "binary snapshot has "
+                                       "unsupported version %"PRIu32,
+                                       version);
+        }
+    }
+    if (!error) {
+        error = binary_pull(&b, &date64, sizeof date64);
+    }
+    if (!error) {
+        error = binary_pull_count(&b, sizeof(uint32_t), &n_strings);
+    }
+    if (error) {
+        return error;
+    }
+
+    /* Read the string table. */
+    strings = xmalloc(n_strings * sizeof *strings);
+    for (i = 0; i < n_strings; i++) {
+        const char *s;
+        uint32_t len;
+
+        error = binary_pull_u32(&b, &len);
+        if (!error) {
+            s = ofpbuf_try_pull(&b, len);
+            if (!s) {
+                error = ovsdb_syntax_error(NULL, NULL,
+                                           "binary snapshot is truncated");
+            } else if (memchr(s, '\0', len)) {
+                error = ovsdb_syntax_error(NULL, NULL, "binary snapshot "
+                                           "string contains null byte");
+            }
+        }
+        if (error) {
+            n_strings = i;
+            goto exit;
+        }
+        strings[i] = xmemdup0(s, len);
+    }
+
+    error = binary_pull_string(&b, strings, n_strings, &comment);
+    if (!error) {
+        error = binary_pull_count(&b, 2 * sizeof(uint32_t), &n_tables);
+    }
+    if (error) {
+        goto exit;
+    }
+
+    txn = ovsdb_txn_create(db);
+    for (i = 0; i < n_tables; i++) {
+        error = binary_pull_table(&b, strings, n_strings, db, txn,
+                                  converting);
+        if (error) {
+            goto exit;
+        }
+    }
+    if (b.size) {
+        error = ovsdb_syntax_error(NULL, NULL, "binary snapshot has %"PRIuSIZE
+                                   " bytes of trailing garbage", b.size);
+        goto exit;
+    }
+
+    *date = date64;
+    if (commentp && comment[0]) {
+        *commentp = xstrdup(comment);
+    }
+    *txnp = txn;
+    txn = NULL;
+
+exit:
+    if (txn) {
+        ovsdb_txn_abort(txn);
+    }
+    for (i = 0; i < n_strings; i++) {
+        free(strings[i]);
+    }
+    free(strings);
+    return error;
+}
+
+/* Converts binary snapshot 'record', from a database file whose schema is
+ * 'schema', into the equivalent JSON transaction record, storing it in
+ * '*jsonp'.  This is useful for displaying binary snapshots.  Returns NULL if
+ * successful, otherwise an error.  The caller must free the returned JSON or
+ * error. */
+struct ovsdb_error *
+ovsdb_file_binary_to_json(const struct ofpbuf *record,
+                          const struct ovsdb_schema *schema,
+                          struct json **jsonp)
+{
+    struct ovsdb_file_txn ftxn;
+    struct ovsdb_error *error;
+    struct ovsdb_txn *txn;
+    long long int date;
+    struct ovsdb *db;
+    char *comment;
+
+    *jsonp = NULL;
+
+    db = ovsdb_create(ovsdb_schema_clone(schema));
+    error = ovsdb_file_txn_from_binary(db, record, false, &date, &comment,
+                                       &txn);
+    if (error) {
+        ovsdb_destroy(db);
+        return error;
+    }
+
+    ovsdb_file_txn_init(&ftxn);
+    ovsdb_txn_for_each_change(txn, ovsdb_file_change_cb, &ftxn);
+    ovsdb_txn_abort(txn);
+    ovsdb_destroy(db);
+
+    *jsonp = ftxn.json ? ftxn.json : json_object_create();
+    if (comment) {
+        json_object_put_string(*jsonp, "_comment", comment);
+        free(comment);
+    }
+    json_object_put(*jsonp, "_date", json_integer_create(date));
+    return NULL;
+}
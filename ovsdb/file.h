@@ -20,6 +20,8 @@
 #include "compiler.h"
 #include "log.h"
 
+struct json;
+struct ofpbuf;
 struct ovsdb;
 struct ovsdb_file;
 struct ovsdb_schema;
@@ -44,4 +46,10 @@ struct ovsdb_error *ovsdb_file_read_schema(const char *file_name,
                                            struct ovsdb_schema **)
     WARN_UNUSED_RESULT;
 
+void ovsdb_file_set_binary_snapshots(bool enable);
+struct ovsdb_error *ovsdb_file_binary_to_json(const struct ofpbuf *,
+                                              const struct ovsdb_schema *,
+                                              struct json **)
+    WARN_UNUSED_RESULT;
+
 #endif /* ovsdb/file.h */
@@ -379,6 +379,7 @@ ovsdb_jsonrpc_session_create(struct ovsdb_jsonrpc_remote *remote,
     s->backlog_threshold = 1024 * 1024;
     s->js = js;
     s->js_seqno = jsonrpc_session_get_seqno(js);
+    jsonrpc_session_use_workers(js);
 
     remote->server->n_sessions++;
 
@@ -26,6 +26,7 @@
 
 #include "json.h"
 #include "lockfile.h"
+#include "ofpbuf.h"
 #include "ovsdb.h"
 #include "ovsdb-error.h"
 #include "sha1.h"
@@ -158,21 +159,33 @@ ovsdb_log_close(struct ovsdb_log *file)
     }
 }
 
+/* Each record in a log starts with a header line that begins with one of
+ * these magic strings.  Most records are JSON.  A binary record holds data
+ * whose format is up to the log's client (see ovsdb/file.c).  A binary record
+ * is followed by a new-line that is not part of its length or hash, so that
+ * every header starts a line just as it does after a JSON record. */
 static const char magic[] = "OVSDB JSON ";
+static const char binary_magic[] = "OVSDB BINARY ";
 
 static bool
-parse_header(char *header, unsigned long int *length,
+parse_header(char *header, bool *binary, unsigned long int *length,
              uint8_t sha1[SHA1_DIGEST_SIZE])
 {
     char *p;
 
     /* 'header' must consist of a magic string... */
-    if (strncmp(header, magic, strlen(magic))) {
+    if (!strncmp(header, magic, strlen(magic))) {
+        *binary = false;
+        p = header + strlen(magic);
+    } else if (!strncmp(header, binary_magic, strlen(binary_magic))) {
+        *binary = true;
+        p = header + strlen(binary_magic);
+    } else {
         return false;
     }
 
     /* ...followed by a length in bytes... */
-    *length = strtoul(header + strlen(magic), &p, 10);
+    *length = strtoul(p, &p, 10);
     if (!*length || *length == ULONG_MAX || *p != ' ') {
         return false;
     }
@@ -201,13 +214,16 @@ struct ovsdb_log_read_cbdata {
 
 static struct ovsdb_error *
 parse_body(struct ovsdb_log *file, off_t offset, unsigned long int length,
-           uint8_t sha1[SHA1_DIGEST_SIZE], struct json **jsonp)
+           struct json_arena *arena, uint8_t sha1[SHA1_DIGEST_SIZE],
+           struct json **jsonp)
 {
     struct json_parser *parser;
     struct sha1_ctx ctx;
 
     sha1_init(&ctx);
-    parser = json_parser_create(JSPF_TRAILER);
+    parser = (arena
+              ? json_parser_create_arena(JSPF_TRAILER, arena)
+              : json_parser_create(JSPF_TRAILER));
 
     while (length > 0) {
         char input[BUFSIZ];
@@ -231,18 +247,98 @@ parse_body(struct ovsdb_log *file, off_t offset, unsigned long int length,
     return NULL;
 }
 
+static struct ovsdb_error *
+parse_binary_body(struct ovsdb_log *file, off_t offset,
+                  unsigned long int length, uint8_t sha1[SHA1_DIGEST_SIZE],
+                  struct ofpbuf **bufferp)
+{
+    struct ofpbuf *buffer;
+
+    /* Binary records are read in one piece, since the point of them is to
+     * avoid per-byte processing. */
+    buffer = ofpbuf_new(length);
+    if (fread(ofpbuf_put_uninit(buffer, length), 1, length, file->stream)
+        != length) {
+        ofpbuf_delete(buffer);
+        return ovsdb_io_error(ferror(file->stream) ? errno : EOF,
+                              "%s: error reading %lu bytes "
+                              "starting at offset %lld", file->name,
+                              length, (long long int) offset);
+    }
+    sha1_bytes(buffer->data, buffer->size, sha1);
+
+    if (getc(file->stream) != '\n') {
+        ofpbuf_delete(buffer);
+        return ovsdb_syntax_error(NULL, NULL, "%s: binary record of %lu "
+                                  "bytes starting at offset %lld is not "
+                                  "followed by a new-line", file->name,
+                                  length, (long long int) offset);
+    }
+
+    *bufferp = buffer;
+    return NULL;
+}
+
+/* Reads the next record from 'file', which must be a JSON record.  On
+ * success, stores the record into '*jsonp', which the caller must eventually
+ * free with json_destroy(), and returns NULL.  At end of file, stores NULL
+ * into '*jsonp' and returns NULL.  On failure, stores NULL into '*jsonp' and
+ * returns an error.
+ *
+ * Use ovsdb_log_read_any() to read a log that might contain binary records. */
 struct ovsdb_error *
 ovsdb_log_read(struct ovsdb_log *file, struct json **jsonp)
+{
+    struct ovsdb_error *error;
+    struct ofpbuf *binary;
+
+    error = ovsdb_log_read_any(file, jsonp, &binary);
+    if (!error && binary) {
+        ofpbuf_delete(binary);
+        error = ovsdb_syntax_error(NULL, NULL, "%s: unexpected binary record "
+                                   "at offset %lld", file->name,
+                                   (long long int) file->prev_offset);
+        file->read_error = ovsdb_error_clone(error);
+    }
+    return error;
+}
+
+/* Reads the next record from 'file'.  On success, returns NULL and stores the
+ * record into '*jsonp' if it is a JSON record or into '*binaryp' if it is a
+ * binary record, storing NULL into the other.  The caller must eventually free
+ * the record with json_destroy() or ofpbuf_delete(), respectively.  At end of
+ * file, stores NULL into both and returns NULL.  On failure, stores NULL into
+ * both and returns an error. */
+struct ovsdb_error *
+ovsdb_log_read_any(struct ovsdb_log *file, struct json **jsonp,
+                   struct ofpbuf **binaryp)
+{
+    return ovsdb_log_read_any_arena(file, NULL, jsonp, binaryp);
+}
+
+/* Like ovsdb_log_read_any(), except that if 'arena' is nonnull then a JSON
+ * record is allocated from 'arena' (see json_parser_create_arena()).  Such a
+ * record is read-only and remains valid only until 'arena' is destroyed, so
+ * the caller must json_clone() any part of it that it wants to keep.  This
+ * saves a malloc() and free() for every value in large records that the
+ * caller only converts into some other form, such as when replaying a
+ * database log. */
+struct ovsdb_error *
+ovsdb_log_read_any_arena(struct ovsdb_log *file, struct json_arena *arena,
+                         struct json **jsonp, struct ofpbuf **binaryp)
 {
     uint8_t expected_sha1[SHA1_DIGEST_SIZE];
     uint8_t actual_sha1[SHA1_DIGEST_SIZE];
     struct ovsdb_error *error;
     off_t data_offset;
     unsigned long data_length;
+    struct ofpbuf *binary;
     struct json *json;
     char header[128];
+    bool is_binary;
 
     *jsonp = json = NULL;
+    *binaryp = binary = NULL;
 
     if (file->read_error) {
         return ovsdb_error_clone(file->read_error);
@@ -259,7 +355,7 @@ ovsdb_log_read(struct ovsdb_log *file, struct json **jsonp)
         goto error;
     }
 
-    if (!parse_header(header, &data_length, expected_sha1)) {
+    if (!parse_header(header, &is_binary, &data_length, expected_sha1)) {
         error = ovsdb_syntax_error(NULL, NULL, "%s: parse error at offset "
                                    "%lld in header line \"%.*s\"",
                                    file->name, (long long int) file->offset,
@@ -268,7 +364,11 @@ ovsdb_log_read(struct ovsdb_log *file, struct json **jsonp)
     }
 
     data_offset = file->offset + strlen(header);
-    error = parse_body(file, data_offset, data_length, actual_sha1, &json);
+    error = (is_binary
+             ? parse_binary_body(file, data_offset, data_length, actual_sha1,
+                                 &binary)
+             : parse_body(file, data_offset, data_length, arena, actual_sha1,
+                          &json));
     if (error) {
         goto error;
     }
@@ -284,7 +384,7 @@ ovsdb_log_read(struct ovsdb_log *file, struct json **jsonp)
         goto error;
     }
 
-    if (json->type == JSON_STRING) {
+    if (json && json->type == JSON_STRING) {
         error = ovsdb_syntax_error(NULL, NULL, "%s: %lu bytes starting at "
                                    "offset %lld are not valid JSON (%s)",
                                    file->name, data_length,
@@ -299,12 +399,17 @@ ovsdb_log_read(struct ovsdb_log *file, struct json **jsonp)
 #else
 	file->offset = data_offset + data_length;
 #endif
+    if (is_binary) {
+        file->offset++;
+    }
     *jsonp = json;
+    *binaryp = binary;
     return NULL;
 
 error:
     file->read_error = ovsdb_error_clone(error);
     json_destroy(json);
+    ofpbuf_delete(binary);
     return error;
 }
 
@@ -324,16 +429,16 @@ ovsdb_log_unread(struct ovsdb_log *file)
     file->offset = file->prev_offset;
 }
 
-struct ovsdb_error *
-ovsdb_log_write(struct ovsdb_log *file, struct json *json)
+/* Appends a record with the given 'record_magic' and the 'length' bytes
+ * starting at 'data' to 'file'.  If 'newline' is true, also writes a new-line
+ * after the data, outside the record's length and hash. */
+static struct ovsdb_error *
+ovsdb_log_write__(struct ovsdb_log *file, const char *record_magic,
+                  const void *data, size_t length, bool newline)
 {
     uint8_t sha1[SHA1_DIGEST_SIZE];
     struct ovsdb_error *error;
-    char *json_string;
     char header[128];
-    size_t length;
-
-    json_string = NULL;
 
     if (file->mode == OVSDB_LOG_READ || file->write_error) {
         file->mode = OVSDB_LOG_WRITE;
@@ -350,25 +455,15 @@ ovsdb_log_write(struct ovsdb_log *file, struct json *json)
         }
     }
 
-    if (json->type != JSON_OBJECT && json->type != JSON_ARRAY) {
-        error = OVSDB_BUG("bad JSON type");
-        goto error;
-    }
-
-    /* Compose content.  Add a new-line (replacing the null terminator) to make
-     * the file easier to read, even though it has no semantic value.  */
-    json_string = json_to_string(json, 0);
-    length = strlen(json_string) + 1;
-    json_string[length - 1] = '\n';
-
     /* Compose header. */
-    sha1_bytes(json_string, length, sha1);
+    sha1_bytes(data, length, sha1);
     snprintf(header, sizeof header, "%s%"PRIuSIZE" "SHA1_FMT"\n",
-             magic, length, SHA1_ARGS(sha1));
+             record_magic, length, SHA1_ARGS(sha1));
 
     /* Write. */
     if (fwrite(header, strlen(header), 1, file->stream) != 1
-        || fwrite(json_string, length, 1, file->stream) != 1
+        || fwrite(data, length, 1, file->stream) != 1
+        || (newline && putc('\n', file->stream) == EOF)
         || fflush(file->stream))
     {
         error = ovsdb_io_error(errno, "%s: write failed", file->name);
@@ -380,16 +475,49 @@ ovsdb_log_write(struct ovsdb_log *file, struct json *json)
         goto error;
     }
 
-    file->offset += strlen(header) + length;
-    free(json_string);
+    file->offset += strlen(header) + length + newline;
     return NULL;
 
 error:
     file->write_error = true;
+    return error;
+}
+
+struct ovsdb_error *
+ovsdb_log_write(struct ovsdb_log *file, struct json *json)
+{
+    struct ovsdb_error *error;
+    char *json_string;
+    size_t length;
+
+    if (json->type != JSON_OBJECT && json->type != JSON_ARRAY) {
+        file->write_error = true;
+        return OVSDB_BUG("bad JSON type");
+    }
+
+    /* Compose content.  Add a new-line (replacing the null terminator) to make
+     * the file easier to read, even though it has no semantic value.  */
+    json_string = json_to_string(json, 0);
+    length = strlen(json_string) + 1;
+    json_string[length - 1] = '\n';
+
+    error = ovsdb_log_write__(file, magic, json_string, length, false);
     free(json_string);
     return error;
 }
 
+/* Appends a binary record containing the 'length' bytes starting at 'data' to
+ * 'file'.  A binary record must not be empty. */
+struct ovsdb_error *
+ovsdb_log_write_binary(struct ovsdb_log *file, const void *data, size_t length)
+{
+    if (!length) {
+        file->write_error = true;
+        return OVSDB_BUG("empty binary record");
+    }
+    return ovsdb_log_write__(file, binary_magic, data, length, true);
+}
+
 struct ovsdb_error *
 ovsdb_log_commit(struct ovsdb_log *file)
 {
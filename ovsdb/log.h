@@ -20,6 +20,8 @@
 #include "compiler.h"
 
 struct json;
+struct json_arena;
+struct ofpbuf;
 struct ovsdb_log;
 
 /* Access mode for opening an OVSDB log. */
@@ -36,10 +38,20 @@ void ovsdb_log_close(struct ovsdb_log *);
 
 struct ovsdb_error *ovsdb_log_read(struct ovsdb_log *, struct json **)
     WARN_UNUSED_RESULT;
+struct ovsdb_error *ovsdb_log_read_any(struct ovsdb_log *, struct json **,
+                                       struct ofpbuf **)
+    WARN_UNUSED_RESULT;
+struct ovsdb_error *ovsdb_log_read_any_arena(struct ovsdb_log *,
+                                             struct json_arena *,
+                                             struct json **, struct ofpbuf **)
+    WARN_UNUSED_RESULT;
 void ovsdb_log_unread(struct ovsdb_log *);
 
 struct ovsdb_error *ovsdb_log_write(struct ovsdb_log *, struct json *)
     WARN_UNUSED_RESULT;
+struct ovsdb_error *ovsdb_log_write_binary(struct ovsdb_log *,
+                                           const void *, size_t)
+    WARN_UNUSED_RESULT;
 struct ovsdb_error *ovsdb_log_commit(struct ovsdb_log *)
     WARN_UNUSED_RESULT;
 
@@ -1038,6 +1038,8 @@ parse_options(int *argcp, char **argvp[],
         OPT_RUN,
         OPT_BOOTSTRAP_CA_CERT,
         OPT_ENABLE_DUMMY,
+        OPT_BINARY_SNAPSHOTS,
+        OPT_WORKER_THREADS,
         VLOG_OPTION_ENUMS,
         LEAK_CHECKER_OPTION_ENUMS,
         DAEMON_OPTION_ENUMS
@@ -1056,6 +1058,8 @@ parse_options(int *argcp, char **argvp[],
         {"certificate", required_argument, NULL, 'c'},
         {"ca-cert",     required_argument, NULL, 'C'},
         {"enable-dummy", optional_argument, NULL, OPT_ENABLE_DUMMY},
+        {"binary-snapshots", no_argument, NULL, OPT_BINARY_SNAPSHOTS},
+        {"worker-threads", required_argument, NULL, OPT_WORKER_THREADS},
         {NULL, 0, NULL, 0},
     };
     char *short_options = long_options_to_short_options(long_options);
@@ -1117,6 +1121,21 @@ parse_options(int *argcp, char **argvp[],
             dummy_enable(optarg && !strcmp(optarg, "override"));
             break;
 
+        case OPT_BINARY_SNAPSHOTS:
+            ovsdb_file_set_binary_snapshots(true);
+            break;
+
+        case OPT_WORKER_THREADS: {
+            unsigned int n;
+
+            if (!str_to_uint(optarg, 10, &n) || n > 64) {
+                ovs_fatal(0, "--worker-threads argument must be between 0 "
+                          "and 64");
+            }
+            jsonrpc_set_worker_threads(n);
+            break;
+        }
+
         case '?':
             exit(EXIT_FAILURE);
 
@@ -1154,6 +1173,9 @@ usage(void)
     printf("\nOther options:\n"
            "  --run COMMAND           run COMMAND as subprocess then exit\n"
            "  --unixctl=SOCKET        override default control socket name\n"
+           "  --binary-snapshots      compact databases to binary snapshots\n"
+           "  --worker-threads=N      parse and serialize JSON-RPC messages\n"
+           "                          in N threads (default: 0)\n"
            "  -h, --help              display this help message\n"
            "  -V, --version           display version information\n");
     leak_checker_usage();
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,7 @@
 #include "lockfile.h"
 #include "log.h"
 #include "json.h"
+#include "ofpbuf.h"
 #include "ovsdb.h"
 #include "ovsdb-data.h"
 #include "ovsdb-error.h"
@@ -74,8 +76,12 @@ main(int argc, char *argv[])
 static void
 parse_options(int argc, char *argv[])
 {
+    enum {
+        OPT_BINARY_SNAPSHOTS = UCHAR_MAX + 1
+    };
     static struct option long_options[] = {
         {"more", no_argument, NULL, 'm'},
+        {"binary-snapshots", no_argument, NULL, OPT_BINARY_SNAPSHOTS},
         {"verbose", optional_argument, NULL, 'v'},
         {"help", no_argument, NULL, 'h'},
         {"version", no_argument, NULL, 'V'},
@@ -96,6 +102,10 @@ parse_options(int argc, char *argv[])
             show_log_verbosity++;
             break;
 
+        case OPT_BINARY_SNAPSHOTS:
+            ovsdb_file_set_binary_snapshots(true);
+            break;
+
         case 'h':
             usage();
 
@@ -138,6 +148,8 @@ usage(void)
     vlog_usage();
     printf("\nOther options:\n"
            "  -m, --more                  increase show-log verbosity\n"
+           "  --binary-snapshots          compact/convert to a binary "
+           "snapshot\n"
            "  -h, --help                  display this help message\n"
            "  -V, --version               display version information\n");
     exit(EXIT_SUCCESS);
@@ -509,10 +521,19 @@ do_show_log(int argc, char *argv[])
     shash_init(&names);
     schema = NULL;
     for (i = 0; ; i++) {
+        struct ofpbuf *binary;
         struct json *json;
 
-        check_ovsdb_error(ovsdb_log_read(log, &json));
-        if (!json) {
+        check_ovsdb_error(ovsdb_log_read_any(log, &json, &binary));
+        if (binary) {
+            if (!schema) {
+                ovs_fatal(0, "%s: binary record precedes schema",
+                          db_file_name);
+            }
+            check_ovsdb_error(ovsdb_file_binary_to_json(binary, schema,
+                                                        &json));
+            ofpbuf_delete(binary);
+        } else if (!json) {
             break;
         }
 
@@ -213,7 +213,10 @@ tests_ovstest_SOURCES = \
 	tests/test-bundle.c \
 	tests/test-byte-order.c \
 	tests/test-classifier.c \
+	tests/test-connmgr.c \
 	tests/test-csum.c \
+	tests/test-dpif-netdev.c \
+	tests/test-dpif-netdev-bench.c \
 	tests/test-file_name.c \
 	tests/test-flows.c \
 	tests/test-hash.c \
@@ -224,10 +227,15 @@ tests_ovstest_SOURCES = \
 	tests/test-jsonrpc.c \
 	tests/test-list.c \
 	tests/test-lockfile.c \
+	tests/test-mac-learning.c \
 	tests/test-multipath.c \
 	tests/test-netflow.c \
 	tests/test-odp.c \
+	tests/test-ofpbuf.c \
+	tests/test-packed-flow.c \
 	tests/test-packets.c \
+	tests/test-pinsched.c \
+	tests/test-pktbuf.c \
 	tests/test-random.c \
 	tests/test-reconnect.c \
 	tests/test-sflow.c \
@@ -237,7 +245,10 @@ tests_ovstest_SOURCES = \
 	tests/test-util.c \
 	tests/test-uuid.c \
 	tests/test-vconn.c
-tests_ovstest_LDADD = lib/libopenvswitch.la
+tests_ovstest_LDADD = \
+	ofproto/libofproto.la \
+	lib/libsflow.la \
+	lib/libopenvswitch.la
 dist_check_SCRIPTS = tests/flowgen.pl
 
 noinst_PROGRAMS += tests/test-strtok_r
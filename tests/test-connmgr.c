@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Tests for the packet-in flow control computations in connmgr. */
+
+#include <config.h>
+#include "ofproto/connmgr.h"
+#include <limits.h>
+#include <stdio.h>
+#include "ovstest.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+static void
+test_drain_rate_first_sample(void)
+{
+    /* The first sample becomes the rate, whatever the rate was before. */
+    assert(ofconn_fc_drain_rate(0, false, 500, 1000) == 500);
+    assert(ofconn_fc_drain_rate(12345, false, 500, 1000) == 500);
+    assert(ofconn_fc_drain_rate(12345, false, 0, 1000) == 0);
+
+    /* Samples are scaled to packet-ins per second. */
+    assert(ofconn_fc_drain_rate(0, false, 300, 1500) == 200);
+    assert(ofconn_fc_drain_rate(0, false, 300, 3000) == 100);
+    assert(ofconn_fc_drain_rate(0, false, 300, 0) == 0);
+}
+
+static void
+test_drain_rate_average(void)
+{
+    unsigned int rate;
+    int i;
+
+    /* Later samples are averaged in with weight 1/4. */
+    assert(ofconn_fc_drain_rate(400, true, 800, 1000) == 500);
+    assert(ofconn_fc_drain_rate(400, true, 0, 1000) == 300);
+    assert(ofconn_fc_drain_rate(400, true, 400, 1000) == 400);
+
+    /* A steady rate converges. */
+    rate = ofconn_fc_drain_rate(0, false, 1000, 1000);
+    for (i = 0; i < 20; i++) {
+        rate = ofconn_fc_drain_rate(rate, true, 2000, 1000);
+    }
+    assert(rate >= 1990 && rate <= 2000);
+
+    /* The rate saturates instead of wrapping around. */
+    assert(ofconn_fc_drain_rate(UINT_MAX, true, ULLONG_MAX / 8000, 1)
+           == UINT_MAX);
+}
+
+static void
+test_rate_limit_backlog(void)
+{
+    /* A backlog of half of the rconn's 100 packet-ins, or an overflow, drops
+     * the limit to 7/8 of the drain rate or of the old limit, whichever is
+     * lower. */
+    assert(ofconn_fc_rate_limit(1000, 800, 50, false, false) == 700);
+    assert(ofconn_fc_rate_limit(1000, 800, 100, false, true) == 700);
+    assert(ofconn_fc_rate_limit(1000, 800, 0, true, false) == 700);
+    assert(ofconn_fc_rate_limit(800, 4000, 60, false, false) == 700);
+
+    /* The limit never drops below OFCONN_FC_MIN_RATE. */
+    assert(ofconn_fc_rate_limit(1000, 0, 50, false, false)
+           == OFCONN_FC_MIN_RATE);
+    assert(ofconn_fc_rate_limit(OFCONN_FC_MIN_RATE, 10, 0, true, false)
+           == OFCONN_FC_MIN_RATE);
+}
+
+static void
+test_rate_limit_headroom(void)
+{
+    /* A nearly empty rconn with packet-ins held back raises the limit by
+     * 1/8. */
+    assert(ofconn_fc_rate_limit(800, 800, 0, false, true) == 900);
+    assert(ofconn_fc_rate_limit(800, 800, 24, false, true) == 900);
+
+    /* ...but not past OFCONN_FC_MAX_RATE. */
+    assert(ofconn_fc_rate_limit(OFCONN_FC_MAX_RATE - 1, 0, 0, false, true)
+           == OFCONN_FC_MAX_RATE);
+
+    /* Otherwise the limit stays put. */
+    assert(ofconn_fc_rate_limit(800, 800, 0, false, false) == 800);
+    assert(ofconn_fc_rate_limit(800, 800, 25, false, true) == 800);
+    assert(ofconn_fc_rate_limit(800, 800, 49, false, true) == 800);
+}
+
+static void
+run_test(void (*function)(void))
+{
+    function();
+    printf(".");
+}
+
+static void
+test_connmgr_main(int argc OVS_UNUSED, char *argv[] OVS_UNUSED)
+{
+    run_test(test_drain_rate_first_sample);
+    run_test(test_drain_rate_average);
+    run_test(test_rate_limit_backlog);
+    run_test(test_rate_limit_headroom);
+    printf("\n");
+}
+
+OVSTEST_REGISTER("test-connmgr", test_connmgr_main);
@@ -16,6 +16,7 @@
 
 #include <config.h>
 #include "csum.h"
+#include "crc32c.h"
 #include <inttypes.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -133,6 +134,156 @@ test_rfc1624(void)
     mark('#');
 }
 
+/* The scalar csum_continue() that the faster implementations replaced. */
+static uint32_t
+reference_csum_continue(uint32_t partial, const void *data_, size_t n)
+{
+    const ovs_be16 *data = data_;
+
+    for (; n > 1; n -= 2, data++) {
+        partial = csum_add16(partial, get_unaligned_be16(data));
+    }
+    if (n) {
+        partial += *(uint8_t *) data;
+    }
+    return partial;
+}
+
+/* Checks every csum_continue() implementation that this CPU supports against
+ * the scalar code, for many lengths and alignments, and when the data is
+ * checksummed in two pieces. */
+static void
+test_csum_continue(void)
+{
+    uint8_t data[1600];
+    const char *name;
+    size_t idx;
+
+    for (idx = 0; (name = csum_impl_name(idx)) != NULL; idx++) {
+        int i;
+
+        if (!csum_set_impl(name)) {
+            continue;
+        }
+
+        for (i = 0; i < 1000; i++) {
+            size_t ofs = random_range(8);
+            size_t n = random_range(sizeof data - ofs + 1);
+            size_t split = random_range(n + 1) & ~1;
+            uint32_t partial = random_range(0x20000);
+            uint32_t expected;
+
+            random_bytes(data, sizeof data);
+            if (i % 10 == 0) {
+                /* Exercise the carries. */
+                memset(data, 0xff, sizeof data);
+            }
+
+            expected = reference_csum_continue(partial, &data[ofs], n);
+            assert(csum_finish(csum_continue(partial, &data[ofs], n))
+                   == csum_finish(expected));
+            assert(csum_finish(csum_continue(
+                                   csum_continue(partial, &data[ofs], split),
+                                   &data[ofs + split], n - split))
+                   == csum_finish(expected));
+        }
+    }
+    mark('#');
+}
+
+/* Returns the CRC32C of the 'n' bytes in 'data', computed a bit at a time. */
+static uint32_t
+reference_crc32c(uint32_t crc, const uint8_t *data, size_t n)
+{
+    while (n--) {
+        int i;
+
+        crc ^= *data++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+        }
+    }
+    return crc;
+}
+
+/* Checks every CRC32C implementation that this CPU supports. */
+static void
+test_crc32c(void)
+{
+    static const char check[] = "123456789";
+    uint8_t data[256];
+    const char *name;
+    size_t idx;
+
+    for (idx = 0; (name = crc32c_impl_name(idx)) != NULL; idx++) {
+        int i;
+
+        if (!crc32c_set_impl(name)) {
+            continue;
+        }
+
+        /* The standard check value for CRC32C. */
+        assert((crc32c_extend(0xffffffff, (const uint8_t *) check,
+                              strlen(check)) ^ 0xffffffff) == 0xe3069283);
+
+        for (i = 0; i < 1000; i++) {
+            size_t ofs = random_range(8);
+            size_t n = random_range(sizeof data - ofs + 1);
+            uint32_t crc = random_uint32();
+
+            random_bytes(data, sizeof data);
+            assert(crc32c_extend(crc, &data[ofs], n)
+                   == reference_crc32c(crc, &data[ofs], n));
+        }
+    }
+    mark('#');
+}
+
+/* Test the incremental checksum update functions, by changing several fields
+ * in a block of data and comparing the updated checksum against both
+ * recomputation and chained recalc_csum32() calls. */
+static void
+test_csum_update(void)
+{
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        ovs_be32 data[16], new_u128[4];
+        ovs_be16 old_csum, chained_csum;
+        uint32_t partial;
+        int j;
+
+        for (j = 0; j < ARRAY_SIZE(data); j++) {
+            data[j] = (OVS_FORCE ovs_be32) random_uint32();
+        }
+        old_csum = csum(data, sizeof data);
+
+        partial = csum_update_init(old_csum);
+        chained_csum = old_csum;
+        for (j = 0; j < 4; j++) {
+            int index = random_range(ARRAY_SIZE(data));
+            ovs_be32 new_u32 = (OVS_FORCE ovs_be32) random_uint32();
+
+            partial = csum_update32(partial, data[index], new_u32);
+            chained_csum = recalc_csum32(chained_csum, data[index], new_u32);
+            data[index] = new_u32;
+        }
+        assert(csum_update_finish(partial) == csum(data, sizeof data));
+        assert(csum_update_finish(partial) == chained_csum);
+
+        /* Change a 128-bit field too. */
+        for (j = 0; j < 4; j++) {
+            new_u128[j] = (OVS_FORCE ovs_be32) random_uint32();
+        }
+        partial = csum_update_init(chained_csum);
+        partial = csum_update128(partial, &data[4], new_u128);
+        memcpy(&data[4], new_u128, sizeof new_u128);
+        assert(csum_update_finish(partial) == csum(data, sizeof data));
+        mark('.');
+    }
+    mark('#');
+}
+
 int
 main(void)
 {
@@ -236,6 +387,10 @@ main(void)
     }
     mark('#');
 
+    test_csum_continue();
+    test_crc32c();
+    test_csum_update();
+
     putchar('\n');
 
     return 0;
@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* End-to-end benchmark for the userspace datapath.
+ *
+ * Creates a bridge through ofproto-dpif on top of a dpif-netdev datapath with
+ * dummy ports, loads an OpenFlow table, and then runs the same main loop as
+ * ovs-vswitchd while the first port generates traffic (see the "gen_flows"
+ * and "replay_pcap" options of dummy netdevs).  The results are printed as a
+ * JSON object, so that they can be compared across commits. */
+
+#include <config.h>
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "command-line.h"
+#include "dpif.h"
+#include "dummy.h"
+#include "json.h"
+#include "netdev.h"
+#include "ofp-errors.h"
+#include "ofp-parse.h"
+#include "ofp-util.h"
+#include "ofproto/ofproto.h"
+#include "ofproto/ofproto-provider.h"
+#include "ovstest.h"
+#include "packets.h"
+#include "poll-loop.h"
+#include "shash.h"
+#include "smap.h"
+#include "util.h"
+#include "vlog.h"
+
+/* Benchmark configuration. */
+static const char *dp_type = "dummy";
+static unsigned int n_ports = 2;
+static const char *flows_file;
+static unsigned int n_gen_flows = 1000;
+static unsigned int packet_size = 64;
+static const char *pcap_file;
+static const char *distribution = "sequential";
+static unsigned int rate;
+static unsigned long long int n_packets = 1000000;
+static unsigned int max_secs = 60;
+
+/* The stages of one iteration of the main loop, in order. */
+enum bench_stage {
+    STAGE_DATAPATH,             /* ofproto_type_run(): dpif_run(). */
+    STAGE_UPCALL,               /* ofproto_type_run_fast(): flow setup. */
+    STAGE_OFPROTO,              /* ofproto_run_fast(), ofproto_run(). */
+    STAGE_POLL,                 /* Waiting and poll_block(). */
+    N_STAGES
+};
+
+static const char *const stage_names[N_STAGES] = {
+    "datapath", "upcall", "ofproto", "poll",
+};
+
+struct bench_stats {
+    uint64_t stage_cycles[N_STAGES];
+    unsigned long long int n_iterations;
+
+    /* Time spent in the upcall stage in iterations that found new misses, as
+     * an estimate of how long it takes to set up a datapath flow. */
+    unsigned long long int setup_ns;
+    unsigned long long int max_setup_ns;
+};
+
+static void parse_options(int argc, char *argv[]);
+static void usage(void) NO_RETURN;
+
+/* Returns a time stamp in CPU cycles, if the CPU has a cheap cycle counter,
+ * otherwise in nanoseconds. */
+static uint64_t
+bench_cycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    uint32_t lo, hi;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static const char *
+bench_cycle_unit(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return "tsc";
+#else
+    return "ns";
+#endif
+}
+
+static unsigned long long int
+bench_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long int) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct netdev *
+bench_add_port(struct ofproto *ofproto, unsigned int idx)
+{
+    uint16_t ofp_port = idx + 1;
+    struct netdev *netdev;
+    char *name;
+    int error;
+
+    name = xasprintf("p%u", idx + 1);
+    error = netdev_open(name, ofproto_port_open_type(dp_type, "dummy"),
+                        &netdev);
+    if (error) {
+        ovs_fatal(error, "%s: could not open network device", name);
+    }
+    error = ofproto_port_add(ofproto, netdev, &ofp_port);
+    if (error) {
+        ovs_fatal(error, "%s: could not add port", name);
+    }
+    free(name);
+
+    return netdev;
+}
+
+static void
+bench_start_traffic(struct netdev *netdev)
+{
+    struct smap args;
+    int error;
+
+    smap_init(&args);
+    if (pcap_file) {
+        smap_add(&args, "replay_pcap", pcap_file);
+    } else {
+        smap_add_format(&args, "gen_flows", "%u", n_gen_flows);
+        smap_add_format(&args, "gen_size", "%u", packet_size);
+    }
+    smap_add(&args, "source_dist", distribution);
+    if (rate) {
+        smap_add_format(&args, "source_rate", "%u", rate);
+    }
+    smap_add_format(&args, "source_count", "%llu", n_packets);
+
+    error = netdev_set_config(netdev, &args);
+    if (error) {
+        ovs_fatal(error, "%s: could not configure traffic source",
+                  netdev_get_name(netdev));
+    }
+    smap_destroy(&args);
+}
+
+static void
+bench_load_flows(struct ofproto *ofproto)
+{
+    struct ofputil_flow_mod *fms = NULL;
+    size_t n_fms = 0;
+    size_t i;
+
+    if (flows_file) {
+        parse_ofp_flow_mod_file(flows_file, OFPFC_ADD, &fms, &n_fms);
+    } else {
+        fms = xmalloc(sizeof *fms);
+        parse_ofp_flow_mod_str(&fms[0], "in_port=1,actions=output:2",
+                               OFPFC_ADD, false);
+        n_fms = 1;
+    }
+
+    for (i = 0; i < n_fms; i++) {
+        int error = ofproto_flow_mod(ofproto, &fms[i]);
+        if (error) {
+            ovs_fatal(0, "flow %"PRIuSIZE": %s", i, ofperr_to_string(error));
+        }
+        free(fms[i].ofpacts);
+    }
+    free(fms);
+}
+
+static uint64_t
+bench_n_received(const struct dpif_dp_stats *stats)
+{
+    return stats->n_hit + stats->n_missed;
+}
+
+static void
+bench_run(struct ofproto *ofproto, struct dpif *dpif,
+          struct bench_stats *bs)
+{
+    unsigned long long int deadline = bench_nsec() + max_secs * 1000000000ULL;
+    uint64_t n_missed = 0;
+
+    for (;;) {
+        struct dpif_dp_stats stats;
+        uint64_t t[N_STAGES + 1];
+        unsigned long long int setup_start;
+        int i;
+
+        t[0] = bench_cycles();
+        ofproto_type_run(dp_type);
+        t[1] = bench_cycles();
+
+        dpif_get_dp_stats(dpif, &stats);
+        setup_start = bench_nsec();
+        ofproto_type_run_fast(dp_type);
+        if (stats.n_missed > n_missed) {
+            unsigned long long int setup_ns = bench_nsec() - setup_start;
+
+            bs->setup_ns += setup_ns;
+            bs->max_setup_ns = MAX(bs->max_setup_ns, setup_ns);
+            n_missed = stats.n_missed;
+        }
+        t[2] = bench_cycles();
+
+        ofproto_run_fast(ofproto);
+        ofproto_run(ofproto);
+        t[3] = bench_cycles();
+
+        if (bench_n_received(&stats) >= n_packets
+            || bench_nsec() >= deadline) {
+            break;
+        }
+        ofproto_type_wait(dp_type);
+        ofproto_wait(ofproto);
+        poll_block();
+        t[4] = bench_cycles();
+
+        for (i = 0; i < N_STAGES; i++) {
+            bs->stage_cycles[i] += t[i + 1] - t[i];
+        }
+        bs->n_iterations++;
+    }
+}
+
+static struct json *
+bench_rate(double count, unsigned long long int ns)
+{
+    return json_real_create(ns ? count * 1e9 / ns : 0.0);
+}
+
+static struct json *
+bench_report(const struct dpif_dp_stats *stats, const struct bench_stats *bs,
+             unsigned long long int elapsed_ns)
+{
+    uint64_t n_received = bench_n_received(stats);
+    struct json *config, *setup, *stages, *report;
+    int i;
+
+    config = json_object_create();
+    json_object_put_string(config, "datapath_type", dp_type);
+    json_object_put(config, "ports", json_integer_create(n_ports));
+    if (flows_file) {
+        json_object_put_string(config, "flows", flows_file);
+    }
+    if (pcap_file) {
+        json_object_put_string(config, "pcap", pcap_file);
+    } else {
+        json_object_put(config, "gen_flows", json_integer_create(n_gen_flows));
+        json_object_put(config, "packet_size",
+                        json_integer_create(packet_size));
+    }
+    json_object_put_string(config, "distribution", distribution);
+    json_object_put(config, "rate", json_integer_create(rate));
+    json_object_put(config, "packets", json_integer_create(n_packets));
+
+    setup = json_object_create();
+    json_object_put(setup, "avg_usec",
+                    json_real_create(stats->n_missed
+                                     ? bs->setup_ns / 1e3 / stats->n_missed
+                                     : 0.0));
+    json_object_put(setup, "max_batch_usec",
+                    json_real_create(bs->max_setup_ns / 1e3));
+
+    stages = json_object_create();
+    for (i = 0; i < N_STAGES; i++) {
+        struct json *stage = json_object_create();
+
+        json_object_put(stage, "cycles",
+                        json_integer_create(bs->stage_cycles[i]));
+        json_object_put(stage, "cycles_per_packet",
+                        json_real_create(n_received
+                                         ? (double) bs->stage_cycles[i]
+                                           / n_received
+                                         : 0.0));
+        json_object_put(stages, stage_names[i], stage);
+    }
+
+    report = json_object_create();
+    json_object_put(report, "config", config);
+    json_object_put(report, "elapsed_usec",
+                    json_integer_create(elapsed_ns / 1000));
+    json_object_put(report, "iterations",
+                    json_integer_create(bs->n_iterations));
+    json_object_put(report, "packets", json_integer_create(n_received));
+    json_object_put(report, "packets_per_sec",
+                    bench_rate(n_received, elapsed_ns));
+    json_object_put(report, "hits", json_integer_create(stats->n_hit));
+    json_object_put(report, "upcalls", json_integer_create(stats->n_missed));
+    json_object_put(report, "upcalls_per_sec",
+                    bench_rate(stats->n_missed, elapsed_ns));
+    json_object_put(report, "lost", json_integer_create(stats->n_lost));
+    json_object_put(report, "megaflows", json_integer_create(stats->n_flows));
+    json_object_put(report, "flow_setup", setup);
+    json_object_put_string(report, "cycle_unit", bench_cycle_unit());
+    json_object_put(report, "stages", stages);
+
+    return report;
+}
+
+static void
+test_dpif_netdev_bench_main(int argc, char *argv[])
+{
+    unsigned long long int start, elapsed_ns;
+    struct dpif_dp_stats stats;
+    struct shash iface_hints;
+    struct bench_stats bs;
+    struct ofproto *ofproto;
+    struct netdev **netdevs;
+    struct json *report;
+    struct dpif *dpif;
+    char *dp_name;
+    char *s;
+    unsigned int i;
+    int error;
+
+    parse_options(argc, argv);
+
+    dummy_enable(false);
+    shash_init(&iface_hints);
+    ofproto_init(&iface_hints);
+
+    /* ovs-vswitchd clears this once it reads its configuration.  Until then,
+     * ofproto-dpif does not receive any upcalls from the datapath. */
+    ofproto_set_flow_restore_wait(false);
+
+    error = ofproto_create("bench", dp_type, &ofproto);
+    if (error) {
+        ovs_fatal(error, "could not create %s datapath", dp_type);
+    }
+
+    dp_name = xasprintf("ovs-%s", dp_type);
+    error = dpif_open(dp_name, dp_type, &dpif);
+    if (error) {
+        ovs_fatal(error, "%s: could not open datapath", dp_name);
+    }
+    free(dp_name);
+
+    netdevs = xmalloc(n_ports * sizeof *netdevs);
+    for (i = 0; i < n_ports; i++) {
+        netdevs[i] = bench_add_port(ofproto, i);
+    }
+    bench_load_flows(ofproto);
+
+    /* Let ofproto-dpif finish configuring the ports before starting the
+     * clock. */
+    ofproto_type_run(dp_type);
+    ofproto_run(ofproto);
+
+    memset(&bs, 0, sizeof bs);
+    bench_start_traffic(netdevs[0]);
+    start = bench_nsec();
+    bench_run(ofproto, dpif, &bs);
+    elapsed_ns = bench_nsec() - start;
+
+    dpif_get_dp_stats(dpif, &stats);
+    report = bench_report(&stats, &bs, elapsed_ns);
+    s = json_to_string(report, JSSF_PRETTY | JSSF_SORT);
+    puts(s);
+    free(s);
+    json_destroy(report);
+
+    ofproto_destroy(ofproto);
+    for (i = 0; i < n_ports; i++) {
+        netdev_close(netdevs[i]);
+    }
+    free(netdevs);
+    dpif_close(dpif);
+    shash_destroy(&iface_hints);
+}
+
+static unsigned int
+parse_uint_option(const char *name, const char *value,
+                  unsigned int min, unsigned int max)
+{
+    unsigned int x;
+
+    if (!str_to_uint(value, 10, &x) || x < min || x > max) {
+        ovs_fatal(0, "--%s argument must be between %u and %u",
+                  name, min, max);
+    }
+    return x;
+}
+
+static void
+parse_options(int argc, char *argv[])
+{
+    enum {
+        OPT_DATAPATH_TYPE = UCHAR_MAX + 1,
+        OPT_PORTS,
+        OPT_FLOWS,
+        OPT_GEN_FLOWS,
+        OPT_SIZE,
+        OPT_PCAP,
+        OPT_DIST,
+        OPT_RATE,
+        OPT_PACKETS,
+        OPT_MAX_TIME,
+        VLOG_OPTION_ENUMS
+    };
+    static struct option long_options[] = {
+        {"datapath-type", required_argument, NULL, OPT_DATAPATH_TYPE},
+        {"ports", required_argument, NULL, OPT_PORTS},
+        {"flows", required_argument, NULL, OPT_FLOWS},
+        {"gen-flows", required_argument, NULL, OPT_GEN_FLOWS},
+        {"size", required_argument, NULL, OPT_SIZE},
+        {"pcap", required_argument, NULL, OPT_PCAP},
+        {"dist", required_argument, NULL, OPT_DIST},
+        {"rate", required_argument, NULL, OPT_RATE},
+        {"packets", required_argument, NULL, OPT_PACKETS},
+        {"max-time", required_argument, NULL, OPT_MAX_TIME},
+        {"help", no_argument, NULL, 'h'},
+        VLOG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0},
+    };
+    char *short_options = long_options_to_short_options(long_options);
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+        case OPT_DATAPATH_TYPE:
+            dp_type = optarg;
+            break;
+
+        case OPT_PORTS:
+            n_ports = parse_uint_option("ports", optarg, 1, 1024);
+            break;
+
+        case OPT_FLOWS:
+            flows_file = optarg;
+            break;
+
+        case OPT_GEN_FLOWS:
+            n_gen_flows = parse_uint_option("gen-flows", optarg, 1, 1u << 24);
+            break;
+
+        case OPT_SIZE:
+            packet_size = parse_uint_option("size", optarg,
+                                            ETH_TOTAL_MIN, UINT16_MAX);
+            break;
+
+        case OPT_PCAP:
+            pcap_file = optarg;
+            break;
+
+        case OPT_DIST:
+            if (strcmp(optarg, "sequential") && strcmp(optarg, "random")
+                && strcmp(optarg, "zipf")) {
+                ovs_fatal(0, "--dist must be sequential, random, or zipf");
+            }
+            distribution = optarg;
+            break;
+
+        case OPT_RATE:
+            rate = parse_uint_option("rate", optarg, 0, INT_MAX);
+            break;
+
+        case OPT_PACKETS:
+            if (!str_to_ullong(optarg, 10, &n_packets) || !n_packets) {
+                ovs_fatal(0, "--packets argument must be a positive integer");
+            }
+            break;
+
+        case OPT_MAX_TIME:
+            max_secs = parse_uint_option("max-time", optarg, 1, UINT_MAX / 2);
+            break;
+
+        case 'h':
+            usage();
+
+        VLOG_OPTION_HANDLERS
+
+        case '?':
+            exit(EXIT_FAILURE);
+
+        default:
+            abort();
+        }
+    }
+    free(short_options);
+
+    if (optind != argc) {
+        ovs_fatal(0, "non-option arguments not supported "
+                  "(use --help for help)");
+    }
+    if (n_ports < 2 && !flows_file) {
+        ovs_fatal(0, "the default flow table needs at least 2 ports");
+    }
+}
+
+static void
+usage(void)
+{
+    printf("%s: userspace datapath benchmark\n"
+           "usage: %s dpif-netdev-bench [OPTIONS]\n"
+           "\nCreates a bridge with dummy ports p1, p2, ... (OpenFlow ports\n"
+           "1, 2, ...), sends traffic into p1, and prints statistics about\n"
+           "the forwarding path as a JSON object.\n"
+           "\nDatapath options:\n"
+           "  --datapath-type=TYPE    datapath type (default: dummy)\n"
+           "  --ports=N               number of ports (default: 2)\n"
+           "  --flows=FILE            load OpenFlow flows from FILE, in\n"
+           "                          ovs-ofctl add-flows syntax (default:\n"
+           "                          in_port=1,actions=output:2)\n"
+           "\nTraffic options:\n"
+           "  --gen-flows=N           send packets in N UDP flows "
+           "(default: 1000)\n"
+           "  --size=BYTES            size of generated packets (default: 64)\n"
+           "  --pcap=FILE             replay packets from FILE instead\n"
+           "  --dist=DIST             sequential, random, or zipf\n"
+           "  --rate=PPS              limit rate to PPS packets per second\n"
+           "  --packets=N             stop after N packets "
+           "(default: 1000000)\n"
+           "  --max-time=SECS         stop after SECS seconds (default: 60)\n",
+           program_name, program_name);
+    vlog_usage();
+    printf("\nOther options:\n"
+           "  -h, --help              display this help message\n");
+    exit(EXIT_SUCCESS);
+}
+
+OVSTEST_REGISTER("dpif-netdev-bench", test_dpif_netdev_bench_main);
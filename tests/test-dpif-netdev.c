@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Execution tests for the HASH and RECIRC actions in the userspace datapath.
+ *
+ * Each test creates a dummy datapath, installs datapath flows directly, the
+ * way "ovs-dpctl add-flow" would, and then sends a packet into a dummy port,
+ * the way "netdev-dummy/receive" would. */
+
+#include <config.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dpif.h"
+#include "dummy.h"
+#include "flow.h"
+#include "netdev.h"
+#include "odp-util.h"
+#include "ofpbuf.h"
+#include "ovstest.h"
+#include "packets.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+struct recirc_test {
+    struct dpif *dpif;
+    struct netdev *netdevs[3];
+    uint32_t port_nos[3];       /* Datapath port numbers of p1, p2, p3. */
+    struct ofpbuf *packet;      /* A UDP packet to receive on p1. */
+    struct flow flow;           /* The datapath's flow for 'packet' on p1. */
+};
+
+static void
+recirc_test_init(struct recirc_test *t)
+{
+    struct flow flow;
+    int i;
+
+    assert(!dpif_create_and_open("recirc", "dummy", &t->dpif));
+    for (i = 0; i < ARRAY_SIZE(t->netdevs); i++) {
+        char *name = xasprintf("p%d", i + 1);
+
+        assert(!netdev_open(name, "dummy", &t->netdevs[i]));
+        t->port_nos[i] = UINT32_MAX;
+        assert(!dpif_port_add(t->dpif, t->netdevs[i], &t->port_nos[i]));
+        free(name);
+    }
+    assert(!dpif_recv_set(t->dpif, true));
+
+    memset(&flow, 0, sizeof flow);
+    memcpy(flow.dl_src, "\x50\x54\x00\x00\x00\x05", ETH_ADDR_LEN);
+    memcpy(flow.dl_dst, "\x50\x54\x00\x00\x00\x07", ETH_ADDR_LEN);
+    flow.dl_type = htons(ETH_TYPE_IP);
+    flow.nw_src = htonl(0xc0a80001);
+    flow.nw_dst = htonl(0xc0a80002);
+    flow.nw_proto = IPPROTO_UDP;
+    flow.nw_ttl = 64;
+    flow.tp_src = htons(8);
+    flow.tp_dst = htons(9);
+
+    t->packet = ofpbuf_new(0);
+    flow_compose(t->packet, &flow);
+    if (t->packet->size < ETH_TOTAL_MIN) {
+        ofpbuf_put_zeros(t->packet, ETH_TOTAL_MIN - t->packet->size);
+    }
+    flow_extract(t->packet, 0, 0, NULL, t->port_nos[0], &t->flow);
+}
+
+static void
+recirc_test_destroy(struct recirc_test *t)
+{
+    int i;
+
+    dpif_delete(t->dpif);
+    dpif_close(t->dpif);
+    for (i = 0; i < ARRAY_SIZE(t->netdevs); i++) {
+        netdev_close(t->netdevs[i]);
+    }
+    ofpbuf_delete(t->packet);
+}
+
+/* Installs a datapath flow for exactly 'flow', with the actions in the
+ * printf()-style 'format'. */
+static void PRINTF_FORMAT(4, 5)
+put_flow(struct recirc_test *t, const struct flow *flow,
+         enum dpif_flow_put_flags flags, const char *format, ...)
+{
+    struct ofpbuf key, actions;
+    va_list args;
+    char *s;
+
+    ofpbuf_init(&key, 0);
+    odp_flow_key_from_flow(&key, flow, flow->in_port);
+
+    va_start(args, format);
+    s = xvasprintf(format, args);
+    va_end(args);
+    ofpbuf_init(&actions, 0);
+    assert(!odp_actions_from_string(s, NULL, &actions));
+    free(s);
+
+    assert(!dpif_flow_put(t->dpif, flags, key.data, key.size, NULL, 0,
+                          actions.data, actions.size, NULL));
+    ofpbuf_uninit(&actions);
+    ofpbuf_uninit(&key);
+}
+
+static void
+del_flow(struct recirc_test *t, const struct flow *flow)
+{
+    struct ofpbuf key;
+
+    ofpbuf_init(&key, 0);
+    odp_flow_key_from_flow(&key, flow, flow->in_port);
+    assert(!dpif_flow_del(t->dpif, key.data, key.size, NULL));
+    ofpbuf_uninit(&key);
+}
+
+static uint64_t
+flow_n_packets(struct recirc_test *t, const struct flow *flow)
+{
+    struct dpif_flow_stats stats;
+    struct ofpbuf key;
+
+    ofpbuf_init(&key, 0);
+    odp_flow_key_from_flow(&key, flow, flow->in_port);
+    assert(!dpif_flow_get(t->dpif, key.data, key.size, NULL, &stats));
+    ofpbuf_uninit(&key);
+
+    return stats.n_packets;
+}
+
+static uint64_t
+tx_packets(struct recirc_test *t, int idx)
+{
+    struct netdev_stats stats;
+
+    assert(!netdev_get_stats(t->netdevs[idx], &stats));
+    return stats.tx_packets;
+}
+
+/* Receives 't->packet' on p1 and runs the datapath once. */
+static void
+receive(struct recirc_test *t)
+{
+    assert(netdev_dummy_queue_packet(t->netdevs[0], t->packet) == 1);
+    dpif_run(t->dpif);
+}
+
+/* Returns the flow that the datapath should look up after 'hash(hash_l4(0)),
+ * recirc(5)' on 't->packet'. */
+static struct flow
+recirc_flow(const struct recirc_test *t)
+{
+    struct flow flow = t->flow;
+
+    flow.recirc_id = 5;
+    flow.dp_hash = flow_hash_symmetric_l4(&t->flow, 0);
+    if (!flow.dp_hash) {
+        flow.dp_hash = 1;
+    }
+    return flow;
+}
+
+/* A packet that misses after recirculation goes to userspace with a key that
+ * includes the new recirc_id and the hash computed before it. */
+static void
+test_recirc_miss(void)
+{
+    struct dpif_upcall upcall;
+    struct recirc_test t;
+    struct flow expected, flow;
+    struct ofpbuf buf;
+
+    recirc_test_init(&t);
+    put_flow(&t, &t.flow, DPIF_FP_CREATE, "hash(hash_l4(0)),recirc(5)");
+    receive(&t);
+    assert(flow_n_packets(&t, &t.flow) == 1);
+
+    ofpbuf_init(&buf, 0);
+    assert(!dpif_recv(t.dpif, &upcall, &buf));
+    assert(upcall.type == DPIF_UC_MISS);
+    assert(upcall.packet->size == t.packet->size);
+    assert(!memcmp(upcall.packet->data, t.packet->data, t.packet->size));
+    assert(odp_flow_key_to_flow(upcall.key, upcall.key_len, &flow)
+           == ODP_FIT_PERFECT);
+    expected = recirc_flow(&t);
+    assert(flow.recirc_id == expected.recirc_id);
+    assert(flow.dp_hash == expected.dp_hash);
+    assert(flow.in_port == t.port_nos[0]);
+    assert(dpif_recv(t.dpif, &upcall, &buf) == EAGAIN);
+    ofpbuf_uninit(&buf);
+
+    recirc_test_destroy(&t);
+}
+
+/* A packet that hits after recirculation executes the second flow's actions,
+ * and both flows count it. */
+static void
+test_recirc_hit(void)
+{
+    struct recirc_test t;
+    struct flow flow;
+
+    recirc_test_init(&t);
+    flow = recirc_flow(&t);
+    put_flow(&t, &t.flow, DPIF_FP_CREATE, "hash(hash_l4(0)),recirc(5)");
+    put_flow(&t, &flow, DPIF_FP_CREATE, "%"PRIu32, t.port_nos[1]);
+
+    receive(&t);
+    receive(&t);
+    assert(flow_n_packets(&t, &t.flow) == 2);
+    assert(flow_n_packets(&t, &flow) == 2);
+    assert(tx_packets(&t, 1) == 2);
+    assert(tx_packets(&t, 2) == 0);
+
+    /* A flow that matches some other hash is not used. */
+    del_flow(&t, &flow);
+    flow.dp_hash++;
+    put_flow(&t, &flow, DPIF_FP_CREATE, "%"PRIu32, t.port_nos[1]);
+    receive(&t);
+    assert(flow_n_packets(&t, &flow) == 0);
+    assert(tx_packets(&t, 1) == 2);
+
+    recirc_test_destroy(&t);
+}
+
+/* Actions after a RECIRC see the packet and the hash as they were before
+ * recirculating, even though the recirculated packet is modified. */
+static void
+test_recirc_clone(void)
+{
+    struct dpif_upcall upcall;
+    struct recirc_test t;
+    struct flow flow5, flow6;
+    struct ofpbuf buf;
+
+    recirc_test_init(&t);
+    flow5 = flow6 = recirc_flow(&t);
+    flow6.recirc_id = 6;
+    put_flow(&t, &t.flow, DPIF_FP_CREATE,
+             "hash(hash_l4(0)),recirc(5),recirc(6)");
+    put_flow(&t, &flow5, DPIF_FP_CREATE,
+             "set(ipv4(src=10.0.0.1,dst=10.0.0.2,proto=17,tos=0,ttl=63,"
+             "frag=no)),%"PRIu32, t.port_nos[1]);
+    put_flow(&t, &flow6, DPIF_FP_CREATE, "%"PRIu32, t.port_nos[2]);
+
+    receive(&t);
+    assert(flow_n_packets(&t, &t.flow) == 1);
+    assert(flow_n_packets(&t, &flow5) == 1);
+    assert(flow_n_packets(&t, &flow6) == 1);
+    assert(tx_packets(&t, 1) == 1);
+    assert(tx_packets(&t, 2) == 1);
+
+    ofpbuf_init(&buf, 0);
+    assert(dpif_recv(t.dpif, &upcall, &buf) == EAGAIN);
+    ofpbuf_uninit(&buf);
+
+    recirc_test_destroy(&t);
+}
+
+/* RECIRC without HASH recirculates with a zero dp_hash, after the actions
+ * before it. */
+static void
+test_recirc_no_hash(void)
+{
+    struct recirc_test t;
+    struct flow flow;
+
+    recirc_test_init(&t);
+    flow = t.flow;
+    flow.recirc_id = 7;
+    put_flow(&t, &t.flow, DPIF_FP_CREATE, "%"PRIu32",recirc(7)",
+             t.port_nos[1]);
+    put_flow(&t, &flow, DPIF_FP_CREATE, "%"PRIu32, t.port_nos[2]);
+
+    receive(&t);
+    assert(flow_n_packets(&t, &flow) == 1);
+    assert(tx_packets(&t, 1) == 1);
+    assert(tx_packets(&t, 2) == 1);
+
+    recirc_test_destroy(&t);
+}
+
+static void
+run_test(void (*function)(void))
+{
+    function();
+    printf(".");
+}
+
+static void
+test_dpif_netdev_main(int argc OVS_UNUSED, char *argv[] OVS_UNUSED)
+{
+    dummy_enable(false);
+
+    run_test(test_recirc_miss);
+    run_test(test_recirc_hit);
+    run_test(test_recirc_clone);
+    run_test(test_recirc_no_hash);
+    printf("\n");
+}
+
+OVSTEST_REGISTER("test-dpif-netdev", test_dpif_netdev_main);
@@ -56,8 +56,12 @@ main(int argc OVS_UNUSED, char *argv[])
     while (fread(&expected_match, sizeof expected_match, 1, flows)) {
         struct ofpbuf *packet;
         struct ofp10_match extracted_match;
+        uint32_t storage[FLOW_U32S];
+        void *layers[5];
+        struct miniflow expected_mf, mf;
         struct match match;
         struct flow flow;
+        uint32_t hash;
 
         n++;
 
@@ -70,6 +74,19 @@ main(int argc OVS_UNUSED, char *argv[])
 
         flow_extract(packet, 0, 0, NULL, 1, &flow);
         match_init_exact(&match, &flow);
+
+        /* miniflow_extract() must agree with flow_extract(). */
+        miniflow_init(&expected_mf, &flow);
+        memcpy(layers, &packet->l2, sizeof layers);
+        hash = miniflow_extract(packet, 0, 0, NULL, 1, &mf, storage);
+        if (!miniflow_equal(&mf, &expected_mf)
+            || memcmp(layers, &packet->l2, sizeof layers)
+            || hash != miniflow_crc_hash(&expected_mf, 0)) {
+            errors++;
+            printf("miniflow mismatch on packet #%d (1-based).\n", n);
+            ovs_hex_dump(stdout, packet->data, packet->size, 0, true);
+        }
+        miniflow_destroy(&expected_mf);
         ofputil_match_to_ofp10_match(&match, &extracted_match);
 
         if (memcmp(&expected_match, &extracted_match, sizeof expected_match)) {
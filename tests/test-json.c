@@ -23,6 +23,8 @@
 #include <getopt.h>
 #include <stdio.h>
 
+#include "dynamic-string.h"
+#include "timeval.h"
 #include "util.h"
 
 /* --pretty: If set, the JSON output is pretty-printed, instead of printed as
@@ -33,8 +35,28 @@ static int pretty = 0;
  * instead of exactly one object or array. */
 static int multiple = 0;
 
+/* --arena: If set, each JSON document is parsed into a "struct json_arena"
+ * instead of being allocated node by node. */
+static int arena = 0;
+
+/* --benchmark=N: If nonzero, the input is parsed N times and the parsing rate
+ * is printed, instead of printing the parsed JSON. */
+static int benchmark = 0;
+
+static struct json_parser *
+create_parser(int flags, struct json_arena **arenap)
+{
+    if (arena) {
+        *arenap = json_arena_create();
+        return json_parser_create_arena(flags, *arenap);
+    } else {
+        *arenap = NULL;
+        return json_parser_create(flags);
+    }
+}
+
 static bool
-print_and_free_json(struct json *json)
+print_and_free_json(struct json *json, struct json_arena *json_arena)
 {
     bool ok;
     if (json->type == JSON_STRING) {
@@ -48,6 +70,7 @@ print_and_free_json(struct json *json)
         ok = true;
     }
     json_destroy(json);
+    json_arena_destroy(json_arena);
     return ok;
 }
 
@@ -70,6 +93,7 @@ refill(FILE *file, void *buffer, size_t buffer_size, size_t *n, size_t *used)
 static bool
 parse_multiple(FILE *stream)
 {
+    struct json_arena *json_arena = NULL;
     struct json_parser *parser;
     char buffer[BUFSIZ];
     size_t n, used;
@@ -84,12 +108,13 @@ parse_multiple(FILE *stream)
             used++;
         } else {
             if (!parser) {
-                parser = json_parser_create(0);
+                parser = create_parser(0, &json_arena);
             }
 
             used += json_parser_feed(parser, &buffer[used], n - used);
             if (used < n) {
-                if (!print_and_free_json(json_parser_finish(parser))) {
+                if (!print_and_free_json(json_parser_finish(parser),
+                                         json_arena)) {
                     ok = false;
                 }
                 parser = NULL;
@@ -97,13 +122,88 @@ parse_multiple(FILE *stream)
         }
     }
     if (parser) {
-        if (!print_and_free_json(json_parser_finish(parser))) {
+        if (!print_and_free_json(json_parser_finish(parser), json_arena)) {
             ok = false;
         }
     }
     return ok;
 }
 
+static bool
+parse_single(FILE *stream)
+{
+    struct json_arena *json_arena;
+    struct json_parser *parser;
+    char buffer[BUFSIZ];
+    size_t n;
+
+    parser = create_parser(JSPF_TRAILER, &json_arena);
+    do {
+        n = fread(buffer, 1, sizeof buffer, stream);
+        if (ferror(stream)) {
+            ovs_fatal(errno, "Error reading input file");
+        }
+    } while (n && json_parser_feed(parser, buffer, n) == n);
+    return print_and_free_json(json_parser_finish(parser), json_arena);
+}
+
+/* Parses the whole contents of 'stream', which must be a single JSON
+ * document, 'benchmark' times, and prints how long that took. */
+static bool
+run_benchmark(FILE *stream)
+{
+    long long int start, elapsed;
+    struct ds input;
+    int i;
+
+    ds_init(&input);
+    for (;;) {
+        char buffer[BUFSIZ];
+        size_t n = fread(buffer, 1, sizeof buffer, stream);
+        if (!n) {
+            break;
+        }
+        ds_put_buffer(&input, buffer, n);
+    }
+    if (ferror(stream)) {
+        ovs_fatal(errno, "Error reading input file");
+    }
+
+    time_refresh();
+    start = time_msec();
+    for (i = 0; i < benchmark; i++) {
+        struct json_arena *json_arena;
+        struct json_parser *parser;
+        struct json *json;
+
+        parser = create_parser(JSPF_TRAILER, &json_arena);
+        json_parser_feed(parser, input.string, input.length);
+        json = json_parser_finish(parser);
+        if (json->type == JSON_STRING) {
+            printf("error: %s\n", json->u.string);
+            json_destroy(json);
+            json_arena_destroy(json_arena);
+            ds_destroy(&input);
+            return false;
+        }
+        json_destroy(json);
+        json_arena_destroy(json_arena);
+    }
+    time_refresh();
+    elapsed = time_msec() - start;
+
+    printf("%s: parsed %zu bytes %d times in %lld ms",
+           arena ? "arena" : "malloc", input.length, benchmark, elapsed);
+    if (elapsed > 0) {
+        printf(" (%.1f MB/s)",
+               (double) input.length * benchmark / elapsed / 1000.0);
+    }
+    putchar('\n');
+
+    ds_destroy(&input);
+    return true;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -117,6 +217,9 @@ main(int argc, char *argv[])
         static const struct option options[] = {
             {"pretty", no_argument, &pretty, 1},
             {"multiple", no_argument, &multiple, 1},
+            {"arena", no_argument, &arena, 1},
+            {"benchmark", required_argument, NULL, 'b'},
+            {NULL, 0, NULL, 0},
         };
         int option_index = 0;
         int c = getopt_long (argc, argv, "", options, &option_index);
@@ -128,6 +231,13 @@ main(int argc, char *argv[])
         case 0:
             break;
 
+        case 'b':
+            benchmark = atoi(optarg);
+            if (benchmark <= 0) {
+                ovs_fatal(0, "--benchmark requires a positive count");
+            }
+            break;
+
         case '?':
             exit(1);
 
@@ -137,8 +247,8 @@ main(int argc, char *argv[])
     }
 
     if (argc - optind != 1) {
-        ovs_fatal(0, "usage: %s [--pretty] [--multiple] INPUT.json",
-                  program_name);
+        ovs_fatal(0, "usage: %s [--pretty] [--multiple] [--arena] "
+                  "[--benchmark=N] INPUT.json", program_name);
     }
 
     input_file = argv[optind];
@@ -147,10 +257,12 @@ main(int argc, char *argv[])
         ovs_fatal(errno, "Cannot open \"%s\"", input_file);
     }
 
-    if (multiple) {
+    if (benchmark) {
+        ok = run_benchmark(stream);
+    } else if (multiple) {
         ok = parse_multiple(stream);
     } else {
-        ok = print_and_free_json(json_from_stream(stream));
+        ok = parse_single(stream);
     }
 
     fclose(stream);
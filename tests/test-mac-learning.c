@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Tests and a multithreaded benchmark for the MAC learning table. */
+
+#include <config.h>
+#include "mac-learning.h"
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "command-line.h"
+#include "ovstest.h"
+#include "random.h"
+#include "timeval.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Ports are just distinct pointers. */
+static char ports[8];
+#define N_PORTS ARRAY_SIZE(ports)
+
+static void
+make_mac(uint32_t idx, uint8_t mac[ETH_ADDR_LEN])
+{
+    mac[0] = 0x50;
+    mac[1] = 0x54;
+    mac[2] = idx >> 24;
+    mac[3] = idx >> 16;
+    mac[4] = idx >> 8;
+    mac[5] = idx;
+}
+
+static void *
+lookup_port(const struct mac_learning *ml, uint32_t idx, uint16_t vlan)
+{
+    uint8_t mac[ETH_ADDR_LEN];
+    struct mac_entry_info info;
+
+    make_mac(idx, mac);
+    return mac_learning_get(ml, mac, vlan, &info, NULL) ? info.port : NULL;
+}
+
+static tag_type
+learn(struct mac_learning *ml, uint32_t idx, uint16_t vlan, void *port,
+      enum mac_grat_arp grat_arp)
+{
+    uint8_t mac[ETH_ADDR_LEN];
+
+    make_mac(idx, mac);
+    return mac_learning_update(ml, mac, vlan, port, grat_arp);
+}
+
+/* Waits until time_now() changes. */
+static void
+wait_for_next_second(void)
+{
+    time_t now = time_now();
+
+    while (time_now() == now) {
+        poll(NULL, 0, 10);
+        time_refresh();
+    }
+}
+
+/* Checks learning, moves, gratuitous ARP locks, and overflow in a single
+ * thread. */
+static void
+check_basics(void)
+{
+    static const uint8_t bcast[ETH_ADDR_LEN] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+    };
+    uint8_t mac1[ETH_ADDR_LEN];
+    struct mac_learning *ml = mac_learning_create(60);
+    struct mac_entry_info info;
+    struct mac_entry *e;
+    tag_type tags;
+    int i;
+
+    /* Learning a new MAC changes the table, refreshing it does not. */
+    assert(!lookup_port(ml, 1, 0));
+    assert(learn(ml, 1, 0, &ports[0], MAC_GRAT_ARP_NONE));
+    assert(lookup_port(ml, 1, 0) == &ports[0]);
+    assert(!lookup_port(ml, 1, 1));
+    assert(!learn(ml, 1, 0, &ports[0], MAC_GRAT_ARP_NONE));
+
+    /* A move changes the table and the tag. */
+    make_mac(1, mac1);
+    tags = 0;
+    assert(mac_learning_get(ml, mac1, 0, &info, &tags));
+    assert(tags == info.tag);
+    assert(learn(ml, 1, 0, &ports[1], MAC_GRAT_ARP_NONE) == info.tag);
+    assert(lookup_port(ml, 1, 0) == &ports[1]);
+
+    /* Multicast destinations are never found. */
+    tags = 0;
+    assert(!mac_learning_get(ml, bcast, 0, &info, &tags));
+    assert(!tags);
+
+    /* A gratuitous ARP on a non-bond port locks the entry against moves by
+     * gratuitous ARPs on bonds, but not by other packets. */
+    learn(ml, 1, 0, &ports[2], MAC_GRAT_ARP_LOCK);
+    assert(!learn(ml, 1, 0, &ports[3], MAC_GRAT_ARP_CHECK));
+    assert(lookup_port(ml, 1, 0) == &ports[2]);
+    assert(learn(ml, 1, 0, &ports[3], MAC_GRAT_ARP_NONE));
+    assert(lookup_port(ml, 1, 0) == &ports[3]);
+
+    /* The least recently learned entry goes first on overflow. */
+    mac_learning_set_max_entries(ml, 10);
+    for (i = 2; i <= 10; i++) {
+        learn(ml, i, 0, &ports[0], MAC_GRAT_ARP_NONE);
+    }
+    assert(ml->n_entries == 10);
+    learn(ml, 11, 0, &ports[0], MAC_GRAT_ARP_NONE);
+    assert(ml->n_entries == 10);
+    assert(!lookup_port(ml, 1, 0));
+    for (i = 2; i <= 11; i++) {
+        assert(lookup_port(ml, i, 0) == &ports[0]);
+    }
+
+    /* The locked interface sees the same entries. */
+    mac_learning_lock(ml);
+    i = 0;
+    LIST_FOR_EACH (e, lru_node, &ml->lrus) {
+        assert(e->port.p == &ports[0]);
+        i++;
+    }
+    assert(i == 10);
+    mac_learning_unlock(ml);
+
+    /* Refreshing an entry in a later second moves it to the back of the LRU
+     * list, so it is no longer the first to go on overflow. */
+    wait_for_next_second();
+    assert(!learn(ml, 2, 0, &ports[0], MAC_GRAT_ARP_NONE));
+    mac_learning_lock(ml);
+    e = CONTAINER_OF(list_back(&ml->lrus), struct mac_entry, lru_node);
+    make_mac(2, mac1);
+    assert(eth_addr_equals(e->mac, mac1));
+    mac_learning_unlock(ml);
+    learn(ml, 12, 0, &ports[0], MAC_GRAT_ARP_NONE);
+    assert(lookup_port(ml, 2, 0) == &ports[0]);
+    assert(!lookup_port(ml, 3, 0));
+    learn(ml, 3, 0, &ports[0], MAC_GRAT_ARP_NONE);
+    assert(!lookup_port(ml, 4, 0));
+
+    /* Growing the table keeps the entries. */
+    mac_learning_set_max_entries(ml, 100000);
+    for (i = 5; i <= 12; i++) {
+        assert(lookup_port(ml, i, 0) == &ports[0]);
+    }
+
+    mac_learning_flush(ml, NULL);
+    assert(!ml->n_entries);
+    assert(!lookup_port(ml, 2, 0));
+
+    mac_learning_destroy(ml);
+}
+
+/* Work for the threads in check_threads() and benchmark(). */
+struct mac_thread {
+    struct mac_learning *ml;
+    pthread_rwlock_t *rwlock;   /* Table-wide lock, if nonnull. */
+    uint32_t n_macs;            /* MACs are numbered 0...n_macs-1. */
+    int n_iterations;
+    unsigned int move_pct;      /* Percentage of updates that move a MAC. */
+    uint32_t seed;
+    unsigned long long int n_found;
+};
+
+static void *
+mac_thread_main(void *t_)
+{
+    struct mac_thread *t = t_;
+    uint32_t seed = t->seed;
+    int i;
+
+    for (i = 0; i < t->n_iterations; i++) {
+        uint32_t r, idx;
+        void *port;
+
+        /* A cheap thread-local random number generator. */
+        seed = seed * 1103515245 + 12345;
+        r = seed >> 8;
+        idx = r % t->n_macs;
+
+        /* Learn the source MAC, usually on the port it is already on. */
+        port = &ports[(r >> 16) % 100 < t->move_pct
+                      ? (r >> 8) % N_PORTS
+                      : idx % N_PORTS];
+        if (t->rwlock) {
+            pthread_rwlock_wrlock(t->rwlock);
+        }
+        learn(t->ml, idx, 0, port, MAC_GRAT_ARP_NONE);
+        if (t->rwlock) {
+            pthread_rwlock_unlock(t->rwlock);
+        }
+
+        /* Look up a destination MAC. */
+        idx = (idx * 7 + 1) % t->n_macs;
+        if (t->rwlock) {
+            pthread_rwlock_rdlock(t->rwlock);
+        }
+        port = lookup_port(t->ml, idx, 0);
+        if (t->rwlock) {
+            pthread_rwlock_unlock(t->rwlock);
+        }
+        if (port) {
+            /* Every port ever learned is one of 'ports'. */
+            assert((char *) port >= ports
+                   && (char *) port < &ports[N_PORTS]);
+            t->n_found++;
+        }
+    }
+    return NULL;
+}
+
+/* Runs 'n_threads' threads against 'ml' and returns the elapsed time in
+ * seconds. */
+static double
+run_threads(struct mac_learning *ml, pthread_rwlock_t *rwlock, int n_threads,
+            uint32_t n_macs, int n_iterations, unsigned int move_pct)
+{
+    struct mac_thread *threads = xcalloc(n_threads, sizeof *threads);
+    pthread_t *tids = xcalloc(n_threads, sizeof *tids);
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n_threads; i++) {
+        struct mac_thread *t = &threads[i];
+
+        t->ml = ml;
+        t->rwlock = rwlock;
+        t->n_macs = n_macs;
+        t->n_iterations = n_iterations;
+        t->move_pct = move_pct;
+        t->seed = random_uint32();
+        if (pthread_create(&tids[i], NULL, mac_thread_main, t)) {
+            ovs_fatal(0, "pthread_create failed");
+        }
+    }
+    for (i = 0; i < n_threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(threads);
+    free(tids);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/* Hammers a small table from several threads, with frequent moves and
+ * overflow, then checks that expiration and flushing leave it consistent. */
+static void
+check_threads(void)
+{
+    struct mac_learning *ml = mac_learning_create(60);
+
+    mac_learning_set_max_entries(ml, 64);
+    run_threads(ml, NULL, 4, 256, 100000, 20);
+    mac_learning_run(ml, NULL);
+    assert(ml->n_entries <= 64);
+    mac_learning_flush(ml, NULL);
+    assert(!ml->n_entries);
+    mac_learning_destroy(ml);
+}
+
+static void
+test_check(int argc OVS_UNUSED, char *argv[] OVS_UNUSED)
+{
+    check_basics();
+    check_threads();
+}
+
+/* Measures learning and lookup throughput with the table's own concurrency
+ * control and, for comparison, with a table-wide reader-writer lock of the
+ * kind that ofproto-dpif-xlate used to wrap around it. */
+static void
+test_benchmark(int argc, char *argv[])
+{
+    int n_threads = argc > 1 ? atoi(argv[1]) : 4;
+    uint32_t n_macs = argc > 2 ? atoi(argv[2]) : 1000;
+    int n_iterations = argc > 3 ? atoi(argv[3]) : 1000000;
+    unsigned int move_pct = argc > 4 ? atoi(argv[4]) : 1;
+    int pass;
+
+    if (n_threads < 1 || !n_macs || n_iterations < 1) {
+        ovs_fatal(0, "usage: benchmark [N_THREADS [N_MACS [N_ITERATIONS "
+                  "[MOVE_PERCENT]]]]");
+    }
+
+    printf("%d threads, %"PRIu32" MACs, %d iterations per thread, "
+           "%u%% moves\n", n_threads, n_macs, n_iterations, move_pct);
+    for (pass = 0; pass < 2; pass++) {
+        struct mac_learning *ml = mac_learning_create(300);
+        pthread_rwlock_t rwlock;
+        double elapsed;
+
+        mac_learning_set_max_entries(ml, n_macs);
+        if (pass) {
+            pthread_rwlock_init(&rwlock, NULL);
+        }
+        elapsed = run_threads(ml, pass ? &rwlock : NULL, n_threads, n_macs,
+                              n_iterations, move_pct);
+        printf("%-8s %8.3f s  %8.2f Mpackets/s\n",
+               pass ? "rwlock" : "striped", elapsed,
+               (double) n_threads * n_iterations / elapsed / 1e6);
+        if (pass) {
+            pthread_rwlock_destroy(&rwlock);
+        }
+        mac_learning_destroy(ml);
+    }
+}
+
+static const struct command commands[] = {
+    {"check", 0, 0, test_check},
+    {"benchmark", 0, 4, test_benchmark},
+    {NULL, 0, 0, NULL},
+};
+
+static void
+test_mac_learning_main(int argc, char *argv[])
+{
+    run_command(argc - 1, argv + 1, commands);
+}
+
+OVSTEST_REGISTER("test-mac-learning", test_mac_learning_main);
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A non-exhaustive test for the pooled buffers declared in ofpbuf.h. */
+
+#include <config.h>
+#include "ofpbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ovstest.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Tests that a pooled buffer has the requested headroom and room, and that
+ * its data is cache-aligned when the headroom is. */
+static void
+test_pool_init(void)
+{
+    struct ofpbuf b;
+
+    ofpbuf_init_pooled(&b, 1500, 64);
+    assert(b.source == OFPBUF_POOL);
+    assert(b.size == 0);
+    assert(ofpbuf_headroom(&b) == 64);
+    assert(ofpbuf_tailroom(&b) >= 1500);
+    assert((uintptr_t) b.base % 64 == 0);
+    assert((uintptr_t) b.data % 64 == 0);
+    ofpbuf_uninit(&b);
+}
+
+/* Tests that freeing a pooled buffer makes it available for the next
+ * allocation in the same size class, and only that size class. */
+static void
+test_pool_reuse(void)
+{
+    struct ofpbuf a, b;
+    void *base;
+
+    ofpbuf_init_pooled(&a, 100, 0);
+    base = a.base;
+    ofpbuf_put_zeros(&a, 100);
+    ofpbuf_uninit(&a);
+
+    ofpbuf_init_pooled(&b, 1000, 16);
+    assert(b.base == base);
+    assert(b.size == 0);
+    assert(ofpbuf_headroom(&b) == 16);
+
+    ofpbuf_init_pooled(&a, 5000, 0);
+    assert(a.base != base);
+    ofpbuf_uninit(&a);
+    ofpbuf_uninit(&b);
+}
+
+/* Tests that growing a pooled buffer beyond its size class moves it into
+ * malloc()'d memory without disturbing its contents or layer pointers. */
+static void
+test_pool_resize(void)
+{
+    struct ofpbuf b;
+    size_t room;
+    uint8_t *p;
+    size_t i;
+
+    ofpbuf_init_pooled(&b, 0, 8);
+    room = ofpbuf_tailroom(&b);
+    p = ofpbuf_put_uninit(&b, room);
+    for (i = 0; i < room; i++) {
+        p[i] = i;
+    }
+    b.l3 = (uint8_t *) b.data + 14;
+
+    ofpbuf_put_zeros(&b, 1);
+    assert(b.source == OFPBUF_MALLOC);
+    assert(b.size == room + 1);
+    assert(ofpbuf_headroom(&b) == 8);
+    assert(b.l3 == (uint8_t *) b.data + 14);
+    p = b.data;
+    for (i = 0; i < room; i++) {
+        assert(p[i] == (uint8_t) i);
+    }
+    assert(p[room] == 0);
+    ofpbuf_uninit(&b);
+}
+
+/* Tests that ofpbuf_steal_data() returns a copy that can be passed to free()
+ * and gives the pooled buffer back. */
+static void
+test_pool_steal_data(void)
+{
+    static const char text[] = "pooled";
+    struct ofpbuf *b;
+    void *base;
+    char *s;
+
+    b = ofpbuf_new_pooled(sizeof text, 0);
+    base = b->base;
+    ofpbuf_put(b, text, sizeof text);
+    s = ofpbuf_steal_data(b);
+    assert(!strcmp(s, text));
+    assert(s != base);
+    free(s);
+    ofpbuf_delete(b);
+
+    b = ofpbuf_new_pooled(sizeof text, 0);
+    assert(b->base == base);
+    ofpbuf_delete(b);
+}
+
+/* Tests that requests too big for the pool fall back to malloc(). */
+static void
+test_pool_large(void)
+{
+    struct ofpbuf b;
+
+    ofpbuf_init_pooled(&b, 65536, 2);
+    assert(b.source == OFPBUF_MALLOC);
+    assert(ofpbuf_headroom(&b) == 2);
+    assert(ofpbuf_tailroom(&b) == 65536);
+    ofpbuf_uninit(&b);
+}
+
+static void
+run_test(void (*function)(void))
+{
+    function();
+    printf(".");
+}
+
+static void
+test_ofpbuf_main(int argc OVS_UNUSED, char *argv[] OVS_UNUSED)
+{
+    run_test(test_pool_init);
+    run_test(test_pool_reuse);
+    run_test(test_pool_resize);
+    run_test(test_pool_steal_data);
+    run_test(test_pool_large);
+    printf("\n");
+}
+
+OVSTEST_REGISTER("test-ofpbuf", test_ofpbuf_main);
@@ -27,6 +27,7 @@
 #include "dynamic-string.h"
 #include "json.h"
 #include "jsonrpc.h"
+#include "ofpbuf.h"
 #include "ovsdb-data.h"
 #include "ovsdb-error.h"
 #include "ovsdb-idl.h"
@@ -58,6 +59,9 @@
 
 static struct command all_commands[NUMBER];
 
+/* --change-track: Enable change tracking in the "idl" command. */
+static bool track;
+
 static void usage(void) NO_RETURN;
 static void parse_options(int argc, char *argv[]);
 
@@ -91,6 +95,7 @@ parse_options(int argc, char *argv[])
     static struct option long_options[] = {
         {"timeout", required_argument, NULL, 't'},
         {"verbose", optional_argument, NULL, 'v'},
+        {"change-track", no_argument, NULL, 'c'},
         {"help", no_argument, NULL, 'h'},
         {NULL, 0, NULL, 0},
     };
@@ -123,6 +128,10 @@ parse_options(int argc, char *argv[])
             vlog_set_verbosity(optarg);
             break;
 
+        case 'c':
+            track = true;
+            break;
+
         case '?':
             exit(EXIT_FAILURE);
 
@@ -209,6 +218,7 @@ usage(void)
     vlog_usage();
     printf("\nOther options:\n"
            "  -t, --timeout=SECS          give up after SECS seconds\n"
+           "  -c, --change-track          track changes in \"idl\" command\n"
            "  -h, --help                  display this help message\n");
     exit(EXIT_SUCCESS);
 }
@@ -318,10 +328,31 @@ do_log_io(int argc, char *argv[])
                 }
                 continue;
             }
+        } else if (!strcmp(command, "read-any")) {
+            struct ofpbuf *binary;
+            struct json *json;
+
+            error = ovsdb_log_read_any(log, &json, &binary);
+            if (!error) {
+                printf("%s: read-any: ", name);
+                if (json) {
+                    print_and_free_json(json);
+                } else if (binary) {
+                    printf("binary \"%.*s\"\n",
+                           (int) binary->size, (char *) binary->data);
+                    ofpbuf_delete(binary);
+                } else {
+                    printf("end of log\n");
+                }
+                continue;
+            }
         } else if (!strncmp(command, "write:", 6)) {
             struct json *json = parse_json(command + 6);
             error = ovsdb_log_write(log, json);
             json_destroy(json);
+        } else if (!strncmp(command, "write-binary:", 13)) {
+            const char *data = command + 13;
+            error = ovsdb_log_write_binary(log, data, strlen(data));
         } else if (!strcmp(command, "commit")) {
             error = ovsdb_log_commit(log);
         } else {
@@ -1693,6 +1724,36 @@ print_idl(struct ovsdb_idl *idl, int step)
     }
 }
 
+static void
+print_idl_track(struct ovsdb_idl *idl, int step)
+{
+    const struct idltest_simple *s;
+
+    IDLTEST_SIMPLE_FOR_EACH_TRACKED (s, idl) {
+        if (idltest_simple_is_deleted(s)) {
+            printf("%03d: deleted row: uuid="UUID_FMT"\n",
+                   step, UUID_ARGS(&s->header_.uuid));
+        } else if (idltest_simple_is_new(s)) {
+            printf("%03d: inserted row: i=%"PRId64" uuid="UUID_FMT"\n",
+                   step, s->i, UUID_ARGS(&s->header_.uuid));
+        } else {
+            size_t i;
+
+            printf("%03d: updated row: i=%"PRId64" columns=[", step, s->i);
+            for (i = 0; i < IDLTEST_SIMPLE_N_COLUMNS; i++) {
+                const struct ovsdb_idl_column *column;
+
+                column = &idltest_simple_columns[i];
+                if (idltest_simple_is_updated(s, column)) {
+                    printf("%s", column->name);
+                }
+            }
+            printf("] uuid="UUID_FMT"\n", UUID_ARGS(&s->header_.uuid));
+        }
+    }
+    ovsdb_idl_track_clear(idl);
+}
+
 static void
 parse_uuids(const struct json *json, struct ovsdb_symbol_table *symtab,
             size_t *n)
@@ -1909,6 +1970,9 @@ do_idl(int argc, char *argv[])
     idltest_init();
 
     idl = ovsdb_idl_create(argv[1], &idltest_idl_class, true, true);
+    if (track) {
+        ovsdb_idl_track_add_all(idl);
+    }
     if (argc > 2) {
         struct stream *stream;
 
@@ -1947,7 +2011,11 @@ do_idl(int argc, char *argv[])
             }
 
             /* Print update. */
-            print_idl(idl, step++);
+            print_idl(idl, step);
+            if (track) {
+                print_idl_track(idl, step);
+            }
+            step++;
         }
         seqno = ovsdb_idl_get_seqno(idl);
 
@@ -1986,7 +2054,11 @@ do_idl(int argc, char *argv[])
         ovsdb_idl_wait(idl);
         poll_block();
     }
-    print_idl(idl, step++);
+    print_idl(idl, step);
+    if (track) {
+        print_idl_track(idl, step);
+    }
+    step++;
     ovsdb_idl_destroy(idl);
     printf("%03d: done\n", step);
 }
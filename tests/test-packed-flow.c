@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Tests and benchmarks for the packed flow kernels in packed-flow.h. */
+
+#include <config.h>
+#include "packed-flow.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "command-line.h"
+#include "crc32c.h"
+#include "flow.h"
+#include "hash.h"
+#include "ovstest.h"
+#include "random.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define N_ROUNDS 10000
+
+/* Fills 'mask' with 'n' words, each of which is randomly all-zeros, all-ones,
+ * or random. */
+static void
+random_mask(uint32_t *mask, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        switch (random_range(3)) {
+        case 0:
+            mask[i] = 0;
+            break;
+        case 1:
+            mask[i] = UINT32_MAX;
+            break;
+        default:
+            mask[i] = random_uint32();
+            break;
+        }
+    }
+}
+
+/* Returns the masked hash of 'p' computed the way the classifier did before
+ * packed-flow.h existed. */
+static uint32_t
+reference_hash_masked(const uint32_t *p, const uint32_t *mask, size_t n,
+                      uint32_t basis)
+{
+    uint32_t hash = basis;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        hash = mhash_add(hash, p[i] & mask[i]);
+    }
+    return mhash_finish(hash, n * 4);
+}
+
+/* Returns the CRC32C-based hash of 'p', computed a byte at a time. */
+static uint32_t
+reference_hash(const uint32_t *p, size_t n, uint32_t basis)
+{
+    uint32_t crc = basis;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint8_t le[4];
+
+        le[0] = p[i];
+        le[1] = p[i] >> 8;
+        le[2] = p[i] >> 16;
+        le[3] = p[i] >> 24;
+        crc = crc32c_extend(crc, le, sizeof le);
+    }
+    return mhash_finish(crc, n * 4);
+}
+
+static bool
+reference_equal_masked(const uint32_t *a, const uint32_t *b,
+                       const uint32_t *mask, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if ((a[i] ^ b[i]) & mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Checks that every implementation that this CPU supports agrees with the
+ * straightforward scalar code. */
+static void
+test_check(int argc OVS_UNUSED, char *argv[] OVS_UNUSED)
+{
+    uint32_t a[FLOW_U32S], b[FLOW_U32S], mask[FLOW_U32S];
+    const char *name;
+    size_t idx;
+    int round;
+
+    for (idx = 0; (name = packed_flow_impl_name(idx)) != NULL; idx++) {
+        if (!packed_flow_set_impl(name)) {
+            continue;
+        }
+
+        random_set_seed(1);
+        for (round = 0; round < N_ROUNDS; round++) {
+            size_t n = random_range(FLOW_U32S + 1);
+            uint32_t basis = random_uint32();
+
+            random_bytes(a, sizeof a);
+            memcpy(b, a, sizeof b);
+            random_mask(mask, n);
+            if (n && random_range(2)) {
+                /* Make 'a' and 'b' differ in a single bit, which may or may
+                 * not be masked. */
+                size_t ofs = random_range(n);
+                b[ofs] ^= 1u << random_range(32);
+            }
+
+            assert(packed_flow_equal_masked(a, b, mask, n)
+                   == reference_equal_masked(a, b, mask, n));
+            assert(packed_flow_hash_masked(a, mask, n, basis)
+                   == reference_hash_masked(a, mask, n, basis));
+            assert(packed_flow_hash(a, n, basis)
+                   == reference_hash(a, n, basis));
+        }
+    }
+}
+
+static unsigned long long int
+now_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Prints the cost per call of the 'n_iterations' calls that began at
+ * 'start'. */
+static void
+print_result(const char *name, const char *function,
+             unsigned long long int start, int n_iterations)
+{
+    printf("%-10s %-14s %6.2f ns/call\n", name, function,
+           (double) (now_nsec() - start) / MAX(n_iterations, 1));
+}
+
+/* Measures each implementation that this CPU supports. */
+static void
+test_benchmark(int argc, char *argv[])
+{
+    int n_iterations = argc > 1 ? atoi(argv[1]) : 10000000;
+    uint32_t a[FLOW_U32S], b[FLOW_U32S], mask[FLOW_U32S];
+    unsigned long long int start;
+    uint32_t hash = 0;
+    const char *name;
+    size_t idx;
+    int i;
+
+    random_set_seed(1);
+    random_bytes(a, sizeof a);
+    memcpy(b, a, sizeof b);
+    memset(mask, 0xff, sizeof mask);
+
+    /* packed_flow_hash_masked() has only one implementation. */
+    start = now_nsec();
+    for (i = 0; i < n_iterations; i++) {
+        hash = packed_flow_hash_masked(a, mask, FLOW_U32S, hash);
+    }
+    print_result("all", "hash_masked", start, n_iterations);
+
+    for (idx = 0; (name = packed_flow_impl_name(idx)) != NULL; idx++) {
+        int equal = 0;
+
+        if (!packed_flow_set_impl(name)) {
+            printf("%-10s not supported\n", name);
+            continue;
+        }
+
+        start = now_nsec();
+        for (i = 0; i < n_iterations; i++) {
+            equal += packed_flow_equal_masked(a, b, mask, FLOW_U32S);
+        }
+        print_result(name, "equal_masked", start, n_iterations);
+
+        start = now_nsec();
+        for (i = 0; i < n_iterations; i++) {
+            hash = packed_flow_hash(a, FLOW_U32S, hash);
+        }
+        print_result(name, "hash", start, n_iterations);
+
+        /* Keep the compiler from optimizing the loops away. */
+        if (equal != n_iterations) {
+            printf("%s: %"PRIu32"\n", name, hash);
+        }
+    }
+}
+
+static const struct command commands[] = {
+    {"check", 0, 0, test_check},
+    {"benchmark", 0, 1, test_benchmark},
+    {NULL, 0, 0, NULL},
+};
+
+static void
+test_packed_flow_main(int argc, char *argv[])
+{
+    run_command(argc - 1, argv + 1, commands);
+}
+
+OVSTEST_REGISTER("test-packed-flow", test_packed_flow_main);
@@ -19,6 +19,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "byte-order.h"
+#include "csum.h"
+#include "ofpbuf.h"
 
 #undef NDEBUG
 #include <assert.h>
@@ -152,6 +155,361 @@ test_ipv6_masking(void)
     assert(ipv6_count_cidr_bits(&dest) == 128);
 }
 
+static const uint8_t tnl_eth_src[ETH_ADDR_LEN] = {
+    0x50, 0x54, 0x00, 0x00, 0x00, 0x01
+};
+static const uint8_t tnl_eth_dst[ETH_ADDR_LEN] = {
+    0x50, 0x54, 0x00, 0x00, 0x00, 0x02
+};
+#define TNL_IP_SRC htonl(0x0a000001)   /* 10.0.0.1 */
+#define TNL_IP_DST htonl(0x0a000002)   /* 10.0.0.2 */
+#define TNL_UDP_SRC htons(54321)
+#define TNL_UDP_DST htons(4789)
+
+static void
+tnl_init(struct flow_tnl *tnl, uint16_t flags, uint64_t tun_id)
+{
+    memset(tnl, 0, sizeof *tnl);
+    tnl->tun_id = htonll(tun_id);
+    tnl->ip_dst = TNL_IP_DST;
+    tnl->ip_tos = 0x10;
+    tnl->flags = flags;
+}
+
+/* Returns a new Ethernet frame of 'size' bytes, for encapsulating. */
+static struct ofpbuf *
+tnl_make_inner(size_t size)
+{
+    struct ofpbuf *packet = ofpbuf_new(size);
+    uint8_t *data = ofpbuf_put_uninit(packet, size);
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        data[i] = i * 7 + 1;
+    }
+    return packet;
+}
+
+static struct ip_header *
+tnl_ip(const struct ofpbuf *packet)
+{
+    return (struct ip_header *) ((uint8_t *) packet->data + ETH_HEADER_LEN);
+}
+
+/* Recomputes the IP checksum of tunnel packet 'packet', and its GRE checksum
+ * if it has one, after the test has modified it. */
+static void
+tnl_fix_csums(struct ofpbuf *packet)
+{
+    struct ip_header *ip = tnl_ip(packet);
+
+    ip->ip_csum = htons(0);
+    ip->ip_csum = csum(ip, IP_HEADER_LEN);
+    if (ip->ip_proto == IPPROTO_GRE) {
+        struct gre_base_hdr *gre = (struct gre_base_hdr *) (ip + 1);
+
+        if (gre->flags & htons(GRE_CSUM)) {
+            ovs_be16 *gre_csum = (ovs_be16 *) (gre + 1);
+
+            *gre_csum = htons(0);
+            *gre_csum = csum(gre, ntohs(ip->ip_tot_len) - IP_HEADER_LEN);
+        }
+    }
+}
+
+/* Checks that 'packet', encapsulated with 'h' built from 'tnl', parses back
+ * into the same metadata and an inner packet identical to 'inner'. */
+static void
+tnl_check_parse(const struct ofpbuf *packet, const struct tnl_header *h,
+                const struct flow_tnl *tnl, const struct ofpbuf *inner)
+{
+    struct flow_tnl parsed;
+    size_t hlen, inner_len;
+    ovs_be16 udp_dst;
+    uint16_t flags;
+    uint64_t tun_id;
+
+    assert(tnl_header_parse(packet, TNL_IP_DST, &parsed, &udp_dst,
+                            &hlen, &inner_len) == h->type);
+    assert(hlen == h->size);
+    assert(inner_len == inner->size);
+    assert(!memcmp((uint8_t *) packet->data + hlen, inner->data, inner_len));
+
+    if (h->type == TNL_TYPE_GRE) {
+        flags = tnl->flags;
+        tun_id = (tnl->flags & FLOW_TNL_F_KEY
+                  ? ntohll(tnl->tun_id) & UINT32_MAX : 0);
+        assert(udp_dst == htons(0));
+    } else {
+        flags = (tnl->flags & FLOW_TNL_F_DONT_FRAGMENT) | FLOW_TNL_F_KEY;
+        tun_id = ntohll(tnl->tun_id) & 0xffffff;
+        assert(udp_dst == TNL_UDP_DST);
+    }
+    assert(parsed.flags == flags);
+    assert(ntohll(parsed.tun_id) == tun_id);
+    assert(parsed.ip_src == TNL_IP_SRC);
+    assert(parsed.ip_dst == TNL_IP_DST);
+    assert(parsed.ip_tos == tnl->ip_tos);
+    assert(parsed.ip_ttl == (tnl->ip_ttl ? tnl->ip_ttl : 64));
+}
+
+/* Encapsulates inner packets of several sizes with tunnel metadata 'tnl' as
+ * 'type', checks the outer headers, and checks that they parse back. */
+static void
+tnl_check_round_trip(enum tnl_type type, const struct flow_tnl *tnl)
+{
+    static const size_t sizes[] = { ETH_HEADER_LEN, 60, 1400 };
+    struct tnl_header h;
+    size_t i;
+
+    tnl_header_build(&h, type, tnl, tnl_eth_src, tnl_eth_dst, TNL_IP_SRC,
+                     TNL_UDP_DST);
+    assert(h.type == type);
+
+    /* The same header must work for packets of any length. */
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        struct ofpbuf *inner = tnl_make_inner(sizes[i]);
+        struct ofpbuf *packet = ofpbuf_clone(inner);
+        const struct eth_header *eth;
+        struct ip_header *ip;
+        size_t size, n;
+
+        tnl_header_push(packet, &h, TNL_UDP_SRC);
+        assert(packet->size == h.size + inner->size);
+
+        eth = packet->data;
+        assert(eth_addr_equals(eth->eth_src, tnl_eth_src));
+        assert(eth_addr_equals(eth->eth_dst, tnl_eth_dst));
+        assert(eth->eth_type == htons(ETH_TYPE_IP));
+
+        ip = tnl_ip(packet);
+        assert(ntohs(ip->ip_tot_len) == packet->size - ETH_HEADER_LEN);
+        assert(!csum(ip, IP_HEADER_LEN));
+        assert(ip->ip_frag_off
+               == (tnl->flags & FLOW_TNL_F_DONT_FRAGMENT
+                   ? htons(IP_DONT_FRAGMENT) : htons(0)));
+        if (type == TNL_TYPE_VXLAN) {
+            struct udp_header *udp = (struct udp_header *) (ip + 1);
+
+            assert(ip->ip_proto == IPPROTO_UDP);
+            assert(udp->udp_src == TNL_UDP_SRC);
+            assert(udp->udp_dst == TNL_UDP_DST);
+            assert(ntohs(udp->udp_len)
+                   == packet->size - ETH_HEADER_LEN - IP_HEADER_LEN);
+        } else {
+            assert(ip->ip_proto == IPPROTO_GRE);
+            assert(h.size == (ETH_HEADER_LEN + IP_HEADER_LEN + GRE_HEADER_LEN
+                              + 4 * !!(tnl->flags & FLOW_TNL_F_CSUM)
+                              + 4 * !!(tnl->flags & FLOW_TNL_F_KEY)));
+        }
+
+        tnl_check_parse(packet, &h, tnl, inner);
+
+        /* Not addressed to us. */
+        {
+            struct flow_tnl parsed;
+            size_t hlen, inner_len;
+            ovs_be16 udp_dst;
+
+            assert(tnl_header_parse(packet, TNL_IP_SRC, &parsed, &udp_dst,
+                                    &hlen, &inner_len) == TNL_TYPE_NONE);
+        }
+
+        /* Ethernet padding after the IP packet is not part of the inner
+         * packet. */
+        ofpbuf_put_zeros(packet, 8);
+        tnl_check_parse(packet, &h, tnl, inner);
+        packet->size -= 8;
+
+        /* Truncated anywhere, the packet is not a tunnel packet. */
+        size = packet->size;
+        for (n = 0; n < size; n++) {
+            struct flow_tnl parsed;
+            size_t hlen, inner_len;
+            ovs_be16 udp_dst;
+
+            packet->size = n;
+            assert(tnl_header_parse(packet, TNL_IP_DST, &parsed, &udp_dst,
+                                    &hlen, &inner_len) == TNL_TYPE_NONE);
+        }
+        packet->size = size;
+
+        /* Nor is a fragment. */
+        ip = tnl_ip(packet);
+        ip->ip_frag_off |= htons(IP_MORE_FRAGMENTS);
+        tnl_fix_csums(packet);
+        {
+            struct flow_tnl parsed;
+            size_t hlen, inner_len;
+            ovs_be16 udp_dst;
+
+            assert(tnl_header_parse(packet, TNL_IP_DST, &parsed, &udp_dst,
+                                    &hlen, &inner_len) == TNL_TYPE_NONE);
+        }
+
+        ofpbuf_delete(packet);
+        ofpbuf_delete(inner);
+    }
+}
+
+static enum tnl_type
+tnl_parse(const struct ofpbuf *packet)
+{
+    struct flow_tnl parsed;
+    size_t hlen, inner_len;
+    ovs_be16 udp_dst;
+
+    return tnl_header_parse(packet, TNL_IP_DST, &parsed, &udp_dst,
+                            &hlen, &inner_len);
+}
+
+static struct ofpbuf *
+tnl_encap(enum tnl_type type, const struct flow_tnl *tnl, size_t inner_size,
+          struct tnl_header *h)
+{
+    struct ofpbuf *packet = tnl_make_inner(inner_size);
+
+    tnl_header_build(h, type, tnl, tnl_eth_src, tnl_eth_dst, TNL_IP_SRC,
+                     TNL_UDP_DST);
+    tnl_header_push(packet, h, TNL_UDP_SRC);
+    return packet;
+}
+
+static void
+test_tnl_gre(void)
+{
+    static const uint16_t flag_sets[] = {
+        0,
+        FLOW_TNL_F_KEY,
+        FLOW_TNL_F_CSUM,
+        FLOW_TNL_F_CSUM | FLOW_TNL_F_KEY,
+        FLOW_TNL_F_DONT_FRAGMENT | FLOW_TNL_F_CSUM | FLOW_TNL_F_KEY,
+    };
+    struct tnl_header h;
+    struct flow_tnl tnl;
+    struct ofpbuf *packet;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(flag_sets); i++) {
+        tnl_init(&tnl, flag_sets[i], 0xfedcba9876543210ULL);
+        tnl_check_round_trip(TNL_TYPE_GRE, &tnl);
+
+        tnl.ip_ttl = 17;
+        tnl_check_round_trip(TNL_TYPE_GRE, &tnl);
+    }
+
+    /* A corrupted packet fails the GRE checksum, if there is one. */
+    tnl_init(&tnl, FLOW_TNL_F_CSUM | FLOW_TNL_F_KEY, 0x1234);
+    packet = tnl_encap(TNL_TYPE_GRE, &tnl, 60, &h);
+    ((uint8_t *) ofpbuf_tail(packet))[-1] ^= 1;
+    assert(tnl_parse(packet) == TNL_TYPE_NONE);
+    ofpbuf_delete(packet);
+
+    tnl_init(&tnl, FLOW_TNL_F_KEY, 0x1234);
+    packet = tnl_encap(TNL_TYPE_GRE, &tnl, 60, &h);
+    ((uint8_t *) ofpbuf_tail(packet))[-1] ^= 1;
+    assert(tnl_parse(packet) == TNL_TYPE_GRE);
+    ofpbuf_delete(packet);
+
+    /* A sequence number, which the encapsulation never adds, is skipped, with
+     * and without a checksum. */
+    for (i = 0; i < 2; i++) {
+        struct gre_base_hdr *gre;
+        struct ofpbuf *inner, *encap;
+        struct ip_header *ip;
+        ovs_be32 seq = htonl(42);
+
+        tnl_init(&tnl, FLOW_TNL_F_KEY | (i ? FLOW_TNL_F_CSUM : 0), 0x1234);
+        inner = tnl_make_inner(60);
+        encap = tnl_encap(TNL_TYPE_GRE, &tnl, 60, &h);
+        packet = ofpbuf_new(encap->size + sizeof seq);
+        ofpbuf_put(packet, encap->data, h.size);
+        ofpbuf_put(packet, &seq, sizeof seq);
+        ofpbuf_put(packet, (uint8_t *) encap->data + h.size,
+                   encap->size - h.size);
+        ofpbuf_delete(encap);
+
+        ip = tnl_ip(packet);
+        ip->ip_tot_len = htons(ntohs(ip->ip_tot_len) + sizeof seq);
+        gre = (struct gre_base_hdr *) (ip + 1);
+        gre->flags |= htons(GRE_SEQ);
+        tnl_fix_csums(packet);
+
+        h.size += sizeof seq;
+        tnl_check_parse(packet, &h, &tnl, inner);
+
+        ofpbuf_delete(packet);
+        ofpbuf_delete(inner);
+    }
+
+    /* Unsupported flags, versions, and protocols are rejected. */
+    for (i = 0; i < 3; i++) {
+        struct gre_base_hdr *gre;
+
+        tnl_init(&tnl, FLOW_TNL_F_KEY, 0x1234);
+        packet = tnl_encap(TNL_TYPE_GRE, &tnl, 60, &h);
+        gre = (struct gre_base_hdr *) (tnl_ip(packet) + 1);
+        if (i == 0) {
+            gre->flags |= htons(0x4000); /* Routing present. */
+        } else if (i == 1) {
+            gre->flags |= htons(1);      /* Version 1. */
+        } else {
+            gre->protocol = htons(ETH_TYPE_IP);
+        }
+        assert(tnl_parse(packet) == TNL_TYPE_NONE);
+        ofpbuf_delete(packet);
+    }
+}
+
+static void
+test_tnl_vxlan(void)
+{
+    struct tnl_header h;
+    struct flow_tnl tnl;
+    struct ofpbuf *packet;
+    struct vxlanhdr *vxh;
+    int i;
+
+    tnl_init(&tnl, FLOW_TNL_F_KEY, 0x123456);
+    tnl_check_round_trip(TNL_TYPE_VXLAN, &tnl);
+
+    /* Only the low 24 bits of the tunnel ID fit in the VNI, and the GRE
+     * checksum flag means nothing to VXLAN. */
+    tnl_init(&tnl, FLOW_TNL_F_DONT_FRAGMENT | FLOW_TNL_F_CSUM,
+             0xfedcba9876543210ULL);
+    tnl.ip_ttl = 255;
+    tnl_check_round_trip(TNL_TYPE_VXLAN, &tnl);
+
+    tnl_init(&tnl, FLOW_TNL_F_KEY, 0);
+    tnl_check_round_trip(TNL_TYPE_VXLAN, &tnl);
+
+    /* The flags must be exactly "VNI valid", and the reserved bits after the
+     * VNI must be zero. */
+    for (i = 0; i < 4; i++) {
+        tnl_init(&tnl, FLOW_TNL_F_KEY, 0x123456);
+        packet = tnl_encap(TNL_TYPE_VXLAN, &tnl, 60, &h);
+        vxh = (struct vxlanhdr *) ((struct udp_header *) (tnl_ip(packet) + 1)
+                                   + 1);
+        if (i == 0) {
+            vxh->vx_flags = htonl(0);
+        } else if (i == 1) {
+            vxh->vx_flags |= htonl(0x00000100);
+        } else if (i == 2) {
+            vxh->vx_vni |= htonl(0x01);
+        } else {
+            vxh->vx_vni |= htonl(0x80);
+        }
+        assert(tnl_parse(packet) == TNL_TYPE_NONE);
+        ofpbuf_delete(packet);
+    }
+
+    /* An inner packet too short for an Ethernet header is rejected. */
+    tnl_init(&tnl, FLOW_TNL_F_KEY, 0x123456);
+    packet = tnl_encap(TNL_TYPE_VXLAN, &tnl, ETH_HEADER_LEN - 1, &h);
+    assert(tnl_parse(packet) == TNL_TYPE_NONE);
+    ofpbuf_delete(packet);
+}
+
 int
 main(void)
 {
@@ -159,6 +517,8 @@ main(void)
     test_ipv6_static_masks();
     test_ipv6_cidr();
     test_ipv6_masking();
+    test_tnl_gre();
+    test_tnl_vxlan();
 
     return 0;
 }
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Tests for the packet-in scheduler. */
+
+#include <config.h>
+#include "ofproto/pinsched.h"
+#include <stdio.h>
+#include "ofpbuf.h"
+#include "ovstest.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* A packet as queued by these tests: the port it arrived on and its position
+ * in that port's sequence of packets. */
+struct test_packet {
+    uint16_t port_no;
+    int seq;
+};
+
+/* Packets passed to tx_cb(), in order. */
+struct tx_log {
+    struct test_packet packets[128];
+    size_t n;
+};
+
+static void
+tx_cb(struct ofpbuf *packet, void *log_)
+{
+    struct tx_log *log = log_;
+
+    assert(packet->size == sizeof(struct test_packet));
+    assert(log->n < ARRAY_SIZE(log->packets));
+    log->packets[log->n++] = *(struct test_packet *) packet->data;
+    ofpbuf_delete(packet);
+}
+
+static void
+send_packet(struct pinsched *ps, uint16_t port_no, int seq,
+            struct tx_log *log)
+{
+    struct test_packet tp;
+
+    tp.port_no = port_no;
+    tp.seq = seq;
+    pinsched_send(ps, port_no, ofpbuf_clone_data(&tp, sizeof tp), tx_cb, log);
+}
+
+static void
+test_round_robin(void)
+{
+    enum { N_PORTS = 3 };
+    static const int n_packets[N_PORTS] = { 20, 20, 3 };
+    int n_left[N_PORTS], next_seq[N_PORTS];
+    uint16_t order[N_PORTS];
+    struct pinsched_stats stats;
+    struct tx_log log;
+    struct pinsched *ps;
+    size_t i, n_order;
+    unsigned int n_total;
+    int port;
+
+    /* Use up the whole burst of 100 packets, so that everything after that
+     * gets queued. */
+    ps = pinsched_create(1, 100);
+    log.n = 0;
+    for (i = 0; i < 100; i++) {
+        send_packet(ps, 0, i, &log);
+    }
+    assert(log.n == 100);
+
+    n_total = 0;
+    for (port = 0; port < N_PORTS; port++) {
+        int seq;
+
+        for (seq = 0; seq < n_packets[port]; seq++) {
+            send_packet(ps, port + 1, seq, &log);
+        }
+        n_left[port] = n_packets[port];
+        next_seq[port] = 0;
+        n_total += n_packets[port];
+    }
+    assert(log.n == 100);
+    assert(pinsched_count_txqlen(ps) == n_total);
+
+    /* Refill the token bucket and release everything. */
+    log.n = 0;
+    pinsched_set_limits(ps, 1, 100);
+    pinsched_run(ps, tx_cb, &log);
+    assert(log.n == n_total);
+
+    /* The ports take turns in a fixed order, which depends on how they hash,
+     * so take it from the order in which they first appear. */
+    n_order = 0;
+    for (i = 0; i < log.n && n_order < N_PORTS; i++) {
+        size_t j;
+
+        for (j = 0; j < n_order; j++) {
+            if (order[j] == log.packets[i].port_no) {
+                break;
+            }
+        }
+        if (j == n_order) {
+            order[n_order++] = log.packets[i].port_no;
+        }
+    }
+    assert(n_order == N_PORTS);
+
+    /* On each turn, a port releases 8 packets, or all of its remaining
+     * packets if fewer.  Each port's packets come out in the order they went
+     * in. */
+    i = 0;
+    while (i < log.n) {
+        size_t start = i;
+        size_t j;
+
+        for (j = 0; j < N_PORTS; j++) {
+            int idx = order[j] - 1;
+            int burst = MIN(n_left[idx], 8);
+
+            n_left[idx] -= burst;
+            while (burst-- > 0) {
+                assert(i < log.n);
+                assert(log.packets[i].port_no == order[j]);
+                assert(log.packets[i].seq == next_seq[idx]++);
+                i++;
+            }
+        }
+        assert(i > start);
+    }
+    for (port = 0; port < N_PORTS; port++) {
+        assert(!n_left[port]);
+    }
+
+    pinsched_get_stats(ps, &stats);
+    assert(stats.n_queued == 0);
+    assert(stats.n_normal == 100);
+    assert(stats.n_limited == n_total);
+    assert(stats.n_queue_dropped == 0);
+
+    pinsched_destroy(ps);
+}
+
+static void
+run_test(void (*function)(void))
+{
+    function();
+    printf(".");
+}
+
+static void
+test_pinsched_main(int argc OVS_UNUSED, char *argv[] OVS_UNUSED)
+{
+    run_test(test_round_robin);
+    printf("\n");
+}
+
+OVSTEST_REGISTER("test-pinsched", test_pinsched_main);
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2014 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A non-exhaustive test for the OpenFlow packet buffers in pktbuf.h. */
+
+#include <config.h>
+#include "ofproto/pktbuf.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ofpbuf.h"
+#include "ovstest.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+static uint32_t
+save(struct pktbuf *pb, size_t size, uint16_t in_port)
+{
+    uint8_t packet[2048];
+
+    assert(size <= sizeof packet);
+    memset(packet, in_port, size);
+    return pktbuf_save(pb, packet, size, in_port);
+}
+
+/* Retrieves 'id' from 'pb' and checks that it is the packet that save()
+ * stored for 'size' and 'in_port'. */
+static void
+check_retrieve(struct pktbuf *pb, uint32_t id, size_t size, uint16_t in_port)
+{
+    struct ofpbuf *buffer;
+    uint16_t port;
+    size_t i;
+
+    assert(!pktbuf_retrieve(pb, id, &buffer, &port));
+    assert(buffer);
+    assert(buffer->size == size);
+    assert(port == in_port);
+    for (i = 0; i < size; i++) {
+        assert(((uint8_t *) buffer->data)[i] == (uint8_t) in_port);
+    }
+    ofpbuf_delete(buffer);
+}
+
+/* Tests that the number of buffers is rounded to a power of 2 in range. */
+static void
+test_pktbuf_capacity(void)
+{
+    struct pktbuf *pb;
+
+    pb = pktbuf_create(0, PKTBUF_DEFAULT_BYTES);
+    assert(pktbuf_capacity(pb) == PKTBUF_MIN_CNT);
+    pktbuf_destroy(pb);
+
+    pb = pktbuf_create(1000, PKTBUF_DEFAULT_BYTES);
+    assert(pktbuf_capacity(pb) == 1024);
+    pktbuf_destroy(pb);
+
+    pb = pktbuf_create(UINT_MAX, PKTBUF_DEFAULT_BYTES);
+    assert(pktbuf_capacity(pb) == PKTBUF_MAX_CNT);
+    pktbuf_destroy(pb);
+}
+
+/* Tests saving and retrieving a packet and the hit and miss statistics. */
+static void
+test_pktbuf_retrieve(void)
+{
+    struct pktbuf_stats stats;
+    struct ofpbuf *buffer;
+    struct pktbuf *pb;
+    uint32_t id;
+
+    pb = pktbuf_create(PKTBUF_DEFAULT_CNT, PKTBUF_DEFAULT_BYTES);
+    id = save(pb, 60, 3);
+    assert(id != UINT32_MAX);
+    assert(pktbuf_count_packets(pb) == 1);
+    check_retrieve(pb, id, 60, 3);
+    assert(!pktbuf_count_packets(pb));
+
+    /* A second retrieval fails. */
+    assert(pktbuf_retrieve(pb, id, &buffer, NULL)
+           == OFPERR_OFPBRC_BUFFER_EMPTY);
+    assert(!buffer);
+
+    /* So does retrieving a discarded packet. */
+    id = save(pb, 60, 4);
+    pktbuf_discard(pb, id);
+    assert(pktbuf_retrieve(pb, id, &buffer, NULL));
+    assert(!buffer);
+
+    /* The null id is always valid and never has a packet. */
+    assert(!pktbuf_retrieve(pb, pktbuf_get_null(), &buffer, NULL));
+    assert(!buffer);
+
+    pktbuf_get_stats(pb, &stats);
+    assert(stats.n_hits == 1);
+    assert(stats.n_misses == 2);
+    assert(stats.n_overwrites == 0);
+    pktbuf_destroy(pb);
+}
+
+/* Tests that recently saved packets are not overwritten when every buffer is
+ * in use or the byte limit is reached. */
+static void
+test_pktbuf_full(void)
+{
+    uint32_t ids[PKTBUF_MIN_CNT];
+    struct pktbuf *pb;
+    int i;
+
+    pb = pktbuf_create(PKTBUF_MIN_CNT, PKTBUF_DEFAULT_BYTES);
+    for (i = 0; i < PKTBUF_MIN_CNT; i++) {
+        ids[i] = save(pb, 64, i);
+        assert(ids[i] != UINT32_MAX);
+    }
+    assert(save(pb, 64, 0) == UINT32_MAX);
+    for (i = 0; i < PKTBUF_MIN_CNT; i++) {
+        check_retrieve(pb, ids[i], 64, i);
+    }
+    assert(save(pb, 64, 0) != UINT32_MAX);
+    pktbuf_destroy(pb);
+
+    pb = pktbuf_create(PKTBUF_MIN_CNT, 1000);
+    assert(save(pb, 1001, 0) == UINT32_MAX);
+    ids[0] = save(pb, 600, 1);
+    assert(ids[0] != UINT32_MAX);
+    assert(save(pb, 600, 2) == UINT32_MAX);
+    ids[1] = save(pb, 400, 3);
+    assert(ids[1] != UINT32_MAX);
+    check_retrieve(pb, ids[0], 600, 1);
+    ids[0] = save(pb, 600, 2);
+    assert(ids[0] != UINT32_MAX);
+    check_retrieve(pb, ids[1], 400, 3);
+    check_retrieve(pb, ids[0], 600, 2);
+    pktbuf_destroy(pb);
+}
+
+/* Tests a large buffer store, retrieving packets in an order unrelated to the
+ * order in which they were saved. */
+static void
+test_pktbuf_large(void)
+{
+    uint32_t *ids = xmalloc(PKTBUF_MAX_CNT * sizeof *ids);
+    struct pktbuf *pb;
+    int i;
+
+    pb = pktbuf_create(PKTBUF_MAX_CNT, SIZE_MAX);
+    for (i = 0; i < PKTBUF_MAX_CNT; i++) {
+        ids[i] = save(pb, 60, i);
+        assert(ids[i] != UINT32_MAX);
+    }
+    assert(pktbuf_count_packets(pb) == PKTBUF_MAX_CNT);
+    for (i = 0; i < PKTBUF_MAX_CNT; i++) {
+        unsigned int j = (i * 40503u) % PKTBUF_MAX_CNT;
+
+        check_retrieve(pb, ids[j], 60, j);
+    }
+    assert(!pktbuf_count_packets(pb));
+    pktbuf_destroy(pb);
+    free(ids);
+}
+
+static void
+run_test(void (*function)(void))
+{
+    function();
+    printf(".");
+}
+
+static void
+test_pktbuf_main(int argc OVS_UNUSED, char *argv[] OVS_UNUSED)
+{
+    run_test(test_pktbuf_capacity);
+    run_test(test_pktbuf_retrieve);
+    run_test(test_pktbuf_full);
+    run_test(test_pktbuf_large);
+    printf("\n");
+}
+
+OVSTEST_REGISTER("test-pktbuf", test_pktbuf_main);
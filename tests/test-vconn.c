@@ -256,18 +256,20 @@ test_read_hello(int argc OVS_UNUSED, char *argv[])
 
 /* Connects to a fake_pvconn with vconn_open(), accepts that connection and
  * sends the 'out' bytes in 'out_size' to it (presumably an OFPT_HELLO
- * message), then verifies that vconn_connect() reports
- * 'expect_connect_error'. */
-static void
-test_send_hello(const char *type, const void *out, size_t out_size,
-                int expect_connect_error)
+ * message), and reads the hello message that the vconn sends in turn.
+ * Returns the final result of vconn_connect(), which is 0 if the connection
+ * completed.  Stores the vconn in '*vconnp' and the accepted end of the
+ * connection in '*streamp'. */
+static int
+connect_vconn(const char *type, const void *out, size_t out_size,
+              struct vconn **vconnp, struct stream **streamp)
 {
     struct fake_pvconn fpv;
     struct vconn *vconn;
-    bool read_hello, connected;
-    struct ofpbuf *msg;
+    bool read_hello;
     struct stream *stream;
     size_t n_sent;
+    int error;
 
     fpv_create(type, &fpv);
     CHECK_ERRNO(vconn_open(fpv.vconn_name, 0, DSCP_DEFAULT, &vconn), 0);
@@ -294,7 +296,8 @@ test_send_hello(const char *type, const void *out, size_t out_size,
         }
     }
 
-    read_hello = connected = false;
+    read_hello = false;
+    error = EAGAIN;
     for (;;) {
        if (!read_hello) {
            struct ofp_header hello;
@@ -313,27 +316,16 @@ test_send_hello(const char *type, const void *out, size_t out_size,
        }
 
        vconn_run(vconn);
-       if (!connected) {
-           int error = vconn_connect(vconn);
-           if (error == expect_connect_error) {
-               if (!error) {
-                   connected = true;
-               } else {
-                   stream_close(stream);
-                   vconn_close(vconn);
-                   return;
-               }
-           } else {
-               CHECK_ERRNO(error, EAGAIN);
-           }
+       if (error == EAGAIN) {
+           error = vconn_connect(vconn);
        }
 
-       if (read_hello && connected) {
+       if (error != EAGAIN && (error || read_hello)) {
            break;
        }
 
        vconn_run_wait(vconn);
-       if (!connected) {
+       if (error == EAGAIN) {
            vconn_connect_wait(vconn);
        }
        if (!read_hello) {
@@ -341,8 +333,30 @@ test_send_hello(const char *type, const void *out, size_t out_size,
        }
        poll_block();
     }
+
+    *vconnp = vconn;
+    *streamp = stream;
+    return error;
+}
+
+/* Connects to a fake_pvconn with vconn_open(), accepts that connection and
+ * sends the 'out' bytes in 'out_size' to it (presumably an OFPT_HELLO
+ * message), then verifies that vconn_connect() reports
+ * 'expect_connect_error'. */
+static void
+test_send_hello(const char *type, const void *out, size_t out_size,
+                int expect_connect_error)
+{
+    struct vconn *vconn;
+    struct ofpbuf *msg;
+    struct stream *stream;
+
+    CHECK_ERRNO(connect_vconn(type, out, out_size, &vconn, &stream),
+                expect_connect_error);
     stream_close(stream);
-    CHECK_ERRNO(vconn_recv_block(vconn, &msg), EOF);
+    if (!expect_connect_error) {
+        CHECK_ERRNO(vconn_recv_block(vconn, &msg), EOF);
+    }
     vconn_close(vconn);
 }
 
@@ -418,6 +432,212 @@ test_send_invalid_version_hello(int argc OVS_UNUSED, char *argv[])
     ofpbuf_delete(hello);
 }
 
+/* Size of each echo request sent by fill_vconn(). */
+enum { ECHO_SIZE = 1000 };
+
+/* Connects to a fake_pvconn of the given 'type' and completes the OpenFlow
+ * handshake.  Stores the vconn in '*vconnp' and the accepted end of the
+ * connection in '*streamp'. */
+static void
+open_connected_vconn(const char *type,
+                     struct vconn **vconnp, struct stream **streamp)
+{
+    struct ofpbuf *hello;
+
+    hello = ofpraw_alloc_xid(OFPRAW_OFPT_HELLO, OFP10_VERSION,
+                             htonl(0x12345678), 0);
+    CHECK_ERRNO(connect_vconn(type, hello->data, hello->size,
+                              vconnp, streamp), 0);
+    ofpbuf_delete(hello);
+}
+
+/* Returns a new ECHO_SIZE-byte echo request with transaction ID 'xid', whose
+ * payload bytes all equal the low byte of 'xid'. */
+static struct ofpbuf *
+make_echo(uint32_t xid)
+{
+    size_t n = ECHO_SIZE - sizeof(struct ofp_header);
+    struct ofpbuf *echo;
+
+    echo = ofpraw_alloc_xid(OFPRAW_OFPT_ECHO_REQUEST, OFP10_VERSION,
+                            htonl(xid), n);
+    memset(ofpbuf_put_uninit(echo, n), xid, n);
+    ofpmsg_update_length(echo);
+    return echo;
+}
+
+/* Sends echo requests with transaction IDs 0, 1, 2, ... to 'vconn', without
+ * running it or reading anything from the other end, until vconn_send()
+ * refuses one with EAGAIN.  Returns the number of echo requests sent. */
+static int
+fill_vconn(struct vconn *vconn)
+{
+    int n;
+
+    for (n = 0; ; n++) {
+        struct ofpbuf *echo = make_echo(n);
+        int error = vconn_send(vconn, echo);
+        if (error) {
+            CHECK_ERRNO(error, EAGAIN);
+            ofpbuf_delete(echo);
+            return n;
+        }
+    }
+}
+
+/* Receives exactly 'size' bytes from 'stream' into 'data', running 'vconn'
+ * meanwhile so that it can flush its queue. */
+static void
+recv_from_vconn(struct vconn *vconn, struct stream *stream,
+                void *data, size_t size)
+{
+    size_t n_recv = 0;
+
+    while (n_recv < size) {
+        int retval;
+
+        retval = stream_recv(stream, (char *) data + n_recv, size - n_recv);
+        if (retval > 0) {
+            n_recv += retval;
+        } else {
+            CHECK_ERRNO(retval, -EAGAIN);
+            stream_run(stream);
+            vconn_run(vconn);
+            stream_run_wait(stream);
+            stream_recv_wait(stream);
+            vconn_run_wait(vconn);
+            poll_block();
+        }
+    }
+}
+
+/* Receives the echo request that make_echo() creates for 'xid' from 'stream',
+ * and verifies that it arrived intact. */
+static void
+recv_echo(struct vconn *vconn, struct stream *stream, uint32_t xid)
+{
+    struct ofpbuf *expected = make_echo(xid);
+    char buffer[ECHO_SIZE];
+
+    recv_from_vconn(vconn, stream, buffer, sizeof buffer);
+    if (memcmp(buffer, expected->data, sizeof buffer)) {
+        ovs_fatal(0, "echo request %"PRIu32" was corrupted", xid);
+    }
+    ofpbuf_delete(expected);
+}
+
+/* Receives up to 'size' bytes from 'stream' into 'data', stopping as soon as
+ * 'stream' has nothing more ready, without running the vconn at the other
+ * end.  Returns the number of bytes received. */
+static size_t
+recv_ready(struct stream *stream, void *data, size_t size)
+{
+    size_t n_recv = 0;
+
+    while (n_recv < size) {
+        int retval;
+
+        retval = stream_recv(stream, (char *) data + n_recv, size - n_recv);
+        if (retval <= 0) {
+            CHECK_ERRNO(retval, -EAGAIN);
+            break;
+        }
+        n_recv += retval;
+    }
+    return n_recv;
+}
+
+/* Sends echo requests to a vconn until the operating system's buffers fill
+ * up, so that one request is only partially written and the rest wait behind
+ * it in the vconn's queue, until the queue reaches its 64 kB limit.  Then
+ * reads them all from the other end, verifying that they arrive whole and in
+ * order, and that the vconn accepts messages again afterward. */
+static void
+test_send_backlog(int argc OVS_UNUSED, char *argv[])
+{
+    const char *type = argv[1];
+    struct vconn *vconn;
+    struct stream *stream;
+    size_t size, n_ready;
+    char *data;
+    int i, n;
+
+    open_connected_vconn(type, &vconn, &stream);
+
+    n = fill_vconn(vconn);
+    size = (size_t) n * ECHO_SIZE;
+    data = xmalloc(size);
+    n_ready = recv_ready(stream, data, size);
+    if (!strcmp(type, "unix")) {
+        /* Everything that a Unix domain socket accepts is ready for the other
+         * end to read, so the rest must have been in the vconn's queue. */
+        size_t n_queued = size - n_ready;
+        if (n_queued < 64 * 1024 || n_queued >= 64 * 1024 + ECHO_SIZE) {
+            ovs_fatal(0, "%"PRIuSIZE" bytes queued at EAGAIN", n_queued);
+        }
+    }
+    recv_from_vconn(vconn, stream, data + n_ready, size - n_ready);
+
+    for (i = 0; i < n; i++) {
+        struct ofpbuf *expected = make_echo(i);
+
+        if (memcmp(data + i * ECHO_SIZE, expected->data, ECHO_SIZE)) {
+            ovs_fatal(0, "echo request %d was corrupted", i);
+        }
+        ofpbuf_delete(expected);
+    }
+    free(data);
+
+    CHECK_ERRNO(vconn_send(vconn, make_echo(n)), 0);
+    recv_echo(vconn, stream, n);
+
+    stream_close(stream);
+    vconn_close(vconn);
+}
+
+/* Fills a vconn's queue, then closes the other end, and verifies that the
+ * failure to flush the queue is reported by the following vconn_send(). */
+static void
+test_send_error(int argc OVS_UNUSED, char *argv[])
+{
+    const char *type = argv[1];
+    struct vconn *vconn;
+    struct stream *stream;
+    struct ofpbuf *echo;
+    int error;
+
+    open_connected_vconn(type, &vconn, &stream);
+    fill_vconn(vconn);
+    stream_close(stream);
+
+    echo = make_echo(0);
+    for (;;) {
+        vconn_run(vconn);
+        error = vconn_send(vconn, echo);
+        if (error != EAGAIN) {
+            break;
+        }
+        vconn_run_wait(vconn);
+        poll_block();
+    }
+    if (!strcmp(type, "tcp")) {
+        /* TCP reports the reset only to the first write after it arrives,
+         * which is the flush in vconn_run(), and EPIPE after that, so this
+         * shows that the error came from the flush. */
+        CHECK_ERRNO(error, ECONNRESET);
+    } else if (error != ECONNRESET && error != EPIPE) {
+        ovs_fatal(0, "unexpected vconn_send() return value %d (%s)",
+                  error, strerror(error));
+    }
+
+    /* The error sticks. */
+    vconn_run(vconn);
+    CHECK_ERRNO(vconn_send(vconn, echo), error);
+
+    ofpbuf_delete(echo);
+    vconn_close(vconn);
+}
+
 static const struct command commands[] = {
     {"refuse-connection", 1, 1, test_refuse_connection},
     {"accept-then-close", 1, 1, test_accept_then_close},
@@ -427,6 +647,8 @@ static const struct command commands[] = {
     {"send-echo-hello", 1, 1, test_send_echo_hello},
     {"send-short-hello", 1, 1, test_send_short_hello},
     {"send-invalid-version-hello", 1, 1, test_send_invalid_version_hello},
+    {"send-backlog", 1, 1, test_send_backlog},
+    {"send-error", 1, 1, test_send_error},
     {NULL, 0, 0, NULL},
 };
 
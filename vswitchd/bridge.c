@@ -60,6 +60,7 @@
 VLOG_DEFINE_THIS_MODULE(bridge);
 
 COVERAGE_DEFINE(bridge_reconfigure);
+COVERAGE_DEFINE(bridge_reconfigure_incremental);
 
 /* Configuration of an uninstantiated iface. */
 struct if_cfg {
@@ -105,6 +106,7 @@ struct port {
     char *name;
 
     const struct ovsrec_port *cfg;
+    bool dirty;                 /* Needs bridge_reconfigure_continue(). */
 
     /* An ordinary bridge port has 1 interface.
      * A bridge port for bonding has at least 2 interfaces. */
@@ -118,6 +120,7 @@ struct bridge {
     uint8_t ea[ETH_ADDR_LEN];   /* Bridge Ethernet Address. */
     uint8_t default_ea[ETH_ADDR_LEN]; /* Default MAC. */
     const struct ovsrec_bridge *cfg;
+    bool dirty;                 /* Needs bridge_reconfigure_continue(). */
 
     /* OpenFlow switch processing. */
     struct ofproto *ofproto;    /* OpenFlow switch. */
@@ -182,6 +185,16 @@ static long long int iface_stats_timer = LLONG_MIN;
 #define OFP_PORT_ACTION_WINDOW 10
 static bool reconfiguring = false;
 
+/* Most database changes touch only a few bridges, ports, and interfaces.  When
+ * the IDL's change tracking shows that to be the case, bridge_run() only
+ * reconfigures the "struct bridge"s and "struct port"s marked dirty, and
+ * 'reconfiguring_incremental' is true while it does so.  Anything that might
+ * have wider effects falls back to a full reconfiguration, as does the first
+ * reconfiguration and any that follows a period in which tracked changes were
+ * discarded ('need_full_reconfigure'). */
+static bool reconfiguring_incremental = false;
+static bool need_full_reconfigure = true;
+
 static void add_del_bridges(const struct ovsrec_open_vswitch *);
 static void bridge_update_ofprotos(void);
 static void bridge_create(const struct ovsrec_bridge *);
@@ -227,6 +240,7 @@ static struct port *port_create(struct bridge *, const struct ovsrec_port *);
 static void port_del_ifaces(struct port *);
 static void port_destroy(struct port *);
 static struct port *port_lookup(const struct bridge *, const char *name);
+static struct port *port_find(const char *name);
 static void port_configure(struct port *);
 static struct lacp_settings *port_configure_lacp(struct port *,
                                                  struct lacp_settings *);
@@ -401,6 +415,10 @@ bridge_init(const char *remote)
 
     ovsdb_idl_omit(idl, &ovsrec_ssl_col_external_ids);
 
+    /* Track changes to everything we are alerted about, so that bridge_run()
+     * can reconfigure only what changed. */
+    ovsdb_idl_track_add_all(idl);
+
     /* Register unixctl commands. */
     unixctl_command_register("qos/show", "interface", 1, 1,
                              qos_unixctl_show, NULL);
@@ -491,6 +509,7 @@ bridge_reconfigure(const struct ovsrec_open_vswitch *ovs_cfg)
 
     ovs_assert(!reconfiguring);
     reconfiguring = true;
+    reconfiguring_incremental = false;
 
     /* Destroy "struct bridge"s, "struct port"s, and "struct iface"s according
      * to 'ovs_cfg' while update the "if_cfg_queue", with only very minimal
@@ -526,6 +545,162 @@ bridge_reconfigure(const struct ovsrec_open_vswitch *ovs_cfg)
     reconfigure_system_stats(ovs_cfg);
 }
 
+/* Marks "struct bridge"s and "struct port"s dirty according to the changes
+ * that the IDL has tracked since the last reconfiguration.
+ *
+ * Returns true if the changes are confined to existing bridges' ports and
+ * interfaces, so that reconfiguring the dirty bridges and ports suffices.
+ * Returns false if a full bridge_reconfigure() is required, in which case some
+ * objects may have been marked dirty anyway; that is harmless, since a full
+ * reconfiguration clears all of the marks. */
+static bool
+bridge_mark_dirty(void)
+{
+    const struct ovsrec_open_vswitch *ovs_cfg;
+    const struct ovsrec_interface *if_cfg;
+    const struct ovsrec_port *port_cfg;
+    const struct ovsrec_bridge *br_cfg;
+    size_t i;
+
+    if (vlan_splinters_enabled_anywhere) {
+        return false;
+    }
+
+    /* Controllers, mirrors, QoS, NetFlow, sFlow, SSL, and the rest are
+     * comparatively rare to change, and changes to them can reach across
+     * bridges, so just start over from scratch. */
+    for (i = 0; i < OVSREC_N_TABLES; i++) {
+        const struct ovsdb_idl_table_class *tc = &ovsrec_table_classes[i];
+
+        if (tc != &ovsrec_table_open_vswitch
+            && tc != &ovsrec_table_bridge
+            && tc != &ovsrec_table_port
+            && tc != &ovsrec_table_interface
+            && ovsdb_idl_track_get_first(idl, tc)) {
+            return false;
+        }
+    }
+
+    /* ovs-vsctl bumps "next_cfg" with every change, but nothing else in the
+     * Open_vSwitch table may change. */
+    OVSREC_OPEN_VSWITCH_FOR_EACH_TRACKED (ovs_cfg, idl) {
+        if (ovsrec_open_vswitch_is_new(ovs_cfg)
+            || ovsrec_open_vswitch_is_deleted(ovs_cfg)) {
+            return false;
+        }
+        for (i = 0; i < OVSREC_OPEN_VSWITCH_N_COLUMNS; i++) {
+            const struct ovsdb_idl_column *column
+                = &ovsrec_open_vswitch_columns[i];
+
+            if (column != &ovsrec_open_vswitch_col_next_cfg
+                && ovsrec_open_vswitch_is_updated(ovs_cfg, column)) {
+                return false;
+            }
+        }
+    }
+
+    /* Bridges may only be modified, and not in ways that require a new
+     * ofproto.  A change to anything other than the set of ports might affect
+     * every port on the bridge. */
+    OVSREC_BRIDGE_FOR_EACH_TRACKED (br_cfg, idl) {
+        struct bridge *br;
+
+        if (ovsrec_bridge_is_new(br_cfg)
+            || ovsrec_bridge_is_deleted(br_cfg)
+            || ovsrec_bridge_is_updated(br_cfg,
+                                        &ovsrec_bridge_col_datapath_type)) {
+            return false;
+        }
+
+        br = bridge_lookup(br_cfg->name);
+        if (!br || br->cfg != br_cfg) {
+            return false;
+        }
+        br->dirty = true;
+
+        for (i = 0; i < OVSREC_BRIDGE_N_COLUMNS; i++) {
+            const struct ovsdb_idl_column *column = &ovsrec_bridge_columns[i];
+
+            if (column != &ovsrec_bridge_col_ports
+                && ovsrec_bridge_is_updated(br_cfg, column)) {
+                struct port *port;
+
+                HMAP_FOR_EACH (port, hmap_node, &br->ports) {
+                    port->dirty = true;
+                }
+                break;
+            }
+        }
+    }
+
+    /* Ports and interfaces that were added or removed show up as changes to
+     * the rows that refer to them, so only modifications need attention. */
+    OVSREC_PORT_FOR_EACH_TRACKED (port_cfg, idl) {
+        struct port *port;
+
+        if (ovsrec_port_is_new(port_cfg) || ovsrec_port_is_deleted(port_cfg)) {
+            continue;
+        }
+
+        port = port_find(port_cfg->name);
+        if (!port || port->cfg != port_cfg) {
+            return false;
+        }
+        port->dirty = port->bridge->dirty = true;
+    }
+
+    OVSREC_INTERFACE_FOR_EACH_TRACKED (if_cfg, idl) {
+        struct iface *iface;
+
+        if (ovsrec_interface_is_deleted(if_cfg)) {
+            continue;
+        } else if (vlan_splinters_is_enabled(if_cfg)) {
+            return false;
+        } else if (ovsrec_interface_is_new(if_cfg)) {
+            continue;
+        }
+
+        iface = iface_find(if_cfg->name);
+        if (!iface || iface->cfg != if_cfg) {
+            return false;
+        }
+        iface->port->dirty = iface->port->bridge->dirty = true;
+    }
+
+    return true;
+}
+
+/* Like bridge_reconfigure(), but only updates the data structures for bridges
+ * that bridge_mark_dirty() marked dirty. */
+static void
+bridge_reconfigure_incremental(void)
+{
+    struct bridge *br;
+
+    COVERAGE_INC(bridge_reconfigure_incremental);
+
+    ovs_assert(!reconfiguring);
+    reconfiguring = true;
+    reconfiguring_incremental = true;
+
+    HMAP_FOR_EACH (br, node, &all_bridges) {
+        if (br->dirty) {
+            bridge_add_del_ports(br, NULL);
+        }
+    }
+
+    HMAP_FOR_EACH (br, node, &all_bridges) {
+        if (br->dirty) {
+            struct if_cfg *if_cfg;
+
+            bridge_refresh_ofp_port(br);
+            HMAP_FOR_EACH (if_cfg, hmap_node, &br->if_cfg_todo) {
+                iface_clear_db_record(if_cfg->cfg);
+            }
+        }
+    }
+}
+
 static bool
 bridge_reconfigure_ofp(void)
 {
@@ -590,15 +765,34 @@ bridge_reconfigure_continue(const struct ovsrec_open_vswitch *ovs_cfg)
     sflow_bridge_number = 0;
     collect_in_band_managers(ovs_cfg, &managers, &n_managers);
     HMAP_FOR_EACH (br, node, &all_bridges) {
+        uint8_t old_ea[ETH_ADDR_LEN];
         struct port *port;
+        bool ea_changed;
+
+        if (reconfiguring_incremental && !br->dirty) {
+            /* Keep the sFlow sub-IDs of the bridges that follow stable. */
+            if (br->cfg->sflow) {
+                sflow_bridge_number++;
+            }
+            continue;
+        }
 
         /* We need the datapath ID early to allow LACP ports to use it as the
          * default system ID. */
+        memcpy(old_ea, br->ea, ETH_ADDR_LEN);
         bridge_configure_datapath_id(br);
+        ea_changed = !eth_addr_equals(old_ea, br->ea);
 
         HMAP_FOR_EACH (port, hmap_node, &br->ports) {
             struct iface *iface;
 
+            if (reconfiguring_incremental && !port->dirty && !ea_changed) {
+                continue;
+            }
+            if (done) {
+                port->dirty = false;
+            }
+
             port_configure(port);
 
             LIST_FOR_EACH (iface, port_elem, &port->ifaces) {
@@ -618,6 +812,10 @@ bridge_reconfigure_continue(const struct ovsrec_open_vswitch *ovs_cfg)
         bridge_configure_stp(br);
         bridge_configure_tables(br);
         bridge_configure_dp_desc(br);
+
+        if (done) {
+            br->dirty = false;
+        }
     }
     free(managers);
 
@@ -1504,6 +1702,7 @@ iface_create(struct bridge *br, struct if_cfg *if_cfg, int ofp_port)
     if (!port) {
         port = port_create(br, port_cfg);
     }
+    port->dirty = true;
 
     /* Create the iface structure. */
     iface = xzalloc(sizeof *iface);
@@ -2292,8 +2491,12 @@ bridge_run(void)
              * with the current situation of multiple ovs-vswitchd daemons,
              * disable system stats collection. */
             system_stats_enable(false);
+            ovsdb_idl_track_clear(idl);
+            need_full_reconfigure = true;
             return;
         } else if (!ovsdb_idl_has_lock(idl)) {
+            ovsdb_idl_track_clear(idl);
+            need_full_reconfigure = true;
             return;
         }
     }
@@ -2355,12 +2558,23 @@ bridge_run(void)
             idl_seqno = ovsdb_idl_get_seqno(idl);
             if (cfg) {
                 reconf_txn = ovsdb_idl_txn_create(idl);
-                bridge_reconfigure(cfg);
+                if (!need_full_reconfigure && !vlan_splinters_changed
+                    && bridge_mark_dirty()) {
+                    bridge_reconfigure_incremental();
+                } else {
+                    bridge_reconfigure(cfg);
+                }
+                need_full_reconfigure = false;
             } else {
                 /* We still need to reconfigure to avoid dangling pointers to
                  * now-destroyed ovsrec structures inside bridge data. */
                 bridge_reconfigure(&null_cfg);
+                need_full_reconfigure = true;
             }
+
+            /* Deleted rows remain accessible until the tracked changes are
+             * cleared, so this must follow the reconfiguration. */
+            ovsdb_idl_track_clear(idl);
         }
     }
 
@@ -2843,6 +3057,9 @@ bridge_ofproto_controller_for_mgmt(const struct bridge *br,
     oc->band = OFPROTO_OUT_OF_BAND;
     oc->rate_limit = 0;
     oc->burst_limit = 0;
+    oc->adaptive_rate_limit = false;
+    oc->n_buffers = 0;
+    oc->buffer_bytes = 0;
     oc->enable_async_msgs = true;
 }
 
@@ -2861,8 +3078,14 @@ bridge_ofproto_controller_from_ovsrec(const struct ovsrec_controller *c,
     oc->rate_limit = c->controller_rate_limit ? *c->controller_rate_limit : 0;
     oc->burst_limit = (c->controller_burst_limit
                        ? *c->controller_burst_limit : 0);
+    oc->adaptive_rate_limit = smap_get_bool(&c->other_config,
+                                            "adaptive-rate-limit", false);
     oc->enable_async_msgs = (!c->enable_async_messages
                              || *c->enable_async_messages);
+    oc->n_buffers = MAX(smap_get_int(&c->other_config, "packet-buffers", 0),
+                        0);
+    oc->buffer_bytes = MAX(smap_get_int(&c->other_config,
+                                        "packet-buffer-bytes", 0), 0);
     dscp = smap_get_int(&c->other_config, "dscp", DSCP_DEFAULT);
     if (dscp < 0 || dscp > 63) {
         dscp = DSCP_DEFAULT;
@@ -3208,6 +3431,21 @@ port_lookup(const struct bridge *br, const char *name)
     return NULL;
 }
 
+static struct port *
+port_find(const char *name)
+{
+    const struct bridge *br;
+
+    HMAP_FOR_EACH (br, node, &all_bridges) {
+        struct port *port = port_lookup(br, name);
+
+        if (port) {
+            return port;
+        }
+    }
+    return NULL;
+}
+
 static bool
 enable_lacp(struct port *port, bool *activep)
 {
@@ -3305,6 +3543,7 @@ port_configure_bond(struct port *port, struct bond_settings *s)
     const char *detect_s;
     struct iface *iface;
     int miimon_interval;
+    int buckets;
 
     s->name = port->name;
     s->balance = BM_AB;
@@ -3354,6 +3593,17 @@ port_configure_bond(struct port *port, struct bond_settings *s)
         s->rebalance_interval = 1000;
     }
 
+    buckets = smap_get_int(&port->cfg->other_config, "bond-hash-buckets",
+                           BOND_DEFAULT_BUCKETS);
+    if (buckets < BOND_MIN_BUCKETS || buckets > BOND_MAX_BUCKETS
+        || !IS_POW2(buckets)) {
+        VLOG_WARN("port %s: bond-hash-buckets must be a power of 2 between "
+                  "%d and %d, defaulting to %d", port->name,
+                  BOND_MIN_BUCKETS, BOND_MAX_BUCKETS, BOND_DEFAULT_BUCKETS);
+        buckets = BOND_DEFAULT_BUCKETS;
+    }
+    s->n_buckets = buckets;
+
     s->fake_iface = port->cfg->bond_fake_iface;
 
     LIST_FOR_EACH (iface, port_elem, &port->ifaces) {